@@ -17,6 +17,7 @@
 #include "mmccard.h"
 #include "paula.h"
 #include "serial.h"
+#include "devsched.h"
 #include "scsi.h"
 #include "sid_b-em.h"
 #include "sound.h"
@@ -232,24 +233,9 @@ int romsel;
 static inline void polltime(int c)
 {
     cycles -= c;
-    via_poll(&sysvia, c);
-    via_poll(&uservia, c);
-    video_poll(c, 1);
-    sound_poll(c);
     otherstuffcount -= c;
-    if (motoron) {
-        if (fdc_time) {
-            fdc_time -= c;
-            if (fdc_time <= 0)
-                fdc_callback();
-        }
-        disc_time -= c;
-        if (disc_time <= 0) {
-            disc_time += 16;
-            disc_poll();
-        }
-    }
     tubecycle += c;
+    sched_advance(c);
 }
 
 static int FEslowdown[8] = { 1, 0, 1, 1, 0, 0, 1, 0 };
@@ -344,8 +330,10 @@ static inline void fetch_opcode(void)
     oldpc = pc;
     vis20k = RAMbank[pc >> 12];
 
-    if (dbg_core6502)
+    if (dbg_core6502) {
+        sched_sync_all();
         debug_preexec(&core6502_cpu_debug, debug_addr(pc));
+    }
     if (pc == buf_remv && x == 0 && clip_paste_ptr)
         os_paste_remv();
     else if (pc == buf_cnpv && x == 0 && clip_paste_ptr)
@@ -373,11 +361,6 @@ static uint32_t do_readmem(uint32_t addr)
 {
     addr &= 0xffff;
 
-        if (pc == addr)
-            fetchc[addr] = 31;
-        else
-            readc[addr] = 31;
-
         if (memstat[vis20k][addr >> 8])
                 return memlook[vis20k][addr >> 8][addr];
         if (MASTER && (acccon & 0x40) && addr >= 0xFC00)
@@ -389,6 +372,7 @@ static uint32_t do_readmem(uint32_t addr)
                         polltime(1);
                 }
         }
+        sched_sync_all();
 
         if (addr >= 0xFCFD && addr <= 0xFDFF) {
             // JIM, including paging registers in FRED.
@@ -553,9 +537,12 @@ static uint32_t do_readmem(uint32_t addr)
 uint8_t readmem(uint16_t addr)
 {
     uint32_t value = do_readmem(addr);
-    if (dbg_core6502)
+    if (dbg_core6502) {
+        if (debug_memview)
+            debug_memview_mark(pc == addr ? MEMVIEW_FETCH : MEMVIEW_READ, addr);
         debug_memread(&core6502_cpu_debug, debug_addr(addr), value, 1);
         //TODO: check why?debug_memread(&core6502_cpu_debug, addr, debug_addr(value), 1);
+    }
     return (uint8_t)value;
 }
 
@@ -766,10 +753,10 @@ static void do_writemem(uint32_t addr, uint32_t val)
 
     addr &= 0xffff;
 
-        writec[addr] = 31;
-
         c = memstat[vis20k][addr >> 8];
         if (c == 1) {
+            if (addr < 0x8000)
+                sched_sync(SCHED_VIDEO); // don't let the CRTC see this early.
             memlook[vis20k][addr >> 8][addr] = (uint8_t)val;
             switch(addr) {
                     case 0x022c:
@@ -813,6 +800,7 @@ static void do_writemem(uint32_t addr, uint32_t val)
                         polltime(1);
                 }
         }
+        sched_sync_all();
 
         if (addr >= 0xFCFD && addr <= 0xFDFF) {
             // JIM, including paging registers in FRED.
@@ -995,11 +983,58 @@ static void do_writemem(uint32_t addr, uint32_t val)
 
 void writemem(uint16_t addr, uint8_t val)
 {
-    if (dbg_core6502)
+    if (dbg_core6502) {
+        if (debug_memview)
+            debug_memview_mark(MEMVIEW_WRITE, addr);
         debug_memwrite(&core6502_cpu_debug, debug_addr(addr), val, 1);
+    }
     do_writemem(addr, val);
 }
 
+/* Block copies to and from memory as the CPU sees it, for VDFS.  Pages
+ * of plain RAM other than page 2, which holds vectors the emulator
+ * watches, are copied directly and anything else goes a byte at a time
+ * through readmem/writemem, as does everything when the debugger is
+ * watching.  Addresses wrap at 64K as for the CPU.
+ */
+void readmem_block(uint16_t addr, uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        size_t chunk = 0x100 - (addr & 0xff);
+        if (chunk > len)
+            chunk = len;
+        if (!dbg_core6502 && memstat[vis20k][addr >> 8]) {
+            memcpy(buf, memlook[vis20k][addr >> 8] + addr, chunk);
+            buf += chunk;
+            addr += chunk;
+        }
+        else
+            for (size_t n = chunk; n; n--)
+                *buf++ = readmem(addr++);
+        len -= chunk;
+    }
+}
+
+void writemem_block(uint16_t addr, const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        size_t chunk = 0x100 - (addr & 0xff);
+        if (chunk > len)
+            chunk = len;
+        if (!dbg_core6502 && memstat[vis20k][addr >> 8] == MSTAT_RAM && (addr >> 8) != 0x02) {
+            if (addr < 0x8000)
+                sched_sync(SCHED_VIDEO);
+            memcpy(memlook[vis20k][addr >> 8] + addr, buf, chunk);
+            buf += chunk;
+            addr += chunk;
+        }
+        else
+            for (size_t n = chunk; n; n--)
+                writemem(addr++, *buf++);
+        len -= chunk;
+    }
+}
+
 int nmi, oldnmi, interrupt, takeint;
 
 void m6502_reset(void)
@@ -1025,6 +1060,7 @@ void m6502_reset(void)
         ram_fe30 = 0;
         ram_fe34 = 0;
         cycles = 0;
+        sched_reset();
 
         pc = readmem(0xFFFC) | (readmem(0xFFFD) << 8);
         p.i = 1;
@@ -1060,7 +1096,7 @@ static void otherstuff_poll(void) {
         music2000_poll();
     if (!tapelcount) {
         tape_poll();
-        tapelcount = tapellatch;
+        tapelcount = tape_instant_active ? 1 : tapellatch;
     }
     tapelcount--;
     if (motorspin) {
@@ -1298,6 +1334,7 @@ void m6502_exec(void)
         int tempi;
         int8_t offset;
         cycles += 40000;
+        sched_sync_all();
 
         while (cycles > 0) {
                 fetch_opcode();
@@ -4037,6 +4074,7 @@ void m6502_exec(void)
                 }
                 oldnmi = nmi;
         }
+        sched_sync_all();
 }
 
 void m65c02_exec(void)
@@ -4047,6 +4085,7 @@ void m65c02_exec(void)
         int tempi;
         int8_t offset;
         cycles += 40000;
+        sched_sync_all();
 //        log_debug("PC = %04X\n",pc);
 //        log_debug("Exec cycles %i\n",cycles);
         while (cycles > 0) {
@@ -5878,6 +5917,7 @@ void m65c02_exec(void)
                 }
                 oldnmi = nmi;
         }
+        sched_sync_all();
 }
 
 void m6502_savestate(FILE * f)
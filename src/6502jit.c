@@ -0,0 +1,1057 @@
+/*B-em 65C02 parasite basic block recompiler
+
+  Runs of 65C02 instructions are translated into x86-64 code the first
+  time they are executed and the translation kept, indexed by the
+  address of the first instruction, until the code is overwritten.  A
+  block ends at a JMP, JSR, RTS or BRA, before an instruction that is
+  left to the interpreter, or when it gets too long.  A conditional
+  branch that is taken leaves the block through a side exit.
+
+  Compiled blocks jump straight to the next while there are cycles left
+  and there is no change on the interrupt lines so, unlike the
+  interpreter, interrupts are only taken between blocks.  The cycles
+  charged are the same as the interpreter's.
+
+  Register use in the compiled code:
+
+    rbx   the jit6502_regs_t, with the tables after it.
+    rbp   parasite RAM.
+    r12d  A
+    r13d  X
+    r14d  Y
+    r15d  NZ, set to the result times 0x101 so Z comes from the low
+          byte and N from bit 15, which lets BIT set both.
+    eax   effective address, or next PC when leaving a block.
+    ecx   page crossing penalty, scratch.
+    edx   operand, scratch.
+
+  Anything that is not a plain access to RAM is left to the interpreter:
+  before a read at or above the read limit, a write at or above FEF0 or
+  a write to a byte that has been compiled, or ADC/SBC in decimal mode,
+  the block bails out, leaving the PC at the instruction for the
+  interpreter to run.  Writes the interpreter makes to compiled code
+  discard the blocks covering it.*/
+
+#include "b-em.h"
+#include "6502jit.h"
+
+#ifdef JIT_6502
+
+#include <sys/mman.h>
+
+#define JIT_BUF_SIZE    (4 * 1024 * 1024)
+#define JIT_BLOCK_SPACE (16 * 1024)     // the most code one block can need.
+#define JIT_MAX_INSNS   48
+#define JIT_MAX_BYTES   128
+#define JIT_MAX_EXITS   (JIT_MAX_INSNS * 4)
+#define JIT_WRITE_LIMIT 0xFEF0
+
+typedef struct {
+    jit6502_regs_t regs;
+    uint32_t page_code[256];    // count of compiled bytes in each page.
+    uint16_t code[0x10000];     // count of blocks covering each byte.
+    uint8_t  len[0x10000];      // length of the block starting at each address.
+    void    *entry[0x10000];    // host code for the block starting at each address.
+} jit_state_t;
+
+static jit_state_t jit;
+
+const uint16_t *jit6502_code = jit.code;
+
+#define OFF(f) ((int32_t)offsetof(jit_state_t, f))
+
+/* The x86-64 side. */
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15, NOREG = -1 };
+enum { ALU_ADD, ALU_OR, ALU_ADC, ALU_SBB, ALU_AND, ALU_SUB, ALU_XOR, ALU_CMP };
+enum { SH_ROL, SH_ROR, SH_RCL, SH_RCR, SH_SHL, SH_SHR };
+enum { CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A, CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G };
+
+#define H_A  R12
+#define H_X  R13
+#define H_Y  R14
+#define H_NZ R15
+
+#define X_W  1
+#define X_66 2
+#define X_0F 4
+
+typedef struct {
+    int base, index, scale;
+    int32_t disp;
+} mem_t;
+
+#define M_ST(f)      ((mem_t){ RBX, NOREG, 0, OFF(f) })
+#define M_RAM(d)     ((mem_t){ RBP, NOREG, 0, (d) })
+#define M_RAMX(r, d) ((mem_t){ RBP, (r), 0, (d) })
+#define M_CODE(r)    ((mem_t){ RBX, (r), 1, OFF(code) })
+#define M_CODEC(a)   ((mem_t){ RBX, NOREG, 0, OFF(code) + 2 * (a) })
+#define M_ENTRY(r)   ((mem_t){ RBX, (r), 3, OFF(entry) })
+#define M_BASE(r, d) ((mem_t){ (r), NOREG, 0, (d) })
+
+static uint8_t *jit_buf, *jit_ptr, *jit_blocks;
+static uint8_t *stub_exit, *stub_bail, *stub_dispatch;
+static void (*jit_enter)(jit6502_regs_t *regs, void *code);
+static uint32_t jit_read_limit;
+bool jit6502_failed;
+
+static inline void emit8(unsigned v)
+{
+    *jit_ptr++ = v;
+}
+
+static inline void emit32(uint32_t v)
+{
+    memcpy(jit_ptr, &v, 4);
+    jit_ptr += 4;
+}
+
+static void x_modrm(int reg, mem_t m)
+{
+    int mod = (m.disp >= -128 && m.disp <= 127) ? 0x40 : 0x80;
+
+    if (m.index == NOREG && (m.base & 7) != RSP)
+        emit8(mod | (reg & 7) << 3 | (m.base & 7));
+    else {
+        int index = m.index == NOREG ? RSP : m.index;
+        emit8(mod | (reg & 7) << 3 | 4);
+        emit8(m.scale << 6 | (index & 7) << 3 | (m.base & 7));
+    }
+    if (mod == 0x40)
+        emit8(m.disp);
+    else
+        emit32(m.disp);
+}
+
+static void x_prefix(int flags, int reg, int index, int base)
+{
+    int rex = ((flags & X_W) ? 8 : 0) | (reg >= 8 ? 4 : 0) | (index >= 8 ? 2 : 0) | (base >= 8 ? 1 : 0);
+    if (flags & X_66)
+        emit8(0x66);
+    if (rex)
+        emit8(0x40 | rex);
+    if (flags & X_0F)
+        emit8(0x0F);
+}
+
+static void x_rm(int flags, int op, int reg, mem_t m)
+{
+    x_prefix(flags, reg, m.index, m.base);
+    emit8(op);
+    x_modrm(reg, m);
+}
+
+static void x_rr(int flags, int op, int reg, int rm)
+{
+    x_prefix(flags, reg, NOREG, rm);
+    emit8(op);
+    emit8(0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+static void x_movzx8(int reg, mem_t m)      { x_rm(X_0F, 0xB6, reg, m); }
+static void x_movzx16(int reg, mem_t m)     { x_rm(X_0F, 0xB7, reg, m); }
+static void x_store8(mem_t m, int reg)      { x_rm(0, 0x88, reg, m); }
+static void x_load32(int reg, mem_t m)      { x_rm(0, 0x8B, reg, m); }
+static void x_store32(mem_t m, int reg)     { x_rm(0, 0x89, reg, m); }
+static void x_mov(int dst, int src)         { x_rr(0, 0x89, src, dst); }
+static void x_shr(int reg, int n)           { x_rr(0, 0xC1, 5, reg); emit8(n); }
+static void x_shl(int reg, int n)           { x_rr(0, 0xC1, 4, reg); emit8(n); }
+static void x_lea(int reg, mem_t m)         { x_rm(0, 0x8D, reg, m); }
+static void x_setcc(int cc, mem_t m)        { x_rm(X_0F, 0x90 + cc, 0, m); }
+static void x_alu_rr(int op, int dst, int src) { x_rr(0, op * 8 + 1, src, dst); }
+static void x_alu8_rm(int op, int reg, mem_t m) { x_rm(0, op * 8 + 2, reg, m); }
+static void x_alu8_mr(int op, mem_t m, int reg) { x_rm(0, op * 8, reg, m); }
+
+static void x_movi(int reg, uint32_t v)
+{
+    x_prefix(0, NOREG, NOREG, reg);
+    emit8(0xB8 + (reg & 7));
+    emit32(v);
+}
+
+static void x_store8i(mem_t m, int v)
+{
+    x_rm(0, 0xC6, 0, m);
+    emit8(v);
+}
+
+static void x_alu8_ri(int op, int reg, int v)
+{
+    x_rr(0, 0x80, op, reg);
+    emit8(v);
+}
+
+static void x_alu8_mi(int op, mem_t m, int v)
+{
+    x_rm(0, 0x80, op, m);
+    emit8(v);
+}
+
+static void x_alu32_ri(int op, int reg, int32_t v)
+{
+    x_rr(0, 0x81, op, reg);
+    emit32(v);
+}
+
+static void x_alu32_mi(int op, mem_t m, int32_t v)
+{
+    if (v >= -128 && v <= 127) {
+        x_rm(0, 0x83, op, m);
+        emit8(v);
+    }
+    else {
+        x_rm(0, 0x81, op, m);
+        emit32(v);
+    }
+}
+
+/* Sets the host carry from the 6502 one. */
+static void x_getc(void)
+{
+    x_rm(X_0F, 0xBA, 4, M_ST(regs.c));
+    emit8(0);
+}
+
+/* NZ from a 32-bit register holding an 8-bit result. */
+static void x_setnz(int reg)
+{
+    x_rr(0, 0x69, H_NZ, reg);
+    emit32(0x101);
+}
+
+/* Keeps N and sets Z from a 32-bit register. */
+static void x_setz_only(int reg)
+{
+    x_alu32_ri(ALU_AND, H_NZ, 0x8000);
+    x_alu_rr(ALU_OR, H_NZ, reg);
+}
+
+static uint8_t *x_jcc(int cc)
+{
+    emit8(0x0F);
+    emit8(0x80 + cc);
+    emit32(0);
+    return jit_ptr - 4;
+}
+
+static uint8_t *x_jmp(void)
+{
+    emit8(0xE9);
+    emit32(0);
+    return jit_ptr - 4;
+}
+
+static void x_patch(uint8_t *site, const uint8_t *dest)
+{
+    int32_t rel = dest - (site + 4);
+    memcpy(site, &rel, 4);
+}
+
+static void x_jmp_to(const uint8_t *dest)
+{
+    x_patch(x_jmp(), dest);
+}
+
+static void x_jcc_to(int cc, const uint8_t *dest)
+{
+    x_patch(x_jcc(cc), dest);
+}
+
+static void x_push(int reg)
+{
+    x_prefix(0, NOREG, NOREG, reg);
+    emit8(0x50 + (reg & 7));
+}
+
+static void x_pop(int reg)
+{
+    x_prefix(0, NOREG, NOREG, reg);
+    emit8(0x58 + (reg & 7));
+}
+
+/* The code shared by all blocks. */
+
+static void jit_stubs(void)
+{
+    static const int saved[] = { RBX, RBP, R12, R13, R14, R15 };
+    uint8_t *miss;
+
+    jit_ptr = jit_buf;
+
+    /* jit_enter(regs, code) */
+    jit_enter = (void (*)(jit6502_regs_t *, void *))jit_ptr;
+    for (int i = 0; i < 6; i++)
+        x_push(saved[i]);
+    x_rr(X_W, 0x89, RDI, RBX);
+    x_rm(X_W, 0x8B, RBP, M_ST(regs.ram));
+    x_load32(H_A, M_ST(regs.reg_a));
+    x_load32(H_X, M_ST(regs.reg_x));
+    x_load32(H_Y, M_ST(regs.reg_y));
+    x_load32(H_NZ, M_ST(regs.nz));
+    x_rr(0, 0xFF, 4, RSI);
+
+    stub_exit = jit_ptr;
+    x_store32(M_ST(regs.reg_a), H_A);
+    x_store32(M_ST(regs.reg_x), H_X);
+    x_store32(M_ST(regs.reg_y), H_Y);
+    x_store32(M_ST(regs.nz), H_NZ);
+    for (int i = 5; i >= 0; i--)
+        x_pop(saved[i]);
+    emit8(0xC3);
+
+    stub_bail = jit_ptr;
+    x_rm(0, 0xC7, 0, M_ST(regs.bailed));
+    emit32(1);
+    x_jmp_to(stub_exit);
+
+    /* Next PC in eax, cycles already charged. */
+    stub_dispatch = jit_ptr;
+    x_store32(M_ST(regs.reg_pc), RAX);
+    x_alu32_mi(ALU_CMP, M_ST(regs.cycles), 0);
+    x_jcc_to(CC_LE, stub_exit);
+    x_rm(X_W, 0x8B, RCX, M_ST(regs.irq));
+    x_load32(RCX, M_BASE(RCX, 0));
+    x_rm(0, 0x33, RCX, M_ST(regs.irq_xor));
+    x_rm(0, 0x85, RCX, M_ST(regs.irq_mask));
+    x_jcc_to(CC_NE, stub_exit);
+    x_rm(X_W, 0x8B, RCX, M_ENTRY(RAX));
+    x_rr(X_W, 0x85, RCX, RCX);
+    miss = x_jcc(CC_E);
+    x_rr(0, 0xFF, 4, RCX);
+    x_patch(miss, stub_exit);
+
+    jit_blocks = jit_ptr;
+}
+
+static bool jit_open(void)
+{
+    void *p = mmap(NULL, JIT_BUF_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (p == MAP_FAILED) {
+        log_error("6502jit: unable to map memory for code: %s, using the interpreter", strerror(errno));
+        jit6502_failed = true;
+        return false;
+    }
+    jit_buf = p;
+    jit_stubs();
+    log_debug("6502jit: code buffer at %p", p);
+    return true;
+}
+
+void jit6502_close(void)
+{
+    if (jit_buf) {
+        munmap(jit_buf, JIT_BUF_SIZE);
+        jit_buf = jit_ptr = NULL;
+    }
+    jit6502_flush();
+}
+
+void jit6502_flush(void)
+{
+    memset(jit.page_code, 0, sizeof jit.page_code);
+    memset(jit.code, 0, sizeof jit.code);
+    memset(jit.len, 0, sizeof jit.len);
+    memset(jit.entry, 0, sizeof jit.entry);
+    if (jit_buf)
+        jit_ptr = jit_blocks;
+}
+
+static void jit_drop(uint16_t start)
+{
+    for (unsigned i = 0; i < jit.len[start]; i++) {
+        uint16_t addr = start + i;
+        jit.code[addr]--;
+        jit.page_code[addr >> 8]--;
+    }
+    jit.entry[start] = NULL;
+    jit.len[start] = 0;
+}
+
+/* Discards the blocks covering a range that has been written. */
+void jit6502_invalidate(uint32_t addr, size_t len)
+{
+    for (; len && addr < 0x10000; addr++, len--) {
+        for (unsigned back = 0; jit.code[addr] && back < JIT_MAX_BYTES; back++) {
+            uint16_t start = addr - back;
+            if (jit.entry[start] && back < jit.len[start])
+                jit_drop(start);
+        }
+    }
+}
+
+/* The 65C02 side. */
+
+typedef enum {
+    K_NONE, K_NOP,
+    K_LDA, K_LDX, K_LDY, K_STA, K_STX, K_STY, K_STZ,
+    K_ORA, K_AND, K_EOR, K_ADC, K_SBC, K_CMP, K_CPX, K_CPY, K_BIT,
+    K_ASL, K_ROL, K_LSR, K_ROR, K_INC, K_DEC, K_TSB, K_TRB,
+    K_INA, K_DEA, K_INX, K_DEX, K_INY, K_DEY,
+    K_TAX, K_TXA, K_TAY, K_TYA, K_TSX, K_TXS,
+    K_PHA, K_PHX, K_PHY, K_PLA, K_PLX, K_PLY,
+    K_CLC, K_SEC, K_CLV, K_CLD, K_SED,
+    K_BPL, K_BMI, K_BVC, K_BVS, K_BCC, K_BCS, K_BNE, K_BEQ, K_BRA,
+    K_JMP, K_JMI, K_JMX, K_JSR, K_RTS
+} kind_t;
+
+typedef enum {
+    M_IMP, M_IMM, M_ZP, M_ZPX, M_ZPY, M_ABS, M_ABSX, M_ABSY,
+    M_IZX, M_IZY, M_IZP, M_REL
+} amode_t;
+
+typedef struct {
+    uint8_t kind, mode, cycles, penalty;
+} opinfo_t;
+
+static const uint8_t mode_len[] = {
+    [M_IMP] = 1, [M_IMM] = 2, [M_ZP] = 2, [M_ZPX] = 2, [M_ZPY] = 2, [M_ABS] = 3,
+    [M_ABSX] = 3, [M_ABSY] = 3, [M_IZX] = 2, [M_IZY] = 2, [M_IZP] = 2, [M_REL] = 2
+};
+
+/*
+ * The instructions compiled with the cycles the interpreter charges
+ * for them and whether it charges one more for a page crossing.  The
+ * rest are left to the interpreter.
+ */
+#define I(k, m, c)  { K_##k, M_##m, c, 0 }
+#define IP(k, m, c) { K_##k, M_##m, c, 1 }
+
+static const opinfo_t ops[256] = {
+    [0x01] = I(ORA, IZX, 6), [0x05] = I(ORA, ZP, 3),    [0x09] = I(ORA, IMM, 2),
+    [0x0D] = I(ORA, ABS, 4), [0x11] = IP(ORA, IZY, 5),  [0x12] = I(ORA, IZP, 5),
+    [0x15] = I(ORA, ZPX, 4), [0x19] = IP(ORA, ABSY, 4), [0x1D] = IP(ORA, ABSX, 4),
+    [0x21] = I(AND, IZX, 6), [0x25] = I(AND, ZP, 3),    [0x29] = I(AND, IMM, 2),
+    [0x2D] = I(AND, ABS, 4), [0x31] = IP(AND, IZY, 5),  [0x32] = I(AND, IZP, 5),
+    [0x35] = I(AND, ZPX, 4), [0x39] = IP(AND, ABSY, 4), [0x3D] = IP(AND, ABSX, 4),
+    [0x41] = I(EOR, IZX, 6), [0x45] = I(EOR, ZP, 3),    [0x49] = I(EOR, IMM, 2),
+    [0x4D] = I(EOR, ABS, 4), [0x51] = IP(EOR, IZY, 5),  [0x52] = I(EOR, IZP, 5),
+    [0x55] = I(EOR, ZPX, 4), [0x59] = IP(EOR, ABSY, 4), [0x5D] = IP(EOR, ABSX, 4),
+    [0x61] = I(ADC, IZX, 6), [0x65] = I(ADC, ZP, 3),    [0x69] = I(ADC, IMM, 2),
+    [0x6D] = I(ADC, ABS, 4), [0x71] = IP(ADC, IZY, 5),  [0x72] = I(ADC, IZP, 5),
+    [0x75] = I(ADC, ZPX, 4), [0x79] = IP(ADC, ABSY, 4), [0x7D] = IP(ADC, ABSX, 4),
+    [0xE1] = I(SBC, IZX, 6), [0xE5] = I(SBC, ZP, 3),    [0xE9] = I(SBC, IMM, 2),
+    [0xED] = I(SBC, ABS, 4), [0xF1] = IP(SBC, IZY, 5),  [0xF2] = I(SBC, IZP, 5),
+    [0xF5] = I(SBC, ZPX, 4), [0xF9] = I(SBC, ABSY, 4),  [0xFD] = IP(SBC, ABSX, 4),
+    [0xC1] = I(CMP, IZX, 6), [0xC5] = I(CMP, ZP, 3),    [0xC9] = I(CMP, IMM, 2),
+    [0xCD] = I(CMP, ABS, 4), [0xD1] = IP(CMP, IZY, 5),  [0xD2] = I(CMP, IZP, 5),
+    [0xD5] = I(CMP, ZPX, 4), [0xD9] = IP(CMP, ABSY, 4), [0xDD] = IP(CMP, ABSX, 4),
+    [0xA1] = I(LDA, IZX, 6), [0xA5] = I(LDA, ZP, 3),    [0xA9] = I(LDA, IMM, 2),
+    [0xAD] = I(LDA, ABS, 4), [0xB1] = IP(LDA, IZY, 5),  [0xB2] = I(LDA, IZP, 5),
+    [0xB5] = I(LDA, ZPX, 4), [0xB9] = IP(LDA, ABSY, 4), [0xBD] = IP(LDA, ABSX, 4),
+    [0xA2] = I(LDX, IMM, 2), [0xA6] = I(LDX, ZP, 3),    [0xAE] = I(LDX, ABS, 4),
+    [0xB6] = I(LDX, ZPY, 4), [0xBE] = IP(LDX, ABSY, 4),
+    [0xA0] = I(LDY, IMM, 2), [0xA4] = I(LDY, ZP, 3),    [0xAC] = I(LDY, ABS, 4),
+    [0xB4] = I(LDY, ZPX, 4), [0xBC] = IP(LDY, ABSX, 4),
+    [0xE0] = I(CPX, IMM, 2), [0xE4] = I(CPX, ZP, 3),    [0xEC] = I(CPX, ABS, 3),
+    [0xC0] = I(CPY, IMM, 2), [0xC4] = I(CPY, ZP, 3),    [0xCC] = I(CPY, ABS, 4),
+    [0x81] = I(STA, IZX, 6), [0x85] = I(STA, ZP, 3),    [0x8D] = I(STA, ABS, 4),
+    [0x91] = IP(STA, IZY, 6), [0x92] = I(STA, IZP, 6),  [0x95] = I(STA, ZPX, 4),
+    [0x99] = I(STA, ABSY, 5), [0x9D] = I(STA, ABSX, 5),
+    [0x86] = I(STX, ZP, 3),  [0x8E] = I(STX, ABS, 4),   [0x96] = I(STX, ZPY, 4),
+    [0x84] = I(STY, ZP, 3),  [0x8C] = I(STY, ABS, 4),   [0x94] = I(STY, ZPX, 4),
+    [0x64] = I(STZ, ZP, 3),  [0x74] = I(STZ, ZPX, 4),   [0x9C] = I(STZ, ABS, 4),
+    [0x9E] = I(STZ, ABSX, 5),
+    [0x24] = I(BIT, ZP, 3),  [0x2C] = I(BIT, ABS, 4),   [0x34] = I(BIT, ZPX, 4),
+    [0x3C] = IP(BIT, ABSX, 4), [0x89] = I(BIT, IMM, 2),
+    [0x04] = I(TSB, ZP, 5),  [0x0C] = I(TSB, ABS, 6),
+    [0x14] = I(TRB, ZP, 5),  [0x1C] = I(TRB, ABS, 6),
+    [0x0A] = I(ASL, IMP, 2), [0x06] = I(ASL, ZP, 5),    [0x0E] = I(ASL, ABS, 6),
+    [0x16] = I(ASL, ZPX, 6), [0x1E] = IP(ASL, ABSX, 6),
+    [0x2A] = I(ROL, IMP, 2), [0x26] = I(ROL, ZP, 5),    [0x2E] = I(ROL, ABS, 6),
+    [0x36] = I(ROL, ZPX, 6), [0x3E] = IP(ROL, ABSX, 6),
+    [0x4A] = I(LSR, IMP, 2), [0x46] = I(LSR, ZP, 5),    [0x4E] = I(LSR, ABS, 6),
+    [0x56] = I(LSR, ZPX, 6), [0x5E] = IP(LSR, ABSX, 6),
+    [0x6A] = I(ROR, IMP, 2), [0x66] = I(ROR, ZP, 5),    [0x6E] = I(ROR, ABS, 6),
+    [0x76] = I(ROR, ZPX, 6), [0x7E] = IP(ROR, ABSX, 6),
+    [0xE6] = I(INC, ZP, 5),  [0xEE] = I(INC, ABS, 6),   [0xF6] = I(INC, ZPX, 6),
+    [0xFE] = I(INC, ABSX, 6),
+    [0xC6] = I(DEC, ZP, 5),  [0xCE] = I(DEC, ABS, 6),   [0xD6] = I(DEC, ZPX, 6),
+    [0xDE] = I(DEC, ABSX, 6),
+    [0x1A] = I(INA, IMP, 2), [0x3A] = I(DEA, IMP, 2),
+    [0xE8] = I(INX, IMP, 2), [0xCA] = I(DEX, IMP, 2),
+    [0xC8] = I(INY, IMP, 2), [0x88] = I(DEY, IMP, 2),
+    [0xAA] = I(TAX, IMP, 2), [0x8A] = I(TXA, IMP, 2),
+    [0xA8] = I(TAY, IMP, 2), [0x98] = I(TYA, IMP, 2),
+    [0xBA] = I(TSX, IMP, 2), [0x9A] = I(TXS, IMP, 2),
+    [0x48] = I(PHA, IMP, 3), [0xDA] = I(PHX, IMP, 3),   [0x5A] = I(PHY, IMP, 3),
+    [0x68] = I(PLA, IMP, 4), [0xFA] = I(PLX, IMP, 4),   [0x7A] = I(PLY, IMP, 4),
+    [0x18] = I(CLC, IMP, 2), [0x38] = I(SEC, IMP, 2),   [0xB8] = I(CLV, IMP, 2),
+    [0xD8] = I(CLD, IMP, 2), [0xF8] = I(SED, IMP, 2),
+    [0x10] = I(BPL, REL, 2), [0x30] = I(BMI, REL, 2),   [0x50] = I(BVC, REL, 2),
+    [0x70] = I(BVS, REL, 2), [0x90] = I(BCC, REL, 2),   [0xB0] = I(BCS, REL, 2),
+    [0xD0] = I(BNE, REL, 2), [0xF0] = I(BEQ, REL, 2),   [0x80] = I(BRA, REL, 3),
+    [0x4C] = I(JMP, ABS, 3), [0x6C] = I(JMI, ABS, 5),   [0x7C] = I(JMX, ABS, 6),
+    [0x20] = I(JSR, ABS, 6), [0x60] = I(RTS, IMP, 6),
+    [0xEA] = I(NOP, IMP, 2),
+    [0x22] = I(NOP, IMM, 2), [0x42] = I(NOP, IMM, 2),   [0x62] = I(NOP, IMM, 2),
+    [0x82] = I(NOP, IMM, 2), [0xC2] = I(NOP, IMM, 2),   [0xE2] = I(NOP, IMM, 2),
+    [0x44] = I(NOP, IMM, 3), [0x54] = I(NOP, IMM, 4),   [0xD4] = I(NOP, IMM, 4),
+    [0xF4] = I(NOP, IMM, 4), [0x5C] = I(NOP, ABS, 8),   [0xDC] = I(NOP, ABS, 4),
+    [0xFC] = I(NOP, ABS, 4)
+};
+
+/* Exits from the middle of a block, emitted after the main line. */
+typedef struct {
+    uint8_t *site;
+    uint16_t pc;
+    bool     bail;
+    int      cycles;
+} jit_exit_t;
+
+static struct {
+    uint16_t   pc;          // the instruction being compiled.
+    int        acc;         // cycles of the instructions before it.
+    int        nexits;
+    jit_exit_t exits[JIT_MAX_EXITS];
+} blk;
+
+static void jit_side_exit(uint8_t *site, uint16_t pc, bool bail, int cycles)
+{
+    jit_exit_t *e = blk.exits + blk.nexits++;
+    e->site = site;
+    e->pc = pc;
+    e->bail = bail;
+    e->cycles = cycles;
+}
+
+/* Leave the instruction to the interpreter if cc holds. */
+static void jit_bail_if(int cc)
+{
+    jit_side_exit(x_jcc(cc), blk.pc, true, blk.acc);
+}
+
+static void jit_charge(int cycles)
+{
+    if (cycles)
+        x_alu32_mi(ALU_SUB, M_ST(regs.cycles), cycles);
+}
+
+static void jit_exit_to(uint16_t pc, int cycles)
+{
+    jit_charge(cycles);
+    x_movi(RAX, pc);
+    x_jmp_to(stub_dispatch);
+}
+
+static void jit_emit_exits(void)
+{
+    uint8_t *stub = NULL;
+    for (int i = 0; i < blk.nexits; i++) {
+        jit_exit_t *e = blk.exits + i;
+        if (!stub || !e->bail || !e[-1].bail || e->pc != e[-1].pc) {
+            stub = jit_ptr;
+            if (e->bail) {
+                x_rm(0, 0xC7, 0, M_ST(regs.reg_pc));
+                emit32(e->pc);
+                jit_charge(e->cycles);
+                x_jmp_to(stub_bail);
+            }
+            else
+                jit_exit_to(e->pc, e->cycles);
+        }
+        x_patch(e->site, stub);
+    }
+}
+
+/*
+ * Works out the effective address.  Returns true with it in *ea if it
+ * is known now, otherwise leaves it in eax with, if asked for, 1 in ecx
+ * if indexing crossed a page.
+ */
+static bool jit_ea(int mode, uint16_t opnd, bool penalty, int *ea)
+{
+    int index;
+
+    switch (mode) {
+        case M_ZP:
+            *ea = opnd & 0xff;
+            return true;
+        case M_ABS:
+            *ea = opnd;
+            return true;
+        case M_ZPX:
+        case M_ZPY:
+            x_mov(RAX, mode == M_ZPX ? H_X : H_Y);
+            x_alu8_ri(ALU_ADD, RAX, opnd);
+            return false;
+        case M_ABSX:
+        case M_ABSY:
+            index = mode == M_ABSX ? H_X : H_Y;
+            if (penalty) {
+                x_lea(RCX, M_BASE(index, opnd & 0xff));
+                x_shr(RCX, 8);
+            }
+            x_lea(RAX, M_BASE(index, opnd));
+            x_rr(X_0F, 0xB7, RAX, RAX);
+            return false;
+        case M_IZX:
+            x_mov(RCX, H_X);
+            x_alu8_ri(ALU_ADD, RCX, opnd);
+            x_movzx8(RAX, M_RAMX(RCX, 0));
+            x_alu8_ri(ALU_ADD, RCX, 1);
+            x_movzx8(RCX, M_RAMX(RCX, 0));
+            x_shl(RCX, 8);
+            x_alu_rr(ALU_OR, RAX, RCX);
+            return false;
+        case M_IZP:
+        case M_IZY:
+            opnd &= 0xff;
+            if (opnd != 0xff)
+                x_movzx16(RAX, M_RAM(opnd));
+            else {
+                x_movzx8(RAX, M_RAM(0xff));
+                x_movzx8(RCX, M_RAM(0));
+                x_shl(RCX, 8);
+                x_alu_rr(ALU_OR, RAX, RCX);
+            }
+            if (mode == M_IZY) {
+                if (penalty) {
+                    x_rr(X_0F, 0xB6, RCX, RAX);
+                    x_alu_rr(ALU_ADD, RCX, H_Y);
+                    x_shr(RCX, 8);
+                }
+                x_alu_rr(ALU_ADD, RAX, H_Y);
+                x_rr(X_0F, 0xB7, RAX, RAX);
+            }
+            return false;
+    }
+    return false;
+}
+
+static bool zp_mode(int mode)
+{
+    return mode == M_ZPX || mode == M_ZPY;
+}
+
+/* Checks on an address in eax before it is read and/or written. */
+static void jit_check_read(int mode)
+{
+    if (!zp_mode(mode)) {
+        x_rm(0, 0x3B, RAX, M_ST(regs.read_limit));
+        jit_bail_if(CC_AE);
+    }
+}
+
+static void jit_check_write(int mode)
+{
+    if (!zp_mode(mode)) {
+        x_alu32_ri(ALU_CMP, RAX, JIT_WRITE_LIMIT);
+        jit_bail_if(CC_AE);
+    }
+    x_rm(X_66, 0x83, 7, M_CODE(RAX));
+    emit8(0);
+    jit_bail_if(CC_NE);
+}
+
+static void jit_check_write_const(int ea)
+{
+    x_rm(X_66, 0x83, 7, M_CODEC(ea));
+    emit8(0);
+    jit_bail_if(CC_NE);
+}
+
+static void jit_check_stack(void)
+{
+    x_alu32_mi(ALU_CMP, M_ST(page_code[1]), 0);
+    jit_bail_if(CC_NE);
+}
+
+
+/* An operand: RAM, or a register holding A or an immediate value. */
+typedef struct {
+    bool  is_reg;
+    int   reg;
+    mem_t m;
+} opnd_t;
+
+static void x_op(int flags, int op, int reg, const opnd_t *o)
+{
+    if (o->is_reg)
+        x_rr(flags, op, reg, o->reg);
+    else
+        x_rm(flags, op, reg, o->m);
+}
+
+static bool reads_memory(int kind)
+{
+    return kind != K_STA && kind != K_STX && kind != K_STY && kind != K_STZ;
+}
+
+static bool writes_memory(int kind)
+{
+    switch (kind) {
+        case K_STA: case K_STX: case K_STY: case K_STZ:
+        case K_ASL: case K_ROL: case K_LSR: case K_ROR:
+        case K_INC: case K_DEC: case K_TSB: case K_TRB:
+            return true;
+    }
+    return false;
+}
+
+static int kind_reg(int kind)
+{
+    switch (kind) {
+        case K_LDX: case K_STX: case K_CPX: case K_INX: case K_DEX: case K_PHX: case K_PLX:
+            return H_X;
+        case K_LDY: case K_STY: case K_CPY: case K_INY: case K_DEY: case K_PHY: case K_PLY:
+            return H_Y;
+    }
+    return H_A;
+}
+
+/* Instructions with an operand in memory, in A or immediate. */
+static void jit_data(const opinfo_t *op, const opnd_t *o)
+{
+    int reg = kind_reg(op->kind);
+
+    switch (op->kind) {
+        case K_LDA: case K_LDX: case K_LDY:
+            x_op(X_0F, 0xB6, reg, o);
+            x_setnz(reg);
+            break;
+        case K_STA: case K_STX: case K_STY:
+            x_store8(o->m, reg);
+            break;
+        case K_STZ:
+            x_store8i(o->m, 0);
+            break;
+        case K_ORA: case K_AND: case K_EOR:
+            x_op(0, (op->kind == K_ORA ? ALU_OR : op->kind == K_AND ? ALU_AND : ALU_XOR) * 8 + 2, H_A, o);
+            x_setnz(H_A);
+            break;
+        case K_ADC:
+            x_getc();
+            x_op(0, ALU_ADC * 8 + 2, H_A, o);
+            x_setcc(CC_B, M_ST(regs.c));
+            x_setcc(CC_O, M_ST(regs.v));
+            x_setnz(H_A);
+            break;
+        case K_SBC:
+            x_getc();
+            emit8(0xF5);        // cmc, the 6502 carry is the inverse of borrow.
+            x_op(0, ALU_SBB * 8 + 2, H_A, o);
+            x_setcc(CC_AE, M_ST(regs.c));
+            x_setcc(CC_O, M_ST(regs.v));
+            x_setnz(H_A);
+            break;
+        case K_CMP: case K_CPX: case K_CPY:
+            x_mov(RDX, reg);
+            x_op(0, ALU_SUB * 8 + 2, RDX, o);
+            x_setcc(CC_AE, M_ST(regs.c));
+            x_setnz(RDX);
+            break;
+        case K_BIT:
+            x_op(X_0F, 0xB6, RDX, o);
+            if (op->mode != M_IMM) {
+                x_rr(0, 0xF6, 0, RDX);          // test dl, 0x40
+                emit8(0x40);
+                x_setcc(CC_NE, M_ST(regs.v));
+                x_setnz(RDX);
+            }
+            x_alu_rr(ALU_AND, RDX, H_A);
+            x_setz_only(RDX);
+            break;
+        case K_TSB: case K_TRB:
+            x_movzx8(RDX, o->m);
+            x_alu_rr(ALU_AND, RDX, H_A);
+            x_setz_only(RDX);
+            if (op->kind == K_TSB)
+                x_alu8_mr(ALU_OR, o->m, H_A);
+            else {
+                x_mov(RDX, H_A);
+                x_rr(0, 0xF7, 2, RDX);          // not edx
+                x_alu8_mr(ALU_AND, o->m, RDX);
+            }
+            break;
+        case K_ASL: case K_ROL: case K_LSR: case K_ROR:
+            if (op->kind == K_ROL || op->kind == K_ROR)
+                x_getc();
+            x_op(0, 0xD0, op->kind == K_ASL ? SH_SHL : op->kind == K_ROL ? SH_RCL : op->kind == K_LSR ? SH_SHR : SH_RCR, o);
+            x_setcc(CC_B, M_ST(regs.c));
+            x_op(X_0F, 0xB6, RDX, o);
+            x_setnz(RDX);
+            break;
+        case K_INC: case K_DEC:
+            x_op(0, 0xFE, op->kind == K_DEC, o);
+            x_op(X_0F, 0xB6, RDX, o);
+            x_setnz(RDX);
+            break;
+    }
+}
+
+/* Addressing modes other than immediate and implied. */
+static void jit_memory(const opinfo_t *op, uint16_t opnd)
+{
+    opnd_t o = { false, NOREG, M_RAMX(RAX, 0) };
+    int ea;
+
+    if (jit_ea(op->mode, opnd, op->penalty, &ea)) {
+        if (writes_memory(op->kind))
+            jit_check_write_const(ea);
+        o.m = M_RAM(ea);
+    }
+    else {
+        if (reads_memory(op->kind))
+            jit_check_read(op->mode);
+        if (writes_memory(op->kind))
+            jit_check_write(op->mode);
+        if (op->penalty)
+            x_rm(0, 0x29, RCX, M_ST(regs.cycles));      // sub [cycles], ecx
+    }
+    jit_data(op, &o);
+}
+
+/* Pushes a register or, if reg is NOREG, the two bytes of value. */
+static void jit_push(int reg, uint16_t value)
+{
+    jit_check_stack();
+    x_load32(RAX, M_ST(regs.reg_s));
+    if (reg != NOREG)
+        x_store8(M_RAMX(RAX, 0x100), reg);
+    else {
+        x_store8i(M_RAMX(RAX, 0x100), value >> 8);
+        x_rr(0, 0xFE, 1, RAX);                  // dec al
+        x_store8i(M_RAMX(RAX, 0x100), value & 0xff);
+    }
+    x_rr(0, 0xFE, 1, RAX);
+    x_store32(M_ST(regs.reg_s), RAX);
+}
+
+static bool abs_ok(int kind, uint16_t addr)
+{
+    switch (kind) {
+        case K_NOP: case K_JMP: case K_JMX: case K_JSR:
+            return true;
+        case K_JMI:
+            return addr + 1 < jit_read_limit;
+    }
+    if (reads_memory(kind) && addr >= jit_read_limit)
+        return false;
+    if (writes_memory(kind) && addr >= JIT_WRITE_LIMIT)
+        return false;
+    return true;
+}
+
+/*
+ * Emits the instruction at blk.pc or, if it has to be left to the
+ * interpreter, returns 0 without emitting anything.  Otherwise returns
+ * its length and sets *end if it ends the block.
+ */
+static int jit_insn(const uint8_t *ram, bool *end)
+{
+    uint16_t pc = blk.pc;
+    const opinfo_t *op = ops + ram[pc];
+    int len = mode_len[op->mode], cycles = op->cycles;
+    uint16_t opnd = 0, next = pc + len, target;
+    opnd_t o;
+    int cc;
+
+    if (op->kind == K_NONE || pc + len > jit_read_limit)
+        return 0;
+    if (len >= 2)
+        opnd = ram[pc + 1];
+    if (len == 3)
+        opnd |= ram[pc + 2] << 8;
+    if (op->mode == M_ABS && !abs_ok(op->kind, opnd))
+        return 0;
+
+    switch (op->kind) {
+        case K_NOP:
+            break;
+
+        case K_INA: case K_DEA: case K_INX: case K_DEX: case K_INY: case K_DEY:
+            x_rr(0, 0xFE, op->kind == K_DEA || op->kind == K_DEX || op->kind == K_DEY, kind_reg(op->kind));
+            x_setnz(kind_reg(op->kind));
+            break;
+        case K_TAX: case K_TAY:
+            x_mov(op->kind == K_TAX ? H_X : H_Y, H_A);
+            x_setnz(H_A);
+            break;
+        case K_TXA: case K_TYA:
+            x_mov(H_A, op->kind == K_TXA ? H_X : H_Y);
+            x_setnz(H_A);
+            break;
+        case K_TSX:
+            x_load32(H_X, M_ST(regs.reg_s));
+            x_setnz(H_X);
+            break;
+        case K_TXS:
+            x_store32(M_ST(regs.reg_s), H_X);
+            break;
+
+        case K_CLC: case K_SEC:
+            x_store8i(M_ST(regs.c), op->kind == K_SEC);
+            break;
+        case K_CLV:
+            x_store8i(M_ST(regs.v), 0);
+            break;
+        case K_CLD: case K_SED:
+            x_store8i(M_ST(regs.d), op->kind == K_SED);
+            break;
+
+        case K_PHA: case K_PHX: case K_PHY:
+            jit_push(kind_reg(op->kind), 0);
+            break;
+        case K_PLA: case K_PLX: case K_PLY:
+            x_load32(RAX, M_ST(regs.reg_s));
+            x_rr(0, 0xFE, 0, RAX);              // inc al
+            x_store32(M_ST(regs.reg_s), RAX);
+            x_movzx8(kind_reg(op->kind), M_RAMX(RAX, 0x100));
+            x_setnz(kind_reg(op->kind));
+            break;
+
+        case K_BPL: case K_BMI: case K_BVC: case K_BVS:
+        case K_BCC: case K_BCS: case K_BNE: case K_BEQ:
+            target = next + (int8_t)opnd;
+            switch (op->kind) {
+                case K_BPL: case K_BMI:
+                    x_rr(0, 0xF7, 0, H_NZ);       // test r15d, 0x8000
+                    emit32(0x8000);
+                    break;
+                case K_BVC: case K_BVS:
+                    x_alu8_mi(ALU_CMP, M_ST(regs.v), 0);
+                    break;
+                case K_BCC: case K_BCS:
+                    x_alu8_mi(ALU_CMP, M_ST(regs.c), 0);
+                    break;
+                default:
+                    x_rr(0, 0x84, H_NZ, H_NZ);  // test r15b, r15b
+            }
+            cc = (op->kind == K_BPL || op->kind == K_BVC || op->kind == K_BCC || op->kind == K_BEQ) ? CC_E : CC_NE;
+            jit_side_exit(x_jcc(cc), target, false, blk.acc + 3 + ((next ^ target) > 0xff));
+            break;
+        case K_BRA:
+            target = next + (int8_t)opnd;
+            jit_exit_to(target, blk.acc + cycles + ((next ^ target) > 0xff));
+            *end = true;
+            break;
+        case K_JMP:
+            jit_exit_to(opnd, blk.acc + cycles);
+            *end = true;
+            break;
+        case K_JMI:
+            x_movzx16(RAX, M_RAM(opnd));
+            jit_charge(blk.acc + cycles);
+            x_jmp_to(stub_dispatch);
+            *end = true;
+            break;
+        case K_JMX:
+            x_lea(RAX, M_BASE(H_X, opnd));
+            x_rr(X_0F, 0xB7, RAX, RAX);
+            x_lea(RCX, M_BASE(RAX, 1));
+            x_rm(0, 0x3B, RCX, M_ST(regs.read_limit));
+            jit_bail_if(CC_AE);
+            x_movzx16(RAX, M_RAMX(RAX, 0));
+            jit_charge(blk.acc + cycles);
+            x_jmp_to(stub_dispatch);
+            *end = true;
+            break;
+        case K_JSR:
+            jit_push(NOREG, pc + 2);
+            jit_exit_to(opnd, blk.acc + cycles);
+            *end = true;
+            break;
+        case K_RTS:
+            x_load32(RAX, M_ST(regs.reg_s));
+            x_rr(0, 0xFE, 0, RAX);
+            x_movzx8(RDX, M_RAMX(RAX, 0x100));
+            x_rr(0, 0xFE, 0, RAX);
+            x_movzx8(RCX, M_RAMX(RAX, 0x100));
+            x_store32(M_ST(regs.reg_s), RAX);
+            x_shl(RCX, 8);
+            x_lea(RAX, ((mem_t){ RDX, RCX, 0, 1 }));
+            x_rr(X_0F, 0xB7, RAX, RAX);
+            jit_charge(blk.acc + cycles);
+            x_jmp_to(stub_dispatch);
+            *end = true;
+            break;
+
+        default:
+            if (op->kind == K_ADC || op->kind == K_SBC) {
+                x_alu8_mi(ALU_CMP, M_ST(regs.d), 0);
+                jit_bail_if(CC_NE);
+            }
+            if (op->mode == M_IMP) {
+                o = (opnd_t){ true, H_A, M_RAM(0) };
+                jit_data(op, &o);
+            }
+            else if (op->mode == M_IMM) {
+                x_movi(RCX, opnd);
+                o = (opnd_t){ true, RCX, M_RAM(0) };
+                jit_data(op, &o);
+            }
+            else
+                jit_memory(op, opnd);
+    }
+    blk.acc += cycles;
+    return len;
+}
+
+static void *jit_compile(const uint8_t *ram, uint16_t start)
+{
+    uint8_t *code;
+    uint16_t pc = start;
+    bool end = false;
+    int n, len;
+
+    if (jit_ptr + JIT_BLOCK_SPACE > jit_buf + JIT_BUF_SIZE) {
+        log_debug("6502jit: code buffer full, flushing");
+        jit6502_flush();
+    }
+    code = jit_ptr;
+    blk.acc = 0;
+    blk.nexits = 0;
+    for (n = 0; n < JIT_MAX_INSNS && !end && pc - start <= JIT_MAX_BYTES - 3; n++) {
+        blk.pc = pc;
+        if (!(len = jit_insn(ram, &end)))
+            break;
+        pc += len;
+    }
+    if (!n) {
+        code = stub_bail;
+        pc = start + 1;
+    }
+    else {
+        if (!end)
+            jit_exit_to(pc, blk.acc);
+        jit_emit_exits();
+    }
+
+    jit.entry[start] = code;
+    jit.len[start] = pc - start;
+    for (uint16_t addr = start; addr != pc; addr++) {
+        jit.code[addr]++;
+        jit.page_code[addr >> 8]++;
+    }
+    return code;
+}
+
+/*
+ * Runs compiled code until the cycles run out, the interrupt lines
+ * change or an instruction is reached that the interpreter has to run.
+ * Returns false if there is no JIT to run.
+ */
+bool jit6502_run(jit6502_regs_t *regs)
+{
+    if (!jit_buf && (jit6502_failed || !jit_open()))
+        return false;
+    if (regs->read_limit != jit_read_limit) {
+        jit6502_flush();
+        jit_read_limit = regs->read_limit;
+    }
+
+    jit.regs = *regs;
+    while (jit.regs.cycles > 0 && !((*jit.regs.irq ^ jit.regs.irq_xor) & jit.regs.irq_mask)) {
+        void *code = jit.entry[jit.regs.reg_pc];
+        if (!code)
+            code = jit_compile(jit.regs.ram, jit.regs.reg_pc);
+        jit.regs.bailed = 0;
+        jit_enter(&jit.regs, code);
+        if (jit.regs.bailed)
+            break;
+    }
+    *regs = jit.regs;
+    return true;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __INC_6502JIT_H
+#define __INC_6502JIT_H
+
+/*
+ * Basic block recompiler for the 65C02 second processor, see 6502jit.c.
+ *
+ * Only built for x86-64 hosts using the System V calling convention,
+ * elsewhere the interpreter in 6502tube.c is all there is.
+ */
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_6502
+#endif
+
+#ifdef JIT_6502
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The parasite state handed to and from the compiled code.  NZ holds
+ * a value whose low byte is zero when Z is set and whose bit 15 is N.
+ * C, V and D are 0 or 1.
+ */
+typedef struct {
+    uint32_t reg_a, reg_x, reg_y, reg_s;
+    uint32_t nz, c, v, d;
+    uint32_t reg_pc;
+    int32_t  cycles;
+    uint32_t read_limit;    // reads at or above this are left to the interpreter.
+    uint32_t irq_xor;       // the run stops when (*irq ^ irq_xor) & irq_mask.
+    uint32_t irq_mask;
+    uint32_t bailed;
+    const int *irq;
+    uint8_t *ram;
+} jit6502_regs_t;
+
+/* Count of compiled blocks covering each address. */
+extern const uint16_t *jit6502_code;
+
+/* Set if the code buffer could not be allocated.  This is separate
+ * from the user's setting, which is left alone.
+ */
+extern bool jit6502_failed;
+
+bool jit6502_run(jit6502_regs_t *regs);
+void jit6502_invalidate(uint32_t addr, size_t len);
+void jit6502_flush(void);
+void jit6502_close(void);
+
+static inline bool jit6502_is_code(uint32_t addr)
+{
+    return addr < 0x10000 && jit6502_code[addr];
+}
+
+#endif
+
+#endif
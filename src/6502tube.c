@@ -8,6 +8,7 @@
 #include "tube.h"
 #include "6502tube.h"
 #include "6502debug.h"
+#include "6502jit.h"
 
 #define a tubea
 #define x tubex
@@ -29,12 +30,16 @@ static size_t tuberamsize;
 static uint8_t *tuberom;
 
 bool tube_6502_rom_in = true;
+bool tube_6502_jit = true;
 
 #define TUBE_6502_RAM_SIZE    0x10000
 #define TURBO_6502_RAM_SIZE 0x1000000
 
 void tube_6502_close()
 {
+#ifdef JIT_6502
+    jit6502_close();
+#endif
     if (tuberam) {
         free(tuberam);
         tuberam = NULL;
@@ -110,6 +115,9 @@ void tube_6502_loadstate(ZFILE *zfp)
 
     savestate_zread(zfp, tuberam, tuberamsize);
     savestate_zread(zfp, tuberom, tubes[curtube].rom_size);
+#ifdef JIT_6502
+    jit6502_flush();
+#endif
 }
 
 static uint32_t dbg_reg_get(int which) {
@@ -197,6 +205,10 @@ static void do_writemem(uint32_t addr, uint32_t value)
         return;
     }
     tuberam[addr] = value;
+#ifdef JIT_6502
+    if (jit6502_is_code(addr))
+        jit6502_invalidate(addr, 1);
+#endif
     if (addr == 0xfef0 && tuberamsize > 0x10000) {
         if (value & 0x80)
             enable_turbo();
@@ -262,6 +274,33 @@ static void tube_6502_writemem(uint32_t addr, uint8_t value) {
     do_writemem(addr, value);
 }
 
+/* Block copies for VDFS: straight to or from RAM unless the debugger
+ * is watching or the block reaches the tube registers or, when paged
+ * in, the ROM.
+ */
+static void tube_6502_readblk(uint32_t addr, uint8_t *buf, size_t len)
+{
+    uint32_t end = tube_6502_rom_in ? 0xF000 : 0xFEF0;
+    if (!dbg_tube6502 && addr < end && len <= end - addr)
+        memcpy(buf, tuberam + addr, len);
+    else
+        while (len--)
+            *buf++ = tube_6502_readmem(addr++);
+}
+
+static void tube_6502_writeblk(uint32_t addr, const uint8_t *buf, size_t len)
+{
+    if (!dbg_tube6502 && addr < 0xFEF0 && len <= 0xFEF0 - addr) {
+        memcpy(tuberam + addr, buf, len);
+#ifdef JIT_6502
+        jit6502_invalidate(addr, len);
+#endif
+    }
+    else
+        while (len--)
+            tube_6502_writemem(addr++, *buf++);
+}
+
 static uint8_t readmem(uint16_t addr)
 {
     return tube_6502_readmem(addr);
@@ -279,6 +318,9 @@ static void writemem(uint16_t addr, uint8_t value)
 void tube_6502_reset()
 {
     tube_6502_rom_in = true;
+#ifdef JIT_6502
+    jit6502_flush();
+#endif
         pc = readmem(0xFFFC) | (readmem(0xFFFD) << 8);
         tubep.i = 1;
         tube_irq = 0;
@@ -304,6 +346,8 @@ static bool common_init(void *rom, size_t memsize)
     tube_type = TUBE6502;
     tube_readmem = tube_6502_readmem;
     tube_writemem = tube_6502_writemem;
+    tube_readblk = tube_6502_readblk;
+    tube_writeblk = tube_6502_writeblk;
     tube_exec  = tube_6502_exec;
     tube_proc_savestate = tube_6502_savestate;
     tube_proc_loadstate = tube_6502_loadstate;
@@ -545,6 +589,43 @@ static INLINE void tube_6502_trace(uint8_t opcode)
 }
 #endif
 
+#if defined(JIT_6502) && !defined(TRACE_TUBE)
+/* Runs compiled code until it stops at something for the interpreter. */
+static void tube_6502_run_jit(void)
+{
+    jit6502_regs_t regs;
+
+    regs.reg_a = a;
+    regs.reg_x = x;
+    regs.reg_y = y;
+    regs.reg_s = s;
+    regs.nz = (tubep.n ? 0x8000 : 0) | (tubep.z ? 0 : 1);
+    regs.c = tubep.c ? 1 : 0;
+    regs.v = tubep.v ? 1 : 0;
+    regs.d = tubep.d ? 1 : 0;
+    regs.reg_pc = pc;
+    regs.cycles = tubecycles;
+    regs.read_limit = tube_6502_rom_in ? 0xF000 : 0xFEF8;
+    regs.irq_xor = tube_6502_oldnmi ? 2 : 0;
+    regs.irq_mask = tubep.i ? 2 : 3;
+    regs.irq = &tube_irq;
+    regs.ram = tuberam;
+    if (!jit6502_run(&regs))
+        return;
+    a = regs.reg_a;
+    x = regs.reg_x;
+    y = regs.reg_y;
+    s = regs.reg_s;
+    tubep.z = !(regs.nz & 0xff);
+    tubep.n = (regs.nz >> 8) & 0x80;
+    tubep.c = regs.c;
+    tubep.v = regs.v;
+    tubep.d = regs.d;
+    pc = regs.reg_pc;
+    tubecycles = regs.cycles;
+}
+#endif
+
 void tube_6502_exec()
 {
         uint8_t opcode;
@@ -556,6 +637,13 @@ void tube_6502_exec()
 //        tubecycles+=(tubecycs<<1);
 //        printf("Tube exec %i %04X\n",tubecycles,pc);
         while (tubecycles > 0) {
+#if defined(JIT_6502) && !defined(TRACE_TUBE)
+                if (tube_6502_jit && !jit6502_failed && !dbg_tube6502 && !tube_6502_skipint && tuberamsize == TUBE_6502_RAM_SIZE) {
+                        tube_6502_run_jit();
+                        if (tubecycles <= 0)
+                                break;
+                }
+#endif
                 oldtpc2 = oldtpc;
                 oldtpc = pc;
         if (dbg_tube6502)
@@ -1666,6 +1754,7 @@ void tube_6502_exec()
                 case 0xA8:
                         /*TAY*/ y = a;
                         setzn(y);
+                        polltime(2);
                         break;
 
                 case 0xA9:      /*LDA imm */
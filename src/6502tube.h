@@ -13,5 +13,6 @@ void tube_6502_mapoutrom(void);
 
 extern cpu_debug_t tube6502_cpu_debug;
 extern bool tube_6502_rom_in;
+extern bool tube_6502_jit;
 
 #endif
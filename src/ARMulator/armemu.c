@@ -42,6 +42,7 @@ static void     LoadMult            (ARMul_State *, ARMword, ARMword, ARMword);
 static void     StoreMult           (ARMul_State *, ARMword, ARMword, ARMword);
 static void     LoadSMult           (ARMul_State *, ARMword, ARMword, ARMword);
 static void     StoreSMult          (ARMul_State *, ARMword, ARMword, ARMword);
+static unsigned MultiplierCycles    (ARMword, int);
 static unsigned Multiply64          (ARMul_State *, ARMword, int, int);
 static unsigned MultiplyAdd64       (ARMul_State *, ARMword, int, int);
 static void     Handle_Load_Double  (ARMul_State *, ARMword);
@@ -968,12 +969,8 @@ mainswitch:
                     else
                         UNDEF_MULPCDest;
 
-                    for (dest = 0, temp = 0; dest < 32; dest ++)
-                        if (rhs & (1L << dest))
-                            temp = dest;
-
-                    /* Mult takes this many/2 I cycles.  */
-                    ARMul_Icycles (state, ARMul_MultTable[temp], 0L);
+                    /* Mult takes this many I cycles.  */
+                    ARMul_Icycles (state, MultiplierCycles (rhs, LSIGNED), 0L);
                 }
                 else
                 {
@@ -1012,12 +1009,8 @@ mainswitch:
                     else
                         UNDEF_MULPCDest;
 
-                    for (dest = 0, temp = 0; dest < 32; dest ++)
-                        if (rhs & (1L << dest))
-                            temp = dest;
-
-                    /* Mult takes this many/2 I cycles.  */
-                    ARMul_Icycles (state, ARMul_MultTable[temp], 0L);
+                    /* Mult takes this many I cycles.  */
+                    ARMul_Icycles (state, MultiplierCycles (rhs, LSIGNED), 0L);
                 }
                 else
                 {
@@ -1051,12 +1044,8 @@ mainswitch:
                     else
                         UNDEF_MULPCDest;
 
-                    for (dest = 0, temp = 0; dest < 32; dest ++)
-                        if (rhs & (1L << dest))
-                            temp = dest;
-
-                    /* Mult takes this many/2 I cycles.  */
-                    ARMul_Icycles (state, ARMul_MultTable[temp], 0L);
+                    /* Mult takes this many I cycles plus one for the add.  */
+                    ARMul_Icycles (state, MultiplierCycles (rhs, LSIGNED) + 1, 0L);
                 }
                 else
                 {
@@ -1095,12 +1084,8 @@ mainswitch:
                     else
                         UNDEF_MULPCDest;
 
-                    for (dest = 0, temp = 0; dest < 32; dest ++)
-                        if (rhs & (1L << dest))
-                            temp = dest;
-
-                    /* Mult takes this many/2 I cycles.  */
-                    ARMul_Icycles (state, ARMul_MultTable[temp], 0L);
+                    /* Mult takes this many I cycles plus one for the add.  */
+                    ARMul_Icycles (state, MultiplierCycles (rhs, LSIGNED) + 1, 0L);
                 }
                 else
                 {
@@ -5079,6 +5064,28 @@ Add32 (ARMword a1, ARMword a2, int *carry)
     return result;
 }
 
+/* The ARM7TDMI multiplier deals with eight bits of the multiplier
+operand (Rs) per cycle and stops early once the remaining bits are all
+zero or, for signed multiplies, all one.  This returns the number of
+cycles, m in the ARM7TDMI instruction cycle timings.  */
+
+static unsigned
+MultiplierCycles (ARMword rs, int msigned)
+{
+    if (msigned && (rs & ((unsigned) 1 << 31)))
+        /* Invert the bits to make the check against zero.  */
+        rs = ~rs;
+
+    if ((rs & 0xFFFFFF00) == 0)
+        return 1;
+    else if ((rs & 0xFFFF0000) == 0)
+        return 2;
+    else if ((rs & 0xFF000000) == 0)
+        return 3;
+    else
+        return 4;
+}
+
 /* This function does the work of multiplying
 two 32bit values to give a 64bit result.  */
 
@@ -5089,7 +5096,7 @@ Multiply64 (ARMul_State * state, ARMword instr, int msigned, int scc)
     int nRdHi, nRdLo, nRs, nRm;
     ARMword RdHi = 0, RdLo = 0, Rm;
     /* Cycle count.  */
-    int scount;
+    unsigned scount;
 
     nRdHi = AEBITS (16, 19);
     nRdLo = AEBITS (12, 15);
@@ -5097,6 +5104,7 @@ Multiply64 (ARMul_State * state, ARMword instr, int msigned, int scc)
     nRm = AEBITS (0, 3);
 
     /* Needed to calculate the cycle count.  */
+    scount = MultiplierCycles (state->Reg[nRs], msigned);
     Rm = state->Reg[nRm];
 
     /* Check for illegal operand combinations first.  */
@@ -5166,22 +5174,7 @@ Multiply64 (ARMul_State * state, ARMword instr, int msigned, int scc)
         but don't let RdLo's sign bit make it to N.  */
         ARMul_NegZero (state, RdHi | (RdLo >> 16) | (RdLo & 0xFFFF));
 
-    /* The cycle count depends on whether the instruction is a signed or
-    unsigned multiply, and what bits are clear in the multiplier.  */
-    if (msigned && (Rm & ((unsigned) 1 << 31)))
-        /* Invert the bits to make the check against zero.  */
-        Rm = ~Rm;			
-
-    if ((Rm & 0xFFFFFF00) == 0)
-        scount = 1;
-    else if ((Rm & 0xFFFF0000) == 0)
-        scount = 2;
-    else if ((Rm & 0xFF000000) == 0)
-        scount = 3;
-    else
-        scount = 4;
-
-    return 2 + scount;
+    return scount + 1;
 }
 
 /* This function does the work of multiplying two 32bit
@@ -34,10 +34,6 @@ ARMword ARMul_DoProg (ARMul_State * state);
 ARMword ARMul_DoInstr (ARMul_State * state);
 void ARMul_Abort (ARMul_State * state, ARMword address);
 
-const unsigned ARMul_MultTable[32] =
-{ 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9,
-10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16, 16
-};
 ARMword ARMul_ImmedTable[4096];	/* immediate DP LHS values */
 char ARMul_BitList[256];	/* number of bits in a byte table */
 
@@ -214,6 +210,7 @@ ARMul_Reset (ARMul_State * state)
     state->NumIcycles = 0;
     state->NumCcycles = 0;
     state->NumFcycles = 0;
+    /* Sets these without rebuilding the Sprow memory map - see map_pages */
     state->remapControlRegister = 0;
     state->romSelectRegister = 1;
 #ifdef ASIM
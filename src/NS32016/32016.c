@@ -45,6 +45,182 @@ OperandSizeType OpSize;
 
 const uint32_t IndexLKUP[8] = { 0x0, 0x1, 0x4, 0x5, 0x8, 0x9, 0xC, 0xD };                    // See Page 2-3 of the manual!
 
+// The parts of a general operand read from the instruction stream
+typedef struct
+{
+   int32_t  Disp[2];
+   uint64_t Immediate;
+} DecodedOperand;
+
+// Everything about an instruction that depends only on its code bytes
+typedef struct
+{
+   uint32_t        Address;                                 // pc of the instruction
+   uint32_t        Generation;                              // of its code page when decoded
+   uint32_t        Opcode;
+   uint32_t        Function;
+   OperandSizeType OpSize;
+   RegLKU          Regs[2];
+   uint8_t         WriteIndex;
+   uint8_t         Length;                                  // Bytes up to the end of the operands
+   uint16_t        Cycles;
+   int32_t         Disp;                                    // Displacement of Format 0 and 1 instructions
+   DecodedOperand  Operand[2];
+} DecodedInstruction;
+
+static DecodedInstruction Decoded;
+
+#ifdef NS_DECODE_CACHE
+// Decoded instructions are kept in a direct mapped cache indexed by pc.
+// Each entry records the generation of the page of RAM holding its code,
+// which is bumped when that page is written, so self modifying code and
+// loading new programs are seen.  Code above RAM is ROM and never changes.
+#define DECODE_CACHE_SIZE 4096                              // Must be a power of 2
+
+static DecodedInstruction DecodeCache[DECODE_CACHE_SIZE];
+static uint32_t CodeGeneration[CODE_PAGE_COUNT];
+uint8_t CodePages[CODE_PAGE_COUNT];                         // Set for pages with cached code
+
+static void FlushDecoded(void)
+{
+   memset(DecodeCache, 0, sizeof(DecodeCache));
+   memset(CodePages, 0, sizeof(CodePages));
+}
+
+void InvalidateDecoded(uint32_t addr, uint32_t Size)
+{
+   uint32_t Page = addr >> CODE_PAGE_SHIFT;
+   uint32_t Last = (addr + Size - 1) >> CODE_PAGE_SHIFT;
+
+   for (; Page <= Last && Page < CODE_PAGE_COUNT; Page++)
+   {
+      if (CodePages[Page])
+      {
+         CodePages[Page] = 0;
+         CodeGeneration[Page]++;
+      }
+   }
+}
+
+static DecodedInstruction* LookupDecoded(uint32_t Address)
+{
+   DecodedInstruction* pInst = &DecodeCache[Address & (DECODE_CACHE_SIZE - 1)];
+
+#ifdef INCLUDE_DEBUGGER
+   if (n32016_debug_enabled)
+   {
+      return NULL;                                          // Let the debugger see every fetch
+   }
+#endif
+
+   if (pInst->Length && pInst->Address == Address)
+   {
+      uint32_t Page = (Address & MEM_MASK) >> CODE_PAGE_SHIFT;
+
+      if (Page >= CODE_PAGE_COUNT || pInst->Generation == CodeGeneration[Page])
+      {
+         return pInst;
+      }
+   }
+
+   return NULL;
+}
+
+// Copies a freshly decoded instruction into the cache if its code is all in one page
+static DecodedInstruction* StoreDecoded(DecodedInstruction* pInst)
+{
+   uint32_t First = startpc & MEM_MASK;
+   uint32_t Last  = First + (pInst->Length < 4 ? 4 : pInst->Length) - 1;  // The opcode is always read as 4 bytes
+   uint32_t Page  = First >> CODE_PAGE_SHIFT;
+
+#ifdef INCLUDE_DEBUGGER
+   if (n32016_debug_enabled)
+   {
+      return pInst;
+   }
+#endif
+
+   if (Last >= IO_BASE || Page != (Last >> CODE_PAGE_SHIFT))
+   {
+      return pInst;
+   }
+
+   if (Page < CODE_PAGE_COUNT)
+   {
+      CodePages[Page] = 1;
+      pInst->Generation = CodeGeneration[Page];
+   }
+
+   pInst->Address = startpc;
+
+   DecodedInstruction* pEntry = &DecodeCache[startpc & (DECODE_CACHE_SIZE - 1)];
+   *pEntry = *pInst;
+   return pEntry;
+}
+#endif
+
+// Clock cycles for the addressing mode of a general operand, see InstructionCycles()
+static const uint8_t AddressingCycles[32] =
+{
+   0, 0, 0, 0, 0, 0, 0, 0,                                  // Register
+   5, 5, 5, 5, 5, 5, 5, 5,                                  // Register relative
+   12, 12, 12,                                              // Memory relative
+   0,                                                       // Illegal
+   0,                                                       // Immediate
+   4,                                                       // Absolute
+   19,                                                      // External
+   2,                                                       // Top of stack
+   5, 5, 5, 5,                                              // Memory space
+   5, 5, 5, 5                                               // Scaled index, plus the base mode
+};
+
+static uint32_t OperandCycles(RegLKU gen, uint32_t Size, uint32_t Access)
+{
+   uint32_t Cycles = 0;
+   uint32_t Mode = gen.OpType;
+   int InMemory;
+
+   if (gen.Whole >= 0xFFFF)
+   {
+      return 0;                                             // No operand
+   }
+
+   if (Mode >= EaPlusRn)
+   {
+      Cycles = AddressingCycles[Mode];
+      Mode = gen.IdxType;
+      InMemory = 1;
+   }
+   else
+   {
+      InMemory = (Mode > R7) && (Mode != Immediate);
+   }
+
+   Cycles += AddressingCycles[Mode];
+
+   if (InMemory)
+   {
+      Cycles += Access * BUS_CYCLES(Size);
+   }
+
+   return Cycles;
+}
+
+// Works out the clock cycles an instruction takes from FunctionTimings[] and its operands
+static uint32_t InstructionCycles(uint32_t Function)
+{
+   const InstructionTiming* pTiming = &FunctionTimings[TRAP];
+
+   if (Function < InstructionCount && FunctionTimings[Function].Base)
+   {
+      pTiming = &FunctionTimings[Function];
+   }
+
+   return pTiming->Base + pTiming->PerByte * OpSize.Op[0]
+          + OperandCycles(Regs[0], OpSize.Op[0], pTiming->Access[0])
+          + OperandCycles(Regs[1], OpSize.Op[1], pTiming->Access[1]);
+}
+
 /* A custom warning logger for n32016 that logs the PC */
 
 void n32016_warn(char *fmt, ...)
@@ -117,6 +293,9 @@ void n32016_reset()
 void n32016_reset_addr(uint32_t StartAddress)
 {
    n32016_build_matrix();
+#ifdef NS_DECODE_CACHE
+   FlushDecoded();
+#endif
 
    pc = StartAddress;
    psr = 0;
@@ -357,7 +536,80 @@ static void getgen(int gen, int c)
    }
 }
 
-static void GetGenPhase2(RegLKU gen, int c)
+// Reads the displacements or immediate value of an operand from the instruction stream.
+// These only depend on the code so are kept with the decoded instruction.
+static void DecodeGen(RegLKU gen, int c, DecodedOperand* pOp)
+{
+   if (gen.Whole < 0xFFFF)                                              // Does this Operand exist ?
+   {
+      if (gen.OpType <= R7)
+      {
+         return;
+      }
+
+      if (gen.OpType == Immediate)
+      {
+         MultiReg temp3;
+
+         if (OpSize.Op[c] == sz64)
+         {
+            temp3.u32 = SWAP32(read_x32(pc));
+            pOp->Immediate = (((uint64_t) temp3.u32) << 32);
+            temp3.u32 = SWAP32(read_x32(pc + 4));
+            pOp->Immediate |= temp3.u32;
+         }
+         else
+         {
+            // Why can't they just decided on an endian and then stick to it?
+            temp3.u32 = SWAP32(read_x32(pc));
+            if (OpSize.Op[c] == sz8)
+               pOp->Immediate = temp3.u8;
+            else if (OpSize.Op[c] == sz16)
+               pOp->Immediate = temp3.u16;
+            else
+               pOp->Immediate = temp3.u32;
+         }
+
+         pc += OpSize.Op[c];
+         return;
+      }
+
+      if (gen.OpType <= R7_Offset)
+      {
+         pOp->Disp[0] = GetDisplacement(&pc);
+         return;
+      }
+
+      if (gen.OpType >= EaPlusRn)
+      {
+         RegLKU NewPattern;
+         NewPattern.Whole = gen.IdxType;
+         DecodeGen(NewPattern, c, pOp);
+         return;
+      }
+
+      switch (gen.OpType)
+      {
+         case FrameRelative:
+         case StackRelative:
+         case StaticRelative:
+         case External:
+            pOp->Disp[0] = GetDisplacement(&pc);
+            pOp->Disp[1] = GetDisplacement(&pc);
+            break;
+
+         case Absolute:
+         case FpRelative:
+         case SpRelative:
+         case SbRelative:
+         case PcRelative:
+            pOp->Disp[0] = GetDisplacement(&pc);
+            break;
+      }
+   }
+}
+
+static void GetGenPhase2(RegLKU gen, int c, const DecodedOperand* pOp)
 {
    if (gen.Whole < 0xFFFF)                                              // Does this Operand exist ?
    {
@@ -395,28 +647,15 @@ static void GetGenPhase2(RegLKU gen, int c)
 
       if (gen.OpType == Immediate)
       {
-         MultiReg temp3;
-
          if (OpSize.Op[c] == sz64)
          {
-            temp3.u32 = SWAP32(read_x32(pc));
-            Immediate64.u64 = (((uint64_t) temp3.u32) << 32);
-            temp3.u32 = SWAP32(read_x32(pc + 4));
-            Immediate64.u64 |= temp3.u32;
+            Immediate64.u64 = pOp->Immediate;
          }
          else
          {
-            // Why can't they just decided on an endian and then stick to it?
-            temp3.u32 = SWAP32(read_x32(pc));
-            if (OpSize.Op[c] == sz8)
-               genaddr[c] = temp3.u8;
-            else if (OpSize.Op[c] == sz16)
-               genaddr[c] = temp3.u16;
-            else
-               genaddr[c] = temp3.u32;
+            genaddr[c] = (uint32_t) pOp->Immediate;
          }
 
-         pc += OpSize.Op[c];
          gentype[c] = OpImmediate;
          return;
       }
@@ -425,7 +664,7 @@ static void GetGenPhase2(RegLKU gen, int c)
 
       if (gen.OpType <= R7_Offset)
       {
-         genaddr[c] = r[gen.Whole & 7] + GetDisplacement(&pc);
+         genaddr[c] = r[gen.Whole & 7] + pOp->Disp[0];
          return;
       }
 
@@ -436,7 +675,7 @@ static void GetGenPhase2(RegLKU gen, int c)
          uint32_t Shift = gen.Whole & 3;
          RegLKU NewPattern;
          NewPattern.Whole = gen.IdxType;
-         GetGenPhase2(NewPattern, c);
+         GetGenPhase2(NewPattern, c, pOp);
 
          int32_t Offset = ((int32_t) r[gen.IdxReg]) * (1 << Shift);
          if (gentype[c] != Register)
@@ -455,35 +694,29 @@ static void GetGenPhase2(RegLKU gen, int c)
       switch (gen.OpType)
       {
          case FrameRelative:
-            temp = GetDisplacement(&pc);
-            temp2 = GetDisplacement(&pc);
-            genaddr[c] = read_x32(fp + temp);
-            genaddr[c] += temp2;
+            genaddr[c] = read_x32(fp + pOp->Disp[0]);
+            genaddr[c] += pOp->Disp[1];
             break;
 
          case StackRelative:
-            temp = GetDisplacement(&pc);
-            temp2 = GetDisplacement(&pc);
-            genaddr[c] = read_x32(GET_SP() + temp);
-            genaddr[c] += temp2;
+            genaddr[c] = read_x32(GET_SP() + pOp->Disp[0]);
+            genaddr[c] += pOp->Disp[1];
             break;
 
          case StaticRelative:
-            temp = GetDisplacement(&pc);
-            temp2 = GetDisplacement(&pc);
-            genaddr[c] = read_x32(sb + temp);
-            genaddr[c] += temp2;
+            genaddr[c] = read_x32(sb + pOp->Disp[0]);
+            genaddr[c] += pOp->Disp[1];
             break;
 
          case Absolute:
-            genaddr[c] = GetDisplacement(&pc);
+            genaddr[c] = pOp->Disp[0];
             break;
 
          case External:
             temp = read_x32(mod + 4);
-            temp += ((int32_t) GetDisplacement(&pc)) * 4;
+            temp += pOp->Disp[0] * 4;
             temp2 = read_x32(temp);
-            genaddr[c] = temp2 + GetDisplacement(&pc);
+            genaddr[c] = temp2 + pOp->Disp[1];
             break;
 
          case TopOfStack:
@@ -492,19 +725,19 @@ static void GetGenPhase2(RegLKU gen, int c)
             break;
 
          case FpRelative:
-            genaddr[c] = GetDisplacement(&pc) + fp;
+            genaddr[c] = pOp->Disp[0] + fp;
             break;
 
          case SpRelative:
-            genaddr[c] = GetDisplacement(&pc) + GET_SP();
+            genaddr[c] = pOp->Disp[0] + GET_SP();
             break;
 
          case SbRelative:
-            genaddr[c] = GetDisplacement(&pc) + sb;
+            genaddr[c] = pOp->Disp[0] + sb;
             break;
 
          case PcRelative:
-            genaddr[c] = GetDisplacement(&pc) + startpc;
+            genaddr[c] = pOp->Disp[0] + startpc;
             break;
 
          default:
@@ -924,6 +1157,7 @@ void PopRegisters(void)
       if (temp & BIT(c))
       {
          r[c ^ 7] = popd();
+         tubecycles -= BUS_CYCLES(sz32);
       }
    }
 }
@@ -986,322 +1220,386 @@ uint32_t ReturnCommon(void)
    return 0;                     // OK
 }
 
-void n32016_exec()
+// Decodes the instruction at pc, leaving pc after its operands.  The
+// processor state set up here is kept in pInst to be reused by later
+// executions of the same instruction.  Returns 0 if the instruction traps
+// before its operands are read.
+static int DecodeInstruction(DecodedInstruction* pInst)
 {
-   uint32_t opcode, WriteIndex;
-   uint32_t temp, temp2, temp3;
-   Temp64Type temp64;
+   uint32_t opcode = read_x32(pc);
    uint32_t Function;
+   uint32_t WriteIndex = 1;                                             // Default to writing operand 0
 
-   // Avoid a "might be uninitialized" warning
-   temp = 0;
-   temp64.u64 = 0;
-
-   if (tube_irq & 2)
-   {
-      // NMI is edge sensitive, so it should be cleared here
-      tube_irq &= ~2;
-      TakeInterrupt(intbase + (1 * 4));
-   }
-   else if ((tube_irq & 1) && (psr & 0x800))
-   {
-      // IRQ is level sensitive, so the called should maintain the state
-      TakeInterrupt(intbase);
-   }
+   WriteSize      = szVaries;                                           // The size a result may be written as
+   OpSize.Whole   = 0;
 
-   while (tubecycles > 0)
-   {
-      tubecycles -= 8;
+   Regs[0].Whole  =
+   Regs[1].Whole  = 0xFFFF;
 
-      CLEAR_TRAP();
+   memset(pInst, 0, sizeof(DecodedInstruction));
+   pInst->Opcode = opcode;
+   pInst->Cycles = FunctionTimings[TRAP].Base;
 
-      WriteSize      = szVaries;                                            // The size a result may be written as
-      WriteIndex     = 1;                                                   // Default to writing operand 0
-      OpSize.Whole   = 0;
+   BreakPoint(startpc, opcode);
 
-      Regs[0].Whole  =
-      Regs[1].Whole  = 0xFFFF;
+   Function = FunctionLookup[opcode & 0xFF];
+   uint32_t Format   = Function >> 4;
 
-      startpc  = pc;
+   if (Format < (FormatCount + 1))
+   {
+      pc += FormatSizes[Format];                                        // Add the basic number of bytes for a particular instruction
+   }
 
-#ifdef INCLUDE_DEBUGGER
-      if (n32016_debug_enabled)
+   switch (Format)
+   {
+      case Format0:
+      case Format1:
       {
-         debug_preexec(&n32016_cpu_debug, pc);
+         // Nothing here!
       }
-#endif
-
-      opcode = read_x32(pc);
+      break;
 
-      if (pc == PR.BPC)
+      case Format2:
       {
-         SET_TRAP(BreakPointHit);
-         goto DoTrap;
+         SET_OP_SIZE(opcode);
+         WriteIndex = 0;
+         getgen(opcode >> 11, 0);
       }
+      break;
 
-      BreakPoint(startpc, opcode);
-
-      Function = FunctionLookup[opcode & 0xFF];
-      uint32_t Format   = Function >> 4;
+      case Format3:
+      {
+         Function += ((opcode >> 7) & 0x0F);
+         SET_OP_SIZE(opcode);
+         getgen(opcode >> 11, 0);
+      }
+      break;
 
-      if (Format < (FormatCount + 1))
+      case Format4:
       {
-         pc += FormatSizes[Format];                                        // Add the basic number of bytes for a particular instruction
+         SET_OP_SIZE(opcode);
+         getgen(opcode >> 11, 0);
+         getgen(opcode >> 6, 1);
       }
+      break;
 
-      switch (Format)
+      case Format5:
       {
-         case Format0:
-         case Format1:
+         Function += ((opcode >> 10) & 0x0F);
+         SET_OP_SIZE(opcode >> 8);
+         if (Function == SETCFG)
          {
-            // Nothing here!
+            OpSize.Whole = 0;
          }
-         break;
-
-         case Format2:
+         else if (opcode & BIT(Translation))
          {
-            SET_OP_SIZE(opcode);
-            WriteIndex = 0;
-            getgen(opcode >> 11, 0);
+            SET_OP_SIZE(0);         // 8 Bit
          }
-         break;
+      }
+      break;
 
-         case Format3:
-         {
-            Function += ((opcode >> 7) & 0x0F);
-            SET_OP_SIZE(opcode);
-            getgen(opcode >> 11, 0);
-         }
-         break;
+      case Format6:
+      {
+         Function += ((opcode >> 10) & 0x0F);
+         SET_OP_SIZE(opcode >> 8);
 
-         case Format4:
+         // Ordering important here, as getgen uses Operand Size
+         switch (Function)
          {
-            SET_OP_SIZE(opcode);
-            getgen(opcode >> 11, 0);
-            getgen(opcode >> 6, 1);
+            case ROT:
+            case ASH:
+            case LSH:
+            {
+               OpSize.Op[0] = sz8;
+            }
+            break;
          }
-         break;
 
-         case Format5:
+         getgen(opcode >> 19, 0);
+         getgen(opcode >> 14, 1);
+      }
+      break;
+
+      case Format7:
+      {
+         Function += ((opcode >> 10) & 0x0F);
+         SET_OP_SIZE(opcode >> 8);
+
+         getgen(opcode >> 19, 0);
+         getgen(opcode >> 14, 1);
+      }
+      break;
+
+      case Format8:
+      {
+         if (opcode & 0x400)
          {
-            Function += ((opcode >> 10) & 0x0F);
-            SET_OP_SIZE(opcode >> 8);
-            if (Function == SETCFG)
+            if (opcode & 0x80)
             {
-               OpSize.Whole = 0;
+               switch (opcode & 0x3CC0)
+               {
+                  case 0x0C80:
+                  {
+                     Function = MOVUS;
+                  }
+                  break;
+
+                  case 0x1C80:
+                  {
+                     Function = MOVSU;
+                  }
+                  break;
+
+                  default:
+                  {
+                     Function = TRAP;
+                  }
+                  break;
+               }
             }
-            else if (opcode & BIT(Translation))
+            else
             {
-               SET_OP_SIZE(0);         // 8 Bit
+               Function = (opcode & 0x40) ? FFS : INDEX;
             }
          }
-         break;
-
-         case Format6:
+         else
          {
-            Function += ((opcode >> 10) & 0x0F);
-            SET_OP_SIZE(opcode >> 8);
+            Function += ((opcode >> 6) & 3);
+         }
 
-            // Ordering important here, as getgen uses Operand Size
-            switch (Function)
-            {
-               case ROT:
-               case ASH:
-               case LSH:
-               {
-                  OpSize.Op[0] = sz8;
-               }
-               break;
-            }
+         SET_OP_SIZE(opcode >> 8);
 
-            getgen(opcode >> 19, 0);
-            getgen(opcode >> 14, 1);
+         if (Function == CVTP)
+         {
+            SET_OP_SIZE(3);               // 32 Bit
          }
-         break;
 
-         case Format7:
-         {
-            Function += ((opcode >> 10) & 0x0F);
-            SET_OP_SIZE(opcode >> 8);
+         getgen(opcode >> 19, 0);
+         getgen(opcode >> 14, 1);
+      }
+      break;
 
-            getgen(opcode >> 19, 0);
-            getgen(opcode >> 14, 1);
+      case Format9:
+      {
+         if (nscfg.fpu_flag == 0)
+         {
+            SET_TRAP(UnknownInstruction);
+            return 0;
          }
-         break;
 
-         case Format8:
+         Function += ((opcode >> 11) & 0x07);
+         switch (Function)
          {
-            if (opcode & 0x400)
+            case MOVif:
             {
-               if (opcode & 0x80)
-               {
-                  switch (opcode & 0x3CC0)
-                  {
-                     case 0x0C80:
-                     {
-                        Function = MOVUS;
-                     }
-                     break;
-
-                     case 0x1C80:
-                     {
-                        Function = MOVSU;
-                     }
-                     break;
-
-                     default:
-                     {
-                        Function = TRAP;
-                     }
-                     break;
-                  }
-               }
-               else
-               {
-                  Function = (opcode & 0x40) ? FFS : INDEX;
-               }
+               OpSize.Op[0] = ((opcode >> 8) & 3) + 1;                           // Source Size (Integer)
+               WriteSize    =
+               OpSize.Op[1] = GET_F_SIZE(opcode & BIT(10));                      // Destination Size (Float/ Double)
+               getgen(opcode >> 19, 0);                                          // Source Operand
+               getgen(opcode >> 14, 1);                                          // Destination Operand
+               Regs[1].RegType = GET_PRECISION(opcode & BIT(10));
             }
-            else
+            break;
+
+            case ROUND:
+            case TRUNC:
+            case FLOOR:
             {
-               Function += ((opcode >> 6) & 3);
+               OpSize.Op[0] = GET_F_SIZE(opcode & BIT(10));                      // Source Size (Float/ Double)
+               WriteSize =
+               OpSize.Op[1] = ((opcode >> 8) & 3) + 1;                           // Destination Size (Integer)
+               getgen(opcode >> 19, 0);                                          // Source Operand
+               getgen(opcode >> 14, 1);                                          // Destination Operand
+               Regs[0].RegType = GET_PRECISION(opcode & BIT(10));
             }
+            break;
 
-            SET_OP_SIZE(opcode >> 8);
+            case MOVFL:
+            {
+               OpSize.Op[0] = sz32;
+               WriteSize =
+               OpSize.Op[1] = sz64;
+               getgen(opcode >> 19, 0);                                          // Source Operand
+               getgen(opcode >> 14, 1);                                          // Destination Operand
+               Regs[0].RegType = SinglePrecision;
+               Regs[1].RegType = DoublePrecision;
+            }
+            break;
 
-            if (Function == CVTP)
+            case MOVLF:
             {
-               SET_OP_SIZE(3);               // 32 Bit
+               OpSize.Op[0] = sz64;
+               WriteSize =
+               OpSize.Op[1] = sz32;
+               getgen(opcode >> 19, 0);                                          // Source Operand
+               getgen(opcode >> 14, 1);                                          // Destination Operand
+               Regs[0].RegType = DoublePrecision;
+               Regs[1].RegType = SinglePrecision;
             }
+            break;
 
-            getgen(opcode >> 19, 0);
-            getgen(opcode >> 14, 1);
-         }
-         break;
+            case LFSR:
+            {
+               SET_OP_SIZE(3);
+               getgen(opcode >> 19, 0);
+            }
+            break;
 
-         case Format9:
-         {
-            if (nscfg.fpu_flag == 0)
+            case SFSR:
             {
-               GOTO_TRAP(UnknownInstruction);
+               SET_OP_SIZE(3);
+               getgen(opcode >> 14, 1);
             }
+            break;
 
-            Function += ((opcode >> 11) & 0x07);
-            switch (Function)
+            default:
             {
-               case MOVif:
-               {
-                  OpSize.Op[0] = ((opcode >> 8) & 3) + 1;                           // Source Size (Integer)
-                  WriteSize    =
-                  OpSize.Op[1] = GET_F_SIZE(opcode & BIT(10));                      // Destination Size (Float/ Double)
-                  getgen(opcode >> 19, 0);                                          // Source Operand
-                  getgen(opcode >> 14, 1);                                          // Destination Operand
-                  Regs[1].RegType = GET_PRECISION(opcode & BIT(10));
-               }
-               break;
+               PiWARN("Unexpected Format 9 Decode: Function = %"PRId32, Function);
+            }
+            break;
+         }
+      }
+      break;
 
-               case ROUND:
-               case TRUNC:
-               case FLOOR:
-               {
-                  OpSize.Op[0] = GET_F_SIZE(opcode & BIT(10));                      // Source Size (Float/ Double)
-                  WriteSize =
-                  OpSize.Op[1] = ((opcode >> 8) & 3) + 1;                           // Destination Size (Integer)
-                  getgen(opcode >> 19, 0);                                          // Source Operand
-                  getgen(opcode >> 14, 1);                                          // Destination Operand
-                  Regs[0].RegType = GET_PRECISION(opcode & BIT(10));
-               }
-               break;
+      case Format11:
+      case Format12:
+      {
+         if (nscfg.fpu_flag == 0)
+         {
+            SET_TRAP(UnknownInstruction);
+            return 0;
+         }
 
-               case MOVFL:
-               {
-                  OpSize.Op[0] = sz32;
-                  WriteSize =
-                  OpSize.Op[1] = sz64;
-                  getgen(opcode >> 19, 0);                                          // Source Operand
-                  getgen(opcode >> 14, 1);                                          // Destination Operand
-                  Regs[0].RegType = SinglePrecision;
-                  Regs[1].RegType = DoublePrecision;
-               }
-               break;
+         Function += ((opcode >> 10) & 0x0F);
+         WriteSize    =
+         OpSize.Op[0] =
+         OpSize.Op[1] = GET_F_SIZE(opcode & BIT(8));
+         getgen(opcode >> 19, 0);
+         getgen(opcode >> 14, 1);
+         Regs[0].RegType =
+         Regs[1].RegType = GET_PRECISION(opcode & BIT(8));
+      }
+      break;
 
-               case MOVLF:
-               {
-                  OpSize.Op[0] = sz64;
-                  WriteSize =
-                  OpSize.Op[1] = sz32;
-                  getgen(opcode >> 19, 0);                                          // Source Operand
-                  getgen(opcode >> 14, 1);                                          // Destination Operand
-                  Regs[0].RegType = DoublePrecision;
-                  Regs[1].RegType = SinglePrecision;
-               }
-               break;
+      case Format14:
+      {
+         Function += ((opcode >> 10) & 0x0F);
+      }
+      break;
 
-               case LFSR:
-               {
-                  SET_OP_SIZE(3);
-                  getgen(opcode >> 19, 0);
-               }
-               break;
+      default:
+      {
+         SET_TRAP(UnknownFormat);
+      }
+      break;
+   }
 
-               case SFSR:
-               {
-                  SET_OP_SIZE(3);
-                  getgen(opcode >> 14, 1);
-               }
-               break;
+#ifdef PC_SIMULATION
+   uint32_t Temp = pc;
+   n32016_show_instruction(startpc, &Temp, opcode, Function, &OpSize);
+#endif
 
-               default:
-               {
-                  PiWARN("Unexpected Format 9 Decode: Function = %"PRId32, Function);
-               }
-               break;
-            }
-         }
-         break;
+   DecodeGen(Regs[0], 0, &pInst->Operand[0]);
+   DecodeGen(Regs[1], 1, &pInst->Operand[1]);
 
-         case Format11:
-         case Format12:
-         {
-            if (nscfg.fpu_flag == 0)
-            {
-               GOTO_TRAP(UnknownInstruction);
-            }
+   if (Function <= RETT)
+   {
+      pInst->Disp = GetDisplacement(&pc);
+   }
 
-            Function += ((opcode >> 10) & 0x0F);
-            WriteSize    =
-            OpSize.Op[0] =
-            OpSize.Op[1] = GET_F_SIZE(opcode & BIT(8));
-            getgen(opcode >> 19, 0);
-            getgen(opcode >> 14, 1);
-            Regs[0].RegType =
-            Regs[1].RegType = GET_PRECISION(opcode & BIT(8));
-         }
-         break;
+   pInst->Function   = Function;
+   pInst->OpSize     = OpSize;
+   pInst->Regs[0]    = Regs[0];
+   pInst->Regs[1]    = Regs[1];
+   pInst->WriteIndex = WriteIndex;
+   pInst->Length     = pc - startpc;
+   pInst->Cycles     = InstructionCycles(Function);
+   return 1;
+}
 
-         case Format14:
+void n32016_exec()
+{
+   uint32_t opcode, WriteIndex;
+   uint32_t temp, temp2, temp3;
+   Temp64Type temp64;
+   uint32_t Function;
+
+   // Avoid a "might be uninitialized" warning
+   temp = 0;
+   temp64.u64 = 0;
+
+   if (tube_irq & 2)
+   {
+      // NMI is edge sensitive, so it should be cleared here
+      tube_irq &= ~2;
+      TakeInterrupt(intbase + (1 * 4));
+   }
+   else if ((tube_irq & 1) && (psr & 0x800))
+   {
+      // IRQ is level sensitive, so the called should maintain the state
+      TakeInterrupt(intbase);
+   }
+
+   while (tubecycles > 0)
+   {
+      DecodedInstruction* pInst;
+
+      CLEAR_TRAP();
+
+      startpc  = pc;
+
+#ifdef INCLUDE_DEBUGGER
+      if (n32016_debug_enabled)
+      {
+         debug_preexec(&n32016_cpu_debug, pc);
+      }
+#endif
+
+      if (pc == PR.BPC)
+      {
+         tubecycles -= FunctionTimings[TRAP].Base;
+         SET_TRAP(BreakPointHit);
+         goto DoTrap;
+      }
+
+#ifdef NS_DECODE_CACHE
+      if ((pInst = LookupDecoded(pc)) != NULL)
+      {
+         pc += pInst->Length;
+         OpSize  = pInst->OpSize;
+         Regs[0] = pInst->Regs[0];
+         Regs[1] = pInst->Regs[1];
+      }
+      else
+#endif
+      {
+         pInst = &Decoded;
+
+         if (!DecodeInstruction(pInst))
          {
-            Function += ((opcode >> 10) & 0x0F);
+            tubecycles -= pInst->Cycles;
+            goto DoTrap;
          }
-         break;
 
-         default:
+#ifdef NS_DECODE_CACHE
+         if (!TrapFlags)
          {
-            SET_TRAP(UnknownFormat);
+            pInst = StoreDecoded(pInst);
          }
-         break;
+#endif
       }
 
-#ifdef PC_SIMULATION
-      uint32_t Temp = pc;
-      n32016_show_instruction(startpc, &Temp, opcode, Function, &OpSize);
-#endif
+      tubecycles -= pInst->Cycles;
+      opcode     = pInst->Opcode;
+      Function   = pInst->Function;
+      WriteIndex = pInst->WriteIndex;
 
-      GetGenPhase2(Regs[0], 0);
-      GetGenPhase2(Regs[1], 1);
+      GetGenPhase2(Regs[0], 0, &pInst->Operand[0]);
+      GetGenPhase2(Regs[1], 1, &pInst->Operand[1]);
 
       if (Function <= RETT)
       {
-         temp = GetDisplacement(&pc);
+         temp = pInst->Disp;
       }
 
       if (TrapFlags)
@@ -1347,6 +1645,7 @@ void n32016_exec()
 
          case BR:
          {
+            tubecycles -= BRANCH_TAKEN_CYCLES;
             pc = startpc + temp;
             continue;
          }
@@ -1437,6 +1736,7 @@ void n32016_exec()
                if (temp & BIT(c))
                {
                   pushd(r[c]);
+                  tubecycles -= BUS_CYCLES(sz32);
                }
             }
             continue;
@@ -1464,6 +1764,7 @@ void n32016_exec()
                if (temp & BIT(c))
                {
                   pushd(r[c]);
+                  tubecycles -= BUS_CYCLES(sz32);
                }
             }
             continue;
@@ -2241,6 +2542,7 @@ void n32016_exec()
             uint32_t Second   = ReadAddress(1);
             //temp = GetDisplacement(&pc) + OpSize.Op[0];                      // disp of 0 means move 1 byte
             temp = (GetDisplacement(&pc) & ~(OpSize.Op[0] - 1))  + OpSize.Op[0];
+            tubecycles -= 2 * BUS_CYCLES(temp);                           // Read and write each byte
             while (temp)
             {
                temp2 = read_x8(First);
@@ -18,6 +18,164 @@ const uint8_t FormatSizes[FormatCount + 1] =
 
 #define FUNC(FORMAT, OFFSET) (((FORMAT) << 4) + (OFFSET))
 
+// Approximations of the NS32016 (and NS32081 FPU) instruction timings
+// with no wait states.  The time for addressing modes and for reading and
+// writing memory operands is added to these by InstructionCycles() in
+// 32016.c, Access giving how many times each operand is transferred: 0
+// when only its address is used, 1 when read or written and 2 when both.
+
+#define T(Base, PerByte, Access0, Access1) { (Base), (PerByte), { (Access0), (Access1) } }
+
+const InstructionTiming FunctionTimings[InstructionCount] =
+{
+   // Format 0
+   [BEQ]      = T(  7,  0, 0, 0 ),
+   [BNE]      = T(  7,  0, 0, 0 ),
+   [BCS]      = T(  7,  0, 0, 0 ),
+   [BCC]      = T(  7,  0, 0, 0 ),
+   [BH]       = T(  7,  0, 0, 0 ),
+   [BLS]      = T(  7,  0, 0, 0 ),
+   [BGT]      = T(  7,  0, 0, 0 ),
+   [BLE]      = T(  7,  0, 0, 0 ),
+   [BFS]      = T(  7,  0, 0, 0 ),
+   [BFC]      = T(  7,  0, 0, 0 ),
+   [BLO]      = T(  7,  0, 0, 0 ),
+   [BHS]      = T(  7,  0, 0, 0 ),
+   [BLT]      = T(  7,  0, 0, 0 ),
+   [BGE]      = T(  7,  0, 0, 0 ),
+   [BR]       = T(  7,  0, 0, 0 ),
+   [BN]       = T(  6,  0, 0, 0 ),
+
+   // Format 1, register lists are charged as they are saved or restored
+   [BSR]      = T( 18,  0, 0, 0 ),
+   [RET]      = T( 16,  0, 0, 0 ),
+   [CXP]      = T( 38,  0, 0, 0 ),
+   [RXP]      = T( 26,  0, 0, 0 ),
+   [RETT]     = T( 34,  0, 0, 0 ),
+   [RETI]     = T( 42,  0, 0, 0 ),
+   [SAVE]     = T( 13,  0, 0, 0 ),
+   [RESTORE]  = T( 12,  0, 0, 0 ),
+   [ENTER]    = T( 18,  0, 0, 0 ),
+   [EXIT]     = T( 17,  0, 0, 0 ),
+   [NOP]      = T(  3,  0, 0, 0 ),
+   [WAIT]     = T(  6,  0, 0, 0 ),
+   [DIA]      = T(  3,  0, 0, 0 ),
+   [FLAG]     = T(  6,  0, 0, 0 ),
+   [SVC]      = T( 40,  0, 0, 0 ),
+   [BPT]      = T( 40,  0, 0, 0 ),
+
+   // Format 2
+   [ADDQ]     = T(  4,  0, 2, 0 ),
+   [CMPQ]     = T(  3,  0, 1, 0 ),
+   [SPR]      = T( 21,  0, 1, 0 ),
+   [Scond]    = T( 10,  0, 1, 0 ),
+   [ACB]      = T( 18,  0, 2, 0 ),
+   [MOVQ]     = T(  3,  0, 1, 0 ),
+   [LPR]      = T( 21,  0, 1, 0 ),
+
+   // Format 3
+   [CXPD]     = T( 40,  0, 1, 0 ),
+   [BICPSR]   = T( 18,  0, 1, 0 ),
+   [JUMP]     = T(  5,  0, 0, 0 ),
+   [BISPSR]   = T( 18,  0, 1, 0 ),
+   [ADJSP]    = T(  6,  0, 1, 0 ),
+   [JSR]      = T( 14,  0, 0, 0 ),
+   [CASE]     = T( 13,  0, 1, 0 ),
+
+   // Format 4
+   [ADD]      = T(  4,  0, 1, 2 ),
+   [CMP]      = T(  3,  0, 1, 1 ),
+   [BIC]      = T(  4,  0, 1, 2 ),
+   [ADDC]     = T(  4,  0, 1, 2 ),
+   [MOV]      = T(  3,  0, 1, 1 ),
+   [OR]       = T(  4,  0, 1, 2 ),
+   [SUB]      = T(  4,  0, 1, 2 ),
+   [ADDR]     = T(  3,  0, 0, 1 ),
+   [AND]      = T(  4,  0, 1, 2 ),
+   [SUBC]     = T(  4,  0, 1, 2 ),
+   [TBIT]     = T(  7,  0, 1, 1 ),
+   [XOR]      = T(  4,  0, 1, 2 ),
+
+   // Format 5, charged for each element
+   [MOVS]     = T( 14,  0, 0, 0 ),
+   [CMPS]     = T( 16,  0, 0, 0 ),
+   [SETCFG]   = T( 15,  0, 0, 0 ),
+   [SKPS]     = T( 12,  0, 0, 0 ),
+
+   // Format 6
+   [ROT]      = T( 14,  0, 1, 2 ),
+   [ASH]      = T( 14,  0, 1, 2 ),
+   [CBIT]     = T( 15,  0, 1, 2 ),
+   [CBITI]    = T( 15,  0, 1, 2 ),
+   [LSH]      = T( 14,  0, 1, 2 ),
+   [SBIT]     = T( 15,  0, 1, 2 ),
+   [SBITI]    = T( 15,  0, 1, 2 ),
+   [NEG]      = T(  5,  0, 1, 1 ),
+   [NOT]      = T(  5,  0, 1, 1 ),
+   [SUBP]     = T( 16,  0, 1, 2 ),
+   [ABS]      = T(  6,  0, 1, 1 ),
+   [COM]      = T(  5,  0, 1, 1 ),
+   [IBIT]     = T( 15,  0, 1, 2 ),
+   [ADDP]     = T( 16,  0, 1, 2 ),
+
+   // Format 7, MOVM is also charged for each byte moved
+   [MOVM]     = T( 15,  0, 0, 0 ),
+   [CMPM]     = T( 20,  0, 0, 0 ),
+   [INSS]     = T( 28,  0, 1, 2 ),
+   [EXTS]     = T( 25,  0, 1, 1 ),
+   [MOVXiW]   = T(  6,  0, 1, 1 ),
+   [MOVZiW]   = T(  5,  0, 1, 1 ),
+   [MOVZiD]   = T(  5,  0, 1, 1 ),
+   [MOVXiD]   = T(  6,  0, 1, 1 ),
+   [MUL]      = T(  5, 16, 1, 2 ),
+   [MEI]      = T(  7, 16, 1, 2 ),
+   [DEI]      = T( 23, 16, 1, 2 ),
+   [QUO]      = T( 29, 16, 1, 2 ),
+   [REM]      = T( 31, 16, 1, 2 ),
+   [MOD]      = T( 34, 16, 1, 2 ),
+   [DIV]      = T( 36, 16, 1, 2 ),
+
+   // Format 8
+   [EXT]      = T( 17,  0, 1, 1 ),
+   [CVTP]     = T( 10,  0, 1, 1 ),
+   [INS]      = T( 26,  0, 1, 2 ),
+   [CHECK]    = T( 14,  0, 1, 1 ),
+   [INDEX]    = T(  9, 16, 1, 1 ),
+   [FFS]      = T( 24,  0, 1, 2 ),
+   [MOVUS]    = T( 20,  0, 1, 1 ),
+   [MOVSU]    = T( 20,  0, 1, 1 ),
+
+   // Format 9, including the slave processor protocol
+   [MOVif]    = T( 52,  0, 1, 1 ),
+   [LFSR]     = T( 20,  0, 1, 0 ),
+   [MOVLF]    = T( 46,  0, 1, 1 ),
+   [MOVFL]    = T( 37,  0, 1, 1 ),
+   [ROUND]    = T( 60,  0, 1, 1 ),
+   [TRUNC]    = T( 60,  0, 1, 1 ),
+   [SFSR]     = T( 20,  0, 0, 1 ),
+   [FLOOR]    = T( 60,  0, 1, 1 ),
+
+   // Format 11
+   [ADDf]     = T( 54,  5, 1, 2 ),
+   [MOVf]     = T( 16,  3, 1, 1 ),
+   [CMPf]     = T( 40,  2, 1, 1 ),
+   [SUBf]     = T( 54,  5, 1, 2 ),
+   [NEGf]     = T( 20,  3, 1, 1 ),
+   [DIVf]     = T( 42, 14, 1, 2 ),
+   [MULf]     = T( 42,  7, 1, 2 ),
+   [ABSf]     = T( 20,  3, 1, 1 ),
+
+   // Format 14
+   [RDVAL]    = T( 25,  0, 0, 0 ),
+   [WRVAL]    = T( 25,  0, 0, 0 ),
+   [LMR]      = T( 30,  0, 1, 0 ),
+   [SMR]      = T( 25,  0, 1, 0 ),
+   [CINV]     = T( 10,  0, 1, 0 ),
+
+   // Anything else traps
+   [TRAP]     = T( 45,  0, 0, 0 )
+};
+
 uint8_t GetFunction(uint8_t FirstByte)
 {
    switch (FirstByte & 0x0F)
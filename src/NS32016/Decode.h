@@ -197,3 +197,17 @@ typedef union
 {
    SingleOperand Op[2];
 } OperandInformation;
+
+// Instruction timings in clock cycles, see FunctionTimings[] in Decode.c
+typedef struct
+{
+   uint8_t Base;                       // Execution time
+   uint8_t PerByte;                    // Extra time per byte of operand size
+   uint8_t Access[2];                  // Times each general operand is read or written
+} InstructionTiming;
+
+extern const InstructionTiming FunctionTimings[InstructionCount];
+
+// The NS32016 has a 16 bit bus taking 4 clocks a transfer
+#define BUS_CYCLES(Size)      ((((Size) + 1) >> 1) * 4)
+#define BRANCH_TAKEN_CYCLES   3        // Refilling the instruction queue
@@ -218,6 +218,7 @@ void write_x8_internal(uint32_t addr, uint8_t val)
 
    if (addr <= (RAM_SIZE - sizeof(uint8_t)))
    {
+      CODE_WRITE(addr, sizeof(uint8_t));
 #ifdef USE_MEMORY_POINTER
       ns32016ram[addr] = val;
 #else
@@ -264,6 +265,7 @@ void write_x16(uint32_t addr, uint16_t val)
          debug_memwrite(&n32016_cpu_debug, addr, val, 2);
       }
 #endif
+      CODE_WRITE(addr, sizeof(uint16_t));
 #ifdef USE_MEMORY_POINTER
       *((uint16_t*) (ns32016ram + addr)) = val;
 #else
@@ -290,6 +292,7 @@ void write_x32(uint32_t addr, uint32_t val)
          debug_memwrite(&n32016_cpu_debug, addr, val, 4);
       }
 #endif
+      CODE_WRITE(addr, sizeof(uint32_t));
 #ifdef USE_MEMORY_POINTER
       *((uint32_t*) (ns32016ram + addr)) = val;
 #else
@@ -331,6 +334,29 @@ void write_x64(uint32_t addr, uint64_t val)
    write_x8(addr,   (uint8_t) (val >> 56));
 }
 
+void read_Arbitary(uint32_t addr, void* pData, uint32_t Size)
+{
+   addr &= 0xFFFFFF;
+
+#ifdef NS_FAST_RAM
+#ifdef INCLUDE_DEBUGGER
+   if ((addr + Size) <= IO_BASE && !n32016_debug_enabled)
+#else
+   if ((addr + Size) <= IO_BASE)
+#endif
+   {
+      memcpy(pData, ns32016ram + addr, Size);
+      return;
+   }
+#endif
+
+   register uint8_t* pValue = (uint8_t*) pData;
+   while (Size--)
+   {
+      *pValue++ = read_x8(addr++);
+   }
+}
+
 void write_Arbitary(uint32_t addr, void* pData, uint32_t Size)
 {
    addr &= 0xFFFFFF;
@@ -342,6 +368,9 @@ void write_Arbitary(uint32_t addr, void* pData, uint32_t Size)
    if ((addr + Size) <= RAM_SIZE) 
 #endif
    {
+#ifdef NS_DECODE_CACHE
+      InvalidateDecoded(addr, Size);
+#endif
       memcpy(ns32016ram + addr, pData, Size);
       return;
    }
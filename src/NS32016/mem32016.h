@@ -10,6 +10,24 @@
 
 //#define PANDORA_ROM_PAGE_OUT
 #define NS_FAST_RAM
+#ifndef PC_SIMULATION
+#define NS_DECODE_CACHE
+#endif
+
+#ifdef NS_DECODE_CACHE
+// Writes to RAM pages holding decoded instructions invalidate them, see 32016.c
+#define CODE_PAGE_SHIFT 10
+#define CODE_PAGE_COUNT (RAM_SIZE >> CODE_PAGE_SHIFT)
+
+extern uint8_t CodePages[CODE_PAGE_COUNT];
+extern void InvalidateDecoded(uint32_t addr, uint32_t Size);
+
+#define CODE_WRITE(addr, Size) \
+   if (CodePages[(addr) >> CODE_PAGE_SHIFT] | CodePages[((addr) + (Size) - 1) >> CODE_PAGE_SHIFT]) \
+      InvalidateDecoded((addr), (Size))
+#else
+#define CODE_WRITE(addr, Size)
+#endif
 
 void init_ram(void);
 
@@ -31,4 +49,5 @@ void     write_x8(uint32_t addr, uint8_t val);
 void     write_x16(uint32_t addr, uint16_t val);
 void     write_x32(uint32_t addr, uint32_t val);
 void     write_x64(uint32_t addr, uint64_t val);
+void     read_Arbitary(uint32_t addr, void* pData, uint32_t Size);
 void     write_Arbitary(uint32_t addr, void* pData, uint32_t Size);
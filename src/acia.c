@@ -114,6 +114,11 @@ void acia_receive(ACIA *acia, uint8_t val) { /*Called when the acia recives some
     acia_updateint(acia);
 }
 
+bool acia_rx_full(ACIA *acia)
+{
+    return acia->status_reg & RXD_REG_FUL;
+}
+
 void acia_savestate(ACIA *acia, FILE *f)
 {
     unsigned char bytes[2];
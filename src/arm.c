@@ -379,6 +379,27 @@ static void writearmb(uint32_t addr, uint8_t val)
     do_writearmb(addr, val);
 }
 
+/* Block copies for VDFS: straight to or from RAM unless the debugger
+ * is watching or the block goes outside it.
+ */
+static void readarm_block(uint32_t addr, uint8_t *buf, size_t len)
+{
+    if (!arm_debug_enabled && addr < ARM_RAM_SIZE && len <= ARM_RAM_SIZE - addr)
+        memcpy(buf, armramb + addr, len);
+    else
+        while (len--)
+            *buf++ = readarmb(addr++);
+}
+
+static void writearm_block(uint32_t addr, const uint8_t *buf, size_t len)
+{
+    if (!arm_debug_enabled && addr < ARM_RAM_SIZE && len <= ARM_RAM_SIZE - addr)
+        memcpy(armramb + addr, buf, len);
+    else
+        while (len--)
+            writearmb(addr++, *buf++);
+}
+
 static void writearml(uint32_t addr, uint32_t val)
 {
         if (arm_debug_enabled)
@@ -664,6 +685,8 @@ bool arm_init(void *rom)
     tube_type = TUBEARM;
     tube_readmem = readarmb;
     tube_writemem = writearmb;
+    tube_readblk = readarm_block;
+    tube_writeblk = writearm_block;
     tube_exec  = arm_exec;
     tube_proc_savestate = arm_savestate;
     tube_proc_loadstate = arm_loadstate;
@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include "b-em.h"
 #include "6502.h"
+#include "main.h"
 #include "mem.h"
 #include "via.h"
 #include "sysvia.h"
@@ -38,6 +39,20 @@ static struct tm rtc_tm;
 
 static uint8_t cmos_data;
 
+/* When set the RTC starts from this time and advances with the frames
+ * emulated rather than following the host clock, so runs repeat.
+ */
+time_t cmos_rtc_epoch;
+
+static time_t rtc_now(void)
+{
+    time_t now;
+
+    if (cmos_rtc_epoch)
+        return cmos_rtc_epoch + framesrun / 50;
+    return time(&now);
+}
+
 static inline uint8_t bcd2bin(uint8_t value) {
     return ((value >> 4) * 10) + (value & 0xf);
 }
@@ -56,10 +71,9 @@ static inline unsigned guess_century(unsigned year) {
 
 static uint8_t read_cmos_rtc(unsigned addr)
 {
-    time_t now;
+    time_t now = rtc_now();
     struct tm *tp;
 
-    time(&now);
     if (rtc_epoc_ref) {
         // The RTC has been set since it was last read so convert
         // the time components set back to seconds since an epoc.
@@ -171,7 +185,7 @@ static void set_cmos(unsigned addr, uint8_t val)
 {
     cmos[addr] = val;
     if ((addr <= 6 && !(addr & 1)) || (addr >= 7 && addr <= 9))
-        time(&rtc_epoc_ref);
+        rtc_epoc_ref = rtc_now();
 }
 
 void cmos_update(uint8_t IC32, uint8_t sdbval)
@@ -1,6 +1,10 @@
 #ifndef __INC_CMOS_H
 #define __INC_CMOS_H
 
+#include <time.h>
+
+extern time_t cmos_rtc_epoch;
+
 void cmos_update(uint8_t IC32, uint8_t sdbval);
 void cmos_writeaddr(uint8_t val);
 void cmos_write_addr_integra(uint8_t val);
@@ -3,9 +3,11 @@
 
 #include "b-em.h"
 
+#include "6502tube.h"
 #include "config.h"
 #include "ddnoise.h"
 #include "disc.h"
+#include "hfe.h"
 #include "keyboard.h"
 #include "main.h"
 #include "mem.h"
@@ -15,6 +17,7 @@
 #include "music5000.h"
 #include "ide.h"
 #include "midi.h"
+#include "rewind.h"
 #include "scsi.h"
 #include "sdf.h"
 #include "sn76489.h"
@@ -146,12 +149,15 @@ void config_load(void)
     al_remove_config_key(bem_cfg, "", "video_resize");
     al_remove_config_key(bem_cfg, "", "tube6502speed");
     defaultwriteprot = get_config_bool("disc", "defaultwriteprotect", 1);
+    hfe_predecode    = get_config_bool("disc", "hfe_predecode", false);
 
     autopause        = get_config_bool(NULL, "autopause", false);
 
     curmodel         = get_config_int(NULL, "model",         3);
     selecttube       = get_config_int(NULL, "tube",         -1);
     tube_speed_num   = get_config_int(NULL, "tubespeed",     0);
+    tube_6502_jit    = get_config_bool(NULL, "tube6502jit", true);
+    rewind_seconds   = get_config_int(NULL, "rewind_seconds", 30);
 
     sound_internal   = get_config_bool("sound", "sndinternal",   true);
     sound_beebsid    = get_config_bool("sound", "sndbeebsid",    true);
@@ -188,6 +194,7 @@ void config_load(void)
     mode7_fontfile   = get_config_string("video", "mode7font", "saa5050");
 
     fasttape         = get_config_bool("tape", "fasttape",      0);
+    tape_instant     = get_config_bool("tape", "instant",       0);
 
     scsi_enabled     = get_config_bool("disc", "scsienable", 0);
     ide_enable       = get_config_bool("disc", "ideenable",     0);
@@ -205,31 +212,36 @@ void config_load(void)
 
     buflen_m5        = get_config_int("sound", "buflen_music5000", BUFLEN_M5);
 
-    for (int act = 0; act < KEY_ACTION_MAX; act++) {
-        const char *str = al_get_config_value(bem_cfg, "key_actions", keyact_const[act].name);
-        if (str) {
-            const char *sep = strchr(str, ',');
-            size_t size = sep ? sep - str : strlen(str);
-            int keycode = -1;
-            for (int kc = 0; kc < ALLEGRO_KEY_MAX; kc++) {
-                if (!strncmp(al_keycode_to_name(kc), str, size)) {
-                    keycode = kc;
-                    break;
+    /* Key names come from the keyboard driver so only map keys if there
+     * is one, i.e. not when running headless.
+     */
+    if (al_is_keyboard_installed()) {
+        for (int act = 0; act < KEY_ACTION_MAX; act++) {
+            const char *str = al_get_config_value(bem_cfg, "key_actions", keyact_const[act].name);
+            if (str) {
+                const char *sep = strchr(str, ',');
+                size_t size = sep ? sep - str : strlen(str);
+                int keycode = -1;
+                for (int kc = 0; kc < ALLEGRO_KEY_MAX; kc++) {
+                    if (!strncmp(al_keycode_to_name(kc), str, size)) {
+                        keycode = kc;
+                        break;
+                    }
+                }
+                if (keycode >= 0) {
+                    keyactions[act].keycode = keycode;
+                    keyactions[act].altstate = (sep && !strcmp(sep, ",down"));
                 }
-            }
-            if (keycode >= 0) {
-                keyactions[act].keycode = keycode;
-                keyactions[act].altstate = (sep && !strcmp(sep, ",down"));
             }
         }
-    }
 
-    for (c = 0; c < ALLEGRO_KEY_MAX; c++) {
-        const char *str = al_get_config_value(bem_cfg, "user_keyboard", al_keycode_to_name(c));
-        if (str) {
-            unsigned bbckey = strtoul(str, NULL, 16);
-            if (bbckey)
-                keylookup[c] = bbckey;
+        for (c = 0; c < ALLEGRO_KEY_MAX; c++) {
+            const char *str = al_get_config_value(bem_cfg, "user_keyboard", al_keycode_to_name(c));
+            if (str) {
+                unsigned bbckey = strtoul(str, NULL, 16);
+                if (bbckey)
+                    keylookup[c] = bbckey;
+            }
         }
     }
     midi_load_config();
@@ -286,6 +298,7 @@ void config_save(void)
         set_config_string("disc", "mmb", mmb_fn);
         set_config_string("disc", "mmccard", mmccard_fn);
         set_config_bool("disc", "defaultwriteprotect", defaultwriteprot);
+        set_config_bool("disc", "hfe_predecode", hfe_predecode);
 
         if (tape_loaded)
             al_set_config_value(bem_cfg, "tape", "tape", al_path_cstr(tape_fn, ALLEGRO_NATIVE_PATH_SEP));
@@ -297,6 +310,8 @@ void config_save(void)
         set_config_int(NULL, "model", curmodel);
         set_config_int(NULL, "tube", selecttube);
         set_config_int(NULL, "tubespeed", tube_speed_num);
+        set_config_bool(NULL, "tube6502jit", tube_6502_jit);
+        set_config_int(NULL, "rewind_seconds", rewind_seconds);
 
         set_config_bool("sound", "sndinternal", sound_internal);
         set_config_bool("sound", "sndbeebsid",  sound_beebsid);
@@ -331,6 +346,7 @@ void config_save(void)
         set_config_string("video", "mode7font", mode7_fontfile);
 
         set_config_bool("tape", "fasttape", fasttape);
+        set_config_bool("tape", "instant", tape_instant);
 
         set_config_bool("disc", "scsienable", scsi_enabled);
         set_config_bool("disc", "ideenable", ide_enable);
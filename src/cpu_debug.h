@@ -12,6 +12,7 @@
 #define WIDTH_32BITS 2
 
 typedef struct breakpoint breakpoint;
+typedef struct breakpoint_index breakpoint_index;
 
 typedef struct cpu_debug_t {
   const char *cpu_name;                                               // Name/model of CPU.
@@ -35,6 +36,7 @@ typedef struct cpu_debug_t {
   uint32_t (*parse_addr)(cpu_debug_t *cpu, const char *arg, const char **end); // Parse an address.
   symbol_table *symbols;                                              // symbol table for storing symbolic addresses
   breakpoint *breakpoints;                                            // Linked list of all breakpoints and watchpoints.
+  breakpoint_index *bp_index;                                         // Pages with breakpoints, built from the list above.
   uint32_t   tbreak;                                                  // Address to break when skipping subroutines.
   uint32_t   prof_start;                                              // Start address for profiling.
   uint32_t   prof_end;                                                // End address for profiling.
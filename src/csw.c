@@ -7,12 +7,14 @@
 #include "sysacia.h"
 #include "csw.h"
 #include "tape.h"
+#include "tapeidx.h"
 
 int csw_toneon=0;
 
 static int csw_intone = 1, csw_indat = 0, csw_datbits = 0, csw_enddat = 0;
 static uint8_t *csw_dat = NULL;
 static int      csw_point;
+static int      csw_len;
 static uint8_t  csw_head[0x34];
 static int      csw_skip = 0;
 static int      csw_loop = 1;
@@ -28,6 +30,8 @@ static void csw_read_failed(FILE *csw_f, const char *fn)
 
 #define CSW_MAXLEN (8 * 1024 * 1024)
 
+static void csw_build_index(void);
+
 void csw_load(const char *fn)
 {
     FILE *csw_f;
@@ -73,6 +77,11 @@ void csw_load(const char *fn)
                     destlen = end;
                 }
                 free(tempin);
+                csw_len = destlen;
+                if (!tapeidx_load_cache(fn)) {
+                    csw_build_index();
+                    tapeidx_save_cache();
+                }
                 /*Reset data pointer*/
                 csw_point = 0;
                 acia_dcdhigh(&sysacia);
@@ -104,11 +113,27 @@ void csw_close()
 }
 
 static int ffound, fdat;
-static int infilenames;
+static int indexing;
+
+/* Carrier detect only goes to the ACIA when the tape is being played,
+   rather than scanned for the index. */
+static void csw_dcdhigh(void)
+{
+        if (indexing)
+           tapeidx_tone(csw_point);
+        else
+           acia_dcdhigh(&sysacia);
+}
+
+static void csw_dcdlow(void)
+{
+        if (!indexing)
+           acia_dcdlow(&sysacia);
+}
 static void csw_receive(uint8_t val)
 {
         csw_toneon--;
-        if (infilenames)
+        if (indexing)
         {
                 ffound = 1;
                 fdat = val;
@@ -127,7 +152,7 @@ void csw_poll()
         {
                 dat = csw_dat[csw_point++];
 
-                if (csw_point >= (8 * 1024 * 1024))
+                if (csw_point >= csw_len)
                 {
                         csw_point = 0;
                         csw_loop = 1;
@@ -142,7 +167,7 @@ void csw_poll()
                         csw_indat = 1;
 
                         csw_datbits = csw_enddat = 0;
-                        acia_dcdlow(&sysacia);
+                        csw_dcdlow();
                         return;
                 }
                 else if (csw_indat && csw_datbits != -1 && csw_datbits != -2)
@@ -181,7 +206,7 @@ void csw_poll()
                 {
                         if (dat <= 0xD) /*Back in tone again*/
                         {
-                                acia_dcdhigh(&sysacia);
+                                csw_dcdhigh();
                                 csw_toneon  = 2;
                                 csw_indat   = 0;
                                 csw_intone  = 1;
@@ -199,119 +224,47 @@ void csw_poll()
         }
 }
 
-#define getcswbyte()            ffound = 0; \
-                                while (!ffound && !csw_loop) \
-                                { \
-                                        csw_poll(); \
-                                } \
-                                if (csw_loop) break;
-
-static uint8_t ffilename[16];
-void csw_findfilenames()
+/* Run over the whole tape once, recording the blocks on it. */
+static void csw_build_index(void)
 {
-        int temp, temps, tempd, tempi, tempsk, tempspd;
-        uint8_t tb;
-        int c;
-        int fsize = 0;
-        char s[256];
-        uint32_t run, load;
-        uint8_t status;
-        int skip;
-        if (!csw_dat) return;
-        temp    = csw_point;
-        temps   = csw_indat;
-        tempi   = csw_intone;
-        tempd   = csw_datbits;
-        tempsk  = csw_skip;
-        tempspd = sysacia_tapespeed;
+        int tempspd = sysacia_tapespeed;
+        sysacia_tapespeed = 0;
         csw_point = 0;
-
-        csw_indat = csw_intone = csw_datbits = csw_skip = 0;
+        csw_indat = csw_datbits = csw_skip = 0;
         csw_intone = 1;
-        sysacia_tapespeed = 0;
-
-//        gzseek(csw,12,SEEK_SET);
+        csw_toneon = 2;
         csw_loop = 0;
-        infilenames = 1;
+        indexing = 1;
+        tapeidx_begin();
         while (!csw_loop)
         {
-//                log_debug("Start\n");
                 ffound = 0;
                 while (!ffound && !csw_loop)
                 {
                         csw_poll();
                 }
                 if (csw_loop) break;
-//                log_debug("FDAT %02X csw_toneon %i\n",fdat,csw_toneon);
-                if (fdat == 0x2A && csw_toneon == 1)
-                {
-                        c = 0;
-                        do
-                        {
-                                ffound = 0;
-                                while (!ffound && !csw_loop)
-                                {
-                                        csw_poll();
-                                }
-                                if (csw_loop) break;
-                                ffilename[c++] = fdat;
-                        } while (fdat != 0x0 && c <= 10);
-                        if (csw_loop) break;
-                        c--;
-                        while (c < 13) ffilename[c++] = 32;
-                        ffilename[c] = 0;
-
-                                getcswbyte();
-                                tb = fdat;
-                                getcswbyte();
-                                load = tb | (fdat << 8);
-                                getcswbyte();
-                                tb = fdat;
-                                getcswbyte();
-                                load |= (tb | (fdat << 8)) << 16;
-
-                                getcswbyte();
-                                tb = fdat;
-                                getcswbyte();
-                                run = tb | (fdat << 8);
-                                getcswbyte();
-                                tb = fdat;
-                                getcswbyte();
-                                run |= (tb | (fdat << 8)) << 16;
-
-                                getcswbyte();
-                                getcswbyte();
-
-                                getcswbyte();
-                                tb = fdat;
-                                getcswbyte();
-                                skip = tb | (fdat << 8);
-
-                                fsize += skip;
-
-                                getcswbyte();
-                                status = fdat;
-
-//log_debug("Got block - %08X %08X %02X\n",load,run,status);
-                        if (status & 0x80)
-                        {
-                                sprintf(s, "%s Size %04X Load %08X Run %08X", ffilename, fsize, load, run);
-                                cataddname(s);
-                                fsize = 0;
-                        }
-                        for (c = 0; c < skip + 8; c++)
-                        {
-                                getcswbyte();
-                        }
-                }
+                tapeidx_byte(fdat, csw_toneon == 1);
         }
-        infilenames = 0;
-        csw_indat   = temps;
-        csw_intone  = tempi;
-        csw_datbits = tempd;
-        csw_skip    = tempsk;
+        tapeidx_end();
+        indexing = 0;
         sysacia_tapespeed = tempspd;
-        csw_point   = temp;
-        csw_loop = 0;
+        csw_seek(0);
+        csw_toneon = 0;
 }
 
+uint32_t csw_tell(void)
+{
+        return csw_point;
+}
+
+/* Move to a point in carrier tone. */
+void csw_seek(uint32_t pos)
+{
+        csw_point   = pos;
+        csw_indat   = 0;
+        csw_intone  = 1;
+        csw_datbits = 0;
+        csw_skip    = 0;
+        csw_loop    = 0;
+}
@@ -4,7 +4,8 @@
 void csw_load(const char *fn);
 void csw_close(void);
 void csw_poll(void);
-void csw_findfilenames(void);
+uint32_t csw_tell(void);
+void csw_seek(uint32_t pos);
 
 extern int csw_ena;
 extern int csw_toneon;
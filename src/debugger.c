@@ -13,6 +13,7 @@
 #include "main.h"
 #include "mem.h"
 #include "model.h"
+#include "rewind.h"
 #include "6502.h"
 #include "debugger_symbols.h"
 
@@ -54,6 +55,57 @@ struct breakpoint {
     int        num;
 };
 
+/*
+ * So that the check made on each instruction or memory access when
+ * debugging is enabled is quick when there is no breakpoint near, the
+ * list of breakpoints is indexed by a bitmap of the 256 byte pages that
+ * have a breakpoint in them, one bitmap for each kind of access.  The
+ * bitmaps are split into leaves of 1Mb of address space and a leaf
+ * that is entirely covered, as by a trace range of all of memory, is
+ * represented by the shared bp_full_leaf.  Only if the bit for the
+ * page is set is the list searched.  The index is rebuilt each time
+ * the list changes and, if there is no memory for it, the list is
+ * searched every time as before.
+ */
+
+#define BP_PAGE_SHIFT  8
+#define BP_LEAF_SHIFT  20
+#define BP_LEAF_PAGES  (1 << (BP_LEAF_SHIFT - BP_PAGE_SHIFT))
+#define BP_NUM_LEAVES  (1 << (32 - BP_LEAF_SHIFT))
+
+typedef enum {
+    BP_CLASS_EXEC,
+    BP_CLASS_READ,
+    BP_CLASS_WRITE,
+    BP_CLASS_INPUT,
+    BP_CLASS_OUTPUT,
+    BP_NUM_CLASSES
+} bp_class;
+
+typedef struct {
+    uint32_t bits[BP_LEAF_PAGES / 32];
+} bp_leaf;
+
+struct breakpoint_index {
+    bp_leaf *leaves[BP_NUM_CLASSES][BP_NUM_LEAVES];
+};
+
+static bp_leaf bp_full_leaf;
+
+static const bp_class break_classes[] = {
+    BP_CLASS_EXEC,      // BREAK_EXEC
+    BP_CLASS_READ,      // BREAK_READ
+    BP_CLASS_WRITE,     // BREAK_WRITE
+    BP_CLASS_INPUT,     // BREAK_INPUT
+    BP_CLASS_OUTPUT,    // BREAK_OUTPUT
+    BP_CLASS_EXEC,      // WATCH_EXEC
+    BP_CLASS_READ,      // WATCH_READ
+    BP_CLASS_WRITE,     // WATCH_WRITE
+    BP_CLASS_INPUT,     // WATCH_INPUT
+    BP_CLASS_OUTPUT,    // WATCH_OUTPUT
+    BP_CLASS_EXEC       // TRACE_EXEC
+};
+
 int debug_core = 0;
 int debug_tube = 0;
 int debug_step = 0;
@@ -92,37 +144,66 @@ static void close_trace(const char *why)
 
 static ALLEGRO_THREAD  *mem_thread;
 
+bool debug_memview;
+uint32_t debug_memview_bits[MEMVIEW_NUM][65536/32];
+
+/* Collect the accesses flagged since the last refresh into the fade
+ * counters that are drawn, which are private to the view thread.
+ */
+static void memview_collect(uint8_t (*fade)[65536])
+{
+    for (int type = 0; type < MEMVIEW_NUM; type++) {
+        uint32_t *bits = debug_memview_bits[type];
+        uint8_t *cnt = fade[type];
+        for (int word = 0; word < 65536/32; word++) {
+            uint32_t w = bits[word];
+            if (w) {
+                bits[word] = 0;
+                for (int bit = 0; bit < 32; bit++)
+                    if (w & (1u << bit))
+                        cnt[word * 32 + bit] = 31;
+            }
+        }
+    }
+}
+
 static void *mem_thread_proc(ALLEGRO_THREAD *thread, void *data)
 {
     ALLEGRO_DISPLAY *mem_disp;
     ALLEGRO_BITMAP *bitmap;
     ALLEGRO_LOCKED_REGION *region;
+    uint8_t (*fade)[65536];
     int row, col, addr, cnt, red, grn, blu;
 
     log_debug("debugger: memory view thread started");
+    if (!(fade = calloc(MEMVIEW_NUM, sizeof *fade))) {
+        log_error("debugger: out of memory for memory view");
+        return NULL;
+    }
     al_set_new_window_title("B-Em Memory View");
     if ((mem_disp = al_create_display(256, 256))) {
         al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP);
         if ((bitmap = al_create_bitmap(256, 256))) {
             while (!quitting && !al_get_thread_should_stop(thread)) {
                 al_rest(0.02);
+                memview_collect(fade);
                 al_set_target_bitmap(bitmap);
                 if ((region = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY))) {
                     addr = 0;
                     for (row = 0; row < 256; row++) {
                         for (col = 0; col < 256; col++) {
                             red = grn = blu = 0;
-                            if ((cnt = writec[addr])) {
+                            if ((cnt = fade[MEMVIEW_WRITE][addr])) {
                                 red = cnt * 8;
-                                writec[addr] = cnt - 1;
+                                fade[MEMVIEW_WRITE][addr] = cnt - 1;
                             }
-                            if ((cnt = readc[addr])) {
+                            if ((cnt = fade[MEMVIEW_READ][addr])) {
                                 grn = cnt * 8;
-                                readc[addr] = cnt - 1;
+                                fade[MEMVIEW_READ][addr] = cnt - 1;
                             }
-                            if ((cnt = fetchc[addr])) {
+                            if ((cnt = fade[MEMVIEW_FETCH][addr])) {
                                 blu = cnt * 8;
-                                fetchc[addr] = cnt - 1;
+                                fade[MEMVIEW_FETCH][addr] = cnt - 1;
                             }
                             al_put_pixel(col, row, al_map_rgb(red, grn, blu));
                             addr++;
@@ -138,6 +219,7 @@ static void *mem_thread_proc(ALLEGRO_THREAD *thread, void *data)
         }
         al_destroy_display(mem_disp);
     }
+    free(fade);
     return NULL;
 }
 
@@ -146,6 +228,8 @@ static void debug_memview_open(void)
     if (!mem_thread) {
         if ((mem_thread = al_create_thread(mem_thread_proc, NULL))) {
             log_debug("debugger: memory view thread created");
+            memset(debug_memview_bits, 0, sizeof debug_memview_bits);
+            debug_memview = true;
             al_start_thread(mem_thread);
         }
         else
@@ -156,6 +240,7 @@ static void debug_memview_open(void)
 static void debug_memview_close(void)
 {
     if (mem_thread) {
+        debug_memview = false;
         al_join_thread(mem_thread, NULL);
         mem_thread = NULL;
     }
@@ -378,8 +463,6 @@ void debug_toggle_tube(void)
         enable_tube_debug();
 }
 
-int readc[65536], writec[65536], fetchc[65536];
-
 static uint32_t debug_memaddr=0;
 static uint32_t debug_disaddr=0;
 static uint8_t  debug_lastcommand=0;
@@ -425,6 +508,7 @@ static const char helptext[] =
     "    r vidproc  - print VIDPROC registers\n"
     "    r sound    - print Sound registers\n"
     "    reset      - reset emulated machine\n"
+    "    rewind [n] - wind the machine back n frames (or 1 if no parameter)\n"
     "    rset r v   - set a CPU register\n"
     "    ruler [s [c]] - draw a ruler to help with hexdumps.\n"
     "                 starts at 's' for 'c' bytes\n"
@@ -603,6 +687,83 @@ static void print_point(cpu_debug_t *cpu, const breakpoint *bp, const char *desc
     }
 }
 
+static void bp_index_free(cpu_debug_t *cpu)
+{
+    breakpoint_index *idx = cpu->bp_index;
+    if (idx) {
+        for (int c = 0; c < BP_NUM_CLASSES; c++)
+            for (int l = 0; l < BP_NUM_LEAVES; l++)
+                if (idx->leaves[c][l] && idx->leaves[c][l] != &bp_full_leaf)
+                    free(idx->leaves[c][l]);
+        free(idx);
+        cpu->bp_index = NULL;
+    }
+}
+
+static bool bp_index_add(bp_leaf **leaves, uint32_t start, uint32_t end)
+{
+    uint32_t page = start >> BP_PAGE_SHIFT;
+    uint32_t last = end >> BP_PAGE_SHIFT;
+    uint32_t last_leaf = last / BP_LEAF_PAGES;
+
+    while (page <= last) {
+        uint32_t leaf_no = page / BP_LEAF_PAGES;
+        uint32_t first_bit = page % BP_LEAF_PAGES;
+        uint32_t last_bit = leaf_no == last_leaf ? last % BP_LEAF_PAGES : BP_LEAF_PAGES - 1;
+        bp_leaf *leaf = leaves[leaf_no];
+        if (leaf != &bp_full_leaf) {
+            if (first_bit == 0 && last_bit == BP_LEAF_PAGES - 1) {
+                if (leaf)
+                    free(leaf);
+                leaves[leaf_no] = &bp_full_leaf;
+            }
+            else {
+                if (!leaf && !(leaf = leaves[leaf_no] = calloc(1, sizeof(bp_leaf))))
+                    return false;
+                for (uint32_t bit = first_bit; bit <= last_bit; bit++)
+                    leaf->bits[bit / 32] |= 1u << (bit % 32);
+            }
+        }
+        page = (leaf_no + 1) * BP_LEAF_PAGES;
+    }
+    return true;
+}
+
+static void bp_index_build(cpu_debug_t *cpu)
+{
+    bp_index_free(cpu);
+    if (cpu->breakpoints) {
+        if (!bp_full_leaf.bits[0])
+            memset(&bp_full_leaf, 0xff, sizeof(bp_full_leaf));
+        breakpoint_index *idx = calloc(1, sizeof(breakpoint_index));
+        if (idx) {
+            cpu->bp_index = idx;
+            for (breakpoint *bp = cpu->breakpoints; bp; bp = bp->next) {
+                if (!bp_index_add(idx->leaves[break_classes[bp->type]], bp->start, bp->end)) {
+                    bp_index_free(cpu);
+                    break;
+                }
+            }
+        }
+        if (!cpu->bp_index)
+            log_warn("debugger: out of memory indexing breakpoints, they will be slow");
+    }
+}
+
+/* Might there be a breakpoint of this class at this address? */
+static inline bool bp_index_test(cpu_debug_t *cpu, bp_class class, uint32_t addr)
+{
+    if (!cpu->breakpoints)
+        return false;
+    if (!cpu->bp_index)
+        return true;
+    const bp_leaf *leaf = cpu->bp_index->leaves[class][addr >> BP_LEAF_SHIFT];
+    if (!leaf)
+        return false;
+    uint32_t bit = (addr >> BP_PAGE_SHIFT) % BP_LEAF_PAGES;
+    return (leaf->bits[bit / 32] >> (bit % 32)) & 1;
+}
+
 static void set_point(cpu_debug_t *cpu, break_type type, const char *desc, uint32_t start, uint32_t end)
 {
     for (breakpoint *bp = cpu->breakpoints; bp; bp = bp->next) {
@@ -623,6 +784,7 @@ static void set_point(cpu_debug_t *cpu, break_type type, const char *desc, uint3
         bp->type = type;
         bp->num = breakpseq++;
         cpu->breakpoints = bp;
+        bp_index_build(cpu);
         print_point(cpu, bp, desc, " set");
     }
     else
@@ -684,6 +846,7 @@ static void parse_clrpnt(cpu_debug_t *cpu, break_type type, char *arg, const cha
             prev->next = found->next;
         else
             cpu->breakpoints = found->next;
+        bp_index_build(cpu);
         print_point(cpu, found, desc, " cleared");
         free(found);
     }
@@ -1095,6 +1258,20 @@ static void debugger_ruler(const char *iptr)
 static const char err_norname[] = "missing register name\n";
 static const char err_novalue[] = "missing value\n";
 
+static void debugger_rewind(const char *iptr)
+{
+    int frames = 1;
+
+    if (*iptr)
+        sscanf(iptr, "%i", &frames);
+    if (!rewind_available())
+        debug_outf("Nothing to rewind\n");
+    else {
+        frames = rewind_restore(frames);
+        debug_outf("Rewound %d frames, %d more available\n", frames, rewind_available());
+    }
+}
+
 static void debugger_rset(cpu_debug_t *cpu, const char *iptr)
 {
     if (*iptr) {
@@ -1237,6 +1414,7 @@ static void debug_trange(cpu_debug_t *cpu, char *iptr)
             else
                 cpu->breakpoints = found->next;
             free(found);
+            bp_index_build(cpu);
         }
         parse_setpnt(cpu, TRACE_EXEC, iptr, "execution trace");
     }
@@ -1415,6 +1593,8 @@ void debugger_do(cpu_debug_t *cpu, uint32_t addr)
                     main_reset();
                     debug_outf("Emulator reset\n");
                 }
+                else if (cmdlen >= 3 && !strncmp(cmd, "rewind", cmdlen))
+                    debugger_rewind(iptr);
                 else if (cmdlen >= 2 && !strncmp(cmd, "rset", cmdlen))
                     debugger_rset(cpu, iptr);
                 else if (cmdlen >= 2 && !strncmp(cmd, "ruler", cmdlen))
@@ -1588,6 +1768,9 @@ static void check_points(cpu_debug_t *cpu, uint32_t addr, uint32_t value, uint8_
     bool found = false;
     const char *enter = "";
 
+    if (!bp_index_test(cpu, break_classes[btype], addr))
+        return;
+
     for (breakpoint *bp = cpu->breakpoints; bp; bp = bp->next) {
         if (addr >= bp->start && addr <= bp->end) {
             if (bp->type == btype) {
@@ -1683,7 +1866,8 @@ void debug_preexec(cpu_debug_t *cpu, uint32_t addr)
         enter = true;
     }
 
-    for (breakpoint *bp = cpu->breakpoints; bp; bp = bp->next) {
+    breakpoint *bp = bp_index_test(cpu, BP_CLASS_EXEC, addr) ? cpu->breakpoints : NULL;
+    for (; bp; bp = bp->next) {
         if (addr >= bp->start && addr <= bp->end) {
             if (bp->type == BREAK_EXEC) {
                 char addr_str[16+SYM_MAX];
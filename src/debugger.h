@@ -7,7 +7,23 @@ extern void debug_end(void);
 extern void debug_toggle_core(void);
 extern void debug_toggle_tube(void);
 
-extern int readc[65536], writec[65536], fetchc[65536];
+/* Memory view instrumentation: one bit per address per kind of access
+ * since the view last looked, only recorded while the view is open.
+ */
+enum {
+    MEMVIEW_WRITE,
+    MEMVIEW_READ,
+    MEMVIEW_FETCH,
+    MEMVIEW_NUM
+};
+
+extern bool debug_memview;
+extern uint32_t debug_memview_bits[MEMVIEW_NUM][65536/32];
+
+static inline void debug_memview_mark(int type, uint16_t addr)
+{
+    debug_memview_bits[type][addr >> 5] |= 1u << (addr & 31);
+}
 
 extern int debug_core,debug_tube,debug_step;
 
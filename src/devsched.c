@@ -0,0 +1,129 @@
+/*B-em host device scheduler - see devsched.h*/
+
+#include "b-em.h"
+#include "disc.h"
+#include "devsched.h"
+#include "sound.h"
+#include "via.h"
+#include "sysvia.h"
+#include "uservia.h"
+#include "video.h"
+
+uint32_t sched_now, sched_deadline;
+
+static void sysvia_dev_poll(int cycles)
+{
+    via_poll(&sysvia, cycles);
+}
+
+static int sysvia_dev_next(void)
+{
+    return via_next_event(&sysvia);
+}
+
+static void uservia_dev_poll(int cycles)
+{
+    via_poll(&uservia, cycles);
+}
+
+static int uservia_dev_next(void)
+{
+    return via_next_event(&uservia);
+}
+
+static void video_dev_poll(int cycles)
+{
+    video_poll(cycles, 1);
+}
+
+static int sound_dev_next(void)
+{
+    return SCHED_MAX_RUN;
+}
+
+static void disc_dev_poll(int cycles)
+{
+    if (motoron) {
+        if (fdc_time) {
+            fdc_time -= cycles;
+            if (fdc_time <= 0)
+                fdc_callback();
+        }
+        disc_time -= cycles;
+        while (disc_time <= 0) {
+            disc_time += 16;
+            disc_poll();
+        }
+    }
+}
+
+static int disc_dev_next(void)
+{
+    int next = SCHED_MAX_RUN;
+    if (motoron) {
+        if (disc_time < next)
+            next = disc_time;
+        if (fdc_time && fdc_time < next)
+            next = fdc_time;
+    }
+    return next;
+}
+
+/* The order here is the order devices are caught up in, which matches
+ * the order the CPU used to poll them in on every cycle.
+ */
+sched_dev_t sched_devs[SCHED_NUM_DEVS] = {
+    [SCHED_SYSVIA]  = { sysvia_dev_poll,  sysvia_dev_next  },
+    [SCHED_USERVIA] = { uservia_dev_poll, uservia_dev_next },
+    [SCHED_VIDEO]   = { video_dev_poll,   video_next_event },
+    [SCHED_SOUND]   = { sound_poll,       sound_dev_next   },
+    [SCHED_DISC]    = { disc_dev_poll,    disc_dev_next    }
+};
+
+void sched_catchup(int dev)
+{
+    sched_dev_t *d = &sched_devs[dev];
+    int cycles = sched_now - d->last;
+    d->last = sched_now;
+    d->poll(cycles);
+}
+
+static void sched_catchup_all(void)
+{
+    for (int dev = 0; dev < SCHED_NUM_DEVS; dev++)
+        if (sched_devs[dev].last != sched_now)
+            sched_catchup(dev);
+}
+
+void sched_run(void)
+{
+    sched_catchup_all();
+
+    /* Deadlines are only worked out once every device has caught up
+     * as catching up one device may change the state of another.
+     */
+    uint32_t deadline = sched_now + SCHED_MAX_RUN;
+    for (int dev = 0; dev < SCHED_NUM_DEVS; dev++) {
+        int next = sched_devs[dev].next_event();
+        if (next < 1)
+            next = 1;
+        else if (next > SCHED_MAX_RUN)
+            next = SCHED_MAX_RUN;
+        if ((int32_t)(sched_now + next - deadline) < 0)
+            deadline = sched_now + next;
+    }
+    sched_deadline = deadline;
+}
+
+void sched_sync_all(void)
+{
+    sched_catchup_all();
+    sched_invalidate();
+}
+
+void sched_reset(void)
+{
+    for (int dev = 0; dev < SCHED_NUM_DEVS; dev++)
+        sched_devs[dev].last = sched_now;
+    sched_invalidate();
+}
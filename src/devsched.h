@@ -0,0 +1,65 @@
+#ifndef __INC_DEVSCHED_H
+#define __INC_DEVSCHED_H
+
+/*
+ * Host device scheduler.
+ *
+ * Rather than fanning every handful of CPU cycles out to each of the
+ * devices, the CPU just advances sched_now.  Devices are only brought
+ * up to date when the earliest of their deadlines is reached (i.e. when
+ * something the CPU can observe, like an interrupt, is due) or when they
+ * are about to be accessed through the I/O area.
+ */
+
+enum {
+    SCHED_SYSVIA,
+    SCHED_USERVIA,
+    SCHED_VIDEO,
+    SCHED_SOUND,
+    SCHED_DISC,
+    SCHED_NUM_DEVS
+};
+
+/* Longest run the CPU is allowed without servicing devices. */
+#define SCHED_MAX_RUN 4096
+
+typedef struct {
+    void     (*poll)(int cycles);   // catch the device up by this many cycles.
+    int      (*next_event)(void);   // cycles until the next CPU-visible event.
+    uint32_t last;                  // sched_now when last caught up.
+} sched_dev_t;
+
+extern sched_dev_t sched_devs[SCHED_NUM_DEVS];
+extern uint32_t sched_now, sched_deadline;
+
+void sched_reset(void);
+void sched_run(void);
+void sched_catchup(int dev);
+void sched_sync_all(void);
+
+/* Advance emulated time, servicing devices only if one is due. */
+static inline void sched_advance(int cycles)
+{
+    sched_now += cycles;
+    if ((int32_t)(sched_now - sched_deadline) >= 0)
+        sched_run();
+}
+
+/* Bring a single device up to date, e.g. before the CPU changes
+ * something it is about to read.
+ */
+static inline void sched_sync(int dev)
+{
+    if (sched_devs[dev].last != sched_now)
+        sched_catchup(dev);
+}
+
+/* Force the deadlines to be recalculated on the next advance, for use
+ * after device state has been changed from outside the scheduler.
+ */
+static inline void sched_invalidate(void)
+{
+    sched_deadline = sched_now;
+}
+
+#endif
@@ -3,6 +3,8 @@
 #include "gui-allegro.h"
 
 #include "6502.h"
+#include "6502jit.h"
+#include "6502tube.h"
 #include "ide.h"
 #include "config.h"
 #include "debugger.h"
@@ -19,6 +21,7 @@
 #include "music5000.h"
 #include "mmccard.h"
 #include "paula.h"
+#include "rewind.h"
 #include "savestate.h"
 #include "sid_b-em.h"
 #include "scsi.h"
@@ -116,6 +119,19 @@ static void add_sorted_set(ALLEGRO_MENU *parent, menu_map_t *map, size_t items,
     }
 }
 
+static ALLEGRO_MENU *create_rewind_menu(void)
+{
+    static const int secs[] = { 1, 5, 10, 30 };
+    ALLEGRO_MENU *menu = al_create_menu();
+    char label[20];
+
+    for (int i = 0; i < sizeof(secs)/sizeof(int); i++) {
+        snprintf(label, sizeof label, "%d second%s", secs[i], secs[i] == 1 ? "" : "s");
+        al_append_menu_item(menu, label, menu_id_num(IDM_FILE_REWIND, secs[i]), 0, NULL, NULL);
+    }
+    return menu;
+}
+
 static ALLEGRO_MENU *create_file_menu(void)
 {
     ALLEGRO_MENU *menu = al_create_menu();
@@ -124,6 +140,7 @@ static ALLEGRO_MENU *create_file_menu(void)
     al_append_menu_item(menu, "Save State...", IDM_FILE_SAVE_STATE, 0, NULL, NULL);
     al_append_menu_item(menu, "Quick Load", IDM_QUICKLOAD, 0, NULL, NULL);
     al_append_menu_item(menu, "Quick Save", IDM_QUICKSAVE, 0, NULL, NULL);
+    al_append_menu_item(menu, "Rewind", 0, 0, NULL, create_rewind_menu());
     al_append_menu_item(menu, "Save Screenshot...", IDM_FILE_SCREEN_SHOT, 0, NULL, NULL);
     add_checkbox_item(menu, "Print to file", IDM_FILE_PRINT, print_dest == PDEST_FILE);
     add_checkbox_item(menu, "Print to command", IDM_FILE_PCMD, print_dest == PDEST_PIPE);
@@ -192,7 +209,7 @@ void gui_allegro_set_eject_text(int drive, ALLEGRO_PATH *path)
 {
     char temp[256];
 
-    if (path) {
+    if (path && disc_menu) {
         snprintf(temp, sizeof temp, "Eject drive %s: %s", drive ? "1/3" : "0/2", al_get_path_filename(path));
         al_set_menu_item_caption(disc_menu, menu_id_num(IDM_DISC_EJECT, drive), temp);
     }
@@ -202,20 +219,21 @@ static ALLEGRO_MENU *create_tape_menu(void)
 {
     ALLEGRO_MENU *menu = al_create_menu();
     ALLEGRO_MENU *speed = al_create_menu();
-    int nflags, fflags;
+    int nflags, fflags, iflags;
     al_append_menu_item(menu, "Load tape...", IDM_TAPE_LOAD, 0, NULL, NULL);
     al_append_menu_item(menu, "Rewind tape", IDM_TAPE_REWIND, 0, NULL, NULL);
     al_append_menu_item(menu, "Eject tape", IDM_TAPE_EJECT, 0, NULL, NULL);
     al_append_menu_item(menu, "Catalogue tape", IDM_TAPE_CAT, 0, NULL, NULL);
-    if (fasttape) {
-        nflags = ALLEGRO_MENU_ITEM_CHECKBOX;
-        fflags = ALLEGRO_MENU_ITEM_CHECKBOX|ALLEGRO_MENU_ITEM_CHECKED;
-    } else {
-        nflags = ALLEGRO_MENU_ITEM_CHECKBOX|ALLEGRO_MENU_ITEM_CHECKED;
-        fflags = ALLEGRO_MENU_ITEM_CHECKBOX;
-    }
+    nflags = fflags = iflags = ALLEGRO_MENU_ITEM_CHECKBOX;
+    if (tape_instant)
+        iflags |= ALLEGRO_MENU_ITEM_CHECKED;
+    else if (fasttape)
+        fflags |= ALLEGRO_MENU_ITEM_CHECKED;
+    else
+        nflags |= ALLEGRO_MENU_ITEM_CHECKED;
     al_append_menu_item(speed, "Normal", IDM_TAPE_SPEED_NORMAL, nflags, NULL, NULL);
     al_append_menu_item(speed, "Fast", IDM_TAPE_SPEED_FAST, fflags, NULL, NULL);
+    al_append_menu_item(speed, "Instant", IDM_TAPE_SPEED_INSTANT, iflags, NULL, NULL);
     al_append_menu_item(menu, "Tape speed", 0, 0, NULL, speed);
     return menu;
 }
@@ -318,6 +336,9 @@ static ALLEGRO_MENU *create_tube_menu(void)
     for (i = 0; i < NUM_TUBE_SPEEDS; i++)
         add_radio_item(sub, tube_speeds[i].name, IDM_TUBE_SPEED, i, tube_speed_num);
     al_append_menu_item(menu, "Tube speed", 0, 0, NULL, sub);
+#ifdef JIT_6502
+    add_checkbox_item(menu, "Compile 6502 code", IDM_TUBE_6502JIT, tube_6502_jit);
+#endif
     return menu;
 }
 
@@ -1096,24 +1117,15 @@ static void tape_eject(void)
     tape_loaded = 0;
 }
 
-static void tape_normal(ALLEGRO_EVENT *event)
+static void tape_speed(ALLEGRO_EVENT *event, bool fast, bool instant)
 {
     ALLEGRO_MENU *menu = (ALLEGRO_MENU *)(event->user.data3);
 
-    if (fasttape) {
-        fasttape = false;
-        al_set_menu_item_flags(menu, IDM_TAPE_SPEED_FAST, ALLEGRO_MENU_ITEM_CHECKBOX);
-    }
-}
-
-static void tape_fast(ALLEGRO_EVENT *event)
-{
-    ALLEGRO_MENU *menu = (ALLEGRO_MENU *)(event->user.data3);
-
-    if (!fasttape) {
-        fasttape = true;
-        al_set_menu_item_flags(menu, IDM_TAPE_SPEED_NORMAL, ALLEGRO_MENU_ITEM_CHECKBOX);
-    }
+    fasttape = fast;
+    tape_instant = instant;
+    al_set_menu_item_flags(menu, IDM_TAPE_SPEED_NORMAL, ALLEGRO_MENU_ITEM_CHECKBOX|(!fast && !instant ? ALLEGRO_MENU_ITEM_CHECKED : 0));
+    al_set_menu_item_flags(menu, IDM_TAPE_SPEED_FAST, ALLEGRO_MENU_ITEM_CHECKBOX|(fast ? ALLEGRO_MENU_ITEM_CHECKED : 0));
+    al_set_menu_item_flags(menu, IDM_TAPE_SPEED_INSTANT, ALLEGRO_MENU_ITEM_CHECKBOX|(instant ? ALLEGRO_MENU_ITEM_CHECKED : 0));
 }
 
 static void rom_load(ALLEGRO_EVENT *event)
@@ -1249,6 +1261,9 @@ void gui_allegro_event(ALLEGRO_EVENT *event)
         case IDM_QUICKLOAD:
             main_quick_load();
             break;
+        case IDM_FILE_REWIND:
+            main_rewind(menu_get_num(event) * REWIND_FPS);
+            break;
         case IDM_QUICKSAVE:
             main_quick_save();
             break;
@@ -1355,10 +1370,13 @@ void gui_allegro_event(ALLEGRO_EVENT *event)
             tape_eject();
             break;
         case IDM_TAPE_SPEED_NORMAL:
-            tape_normal(event);
+            tape_speed(event, false, false);
             break;
         case IDM_TAPE_SPEED_FAST:
-            tape_fast(event);
+            tape_speed(event, true, false);
+            break;
+        case IDM_TAPE_SPEED_INSTANT:
+            tape_speed(event, false, true);
             break;
         case IDM_TAPE_CAT:
             gui_tapecat_start();
@@ -1381,6 +1399,9 @@ void gui_allegro_event(ALLEGRO_EVENT *event)
         case IDM_TUBE_SPEED:
             change_tube_speed(event);
             break;
+        case IDM_TUBE_6502JIT:
+            tube_6502_jit = !tube_6502_jit;
+            break;
         case IDM_VIDEO_DISPTYPE:
             video_set_disptype(radio_event_simple(event, vid_dtype_user));
             break;
@@ -6,6 +6,7 @@ typedef enum {
     IDM_FILE_RESET,
     IDM_FILE_LOAD_STATE,
     IDM_FILE_SAVE_STATE,
+    IDM_FILE_REWIND,
     IDM_FILE_SCREEN_SHOT,
     IDM_FILE_PRINT,
     IDM_FILE_PCMD,
@@ -47,12 +48,14 @@ typedef enum {
     IDM_TAPE_CAT,
     IDM_TAPE_SPEED_NORMAL,
     IDM_TAPE_SPEED_FAST,
+    IDM_TAPE_SPEED_INSTANT,
     IDM_ROMS_LOAD,
     IDM_ROMS_CLEAR,
     IDM_ROMS_RAM,
     IDM_MODEL,
     IDM_TUBE,
     IDM_TUBE_SPEED,
+    IDM_TUBE_6502JIT,
     IDM_VIDEO_DISPTYPE,
     IDM_VIDEO_PAL,
     IDM_VIDEO_BORDERS,
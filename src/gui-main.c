@@ -0,0 +1,42 @@
+/*B-em
+  Front end for the interactive emulator with a display, keyboard and
+  sound.  The start up it shares with b-em-headless is in main.c*/
+
+#include "b-em.h"
+#include "main.h"
+
+static const char helptext[] =
+    VERSION_STR " command line options:\n\n"
+    "-mx             - start as model x (see readme.txt for models)\n"
+    "-tx             - start with tube x (see readme.txt for tubes)\n"
+    "-disc disc.ssd  - load disc.ssd into drives :0/:2\n"
+    "-disc1 disc.ssd - load disc.ssd into drives :1/:3\n"
+    "-autoboot       - boot disc in drive :0\n"
+    "-tape tape.uef  - load tape.uef\n"
+    "-fasttape       - set tape speed to fast\n"
+    "-instanttape    - load standard tape blocks instantly\n"
+    "-tapefile name  - start the tape at file name\n"
+    "-Fx             - set maximum video frames skipped\n"
+    "-s              - scanlines display mode\n"
+    "-i              - interlace display mode\n"
+    "-spx            - Emulation speed x from 0 to 9 (default 4)\n"
+    "-debug          - start debugger\n"
+    "-debugtube      - start debugging tube processor\n"
+    "-exec file      - debugger to execute file\n"
+    "-paste string   - paste string in as if typed\n"
+    "-vroot host-dir - set the VDFS root\n"
+    "-vdir guest-dir - set the initial (boot) dir in VDFS\n"
+    "-fullscreen     - start fullscreen\n\n";
+
+static const main_frontend_t frontend = {
+    .helptext = helptext,
+    .headless = false
+};
+
+int main(int argc, char **argv)
+{
+    main_init(argc, argv, &frontend);
+    main_run();
+    main_close();
+    return 0;
+}
@@ -0,0 +1,199 @@
+/*B-em headless batch runner
+  Runs the emulation core without a display, keyboard or audio as fast
+  as the host allows then dumps screen, memory and/or state.*/
+
+#include "b-em.h"
+#include <zlib.h>
+
+#include "6502.h"
+#include "model.h"
+#include "cmos.h"
+#include "main.h"
+#include "mem.h"
+#include "savestate.h"
+#include "tube.h"
+#include "video_render.h"
+
+#undef printf
+
+/* Frames to wait for the CRTC to produce a vsync after a screenshot
+ * has been asked for before giving up.
+ */
+#define SCRSHOT_MAX_FRAMES 50
+
+static const char helptext[] =
+    VERSION_STR " headless command line options:\n\n"
+    "-mx             - start as model x (see readme.txt for models)\n"
+    "-tx             - start with tube x (see readme.txt for tubes)\n"
+    "-disc disc.ssd  - load disc.ssd into drives :0/:2\n"
+    "-disc1 disc.ssd - load disc.ssd into drives :1/:3\n"
+    "-autoboot       - boot disc in drive :0\n"
+    "-tape tape.uef  - load tape.uef\n"
+    "-fasttape       - set tape speed to fast\n"
+    "-instanttape    - load standard tape blocks instantly\n"
+    "-tapefile name  - start the tape at file name\n"
+    "-s              - scanlines display mode\n"
+    "-i              - interlace display mode\n"
+    "-paste string   - paste string in as if typed\n"
+    "-vroot host-dir - set the VDFS root\n"
+    "-vdir guest-dir - set the initial (boot) dir in VDFS\n"
+    "-frames n       - stop after n frames (default: run until *QUIT)\n"
+    "-screen file    - save a screenshot to file when stopped\n"
+    "-mem file       - save host RAM to file when stopped\n"
+    "-state file     - save a snapshot to file when stopped\n"
+    "-bench          - report speed and a hash of memory when stopped\n"
+    "-tubes          - list the tube processors in this build and exit\n\n";
+
+static void headless_exec(void)
+{
+    if (autoboot)
+        autoboot--;
+    framesrun++;
+
+    if (x65c02)
+        m65c02_exec();
+    else
+        m6502_exec();
+
+    if (savestate_wantload)
+        savestate_doload();
+    if (savestate_wantsave)
+        savestate_dosave();
+}
+
+static bool dump_screen(const char *fn)
+{
+    int frames;
+
+    strncpy(vid_scrshotname, fn, sizeof vid_scrshotname-1);
+    vid_scrshotname[sizeof vid_scrshotname-1] = 0;
+    vid_savescrshot = 2;
+    for (frames = 0; vid_savescrshot && frames < SCRSHOT_MAX_FRAMES; frames++)
+        headless_exec();
+    if (vid_savescrshot) {
+        log_error("headless: no frame displayed, screenshot not saved");
+        vid_savescrshot = 0;
+        return false;
+    }
+    return true;
+}
+
+static bool dump_mem(const char *fn)
+{
+    FILE *f;
+
+    if (!(f = fopen(fn, "wb"))) {
+        log_error("headless: unable to open %s for writing: %s", fn, strerror(errno));
+        return false;
+    }
+    if (fwrite(ram, RAM_SIZE, 1, f) != 1) {
+        log_error("headless: error writing %s: %s", fn, strerror(errno));
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+
+static bool dump_state(const char *fn)
+{
+    savestate_save(fn);
+    if (!savestate_wantsave)
+        return false;
+    savestate_dosave();
+    return savestate_wait();
+}
+
+/* Report how fast the emulation ran along with a checksum of the host
+ * and tube memory so changes in behaviour show up as well as speed.
+ */
+static void bench_report(double elapsed)
+{
+    double emu_cycles = (double)framesrun * 40000;
+    uLong ram_crc = crc32(0, ram, RAM_SIZE);
+    uLong tube_crc = 0;
+
+    if (curtube != -1) {
+        cpu_debug_t *cpu = tubes[curtube].debug;
+        for (uint32_t addr = 0; addr < 0x10000; addr++) {
+            uint32_t value = cpu->memread(addr);
+            unsigned char bytes[4] = { value, value >> 8, value >> 16, value >> 24 };
+            tube_crc = crc32(tube_crc, bytes, sizeof bytes);
+        }
+    }
+    printf("%-28s %-14s %6d %8.3f %8.2f %08lx %08lx\n",
+           models[curmodel].name, curtube == -1 ? "none" : tubes[curtube].name,
+           framesrun, emu_cycles / elapsed / 1000000, elapsed * 1e9 / emu_cycles,
+           (unsigned long)ram_crc, (unsigned long)tube_crc);
+}
+
+static int frames = 0;
+static const char *screen_fn, *mem_fn, *state_fn;
+static bool bench = false;
+
+static int headless_option(int argc, char *argv[], int c)
+{
+    if (!strcasecmp(argv[c], "-bench")) {
+        /* The RTC follows emulated time from a fixed start so
+         * the memory hashes repeat from run to run. */
+        cmos_rtc_epoch = 946684800; // 2000-01-01 00:00 UTC
+        bench = true;
+        return 1;
+    }
+    if (!strcasecmp(argv[c], "-tubes")) {
+        for (int t = 0; t < NUM_TUBES; t++)
+            printf("%d\t%s\n", t, tubes[t].name);
+        exit(0);
+    }
+    if (!strcasecmp(argv[c], "-frames")) {
+        if (c + 1 < argc)
+            frames = atoi(argv[c + 1]);
+    }
+    else if (!strcasecmp(argv[c], "-screen")) {
+        if (c + 1 < argc)
+            screen_fn = argv[c + 1];
+    }
+    else if (!strcasecmp(argv[c], "-mem")) {
+        if (c + 1 < argc)
+            mem_fn = argv[c + 1];
+    }
+    else if (!strcasecmp(argv[c], "-state")) {
+        if (c + 1 < argc)
+            state_fn = argv[c + 1];
+    }
+    else
+        return 0;
+    return c + 1 < argc ? 2 : 1;
+}
+
+static const main_frontend_t frontend = {
+    .helptext = helptext,
+    .headless = true,
+    .option = headless_option
+};
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+    double start;
+
+    main_init(argc, argv, &frontend);
+
+    log_debug("headless: running for %d frames", frames);
+    start = al_get_time();
+    while (!quitting && (frames <= 0 || framesrun < frames))
+        headless_exec();
+    if (bench)
+        bench_report(al_get_time() - start);
+    log_info("headless: stopped after %d frames", framesrun);
+
+    if (screen_fn)
+        ok &= dump_screen(screen_fn);
+    if (mem_fn)
+        ok &= dump_mem(mem_fn);
+    if (state_fn)
+        ok &= dump_state(state_fn);
+
+    main_close();
+    return ok ? 0 : 2;
+}
@@ -248,6 +248,18 @@ struct hfe_poll_state
 };
 
 
+enum { HFE_CACHE_TRACKS = 84 };  /* enough to hold every track of most discs. */
+
+/* A decoded track bitstream kept in the per-drive cache. */
+struct hfe_cached_track
+{
+  int track;                    /* NO_TRACK if the slot is free. */
+  unsigned char *data;
+  size_t bytes;
+  int poll_calls_per_bit;
+  unsigned long last_used;
+};
+
 struct hfe_info
 {
   /* The open image file. */
@@ -260,6 +272,19 @@ struct hfe_info
   int current_track;
   unsigned char *track_data;
   size_t track_data_bytes;
+  /* Whether track_data belongs to us rather than to the cache, which
+     is the case for tracks which can't be cached. */
+  bool track_data_owned;
+
+  /* Decoded tracks.  Seeking to a track which has been seen before
+     is just a matter of pointing track_data at the cached copy.
+     When the cache is full the least recently used track is
+     dropped.  cache_lock guards the cache and the file as the cache
+     may be filled by predecode_thread. */
+  struct hfe_cached_track cache[HFE_CACHE_TRACKS];
+  unsigned long cache_clock;
+  ALLEGRO_MUTEX *cache_lock;
+  ALLEGRO_THREAD *predecode_thread;
 
   /* b-em calls our poll function every 16 clock cycles.  With a 2MHz
      clock that's 1.25e5 Hz (i.e. every 8 microseconds).  The floppy
@@ -301,6 +326,8 @@ enum { SECTOR_ADDR_BYTES = 7 /* includes address mark */ };
 
 static struct hfe_info  *hfe_info[HFE_DRIVES];
 static int hfe_selected_drive;
+/* Decode all tracks in the background when an image is loaded. */
+bool hfe_predecode = false;
 /* We issue a "write operations are not supported" warning only
    once. */
 static bool write_warning_issued = false;
@@ -488,11 +515,27 @@ void hfe_init()
 }
 
 
+static void hfe_cache_free(struct hfe_info *p)
+{
+  for (int i = 0; i < HFE_CACHE_TRACKS; ++i)
+    {
+      free(p->cache[i].data);
+      p->cache[i].data = NULL;
+      p->cache[i].track = NO_TRACK;
+    }
+}
+
 static void hfe_close(int drive)
 {
   log_debug("hfe: drive %d: close", drive);
   if (hfe_info[drive])
     {
+      if (hfe_info[drive]->predecode_thread)
+        {
+          /* Stops and joins the thread. */
+          al_destroy_thread(hfe_info[drive]->predecode_thread);
+          hfe_info[drive]->predecode_thread = NULL;
+        }
       if (hfe_info[drive]->state.motor_running)
         {
           /* This happens if you *QUIT with the motor running. */
@@ -510,13 +553,14 @@ static void hfe_close(int drive)
           clear_op_state(&hfe_info[drive]->state);
         }
       hfe_info[drive]->current_track = NO_TRACK;
-      if (hfe_info[drive]->track_data)
-        {
-          free(hfe_info[drive]->track_data);
-          hfe_info[drive]->track_data = NULL;
-
-        }
+      if (hfe_info[drive]->track_data_owned)
+        free(hfe_info[drive]->track_data);
+      hfe_info[drive]->track_data = NULL;
+      hfe_info[drive]->track_data_owned = false;
       hfe_info[drive]->track_data_bytes = 0;
+      hfe_cache_free(hfe_info[drive]);
+      if (hfe_info[drive]->cache_lock)
+        al_destroy_mutex(hfe_info[drive]->cache_lock);
       hfe_info[drive]->poll_calls_per_bit = 1;
       free(hfe_info[drive]);
       log_debug("hfe: drive %d: hfe_close setting hfe_info[%d] to NULL", drive, drive);
@@ -638,10 +682,12 @@ unsigned char hfe_random_byte(void)
   return (rand() >> 5) & 0xFF;
 }
 
+/* *random is set if the track uses the HFE3 RAND opcode, whose data
+   is different each time the track is decoded. */
 static size_t hfe_copy_bits(int version, int encoding,
                             int drive, int track,
                             const unsigned char *src, size_t in_bytes,
-                            unsigned char *dest)
+                            unsigned char *dest, bool *random)
 {
   /* I don't know how HFE_FMT_ENC_EMU_FM_ENCODING differs from
      HFE_FMT_ENC_ISOIBM_FM_ENCODING */
@@ -678,6 +724,7 @@ static size_t hfe_copy_bits(int version, int encoding,
 
             case HFE_OPCODE_RAND:
               in = hfe_random_byte();
+              *random = true;
               break;
 
             case HFE_OPCODE_NOP:
@@ -787,7 +834,8 @@ unsigned char encoding_of_track(int drive, int side, int track)
 static bool hfe_read_track_data(int drive, int track, int side,
                                 unsigned long pos, unsigned long len,
                                 unsigned char encoding,
-                                unsigned char **result, size_t *bytes_read, int *err)
+                                unsigned char **result, size_t *bytes_read,
+                                bool *random, int *err)
 {
   /* The track data consists of a 256-byte block of data for side 0
      followed by a 256-byte block of data for side 1.  Then, another
@@ -807,8 +855,10 @@ static bool hfe_read_track_data(int drive, int track, int side,
     }
   if (!hfe_read_at_pos(hfe_info[drive]->fp, pos, len, in, err))
     {
-      if (!err)
+      if (!*err)
         log_error("hfe: short read on track data for drive %d track %d", drive, track);
+      free(in);
+      free(out);
       return false;
     }
   hfe_reverse_bit_order(in, len);
@@ -819,8 +869,10 @@ static bool hfe_read_track_data(int drive, int track, int side,
     {
       (*bytes_read) += hfe_copy_bits(hfe_info[drive]->hfe_version,
                                      encoding, drive, track,
-                                     in + begin, 256, out + (*bytes_read));
+                                     in + begin, 256, out + (*bytes_read),
+                                     random);
     }
+  free(in);
   *result = out;
   return true;
 }
@@ -834,16 +886,103 @@ static void hfe_track_load_failed(int drive, int track, int err)
     log_error("hfe: failed to load track data for drive %d track %d", drive, track);
 }
 
-static void hfe_seek(int drive, int track)
+/* Read and decode a track from the image file.  The caller must hold
+   cache_lock.  *cacheable is cleared for tracks which must be decoded
+   afresh each time they are visited. */
+static bool hfe_decode_track(int drive, int track, struct hfe_cached_track *out,
+                             bool *cacheable, int *err)
 {
-  int err = 0;
   const int side = 0;           /* XXX: how are sides selected? */
   struct track_data_pos where;
-  unsigned char *trackbits = NULL;
-  size_t track_len = 0;
+  bool random = false;
+
+  if (!hfe_locate_track_data(drive, track, &where, err))
+    return false;
+  log_debug("hfe: drive %d: track %d data: %lu bytes at %lu", drive, track, where.len, where.pos);
+  const unsigned char encoding = encoding_of_track(drive, side, track);
+  if (!hfe_read_track_data(drive, track, side, where.pos, where.len,
+                           encoding, &out->data, &out->bytes, &random, err))
+    return false;
+#ifdef DUMP_TRACK
+  dump_memory(out->data, out->bytes, 0);
+#endif
+  out->track = track;
+  out->poll_calls_per_bit = encoding ? 1 : 2;
+  *cacheable = !random;
+  return true;
+}
+
+static struct hfe_cached_track *hfe_cache_find(struct hfe_info *p, int track)
+{
+  for (int i = 0; i < HFE_CACHE_TRACKS; ++i)
+    if (p->cache[i].track == track)
+      return &p->cache[i];
+  return NULL;
+}
+
+/* Find a slot for a new track, a free one if there is one, otherwise,
+   if evict is set, the least recently used one, which is emptied. */
+static struct hfe_cached_track *hfe_cache_slot(struct hfe_info *p, bool evict)
+{
+  struct hfe_cached_track *lru = NULL;
+  for (int i = 0; i < HFE_CACHE_TRACKS; ++i)
+    {
+      struct hfe_cached_track *c = &p->cache[i];
+      if (c->track == NO_TRACK)
+        return c;
+      if (!lru || c->last_used < lru->last_used)
+        lru = c;
+    }
+  if (!evict)
+    return NULL;
+  log_debug("hfe: evicting track %d from cache", lru->track);
+  free(lru->data);
+  lru->data = NULL;
+  lru->track = NO_TRACK;
+  return lru;
+}
+
+static void *hfe_predecode_thread(ALLEGRO_THREAD *thread, void *arg)
+{
+  const int drive = (intptr_t)arg;
+  struct hfe_info *p = hfe_info[drive];
+  int track, err = 0;
+
+  for (track = 0; track < p->header.number_of_track && !al_get_thread_should_stop(thread); ++track)
+    {
+      al_lock_mutex(p->cache_lock);
+      struct hfe_cached_track *slot = NULL;
+      if (!hfe_cache_find(p, track) && (slot = hfe_cache_slot(p, false)))
+        {
+          struct hfe_cached_track decoded;
+          bool cacheable;
+          if (hfe_decode_track(drive, track, &decoded, &cacheable, &err))
+            {
+              if (cacheable)
+                *slot = decoded;
+              else
+                free(decoded.data);
+            }
+          else
+            hfe_track_load_failed(drive, track, err);
+        }
+      al_unlock_mutex(p->cache_lock);
+      if (!slot && !hfe_cache_find(p, track))
+        break;  /* cache full */
+    }
+  log_debug("hfe: drive %d: pre-decoded tracks 0-%d", drive, track - 1);
+  return NULL;
+}
+
+static void hfe_seek(int drive, int track)
+{
+  int err = 0;
+  struct hfe_info *p = hfe_info[drive];
+  struct hfe_cached_track *cached, decoded;
+  bool cacheable = false;
 
   log_info("hfe: drive %d seek to track %d", drive, track);
-  if (NULL == hfe_info[drive]->fp)
+  if (NULL == p->fp)
     {
       log_warn("hfe: seek on unoccupied drive %d track %d", drive, track);
       return;
@@ -853,48 +992,56 @@ static void hfe_seek(int drive, int track)
       log_warn("hfe: seek on drive %d to negative track %d", drive, track);
       track = 0;
     }
-  else if (track >= hfe_info[drive]->header.number_of_track)
+  else if (track >= p->header.number_of_track)
     {
       log_warn("hfe: seek on drive %d to track %d, but file only has %d tracks",
-               drive, track, hfe_info[drive]->header.number_of_track);
+               drive, track, p->header.number_of_track);
       /* We checked when we parsed the header that number_of_track > 0 */
-      track = hfe_info[drive]->header.number_of_track-1;
+      track = p->header.number_of_track-1;
     }
 
   log_debug("hfe: drive %d: seek to track %d", drive, track);
-  if (!hfe_locate_track_data(drive, track, &where, &err))
+  al_lock_mutex(p->cache_lock);
+  if (!(cached = hfe_cache_find(p, track)))
     {
-      hfe_track_load_failed(drive, track, err);
-      hfe_undiagnosed_failure(drive);
-      return;
+      if (!hfe_decode_track(drive, track, &decoded, &cacheable, &err))
+        {
+          al_unlock_mutex(p->cache_lock);
+          hfe_track_load_failed(drive, track, err);
+          hfe_undiagnosed_failure(drive);
+          return;
+        }
+      if (cacheable)
+        {
+          cached = hfe_cache_slot(p, true);
+          *cached = decoded;
+        }
     }
-  log_debug("hfe: drive %d: track %d data: %lu bytes at %lu", drive, track, where.len, where.pos);
-  const unsigned char encoding = encoding_of_track(drive, side, track);
-  if (!hfe_read_track_data(drive, track, side, where.pos, where.len,
-                           encoding, &trackbits, &track_len, &err))
+  if (p->track_data_owned)
+    free(p->track_data);
+  if (cached)
     {
-      hfe_track_load_failed(drive, track, err);
-      hfe_undiagnosed_failure(drive);
-      return;
+      cached->last_used = ++p->cache_clock;
+      p->track_data = cached->data;
+      p->track_data_bytes = cached->bytes;
+      p->poll_calls_per_bit = cached->poll_calls_per_bit;
+      p->track_data_owned = false;
     }
-#ifdef DUMP_TRACK
-  dump_memory(trackbits, track_len, 0);
-#endif
-  if (hfe_info[drive]->track_data)
+  else
     {
-      free(hfe_info[drive]->track_data);
-      hfe_info[drive]->track_data = NULL;
+      p->track_data = decoded.data;
+      p->track_data_bytes = decoded.bytes;
+      p->poll_calls_per_bit = decoded.poll_calls_per_bit;
+      p->track_data_owned = true;
     }
-
-  hfe_info[drive]->current_track = track;
-  hfe_info[drive]->track_data = trackbits;
-  hfe_info[drive]->track_data_bytes = track_len;
-  hfe_info[drive]->poll_calls_per_bit = encoding ? 1 : 2;
-  log_debug("hfe: seek: loaded %lu bytes of data for drive %d track %d at %p",
-            (unsigned long)hfe_info[drive]->track_data_bytes,
+  al_unlock_mutex(p->cache_lock);
+  p->current_track = track;
+  log_debug("hfe: seek: %s %lu bytes of data for drive %d track %d at %p",
+            cached ? "using" : "loaded",
+            (unsigned long)p->track_data_bytes,
             drive,
             track,
-            hfe_info[drive]->track_data);
+            p->track_data);
 }
 
 static void set_up_for_sector_read(int drive, size_t sector_bytes_to_read)
@@ -1730,6 +1877,15 @@ static void init_hfe_info(struct hfe_info *p, FILE *f)
   p->current_track = NO_TRACK;
   p->track_data = NULL;
   p->track_data_bytes = 0;
+  p->track_data_owned = false;
+  for (int i = 0; i < HFE_CACHE_TRACKS; ++i)
+    {
+      p->cache[i].track = NO_TRACK;
+      p->cache[i].data = NULL;
+    }
+  p->cache_clock = 0;
+  p->cache_lock = NULL;
+  p->predecode_thread = NULL;
   p->fp = f;
   init_hfe_poll_state(&p->state, p->poll_calls_per_bit);
 }
@@ -1797,13 +1953,29 @@ void hfe_load(int drive, const char *fn)
     {
       log_error("hfe: HFE disc image '%s' has an invalid header", fn);
       /* unwind the initialization. */
-      free(hfe_info[drive]);
       fclose(hfe_info[drive]->fp);
+      free(hfe_info[drive]);
       log_warn("hfe: drive %d: hfe_load setting hfe_info[%d] to NULL (after failing to load %s)",
                drive, drive, fn);
       hfe_info[drive] = NULL;
       return;
     }
+  if (!(hfe_info[drive]->cache_lock = al_create_mutex()))
+    {
+      log_error("hfe: unable to create track cache lock for drive %d", drive);
+      fclose(hfe_info[drive]->fp);
+      free(hfe_info[drive]);
+      hfe_info[drive] = NULL;
+      return;
+    }
+  if (hfe_predecode)
+    {
+      hfe_info[drive]->predecode_thread = al_create_thread(hfe_predecode_thread, (void *)(intptr_t)drive);
+      if (hfe_info[drive]->predecode_thread)
+        al_start_thread(hfe_info[drive]->predecode_thread);
+      else
+        log_warn("hfe: unable to start thread to pre-decode tracks for drive %d", drive);
+    }
   drives[drive].close       = hfe_close;
   drives[drive].seek        = hfe_seek;
   drives[drive].readsector  = hfe_readsector;
@@ -1,6 +1,8 @@
 #ifndef INC_HFE_H
 #define INC_HFE_H
 
+extern bool hfe_predecode;
+
 void hfe_init(void);
 void hfe_load(int, const char *);
 
@@ -717,7 +717,9 @@ const struct key_act_const keyact_const[KEY_ACTION_MAX] = {
     { "insert-disk-1",  ALLEGRO_KEY_F1,    true,  insert_disk_1,           do_nothing      },
     { "insert-disk-2",  ALLEGRO_KEY_F2,    true,  insert_disk_2,           do_nothing      },
     { "insert-tape",    ALLEGRO_KEY_F3,    true,  insert_tape,             do_nothing      },
-    { "full-screen2",   ALLEGRO_KEY_ENTER, true,  toggle_fullscreen_menu,  do_nothing      }
+    { "full-screen2",   ALLEGRO_KEY_ENTER, true,  toggle_fullscreen_menu,  do_nothing      },
+    { "full-throttle",  ALLEGRO_KEY_PGUP,  true,  main_key_fullthrottle,   do_nothing      },
+    { "rewind",         ALLEGRO_KEY_BACKSPACE, true, main_key_rewind,      do_nothing      }
 };
 
 uint8_t keylookup[ALLEGRO_KEY_MAX];
@@ -25,6 +25,7 @@ typedef struct {
     int turn_off_at;
     char cfgcol[8];
     ALLEGRO_COLOR colour;
+    bool drawn;
 } led_details_t;
 
 static led_details_t led_details[LED_MAX] = {
@@ -99,6 +100,7 @@ void led_init(void)
                 led_details[i].colour = get_config_colour("leds", led_details[i].cfgcol, dcol);
                 draw_led_full(&led_details[i], false, bgcol);
                 led_details[i].state = false;
+                led_details[i].drawn = false;
             }
             return;
         }
@@ -110,7 +112,6 @@ void led_update(led_name_t led_name, bool b, int ticks)
 {
     if (vid_ledlocation > LED_LOC_NONE && led_name < LED_MAX) {
         if (b != led_details[led_name].state) {
-            draw_led(&led_details[led_name], b);
             last_led_update_at = framesrun;
             led_details[led_name].state = b;
         }
@@ -134,7 +135,6 @@ void led_timer_fired(void)
                     if (led_details[i].state != false) {
                         last_led_update_at = framesrun;
                         led_details[i].state = false;
-                        draw_led(&led_details[i], false);
                     }
                     led_details[i].turn_off_at = 0;
                 }
@@ -149,6 +149,22 @@ void led_timer_fired(void)
     }
 }
 
+/* LEDs change as the emulation runs, which may be on a thread that
+ * can't draw, so the bitmap is brought up to date here, from the
+ * thread that shows the frame.
+ */
+void led_draw(void)
+{
+    if (vid_ledlocation > LED_LOC_NONE) {
+        for (int i = 0; i < sizeof(led_details)/sizeof(led_details[0]); i++) {
+            if (led_details[i].drawn != led_details[i].state) {
+                draw_led(&led_details[i], led_details[i].state);
+                led_details[i].drawn = led_details[i].state;
+            }
+        }
+    }
+}
+
 bool led_any_transient_led_on(void)
 {
     for (int i = 0; i < sizeof(led_details)/sizeof(led_details[0]); i++)
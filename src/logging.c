@@ -9,6 +9,12 @@
 #include <stdarg.h>
 #include <time.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #define LOG_DEST_FILE   0x01
 #define LOG_DEST_STDERR 0x02
 #define LOG_DEST_MSGBOX 0x04
@@ -23,7 +29,7 @@ static const log_level_t ll_fatal = { 0xf0000, 16, "FATAL"   };
 static const log_level_t ll_error = { 0x0f000, 12, "ERROR"   };
 static const log_level_t ll_warn  = { 0x00f00,  8, "WARNING" };
 static const log_level_t ll_info  = { 0x000f0,  4, "INFO"    };
-static const log_level_t ll_debug = { 0x0000f,  0, "DEBUG"   };
+static const log_level_t ll_debug = { LOG_OPT_DEBUG, 0, "DEBUG" };
 
 static const log_level_t *log_levels[] =
 {
@@ -38,12 +44,101 @@ static const log_level_t *log_levels[] =
 static const char log_section[]    = "logging";
 static const char log_default_fn[] = "b-emlog";
 
-static unsigned log_options = 0x22222;
+unsigned log_options = 0x22222;
 
 static FILE *log_fp;
 static char   tmstr[20];
 static time_t last = 0;
 
+/*
+ * Messages for the log file and stderr are not normally written out by
+ * the thread that logs them.  Each thread copies its messages, with a
+ * sequence number and the time, into a ring buffer of its own and a
+ * flusher thread takes them from all the rings in sequence order,
+ * writes them out and flushes the file once for each batch.  Only the
+ * thread that owns a ring moves its head.  Tails are moved with
+ * log_mutex held, normally by the flusher but also by a thread that
+ * finds its ring full and so empties the rings itself.
+ *
+ * Messages for a message box, those logged when the flusher is not
+ * running and any too big for a ring are written directly, after
+ * whatever is waiting in the rings.
+ *
+ * When a thread exits its ring is marked free, through a thread-local
+ * destructor, for the next new thread to take over along with anything
+ * still waiting in it, so threads that come and go don't each leave a
+ * ring behind.  All the rings are freed by log_close.
+ *
+ * A thread that must not touch the display, such as the emulation
+ * thread, calls log_defer_msgbox and its message boxes are queued for
+ * the main thread to show from log_show_deferred.
+ */
+
+#define LOG_RING_SIZE  0x10000
+#define LOG_FLUSH_SECS 0.02
+#define LOG_REC_WRAP   UINT32_MAX
+#define LOG_REC_SIZE(len) ((sizeof(log_rec_t) + (len) + 7) & ~(size_t)7)
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LOG_THREAD __declspec(thread)
+/* MSVC volatile accesses have acquire and release semantics. */
+#define log_load_acquire(p)     (*(volatile size_t *)(p))
+#define log_store_release(p, v) (*(volatile size_t *)(p) = (v))
+#define log_next_seq()          ((uint32_t)_InterlockedIncrement((volatile long *)&log_seq))
+#define log_async_on()          (*(volatile bool *)&log_async)
+#define log_set_async(v)        (*(volatile bool *)&log_async = (v))
+#else
+#define LOG_THREAD __thread
+#define log_load_acquire(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define log_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define log_next_seq()          __atomic_add_fetch(&log_seq, 1, __ATOMIC_RELAXED)
+#define log_async_on()          __atomic_load_n(&log_async, __ATOMIC_ACQUIRE)
+#define log_set_async(v)        __atomic_store_n(&log_async, v, __ATOMIC_RELEASE)
+#endif
+
+typedef struct {
+    uint32_t   len;     // length of the message that follows or LOG_REC_WRAP.
+    uint32_t   seq;
+    time_t     when;
+    const char *level;
+    unsigned   dest;
+} log_rec_t;
+
+typedef struct log_ring {
+    struct log_ring *next;
+    bool   in_use;      // owned by a running thread.
+    size_t head;
+    size_t tail;
+    char   data[LOG_RING_SIZE];
+} log_ring_t;
+
+static ALLEGRO_MUTEX  *log_mutex;
+static ALLEGRO_COND   *log_cond;
+static ALLEGRO_THREAD *log_thread;
+static bool           log_async;
+static uint32_t       log_seq;
+static log_ring_t     *log_rings;
+static LOG_THREAD     log_ring_t *log_my_ring;
+
+typedef struct log_box {
+    struct log_box *next;
+    const char     *level;
+    char           msg[];
+} log_box_t;
+
+static ALLEGRO_MUTEX  *log_box_mutex;
+static log_box_t      *log_boxes;
+static log_box_t      **log_boxes_end = &log_boxes;
+static LOG_THREAD     bool log_box_defer;
+
+#ifdef _WIN32
+static DWORD          log_ring_key = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t  log_ring_key;
+static bool           log_ring_key_ok;
+#endif
+
 static void log_msgbox(const char *level, char *msg)
 {
     const int max_len = 80;
@@ -71,14 +166,9 @@ static void log_msgbox(const char *level, char *msg)
     }
 }
 
-static void log_common(unsigned dest, const char *level, char *msg, size_t len)
+static void log_write(unsigned dest, const char *level, time_t now, const char *msg, size_t len)
 {
-    time_t now;
-
-    while (msg[len-1] == '\n')
-        len--;
     if ((dest & LOG_DEST_FILE) && log_fp) {
-        time(&now);
         if (now != last) {
             strftime(tmstr, sizeof(tmstr), "%d/%m/%Y %H:%M:%S", localtime(&now));
             last = now;
@@ -86,14 +176,239 @@ static void log_common(unsigned dest, const char *level, char *msg, size_t len)
         fprintf(log_fp, "%s %s ", tmstr, level);
         fwrite(msg, len, 1, log_fp);
         putc('\n', log_fp);
-        fflush(log_fp);
     }
     if (dest & LOG_DEST_STDERR) {
         fwrite(msg, len, 1, stderr);
         putc('\n', stderr);
     }
-    if (dest & LOG_DEST_MSGBOX)
-        log_msgbox(level, msg);
+}
+
+/* Called by the thread that owns the ring. */
+
+static bool ring_put(log_ring_t *ring, unsigned dest, const char *level, const char *msg, size_t len)
+{
+    size_t need = LOG_REC_SIZE(len);
+    size_t head = ring->head;
+    size_t pos = head % LOG_RING_SIZE;
+    size_t room = LOG_RING_SIZE - pos;
+    size_t skip = room < need ? room : 0;
+
+    if (skip + need > LOG_RING_SIZE - (head - log_load_acquire(&ring->tail)))
+        return false;
+    if (skip) {
+        // Not enough room before the end so continue at the start.
+        if (room >= sizeof(log_rec_t))
+            ((log_rec_t *)(ring->data + pos))->len = LOG_REC_WRAP;
+        head += skip;
+        pos = 0;
+    }
+    log_rec_t *rec = (log_rec_t *)(ring->data + pos);
+    rec->len = len;
+    rec->seq = log_next_seq();
+    rec->when = time(NULL);
+    rec->level = level;
+    rec->dest = dest;
+    memcpy(rec + 1, msg, len);
+    log_store_release(&ring->head, head + need);
+    return true;
+}
+
+/* Called with log_mutex held. */
+
+static log_rec_t *ring_peek(log_ring_t *ring)
+{
+    size_t head = log_load_acquire(&ring->head);
+    size_t tail = ring->tail;
+
+    if (tail == head)
+        return NULL;
+    size_t pos = tail % LOG_RING_SIZE;
+    size_t room = LOG_RING_SIZE - pos;
+    if (room < sizeof(log_rec_t) || ((log_rec_t *)(ring->data + pos))->len == LOG_REC_WRAP) {
+        tail += room;
+        log_store_release(&ring->tail, tail);
+        if (tail == head)
+            return NULL;
+        pos = 0;
+    }
+    return (log_rec_t *)(ring->data + pos);
+}
+
+static void log_drain(void)
+{
+    for (;;) {
+        log_ring_t *first = NULL;
+        log_rec_t *first_rec = NULL;
+        for (log_ring_t *ring = log_rings; ring; ring = ring->next) {
+            log_rec_t *rec = ring_peek(ring);
+            if (rec && (!first_rec || (int32_t)(rec->seq - first_rec->seq) < 0)) {
+                first = ring;
+                first_rec = rec;
+            }
+        }
+        if (!first)
+            break;
+        log_write(first_rec->dest, first_rec->level, first_rec->when, (const char *)(first_rec + 1), first_rec->len);
+        log_store_release(&first->tail, first->tail + LOG_REC_SIZE(first_rec->len));
+    }
+    if (log_fp)
+        fflush(log_fp);
+}
+
+/* Called as a thread that has logged exits. */
+
+#ifdef _WIN32
+static void WINAPI log_ring_release(void *data)
+#else
+static void log_ring_release(void *data)
+#endif
+{
+    if (data && log_mutex) {
+        al_lock_mutex(log_mutex);
+        for (log_ring_t *ring = log_rings; ring; ring = ring->next) {
+            if (ring == data) {
+                ring->in_use = false;
+                break;
+            }
+        }
+        al_unlock_mutex(log_mutex);
+    }
+}
+
+static void log_ring_key_create(void)
+{
+#ifdef _WIN32
+    if (log_ring_key == FLS_OUT_OF_INDEXES)
+        log_ring_key = FlsAlloc(log_ring_release);
+#else
+    if (!log_ring_key_ok)
+        log_ring_key_ok = !pthread_key_create(&log_ring_key, log_ring_release);
+#endif
+}
+
+static log_ring_t *log_thread_ring(void)
+{
+    log_ring_t *ring = log_my_ring;
+    if (!ring) {
+        al_lock_mutex(log_mutex);
+        for (ring = log_rings; ring && ring->in_use; ring = ring->next)
+            ;
+        if (!ring && (ring = malloc(sizeof(log_ring_t)))) {
+            ring->head = ring->tail = 0;
+            ring->next = log_rings;
+            log_rings = ring;
+        }
+        if (ring)
+            ring->in_use = true;
+        al_unlock_mutex(log_mutex);
+        if (ring) {
+#ifdef _WIN32
+            if (log_ring_key != FLS_OUT_OF_INDEXES)
+                FlsSetValue(log_ring_key, ring);
+#else
+            if (log_ring_key_ok)
+                pthread_setspecific(log_ring_key, ring);
+#endif
+            log_my_ring = ring;
+        }
+    }
+    return ring;
+}
+
+static void log_common(unsigned dest, const char *level, char *msg, size_t len)
+{
+    while (len > 0 && msg[len-1] == '\n')
+        len--;
+    if (log_async_on() && !(dest & LOG_DEST_MSGBOX) && LOG_REC_SIZE(len) <= LOG_RING_SIZE / 2) {
+        log_ring_t *ring = log_thread_ring();
+        if (ring) {
+            if (ring_put(ring, dest, level, msg, len))
+                return;
+            al_lock_mutex(log_mutex);
+            log_drain();
+            al_unlock_mutex(log_mutex);
+            if (ring_put(ring, dest, level, msg, len))
+                return;
+        }
+    }
+    if (log_mutex) {
+        al_lock_mutex(log_mutex);
+        log_drain();
+        log_write(dest, level, time(NULL), msg, len);
+        al_unlock_mutex(log_mutex);
+    }
+    else {
+        log_write(dest, level, time(NULL), msg, len);
+        if (log_fp)
+            fflush(log_fp);
+    }
+    if (dest & LOG_DEST_MSGBOX) {
+        if (log_box_defer && log_box_mutex) {
+            log_box_t *box = malloc(sizeof(log_box_t) + len + 1);
+            if (box) {
+                box->next = NULL;
+                box->level = level;
+                memcpy(box->msg, msg, len);
+                box->msg[len] = 0;
+                al_lock_mutex(log_box_mutex);
+                *log_boxes_end = box;
+                log_boxes_end = &box->next;
+                al_unlock_mutex(log_box_mutex);
+            }
+        }
+        else
+            log_msgbox(level, msg);
+    }
+}
+
+void log_defer_msgbox(void)
+{
+    log_box_defer = true;
+}
+
+void log_show_deferred(void)
+{
+    log_box_t *box, *next;
+
+    if (!log_box_mutex || !log_boxes)
+        return;
+    al_lock_mutex(log_box_mutex);
+    box = log_boxes;
+    log_boxes = NULL;
+    log_boxes_end = &log_boxes;
+    al_unlock_mutex(log_box_mutex);
+    for (; box; box = next) {
+        next = box->next;
+        log_msgbox(box->level, box->msg);
+        free(box);
+    }
+}
+
+static void *log_flusher(ALLEGRO_THREAD *thread, void *arg)
+{
+    al_lock_mutex(log_mutex);
+    while (!al_get_thread_should_stop(thread)) {
+        ALLEGRO_TIMEOUT timeout;
+        log_drain();
+        al_init_timeout(&timeout, LOG_FLUSH_SECS);
+        al_wait_cond_until(log_cond, log_mutex, &timeout);
+    }
+    log_drain();
+    al_unlock_mutex(log_mutex);
+    return NULL;
+}
+
+static void log_start_flusher(void)
+{
+    if (!log_mutex && !(log_mutex = al_create_mutex()))
+        return;
+    if (!log_cond && !(log_cond = al_create_cond()))
+        return;
+    log_ring_key_create();
+    if ((log_thread = al_create_thread(log_flusher, NULL))) {
+        al_start_thread(log_thread);
+        log_set_async(true);
+    }
 }
 
 static char msg_malloc[] = "log_format: out of space - following message truncated";
@@ -124,7 +439,7 @@ static void log_format(const log_level_t *ll, const char *fmt, va_list ap)
 
 #ifdef _DEBUG
 
-void log_debug(const char *fmt, ...)
+void (log_debug)(const char *fmt, ...)
 {
     va_list ap;
 
@@ -321,13 +636,52 @@ void log_open(void)
             new_opt |= (LOG_DEST_MSGBOX << ll->shift);
     }
     log_options = new_opt;
+    if (!log_box_mutex)
+        log_box_mutex = al_create_mutex();
     if (open_file)
         log_open_file();
+    if (new_opt & ~(LOG_DEST_MSGBOX * 0x11111))
+        log_start_flusher();
     log_debug("log_open: log options=%x", log_options);
 }
 
 void log_close(void)
 {
-    if (log_fp)
+    if (log_thread) {
+        log_set_async(false);
+        al_set_thread_should_stop(log_thread);
+        al_broadcast_cond(log_cond);
+        al_join_thread(log_thread, NULL);
+        al_destroy_thread(log_thread);
+        log_thread = NULL;
+    }
+    if (log_mutex) {
+        al_lock_mutex(log_mutex);
+        log_drain();
+        while (log_rings) {
+            log_ring_t *next = log_rings->next;
+            free(log_rings);
+            log_rings = next;
+        }
+        log_my_ring = NULL;
+        if (log_fp) {
+            fclose(log_fp);
+            log_fp = NULL;
+        }
+        al_unlock_mutex(log_mutex);
+    }
+    else if (log_fp) {
         fclose(log_fp);
+        log_fp = NULL;
+    }
+    if (log_box_mutex) {
+        while (log_boxes) {
+            log_box_t *next = log_boxes->next;
+            free(log_boxes);
+            log_boxes = next;
+        }
+        log_boxes_end = &log_boxes;
+        al_destroy_mutex(log_box_mutex);
+        log_box_mutex = NULL;
+    }
 }
@@ -7,8 +7,17 @@
 #define printflike
 #endif
 
+// Which destinations each level of message goes to, four bits a level.
+// Exported so the level check for debug messages is cheap.
+
+#define LOG_OPT_DEBUG 0x0000f
+
+extern unsigned log_options;
+
 extern void log_open(void);
 extern void log_close(void);
+extern void log_defer_msgbox(void);
+extern void log_show_deferred(void);
 extern void log_fatal(const char *fmt, ...) printflike;
 extern void log_error(const char *fmt, ...) printflike;
 extern void log_warn(const char *fmt, ...) printflike;
@@ -19,9 +28,15 @@ extern void log_info(const char *fmt, ...) printflike;
 // optionis disabled we use a static inline empty function to make the
 // debug calls disappear but in a way that does not generate warnings
 // about unused variables etc.
+//
+// When enabled, calls go through a macro that checks whether debug
+// messages are going anywhere before evaluating the arguments so a
+// build with debugging compiled in but not configured runs at full
+// speed.
 
 #ifdef _DEBUG
-extern void log_debug(const char *format, ...) printflike;
+extern void (log_debug)(const char *format, ...) printflike;
+#define log_debug(...) ((log_options & LOG_OPT_DEBUG) ? (log_debug)(__VA_ARGS__) : (void)0)
 extern void log_dump(const char *prefix, uint8_t *data, size_t size);
 extern void log_bitfield(const char *fmt, unsigned value, const char **names);
 #else
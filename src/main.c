@@ -28,6 +28,7 @@
 #include "led.h"
 #include "main.h"
 #include "6809tube.h"
+#include "mc68000tube.h"
 #include "mem.h"
 #include "mouse.h"
 #include "midi.h"
@@ -36,6 +37,7 @@
 #include "mmccard.h"
 #include "paula.h"
 #include "pal.h"
+#include "rewind.h"
 #include "savestate.h"
 #include "scsi.h"
 #include "sdf.h"
@@ -93,6 +95,28 @@ static double time_limit;
 static int fcount = 0;
 static fspeed_type_t fullspeed = FSPEED_NONE;
 static bool bempause  = false;
+static bool main_paused = false;
+static bool main_headless = false;
+
+/*
+ * Full speed.  Rather than running a frame for each timer event the
+ * emulation runs flat out on its own thread and the main thread just
+ * handles input, menus and the speed shown in the title bar.  The
+ * emulation thread holds emu_mutex for the whole of each frame so when
+ * the main thread needs to touch emulated state main_emu_lock holds the
+ * emulation thread between frames.  The display stays with the main
+ * thread throughout: the emulation thread leaves frames to be shown
+ * with video_doblit, which tells the main thread with
+ * main_frame_handoff and carries on without waiting for it.
+ */
+static ALLEGRO_THREAD *emu_thread;
+static ALLEGRO_MUTEX  *emu_mutex;
+static ALLEGRO_COND   *emu_cond;
+static volatile bool emu_hold;
+static bool emu_thread_failed;
+static bool emu_in_frame;
+
+#define EMU_EVENT_FRAME ALLEGRO_GET_EVENT_TYPE('B','E','F','R')
 
 const emu_speed_t emu_speeds[NUM_EMU_SPEEDS] = {
     {  "10%", 1.0 / (50.0 * 0.10), 1 },
@@ -129,36 +153,19 @@ void main_reset()
     tube_reset();
 }
 
-static const char helptext[] =
-    VERSION_STR " command line options:\n\n"
-    "-mx             - start as model x (see readme.txt for models)\n"
-    "-tx             - start with tube x (see readme.txt for tubes)\n"
-    "-disc disc.ssd  - load disc.ssd into drives :0/:2\n"
-    "-disc1 disc.ssd - load disc.ssd into drives :1/:3\n"
-    "-autoboot       - boot disc in drive :0\n"
-    "-tape tape.uef  - load tape.uef\n"
-    "-fasttape       - set tape speed to fast\n"
-    "-Fx             - set maximum video frames skipped\n"
-    "-s              - scanlines display mode\n"
-    "-i              - interlace display mode\n"
-    "-spx            - Emulation speed x from 0 to 9 (default 4)\n"
-    "-debug          - start debugger\n"
-    "-debugtube      - start debugging tube processor\n"
-    "-exec file      - debugger to execute file\n"
-    "-paste string   - paste string in as if typed\n"
-    "-vroot host-dir - set the VDFS root\n"
-    "-vdir guest-dir - set the initial (boot) dir in VDFS\n"
-    "-fullscreen     - start fullscreen\n\n";
-
-void main_init(int argc, char *argv[])
+void main_init(int argc, char *argv[], const main_frontend_t *fe)
 {
     bool start_fullscreen = false;
-    int tapenext = 0, discnext = 0, execnext = 0, vdfsnext = 0, pastenext = 0;
-    ALLEGRO_DISPLAY *display;
+    int tapenext = 0, discnext = 0, execnext = 0, vdfsnext = 0, pastenext = 0, tapefilenext = 0;
+    int n;
+    const char *tape_file = NULL;
+    ALLEGRO_DISPLAY *display = NULL;
     ALLEGRO_PATH *path;
     const char *ext, *exec_fn = NULL;
     const char *vroot = NULL, *vdir = NULL;
 
+    main_headless = fe->headless;
+
     if (!al_init()) {
         fputs("Failed to initialise Allegro!\n", stderr);
         exit(1);
@@ -174,12 +181,14 @@ void main_init(int argc, char *argv[])
         }
     }
 
-    al_init_native_dialog_addon();
-    al_set_new_window_title(VERSION_STR);
-    al_init_primitives_addon();
-    if (!al_install_keyboard()) {
-        log_fatal("main: unable to install keyboard");
-        exit(1);
+    if (!main_headless) {
+        al_init_native_dialog_addon();
+        al_set_new_window_title(VERSION_STR);
+        al_init_primitives_addon();
+        if (!al_install_keyboard()) {
+            log_fatal("main: unable to install keyboard");
+            exit(1);
+        }
     }
     key_init();
     config_load();
@@ -190,9 +199,11 @@ void main_init(int argc, char *argv[])
 
     for (int c = 1; c < argc; c++) {
         if (!strcasecmp(argv[c], "--help") || !strcmp(argv[c], "-?") || !strcasecmp(argv[c], "-h")) {
-            fwrite(helptext, sizeof helptext - 1, 1, stdout);
-            exit(1);
+            fputs(fe->helptext, stdout);
+            exit(0);
         }
+        else if (fe->option && (n = fe->option(argc, argv, c)))
+            c += n - 1;
         else if (!strncasecmp(argv[c], "-sp", 3)) {
             sscanf(&argv[c][3], "%i", &emuspeed);
             if (!(emuspeed < NUM_EMU_SPEEDS))
@@ -206,10 +217,16 @@ void main_init(int argc, char *argv[])
             discnext = 2;
         else if (argv[c][0] == '-' && (argv[c][1] == 'm' || argv[c][1] == 'M'))
             sscanf(&argv[c][2], "%i", &curmodel);
-        else if (argv[c][0] == '-' && (argv[c][1] == 't' || argv[c][1] == 'T'))
-            sscanf(&argv[c][2], "%i", &curtube);
+        else if (argv[c][0] == '-' && (argv[c][1] == 't' || argv[c][1] == 'T')) {
+            sscanf(&argv[c][2], "%i", &selecttube);
+            curtube = selecttube;
+        }
         else if (!strcasecmp(argv[c], "-fasttape"))
             fasttape = true;
+        else if (!strcasecmp(argv[c], "-instanttape"))
+            tape_instant = true;
+        else if (!strcasecmp(argv[c], "-tapefile"))
+            tapefilenext = 1;
         else if (!strcasecmp(argv[c], "-autoboot"))
             autoboot = 150;
         else if (!strcasecmp(argv[c], "-fullscreen"))
@@ -235,6 +252,12 @@ void main_init(int argc, char *argv[])
             vdfsnext = 2;
         else if (!strcasecmp(argv[c], "-paste"))
             pastenext = 1;
+        else if (!strcasecmp(argv[c], "-portable"))
+            ;
+        else if (tapefilenext) {
+            tape_file = argv[c];
+            tapefilenext = 0;
+        }
         else if (tapenext) {
             if (tape_fn)
                 al_destroy_path(tape_fn);
@@ -262,12 +285,15 @@ void main_init(int argc, char *argv[])
             argv[c] = strreplace(argv[c], "\\n", "\n");
             argv[c] = strreplace(argv[c], "\\r", "\n");
             os_paste_start(strdup(argv[c]));
+            pastenext = 0;
         }
         else {
             path = al_create_path(argv[c]);
             ext = al_get_path_extension(path);
-            if (ext && !strcasecmp(ext, ".snp"))
+            if (ext && !strcasecmp(ext, ".snp")) {
                 savestate_load(argv[c]);
+                al_destroy_path(path);
+            }
             else if (ext && (!strcasecmp(ext, ".uef") || !strcasecmp(ext, ".csw"))) {
                 if (tape_fn)
                     al_destroy_path(tape_fn);
@@ -285,15 +311,24 @@ void main_init(int argc, char *argv[])
         if (tapenext) tapenext--;
     }
 
-    display = video_init();
-    if (start_fullscreen) {
-        fullscreen = 1;
-        video_enterfullscreen();
+    if (main_headless) {
+        /* Nothing to see or hear, so don't let the config ask for it. */
+        vid_ledlocation = LED_LOC_NONE;
+        sound_ddnoise = sound_tape = false;
+        video_init_headless();
+    }
+    else {
+        display = video_init();
+        if (start_fullscreen) {
+            fullscreen = 1;
+            video_enterfullscreen();
+        }
     }
 
     mode7_makechars();
     al_init_image_addon();
-    led_init();
+    if (!main_headless)
+        led_init();
 
     mem_init();
 
@@ -301,28 +336,31 @@ void main_init(int argc, char *argv[])
         log_fatal("main: unable to create event queue");
         exit(1);
     }
-    al_register_event_source(queue, al_get_display_event_source(display));
 
-    if (!al_install_audio()) {
-        log_fatal("main: unable to initialise audio");
-        exit(1);
-    }
-    if (!al_reserve_samples(3)) {
-        log_fatal("main: unable to reserve audio samples");
-        exit(1);
-    }
-    if (!al_init_acodec_addon()) {
-        log_fatal("main: unable to initialise audio codecs");
-        exit(1);
-    }
+    if (!main_headless) {
+        al_register_event_source(queue, al_get_display_event_source(display));
+
+        if (!al_install_audio()) {
+            log_fatal("main: unable to initialise audio");
+            exit(1);
+        }
+        if (!al_reserve_samples(3)) {
+            log_fatal("main: unable to reserve audio samples");
+            exit(1);
+        }
+        if (!al_init_acodec_addon()) {
+            log_fatal("main: unable to initialise audio codecs");
+            exit(1);
+        }
 
-    sound_init();
+        sound_init();
+        music5000_init(queue);
+        ddnoise_init();
+        tapenoise_init(queue);
+    }
     sid_init();
     sid_settype(sidmethod, cursid);
-    music5000_init(queue);
     paula_init();
-    ddnoise_init();
-    tapenoise_init(queue);
 
     adc_init();
     pal_init();
@@ -336,29 +374,32 @@ void main_init(int argc, char *argv[])
 
     model_init();
 
-    midi_init();
+    if (!main_headless)
+        midi_init();
     main_reset();
 
-    joystick_init(queue);
+    oldmodel = curmodel;
 
-    tmp_display = display;
-    gui_allegro_init(queue, display);
+    if (!main_headless) {
+        joystick_init(queue);
 
-    time_limit = 2.0 / 50.0;
-    if (!(timer = al_create_timer(1.0 / 50.0))) {
-        log_fatal("main: unable to create timer");
-        exit(1);
-    }
-    al_register_event_source(queue, al_get_timer_event_source(timer));
-    al_init_user_event_source(&evsrc);
-    al_register_event_source(queue, &evsrc);
+        tmp_display = display;
+        gui_allegro_init(queue, display);
 
-    al_register_event_source(queue, al_get_keyboard_event_source());
+        time_limit = 2.0 / 50.0;
+        if (!(timer = al_create_timer(1.0 / 50.0))) {
+            log_fatal("main: unable to create timer");
+            exit(1);
+        }
+        al_register_event_source(queue, al_get_timer_event_source(timer));
+        al_init_user_event_source(&evsrc);
+        al_register_event_source(queue, &evsrc);
 
-    oldmodel = curmodel;
+        al_register_event_source(queue, al_get_keyboard_event_source());
 
-    al_install_mouse();
-    al_register_event_source(queue, al_get_mouse_event_source());
+        al_install_mouse();
+        al_register_event_source(queue, al_get_mouse_event_source());
+    }
 
     if (mmb_fn)
         mmb_load(mmb_fn);
@@ -366,10 +407,15 @@ void main_init(int argc, char *argv[])
         disc_load(0, discfns[0]);
     disc_load(1, discfns[1]);
     tape_load(tape_fn);
+    if (tape_file && tape_loaded)
+        tape_seek_file(tape_file);
     if (mmccard_fn)
         mmccard_load(mmccard_fn);
     if (defaultwriteprot)
         writeprot[0] = writeprot[1] = 1;
+    if (main_headless)
+        return;
+
     if (discfns[0])
         gui_set_disc_wprot(0, writeprot[0]);
     if (discfns[1])
@@ -409,8 +455,10 @@ void main_start_fullspeed(void)
         log_debug("main: starting full-speed");
         al_stop_timer(timer);
         fullspeed = FSPEED_RUNNING;
-        event.type = ALLEGRO_EVENT_TIMER;
-        al_emit_user_event(&evsrc, &event, NULL);
+        if ((emu_thread_failed || debug_core || debug_tube) && !bempause && !main_paused) {
+            event.type = ALLEGRO_EVENT_TIMER;
+            al_emit_user_event(&evsrc, &event, NULL);
+        }
     }
 }
 
@@ -451,6 +499,14 @@ void main_key_fullspeed(void)
         main_start_fullspeed();
 }
 
+void main_key_fullthrottle(void)
+{
+    if (fullspeed == FSPEED_RUNNING)
+        main_stop_fullspeed(false);
+    else
+        main_start_fullspeed();
+}
+
 void main_key_pause(void)
 {
     if (bempause) {
@@ -495,9 +551,9 @@ void main_quick_save(void)
     cpath = al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP);
     savestate_save(cpath);
     
-    //hud
+    //hud, updated when the save has been written
     if (quick_save_hud != NULL) free(quick_save_hud);
-    prefix = "Saved State: ";
+    prefix = "Saving State: ";
     quick_save_hud = malloc(strlen(prefix) + strlen(filename) + 1);
     strcpy(quick_save_hud, prefix);
     strcat(quick_save_hud, filename);
@@ -576,67 +632,303 @@ void main_quick_slot_next(void)
     quick_save_hud_alpha = 255;
 }
 
+/* Rewind the machine and say how far on the HUD. */
+void main_rewind(int frames)
+{
+    char buf[40];
+    int done = rewind_restore(frames);
+
+    if (done)
+        snprintf(buf, sizeof buf, "Rewound %.1f seconds", (double)done / REWIND_FPS);
+    else
+        snprintf(buf, sizeof buf, "Nothing to rewind");
+    if (quick_save_hud != NULL) free(quick_save_hud);
+    quick_save_hud = strdup(buf);
+    quick_save_hud_alpha = 255;
+}
+
+void main_key_rewind(void)
+{
+    main_rewind(REWIND_FPS);
+}
+
+/* Say on the HUD when a save written in the background is done. */
+static void main_savestate_hud(void)
+{
+    bool ok;
+    const char *name = savestate_poll(&ok);
+
+    if (name) {
+        const char *base = name;
+        for (const char *p = name; *p; p++)
+            if (*p == '/' || *p == '\\')
+                base = p + 1;
+        const char *prefix = ok ? "Saved State: " : "Error saving state: ";
+        if (quick_save_hud != NULL) free(quick_save_hud);
+        quick_save_hud = malloc(strlen(prefix) + strlen(base) + 1);
+        strcpy(quick_save_hud, prefix);
+        strcat(quick_save_hud, base);
+        quick_save_hud_alpha = 255;
+    }
+}
+
 double prev_time = 0;
-int execs = 0;
+volatile int execs = 0;
+static int prev_execs = 0;
 double spd = 0;
 
+static void main_frame(void)
+{
+    if (autoboot)
+        autoboot--;
+    framesrun++;
+
+    if (x65c02)
+        m65c02_exec();
+    else
+        m6502_exec();
+    execs++;
+    rewind_capture();
+    main_savestate_hud();
+
+    if (ddnoise_ticks > 0 && --ddnoise_ticks == 0)
+        ddnoise_headdown();
+
+    if (tapeledcount) {
+        if (--tapeledcount == 0 && !motor) {
+            log_debug("main: delayed cassette motor LED off");
+            led_update(LED_CASSETTE_MOTOR, 0, 0);
+        }
+    }
+    if (led_ticks > 0 && --led_ticks == 0)
+        led_timer_fired();
+}
+
+static void main_savestates(void)
+{
+    if (savestate_wantload)
+        savestate_doload();
+    if (savestate_wantsave)
+        savestate_dosave();
+}
+
+/* Emulated speed, in MHz and as a percentage of a real 2MHz machine. */
+static void main_show_speed(double now)
+{
+    if (now - prev_time > 0.1) {
+        int frames = execs - prev_execs;
+        double speed = frames * 40000 / (now - prev_time);
+
+        if (spd < 0.01)
+            spd = 100.0 * speed / 2000000;
+        else
+            spd = spd * 0.75 + 0.25 * (100.0 * speed / 2000000);
+
+
+        char buf[120];
+        snprintf(buf, 120, "%s %.3fMHz %.1f%%", VERSION_STR, speed / 1000000, spd);
+        al_set_window_title(tmp_display, buf);
+
+        prev_execs += frames;
+        prev_time = now;
+    }
+}
+
 static void main_timer(ALLEGRO_EVENT *event)
 {
     double now = al_get_time();
     double delay = now - event->any.timestamp;
 
     if (delay < time_limit) {
-        if (autoboot)
-            autoboot--;
-        framesrun++;
-
-        if (x65c02)
-            m65c02_exec();
-        else
-            m6502_exec();
-        execs++;
-
-        if (ddnoise_ticks > 0 && --ddnoise_ticks == 0)
-            ddnoise_headdown();
+        main_frame();
+        main_savestates();
+        if (fullspeed == FSPEED_RUNNING && !emu_thread)
+            al_emit_user_event(&evsrc, event, NULL);
+        main_show_speed(now);
+    }
+}
 
-        if (tapeledcount) {
-            if (--tapeledcount == 0 && !motor) {
-                log_debug("main: delayed cassette motor LED off");
-                led_update(LED_CASSETTE_MOTOR, 0, 0);
-            }
+static void *emu_thread_proc(ALLEGRO_THREAD *thread, void *data)
+{
+    log_debug("main: emulation thread started");
+    log_defer_msgbox();
+    al_lock_mutex(emu_mutex);
+    while (!al_get_thread_should_stop(thread)) {
+        if (emu_hold) {
+            while (emu_hold && !al_get_thread_should_stop(thread))
+                al_wait_cond(emu_cond, emu_mutex);
         }
-        if (led_ticks > 0 && --led_ticks == 0)
-            led_timer_fired();
-
-        if (savestate_wantload)
-            savestate_doload();
-        if (savestate_wantsave)
-            savestate_dosave();
-        if (fullspeed == FSPEED_RUNNING)
-            al_emit_user_event(&evsrc, event, NULL);
+        else {
+            emu_in_frame = true;
+            main_frame();
+            emu_in_frame = false;
+        }
+    }
+    al_unlock_mutex(emu_mutex);
+    log_debug("main: emulation thread finished");
+    return NULL;
+}
 
-        if (now - prev_time > 0.1) {
+static void main_emu_start(void)
+{
+    if (!emu_mutex) {
+        if (!(emu_mutex = al_create_mutex()) || !(emu_cond = al_create_cond())) {
+            log_error("main: unable to create emulation thread mutex/condition, running full speed on the main thread");
+            emu_thread_failed = true;
+            return;
+        }
+    }
+    emu_hold = false;
+    if (!(emu_thread = al_create_thread(emu_thread_proc, NULL))) {
+        log_error("main: unable to create emulation thread, running full speed on the main thread");
+        emu_thread_failed = true;
+        return;
+    }
+    al_start_thread(emu_thread);
+}
 
-            double speed = execs * 40000 / (now - prev_time);
+static void main_emu_stop(void)
+{
+    al_lock_mutex(emu_mutex);
+    al_set_thread_should_stop(emu_thread);
+    al_broadcast_cond(emu_cond);
+    al_unlock_mutex(emu_mutex);
+    al_join_thread(emu_thread, NULL);
+    al_destroy_thread(emu_thread);
+    emu_thread = NULL;
+    video_show_frame();
+}
 
-            if (spd < 0.01)
-                spd = 100.0 * speed / 2000000;
-            else
-                spd = spd * 0.75 + 0.25 * (100.0 * speed / 2000000);
+/* Called by video_doblit to find whether the frame has to be passed to
+ * the main thread to be shown.
+ */
+bool main_on_emu_thread(void)
+{
+    return emu_in_frame;
+}
 
+/* Called by video_doblit on the emulation thread when it has left a
+ * frame for video_show_frame.
+ */
+void main_frame_handoff(void)
+{
+    ALLEGRO_EVENT event;
 
-            char buf[120];
-            snprintf(buf, 120, "%s %.3fMHz %.1f%%", VERSION_STR, speed / 1000000, spd);
-            al_set_window_title(tmp_display, buf);
+    event.type = EMU_EVENT_FRAME;
+    al_emit_user_event(&evsrc, &event, NULL);
+}
 
-            execs = 0;
-            prev_time = now;
+/* Start or stop the emulation thread to match what has been asked for.
+ * Debugging runs on the main thread as the debugger expects to be
+ * entered from there.
+ */
+static void main_emu_update(void)
+{
+    bool threaded = !emu_thread_failed && !debug_core && !debug_tube;
+    bool want = fullspeed == FSPEED_RUNNING && !bempause && !main_paused && threaded;
+
+    if (want && !emu_thread)
+        main_emu_start();
+    else if (!want && emu_thread) {
+        main_emu_stop();
+        if (fullspeed == FSPEED_RUNNING && !threaded) {
+            ALLEGRO_EVENT event;
+            event.type = ALLEGRO_EVENT_TIMER;
+            al_emit_user_event(&evsrc, &event, NULL);
         }
     }
 }
 
+static void main_emu_lock(void)
+{
+    if (emu_thread) {
+        emu_hold = true;
+        al_lock_mutex(emu_mutex);
+    }
+}
+
+static void main_emu_unlock(void)
+{
+    if (emu_thread) {
+        emu_hold = false;
+        al_broadcast_cond(emu_cond);
+        al_unlock_mutex(emu_mutex);
+    }
+}
+
 static double last_switch_in = 0.0;
 
+static void main_event(ALLEGRO_EVENT *event)
+{
+    switch(event->type) {
+        case ALLEGRO_EVENT_KEY_DOWN:
+            if (!keydefining)
+                key_down_event(event);
+            break;
+        case ALLEGRO_EVENT_KEY_CHAR:
+            if (!keydefining)
+                key_char_event(event);
+            break;
+        case ALLEGRO_EVENT_KEY_UP:
+            if (!keydefining)
+                key_up_event(event);
+            break;
+        case ALLEGRO_EVENT_MOUSE_AXES:
+            mouse_axes(event);
+            break;
+        case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+            log_debug("main: mouse button down");
+            mouse_btn_down(event);
+            break;
+        case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+            log_debug("main: mouse button up");
+            mouse_btn_up(event);
+            break;
+        case ALLEGRO_EVENT_JOYSTICK_AXIS:
+            joystick_axis(event);
+            break;
+        case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
+            joystick_button_down(event);
+            break;
+        case ALLEGRO_EVENT_JOYSTICK_BUTTON_UP:
+            joystick_button_up(event);
+            break;
+        case ALLEGRO_EVENT_DISPLAY_CLOSE:
+            log_debug("main: event display close - quitting");
+            quitting = true;
+            break;
+        case ALLEGRO_EVENT_TIMER:
+            main_timer(event);
+            break;
+        case EMU_EVENT_FRAME:
+            video_show_frame();
+            break;
+        case ALLEGRO_EVENT_MENU_CLICK:
+            main_pause("menu active");
+            gui_allegro_event(event);
+            main_resume();
+            break;
+        case ALLEGRO_EVENT_AUDIO_STREAM_FRAGMENT:
+            music5000_streamfrag();
+            break;
+        case ALLEGRO_EVENT_DISPLAY_RESIZE:
+            video_update_window_size(event);
+            break;
+        case ALLEGRO_EVENT_DISPLAY_SWITCH_OUT:
+            /* bodge for when OUT events immediately follow an IN event */
+            if ((event->any.timestamp - last_switch_in) > 0.01) {
+                key_lost_focus();
+                if (autopause && !debug_core && !debug_tube)
+                    main_pause("auto-paused");
+            }
+            break;
+        case ALLEGRO_EVENT_DISPLAY_SWITCH_IN:
+            last_switch_in = event->any.timestamp;
+            if (autopause)
+                main_resume();
+    }
+}
+
 void main_run()
 {
     ALLEGRO_EVENT event;
@@ -646,86 +938,50 @@ void main_run()
 
     log_debug("main: entering main loop");
     while (!quitting) {
-        al_wait_for_event(queue, &event);
-        switch(event.type) {
-            case ALLEGRO_EVENT_KEY_DOWN:
-                if (!keydefining)
-                    key_down_event(&event);
-                break;
-            case ALLEGRO_EVENT_KEY_CHAR:
-                if (!keydefining)
-                    key_char_event(&event);
-                break;
-            case ALLEGRO_EVENT_KEY_UP:
-                if (!keydefining)
-                    key_up_event(&event);
-                break;
-            case ALLEGRO_EVENT_MOUSE_AXES:
-                mouse_axes(&event);
-                break;
-            case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
-                log_debug("main: mouse button down");
-                mouse_btn_down(&event);
-                break;
-            case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
-                log_debug("main: mouse button up");
-                mouse_btn_up(&event);
-                break;
-            case ALLEGRO_EVENT_JOYSTICK_AXIS:
-                joystick_axis(&event);
-                break;
-            case ALLEGRO_EVENT_JOYSTICK_BUTTON_DOWN:
-                joystick_button_down(&event);
-                break;
-            case ALLEGRO_EVENT_JOYSTICK_BUTTON_UP:
-                joystick_button_up(&event);
-                break;
-            case ALLEGRO_EVENT_DISPLAY_CLOSE:
-                log_debug("main: event display close - quitting");
-                quitting = true;
-                break;
-            case ALLEGRO_EVENT_TIMER:
-                main_timer(&event);
-                break;
-            case ALLEGRO_EVENT_MENU_CLICK:
-                main_pause("menu active");
-                gui_allegro_event(&event);
-                main_resume();
-                break;
-            case ALLEGRO_EVENT_AUDIO_STREAM_FRAGMENT:
-                music5000_streamfrag();
-                break;
-            case ALLEGRO_EVENT_DISPLAY_RESIZE:
-                video_update_window_size(&event);
-                break;
-            case ALLEGRO_EVENT_DISPLAY_SWITCH_OUT:
-                /* bodge for when OUT events immediately follow an IN event */
-                if ((event.any.timestamp - last_switch_in) > 0.01) {
-                    key_lost_focus();
-                    if (autopause && !debug_core && !debug_tube)
-                        main_pause("auto-paused");
+        main_emu_update();
+        log_show_deferred();
+        if (emu_thread) {
+            if (al_wait_for_event_timed(queue, &event, 0.1)) {
+                /* Frames are shown while the emulation carries on. */
+                if (event.type == EMU_EVENT_FRAME)
+                    video_show_frame();
+                else {
+                    main_emu_lock();
+                    main_event(&event);
+                    main_emu_unlock();
                 }
-                break;
-            case ALLEGRO_EVENT_DISPLAY_SWITCH_IN:
-                last_switch_in = event.any.timestamp;
-                if (autopause)
-                    main_resume();
+            }
+            if (savestate_wantload || savestate_wantsave) {
+                main_emu_lock();
+                main_savestates();
+                main_emu_unlock();
+            }
+            main_show_speed(al_get_time());
+        }
+        else {
+            al_wait_for_event(queue, &event);
+            main_event(&event);
         }
     }
+    if (emu_thread)
+        main_emu_stop();
     log_debug("main: end loop");
 }
 
 void main_close()
 {
-    gui_tapecat_close();
-    gui_keydefine_close();
+    if (!main_headless) {
+        gui_tapecat_close();
+        gui_keydefine_close();
 
-    debug_kill();
+        debug_kill();
 
-    config_save();
+        config_save();
+    }
     cmos_save(&models[curmodel]);
 
-    midi_close();
+    if (!main_headless)
+        midi_close();
     mem_close();
     uef_close();
     csw_close();
@@ -736,16 +992,22 @@ void main_close()
     w65816_close();
     n32016_close();
     mc6809nc_close();
+    tube_68000_close();
     sprow_close();
     disc_close(0);
     disc_close(1);
     scsi_close();
     ide_close();
     vdfs_close();
-    music5000_close();
-    ddnoise_close();
-    tapenoise_close();
+    if (!main_headless) {
+        music5000_close();
+        ddnoise_close();
+        tapenoise_close();
+    }
 
+    savestate_close();
+    rewind_close();
+    pal_close();
     video_close();
     log_close();
 }
@@ -776,15 +1038,20 @@ void main_setspeed(int speed)
 void main_pause(const char *why)
 {
     char buf[120];
-    snprintf(buf, sizeof(buf), "%s (%s)", VERSION_STR, why);
-    al_set_window_title(tmp_display, buf);
-    al_stop_timer(timer);
+    if (tmp_display) {
+        snprintf(buf, sizeof(buf), "%s (%s)", VERSION_STR, why);
+        al_set_window_title(tmp_display, buf);
+    }
+    if (timer)
+        al_stop_timer(timer);
+    main_paused = true;
 }
 
 void main_resume(void)
 {
-    if (emuspeed != EMU_SPEED_PAUSED && emuspeed != EMU_SPEED_FULL)
+    if (timer && emuspeed != EMU_SPEED_PAUSED && emuspeed != EMU_SPEED_FULL)
         al_start_timer(timer);
+    main_paused = false;
 }
 
 void main_setquit(void)
@@ -792,14 +1059,6 @@ void main_setquit(void)
     quitting = 1;
 }
 
-int main(int argc, char **argv)
-{
-    main_init(argc, argv);
-    main_run();
-    main_close();
-    return 0;
-}
-
 char* strreplace(char* s, const char* s1, const char* s2) {
     char* p = strstr(s, s1);
     if (p != NULL) {
@@ -22,7 +22,18 @@ extern bool quitting;
 extern bool keydefining;
 extern bool autopause;
 
-void main_init(int argc, char *argv[]);
+/* What a front end adds to the start up shared by b-em and
+ * b-em-headless.  option is offered each command line argument before
+ * the common ones and returns how many arguments it used, or 0 if the
+ * argument is not one of its own.
+ */
+typedef struct {
+    const char *helptext;
+    bool headless;
+    int (*option)(int argc, char *argv[], int c);
+} main_frontend_t;
+
+void main_init(int argc, char *argv[], const main_frontend_t *fe);
 void main_softreset(void);
 void main_reset(void);
 void main_restart(void);
@@ -34,9 +45,14 @@ void main_setspeed(int speed);
 void main_setquit(void);
 void main_start_fullspeed(void);
 void main_stop_fullspeed(bool hostshift);
+bool main_on_emu_thread(void);
+void main_frame_handoff(void);
 
 void main_key_break(void);
 void main_key_pause(void);
+void main_key_fullthrottle(void);
+void main_key_rewind(void);
+void main_rewind(int frames);
 void main_quick_save(void);
 void main_quick_load(void);
 void main_quick_slot_prev(void);
@@ -9,38 +9,109 @@ static uint8_t *mc68000_ram, *mc68000_rom;
 static bool mc68000_debug_enabled = false;
 static bool rom_low;
 
-static uint8_t readmem(uint32_t addr)
+/*
+ * The 32-bit address space is mapped in 32K pages, the size of the ROM,
+ * so the ROM mirrors in the top 64K each fill a page.  An entry points
+ * to the memory for its page or is NULL for pages that need the slow
+ * path: tube I/O, writes to ROM and, while the ROM is paged in low,
+ * reads with A18 set as these page the ROM out.
+ */
+
+#define MC68000_PAGE_SHIFT 15
+#define MC68000_PAGE_SIZE  (1 << MC68000_PAGE_SHIFT)
+#define MC68000_PAGE_MASK  (MC68000_PAGE_SIZE - 1)
+#define MC68000_NPAGES     (1 << (32 - MC68000_PAGE_SHIFT))
+
+static uint8_t **read_map, **write_map;
+
+static void map_pages(void)
+{
+    for (uint32_t page = 0; page < MC68000_NPAGES; page++) {
+        uint32_t addr = page << MC68000_PAGE_SHIFT;
+        uint32_t top = addr & 0xFFFF0000;
+        uint8_t *rd, *wr;
+        if (top == 0xFFFF0000) {
+            rd = mc68000_rom;
+            wr = NULL;
+        }
+        else if (top == 0xFFFE0000)
+            rd = wr = NULL;
+        else
+            rd = wr = mc68000_ram + (addr % MC68000_RAM_SIZE);
+        if (rom_low) {
+            if (addr & 0x40000)
+                rd = NULL;
+            else if (addr < MC68000_ROM_SIZE)
+                rd = mc68000_rom;
+        }
+        read_map[page] = rd;
+        write_map[page] = wr;
+    }
+}
+
+static void set_rom_low(bool low)
+{
+    if (low != rom_low) {
+        rom_low = low;
+        map_pages();
+    }
+}
+
+static uint8_t readmem_slow(uint32_t addr)
 {
     if (rom_low) {
         if (addr & 0x40000) {
-            rom_low = false;
+            set_rom_low(false);
             log_debug("mc68000: readmem paging out ROM");
         }
-        else if (addr < MC68000_ROM_SIZE) {
-            uint8_t data = mc68000_rom[addr & 0x7FFF];
-            //log_debug("mc68000: read %08X as low ROM -> %02X", addr, data);
-            return data;
-        }
+        else if (addr < MC68000_ROM_SIZE)
+            return mc68000_rom[addr & 0x7FFF];
     }
     uint32_t top = addr & 0xFFFF0000;
-    if (top == 0xFFFF0000) {
-        uint8_t data = mc68000_rom[addr & 0x7FFF];
-        //log_debug("mc68000: read %08X as high ROM -> %02X", addr, data);
-        return data;
-    }
+    if (top == 0xFFFF0000)
+        return mc68000_rom[addr & 0x7FFF];
     else if (top == 0xFFFE0000) {
         uint8_t data = tube_parasite_read(addr);
         //log_debug("mc68000: read %08X as I/O -> %02X (%d cycles left)", addr, data, m68k_cycles_remaining());
         return data;
     }
     else
-    {
-        uint8_t data = mc68000_ram[addr % MC68000_RAM_SIZE];
-        log_debug("mc68000: read %08X as RAM -> %02X", addr, data);
-        return data;
+        return mc68000_ram[addr % MC68000_RAM_SIZE];
+}
+
+static inline uint8_t readmem(uint32_t addr)
+{
+    const uint8_t *page = read_map[addr >> MC68000_PAGE_SHIFT];
+    if (page)
+        return page[addr & MC68000_PAGE_MASK];
+    return readmem_slow(addr);
+}
+
+/* Big-endian reads within a page are done directly, the compiler turns
+ * these into a load and a byte swap.  Accesses that cross a page or
+ * hit a slow page are done a byte at a time.
+ */
+
+static inline uint32_t readmem16(uint32_t addr)
+{
+    const uint8_t *page = read_map[addr >> MC68000_PAGE_SHIFT];
+    uint32_t offset = addr & MC68000_PAGE_MASK;
+    if (page && offset <= MC68000_PAGE_SIZE - 2) {
+        const uint8_t *p = page + offset;
+        return (p[0] << 8) | p[1];
     }
-    log_debug("mc68000: read %08X unmapped", addr);
-    return 0xff;
+    return (readmem(addr) << 8) | readmem(addr+1);
+}
+
+static inline uint32_t readmem32(uint32_t addr)
+{
+    const uint8_t *page = read_map[addr >> MC68000_PAGE_SHIFT];
+    uint32_t offset = addr & MC68000_PAGE_MASK;
+    if (page && offset <= MC68000_PAGE_SIZE - 4) {
+        const uint8_t *p = page + offset;
+        return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+    return ((uint32_t)readmem(addr) << 24) | (readmem(addr+1) << 16) | (readmem(addr+2) << 8) | readmem(addr+3);
 }
 
 unsigned int m68k_read_memory_8(unsigned int address)
@@ -58,7 +129,7 @@ unsigned int m68k_read_disassembler_8(unsigned int address)
 
 unsigned int m68k_read_memory_16(unsigned int address)
 {
-    uint32_t data = (readmem(address) << 8) | readmem(address+1);
+    uint32_t data = readmem16(address);
     if (mc68000_debug_enabled)
         debug_memread(&mc68000_cpu_debug, address, data, 2);
     return data;
@@ -66,12 +137,12 @@ unsigned int m68k_read_memory_16(unsigned int address)
 
 unsigned int m68k_read_disassembler_16(unsigned int address)
 {
-    return (readmem(address) << 8) | readmem(address+1);
+    return readmem16(address);
 }
 
 unsigned int  m68k_read_memory_32(unsigned int address)
 {
-    uint32_t data = (readmem(address) << 24) | (readmem(address+1) << 16) | (readmem(address+2) << 8) | readmem(address+3);
+    uint32_t data = readmem32(address);
     if (mc68000_debug_enabled)
         debug_memread(&mc68000_cpu_debug, address, data, 4);
     return data;
@@ -79,25 +150,29 @@ unsigned int  m68k_read_memory_32(unsigned int address)
 
 unsigned int m68k_read_disassembler_32 (unsigned int address)
 {
-    return (readmem(address) << 24) | (readmem(address+1) << 16) | (readmem(address+2) << 8) | readmem(address+3);
+    return readmem32(address);
+}
+
+static void writemem_slow(uint32_t addr, uint8_t data)
+{
+    uint32_t top = addr & 0xFFFF0000;
+    if (top == 0xFFFE0000) {
+        //log_debug("mc68000: write %09X as I/O <- %02X", addr, data);
+        tube_parasite_write(addr, data);
+    }
+    else if (top == 0xFFFF0000)
+        log_debug("mc68000: write %08X as ROM (ignored) <- %02X", addr, data);
+    else
+        mc68000_ram[addr % MC68000_RAM_SIZE] = data;
 }
 
-static void writemem(uint32_t addr, uint8_t data)
+static inline void writemem(uint32_t addr, uint8_t data)
 {
-  uint32_t top = addr & 0xFFFF0000;
-  if (top == 0xFFFE0000) {
-      //log_debug("mc68000: write %09X as I/O <- %02X", addr, data);
-      tube_parasite_write(addr, data);
-  }
-  else if (top == 0xFFFF0000)
-  {
-      log_debug("mc68000: write %08X as ROM (ignored) <- %02X", addr, data);
-  }
-  else
-  {
-    log_debug("mc68000: write %08X as RAM <- %02X", addr, data);
-    mc68000_ram[addr % MC68000_RAM_SIZE] = data;
-  }
+    uint8_t *page = write_map[addr >> MC68000_PAGE_SHIFT];
+    if (page)
+        page[addr & MC68000_PAGE_MASK] = data;
+    else
+        writemem_slow(addr, data);
 }
 
 void m68k_write_memory_8(unsigned int address, unsigned int value)
@@ -111,18 +186,38 @@ void m68k_write_memory_16(unsigned int address, unsigned int value)
 {
     if (mc68000_debug_enabled)
         debug_memwrite(&mc68000_cpu_debug, address, value, 2);
-    writemem(address, value >> 8);
-    writemem(address+1, value);
+    uint8_t *page = write_map[address >> MC68000_PAGE_SHIFT];
+    uint32_t offset = address & MC68000_PAGE_MASK;
+    if (page && offset <= MC68000_PAGE_SIZE - 2) {
+        uint8_t *p = page + offset;
+        p[0] = value >> 8;
+        p[1] = value;
+    }
+    else {
+        writemem(address, value >> 8);
+        writemem(address+1, value);
+    }
 }
 
 void m68k_write_memory_32(unsigned int address, unsigned int value)
 {
     if (mc68000_debug_enabled)
         debug_memwrite(&mc68000_cpu_debug, address, value, 4);
-    writemem(address, value >> 24);
-    writemem(address+1, value >> 16);
-    writemem(address+2, value >> 8);
-    writemem(address+3, value);
+    uint8_t *page = write_map[address >> MC68000_PAGE_SHIFT];
+    uint32_t offset = address & MC68000_PAGE_MASK;
+    if (page && offset <= MC68000_PAGE_SIZE - 4) {
+        uint8_t *p = page + offset;
+        p[0] = value >> 24;
+        p[1] = value >> 16;
+        p[2] = value >> 8;
+        p[3] = value;
+    }
+    else {
+        writemem(address, value >> 24);
+        writemem(address+1, value >> 16);
+        writemem(address+2, value >> 8);
+        writemem(address+3, value);
+    }
 }
 
 static void mc6809nc_exec(void)
@@ -133,7 +228,7 @@ static void mc6809nc_exec(void)
 
 void tube_68000_rst(void)
 {
-    rom_low = true;
+    set_rom_low(true);
     m68k_pulse_reset();
 }
 
@@ -179,6 +274,14 @@ bool tube_68000_init(void *rom)
         m68k_init();
         m68k_set_cpu_type(M68K_CPU_TYPE_68020);
     }
+    if (!read_map) {
+        read_map = malloc(2 * MC68000_NPAGES * sizeof(uint8_t *));
+        if (!read_map) {
+            log_error("mc68000: unable to allocate memory map: %s", strerror(errno));
+            return false;
+        }
+        write_map = read_map + MC68000_NPAGES;
+    }
     mc68000_rom = rom;
     tube_type = TUBE68000;
     tube_readmem = readmem;
@@ -187,10 +290,23 @@ bool tube_68000_init(void *rom)
     tube_proc_savestate = mc68000_savestate;
     tube_proc_loadstate = mc68000_loadstate;
     rom_low = true;
+    map_pages();
     m68k_pulse_reset();
     return true;
 }
 
+void tube_68000_close(void)
+{
+    if (read_map) {
+        free(read_map);
+        read_map = write_map = NULL;
+    }
+    if (mc68000_ram) {
+        free(mc68000_ram);
+        mc68000_ram = NULL;
+    }
+}
+
 static int dbg_debug_enable(int newvalue)
 {
     int oldvalue = mc68000_debug_enabled;
@@ -8,6 +8,7 @@
 
 extern bool tube_68000_init(void *rom);
 extern void tube_68000_rst(void);
+extern void tube_68000_close(void);
 
 extern cpu_debug_t mc68000_cpu_debug;
 
@@ -77,7 +77,7 @@ TUBE tubes[NUM_TUBES]=
     {"68000",          tube_68000_init, tube_68000_rst,  &mc68000_cpu_debug,   0x8000, "CiscOS",           4 },
 #endif
     {"65816Dossy",     w65816_init_dossy,     w65816_reset,    &tube65816_cpu_debug, 0x8000, "Dossy_816", 16 },
-    {"Sprow ARM",      sprow_init,        sprow_reset,  &tubesprow_cpu_debug,   0x80000, "Sprow_ARM",      4 }
+    {"Sprow ARM",      sprow_init,        sprow_reset,  &tubesprow_cpu_debug,   0x80000, "Sprow_ARM",     64 }
 };
 
 static fdc_type_t model_find_fdc(const char *name, const char *model)
@@ -185,6 +185,8 @@ static void tube_init(void)
     FILE *romf;
 
     if (curtube!=-1) {
+        tube_readblk = tube_readblk_bytes;
+        tube_writeblk = tube_writeblk_bytes;
         if (!tubes[curtube].bootrom[0]) { // no boot ROM needed
             tubes[curtube].init(NULL);
             tube_updatespeed();
@@ -23,6 +23,8 @@ m2000_dev_t m2000_out3;
 static void acia_tx(ACIA *acia, uint8_t data) {
     m2000_dev_t *m2000 = acia->udata;
 
+    if (!m2000->dev)   // no MIDI output, e.g. headless.
+        return;
     if (data & 0x80) {               // status byte
         switch(data >> 4) {
             case 0x8: // note off
@@ -1,4 +1,5 @@
 #include <math.h>
+#include <stddef.h>
 #include "b-em.h"
 
 #include "pal.h"
@@ -207,126 +208,432 @@ void pal_convert(ALLEGRO_BITMAP *inb, int x1, int y1, int x2, int y2, int yoff)
 
 #ifdef PAL_FLOAT
 
-static inline int get_pixel(ALLEGRO_LOCKED_REGION *region, int x, int y)
+/* The frame is split into bands of lines which are converted on a pool
+ * of worker threads.  Each band first runs the two lines before it,
+ * the first to settle the IIR filters and the second to fill the delay
+ * line, so the result matches converting the frame in one go.  As in
+ * the single pass the filters carry on from the end of the last frame
+ * and when only every other line is converted (yoff 2) the delay line
+ * stays empty.  While the workers
+ * convert a frame the display is given the frame converted last time
+ * so the conversion overlaps emulating the next frame.
+ *
+ * Everything except the two IIR filters, which have to be run along the
+ * line one pixel at a time, is done four pixels at a time with SSE2
+ * where the compiler targets it.
+ */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PAL_SSE2
+#endif
+
+#define PAL_MAX_WIDTH   1536
+#define PAL_WT_PERIOD   832
+#define PAL_MAX_THREADS 8
+
+#define WT_INC ((4433618.75 / 16000000.0) * (2 * 3.14))
+
+static float sint[PAL_WT_PERIOD + PAL_MAX_WIDTH], cost[PAL_WT_PERIOD + PAL_MAX_WIDTH];
+static const float pal_zero[PAL_MAX_WIDTH];
+
+/* Filter state carried from one pixel to the next. */
+typedef struct {
+    float vis;              /* vision IIR */
+    float cx[3], cy[3];     /* chroma IIR inputs and outputs */
+    float pu[3], pv[3];     /* the last three demodulated samples */
+} pal_state_t;
+
+/* A conversion: line n of the job is at src + n * src_stride bytes
+ * and goes to dst + n * dst_stride.
+ */
+typedef struct {
+    const char *src;
+    ptrdiff_t  src_stride;
+    char       *dst;
+    ptrdiff_t  dst_stride;
+    int        width;
+    int        lines;
+    int        wt;          /* sub-carrier phase at the start of the first line. */
+    bool       delay;       /* mix in the previous line through the delay line. */
+    pal_state_t carry;      /* filter state at the end of the last frame. */
+} pal_job_t;
+
+static pal_state_t pal_carry;
+
+void pal_init(void)
 {
-    return *((uint32_t *)((char *)region->data + region->pitch * y + x * region->pixel_size));
+        int c;
+        float wt = 0.0;
+        for (c = 0; c < PAL_WT_PERIOD + PAL_MAX_WIDTH; c++)
+        {
+                sint[c] = sin(wt);
+                cost[c] = cos(wt);
+                wt += WT_INC;
+        }
 }
 
-static inline void put_pixel(ALLEGRO_LOCKED_REGION *region, int x, int y, uint32_t colour)
+/* Convert one line.  With unew NULL only the IIR filter state is
+ * updated and with dst NULL only the delay line is filled.
+ */
+static void pal_row(pal_state_t *st, const uint32_t *src, int width, int wt,
+                    const float *uprev, const float *vprev, float *unew, float *vnew,
+                    uint32_t *dst)
 {
-    *((uint32_t *)((char *)region->data + region->pitch * y + x * region->pixel_size)) = colour;
+    float ybuf[PAL_MAX_WIDTH], cbuf[PAL_MAX_WIDTH];
+    float pu[PAL_MAX_WIDTH + 3], pv[PAL_MAX_WIDTH + 3];
+    const float *sn = sint + wt, *cs = cost + wt;
+    int x = 0;
+
+    /* Luma and the modulated chroma. */
+#ifdef PAL_SSE2
+    const __m128i mask = _mm_set1_epi32(0xff);
+    for (; x + 4 <= width; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128 r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 16), mask));
+        __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 8), mask));
+        __m128 b = _mm_cvtepi32_ps(_mm_and_si128(p, mask));
+        __m128 Y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.299f)), _mm_mul_ps(g, _mm_set1_ps(0.587f))), _mm_mul_ps(b, _mm_set1_ps(0.114f)));
+        __m128 U = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(r, _mm_set1_ps(-0.147f)), _mm_mul_ps(g, _mm_set1_ps(0.289f))), _mm_mul_ps(b, _mm_set1_ps(0.436f)));
+        __m128 V = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(r, _mm_set1_ps(0.615f)), _mm_mul_ps(g, _mm_set1_ps(0.515f))), _mm_mul_ps(b, _mm_set1_ps(0.100f)));
+        _mm_storeu_ps(ybuf + x, Y);
+        _mm_storeu_ps(cbuf + x, _mm_add_ps(_mm_mul_ps(U, _mm_loadu_ps(sn + x)), _mm_mul_ps(V, _mm_loadu_ps(cs + x))));
+    }
+#endif
+    for (; x < width; x++) {
+        uint32_t pixel = src[x];
+        float r = (float)((pixel >> 16) & 0xff);
+        float g = (float)((pixel >> 8) & 0xff);
+        float b = (float)(pixel & 0xff);
+        float U = -0.147f * r - 0.289f * g + 0.436f * b;
+        float V =  0.615f * r - 0.515f * g - 0.100f * b;
+        ybuf[x] = 0.299f * r + 0.587f * g + 0.114f * b;
+        cbuf[x] = U * sn[x] + V * cs[x];
+    }
+
+    /* The vision and chroma IIR filters then demodulation. */
+    float vis = st->vis;
+    float cx0 = st->cx[0], cx1 = st->cx[1], cx2 = st->cx[2];
+    float cy0 = st->cy[0], cy1 = st->cy[1], cy2 = st->cy[2];
+    pu[0] = st->pu[0]; pu[1] = st->pu[1]; pu[2] = st->pu[2];
+    pv[0] = st->pv[0]; pv[1] = st->pv[1]; pv[2] = st->pv[2];
+    for (x = 0; x < width; x++) {
+        vis = (vis + ybuf[x]) * 0.5f;
+        cx2 = cx1; cx1 = cx0; cx0 = cbuf[x];
+        cy2 = cy1; cy1 = cy0;
+        cy0 = 0.754226f * cx0 - 0.184815f * cy1 - 0.754226f * cx2 - 0.332316f * cy2;
+        float signal = vis + cy0;
+        ybuf[x] = vis;
+        pu[x + 3] = signal * sn[x];
+        pv[x + 3] = signal * cs[x];
+    }
+    st->vis = vis;
+    st->cx[0] = cx0; st->cx[1] = cx1; st->cx[2] = cx2;
+    st->cy[0] = cy0; st->cy[1] = cy1; st->cy[2] = cy2;
+    st->pu[0] = pu[width]; st->pu[1] = pu[width + 1]; st->pu[2] = pu[width + 2];
+    st->pv[0] = pv[width]; st->pv[1] = pv[width + 1]; st->pv[2] = pv[width + 2];
+    if (!unew)
+        return;
+
+    /* Sum of the last four samples, the delay line and back to RGB. */
+    x = 0;
+#ifdef PAL_SSE2
+    const __m128 zero = _mm_setzero_ps(), max = _mm_set1_ps(255.0f);
+    for (; x + 4 <= width; x += 4) {
+        __m128 U = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(pu + x), _mm_loadu_ps(pu + x + 1)),
+                              _mm_add_ps(_mm_loadu_ps(pu + x + 2), _mm_loadu_ps(pu + x + 3)));
+        __m128 V = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(pv + x), _mm_loadu_ps(pv + x + 1)),
+                              _mm_add_ps(_mm_loadu_ps(pv + x + 2), _mm_loadu_ps(pv + x + 3)));
+        _mm_storeu_ps(unew + x, U);
+        _mm_storeu_ps(vnew + x, V);
+        if (dst) {
+            __m128 Y = _mm_loadu_ps(ybuf + x);
+            U = _mm_add_ps(U, _mm_loadu_ps(uprev + x));
+            V = _mm_add_ps(V, _mm_loadu_ps(vprev + x));
+            __m128 r = _mm_add_ps(Y, _mm_mul_ps(V, _mm_set1_ps(1.140f / 2.0f)));
+            __m128 g = _mm_sub_ps(_mm_sub_ps(Y, _mm_mul_ps(U, _mm_set1_ps(0.396f / 2.0f))), _mm_mul_ps(V, _mm_set1_ps(0.581f / 8.0f)));
+            __m128 b = _mm_add_ps(Y, _mm_mul_ps(U, _mm_set1_ps(2.029f / 2.0f)));
+            __m128i ri = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(r, zero), max));
+            __m128i gi = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(g, zero), max));
+            __m128i bi = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(b, zero), max));
+            __m128i p = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(ri, 16), _mm_slli_epi32(gi, 8)), bi);
+            _mm_storeu_si128((__m128i *)(dst + x), _mm_or_si128(p, _mm_set1_epi32(0xff000000)));
+        }
+    }
+#endif
+    for (; x < width; x++) {
+        float U = pu[x] + pu[x + 1] + pu[x + 2] + pu[x + 3];
+        float V = pv[x] + pv[x + 1] + pv[x + 2] + pv[x + 3];
+        unew[x] = U;
+        vnew[x] = V;
+        if (dst) {
+            float Y = ybuf[x];
+            U += uprev[x];
+            V += vprev[x];
+            float r = Y + (1.140f / 2.0f) * V;
+            float g = Y - (0.396f / 2.0f) * U - (0.581f / 8.0f) * V;
+            float b = Y + (2.029f / 2.0f) * U;
+
+            if (r > 255) r = 255;
+            if (r < 0)   r = 0;
+            if (g > 255) g = 255;
+            if (g < 0)   g = 0;
+            if (b > 255) b = 255;
+            if (b < 0)   b = 0;
+
+            dst[x] = 0xff000000|((uint32_t)r << 16)|((uint32_t)g << 8)|(uint32_t)b;
+        }
+    }
 }
 
-static float vision_iir(float NewSample) {
-    static float x; //input samples
+/* The sub-carrier phase advances by 1024 a line. */
+static inline int pal_wt(const pal_job_t *job, int line)
+{
+    return (job->wt + (long)line * 1024) % PAL_WT_PERIOD;
+}
 
-    x = (x + NewSample) * 0.5;
-//    x = NewSample;
+static inline const uint32_t *pal_src(const pal_job_t *job, int line)
+{
+    return (const uint32_t *)(job->src + job->src_stride * line);
+}
 
-    return x;
+/* Convert lines first to last-1 of a job. */
+static void pal_band(const pal_job_t *job, int first, int last)
+{
+    pal_state_t st;
+    float ubuf[2][PAL_MAX_WIDTH], vbuf[2][PAL_MAX_WIDTH];
+    const float *uprev = pal_zero, *vprev = pal_zero;
+    int cur = 0;
+
+    /* The IIR filters run on from the last frame, the demodulator
+     * starts afresh each frame.
+     */
+    st = job->carry;
+    memset(st.pu, 0, sizeof(st.pu));
+    memset(st.pv, 0, sizeof(st.pv));
+    for (int line = first < 2 ? 0 : first - 2; line < first; line++) {
+        bool fill = line == first - 1;
+        pal_row(&st, pal_src(job, line), job->width, pal_wt(job, line), pal_zero, pal_zero,
+                fill ? ubuf[1] : NULL, fill ? vbuf[1] : NULL, NULL);
+    }
+    if (first >= 1 && job->delay) {
+        uprev = ubuf[1];
+        vprev = vbuf[1];
+    }
+    for (int line = first; line < last; line++) {
+        pal_row(&st, pal_src(job, line), job->width, pal_wt(job, line), uprev, vprev,
+                ubuf[cur], vbuf[cur], (uint32_t *)(job->dst + job->dst_stride * line));
+        if (job->delay) {
+            uprev = ubuf[cur];
+            vprev = vbuf[cur];
+        }
+        cur ^= 1;
+    }
+    if (last == job->lines)
+        pal_carry = st;
 }
 
+/* Worker pool. */
 
-#define NCoef 2
+static ALLEGRO_THREAD *pal_threads[PAL_MAX_THREADS];
+static int pal_nthreads;            /* -1 if there are no workers. */
+static ALLEGRO_MUTEX *pal_mutex;
+static ALLEGRO_COND *pal_work_cond, *pal_done_cond;
+static pal_job_t pal_job;
+static int pal_nbands, pal_next_band, pal_bands_left;
+static bool pal_quit;
 
-static inline float chroma_iir(float NewSample) {
-    static float y[NCoef+1]; //output samples
-    static float x[NCoef+1]; //input samples
+/* Called, and returns, with pal_mutex held. */
+static void pal_run_band(void)
+{
+    int band = pal_next_band++;
+    int first = pal_job.lines * band / pal_nbands;
+    int last = pal_job.lines * (band + 1) / pal_nbands;
+    al_unlock_mutex(pal_mutex);
+    pal_band(&pal_job, first, last);
+    al_lock_mutex(pal_mutex);
+    if (--pal_bands_left == 0)
+        al_broadcast_cond(pal_done_cond);
+}
 
-    x[2] = x[1];
-    x[1] = x[0];
-    x[0] = NewSample;
-    y[2] = y[1];
-    y[1] = y[0];
+static void *pal_worker(ALLEGRO_THREAD *thread, void *arg)
+{
+    al_lock_mutex(pal_mutex);
+    while (!pal_quit) {
+        if (pal_next_band < pal_nbands)
+            pal_run_band();
+        else
+            al_wait_cond(pal_work_cond, pal_mutex);
+    }
+    al_unlock_mutex(pal_mutex);
+    return NULL;
+}
 
+static bool pal_pool_start(void)
+{
+    if (pal_nthreads)
+        return pal_nthreads > 0;
+    pal_nthreads = -1;
+    int count = al_get_cpu_count() - 1;  /* leave one for the emulation. */
+    if (count > PAL_MAX_THREADS)
+        count = PAL_MAX_THREADS;
+    if (count < 1)
+        return false;
+    if (!(pal_mutex = al_create_mutex()) || !(pal_work_cond = al_create_cond()) || !(pal_done_cond = al_create_cond())) {
+        log_warn("pal: unable to create worker synchronisation, converting on one thread");
+        return false;
+    }
+    int n;
+    for (n = 0; n < count; n++) {
+        if (!(pal_threads[n] = al_create_thread(pal_worker, NULL)))
+            break;
+        al_start_thread(pal_threads[n]);
+    }
+    if (n == 0) {
+        log_warn("pal: unable to start worker threads, converting on one thread");
+        return false;
+    }
+    log_debug("pal: started %d worker threads", n);
+    pal_nthreads = n;
+    return true;
+}
 
-    //Calculate the new output
-    y[0]  = 0.754226 * x[0];
-    y[0] -= 0.184815 * y[1];
-    y[0] -= 0.754226 * x[2];
-    y[0] -= 0.332316 * y[2];
+static void pal_wait(void)
+{
+    al_lock_mutex(pal_mutex);
+    while (pal_bands_left)
+        al_wait_cond(pal_done_cond, pal_mutex);
+    al_unlock_mutex(pal_mutex);
+}
 
-    return y[0];
+/* Hand a job to the workers, optionally helping and waiting for it. */
+static void pal_submit(const pal_job_t *job, bool wait)
+{
+    al_lock_mutex(pal_mutex);
+    pal_job = *job;
+    pal_nbands = pal_nthreads + (wait ? 1 : 0);
+    if (pal_nbands > pal_job.lines)
+        pal_nbands = pal_job.lines;
+    pal_next_band = 0;
+    pal_bands_left = pal_nbands;
+    al_broadcast_cond(pal_work_cond);
+    if (wait) {
+        while (pal_next_band < pal_nbands)
+            pal_run_band();
+        while (pal_bands_left)
+            al_wait_cond(pal_done_cond, pal_mutex);
+    }
+    al_unlock_mutex(pal_mutex);
 }
 
-#define WT_INC ((4433618.75 / 16000000.0) * (2 * 3.14))
+void pal_close(void)
+{
+    if (pal_nthreads > 0) {
+        al_lock_mutex(pal_mutex);
+        pal_quit = true;
+        al_broadcast_cond(pal_work_cond);
+        al_unlock_mutex(pal_mutex);
+        for (int n = 0; n < pal_nthreads; n++)
+            al_destroy_thread(pal_threads[n]);
+    }
+    if (pal_done_cond)
+        al_destroy_cond(pal_done_cond);
+    if (pal_work_cond)
+        al_destroy_cond(pal_work_cond);
+    if (pal_mutex)
+        al_destroy_mutex(pal_mutex);
+    pal_done_cond = pal_work_cond = NULL;
+    pal_mutex = NULL;
+    pal_nthreads = 0;
+    pal_quit = false;
+}
 
-static float sint[832*2], cost[832*2];
+/* Frames are copied in and converted out of these buffers when the
+ * conversion overlaps emulation.
+ */
+static uint32_t *pal_in, *pal_out[2];
+static size_t pal_buf_size;
+static int pal_cur;
+static bool pal_out_valid;
+static int pal_out_x, pal_out_y, pal_out_width, pal_out_lines, pal_out_yoff;
 
-void pal_init(void)
+static bool pal_buffers(size_t pixels)
 {
-        int c;
-        float wt = 0.0;
-        for (c = 0; c < 832*2; c++)
-        {
-                sint[c] = sin(wt);
-                cost[c] = cos(wt);
-                wt += WT_INC;
-        }
+    if (pixels > pal_buf_size) {
+        uint32_t *in = realloc(pal_in, pixels * sizeof(uint32_t));
+        if (in)
+            pal_in = in;
+        uint32_t *out0 = realloc(pal_out[0], pixels * sizeof(uint32_t));
+        if (out0)
+            pal_out[0] = out0;
+        uint32_t *out1 = realloc(pal_out[1], pixels * sizeof(uint32_t));
+        if (out1)
+            pal_out[1] = out1;
+        if (!in || !out0 || !out1)
+            return false;
+        pal_buf_size = pixels;
+    }
+    return true;
 }
 
-void pal_convert(int x1, int y1, int x2, int y2, int yoff)
+void pal_convert(const ALLEGRO_LOCKED_REGION *src, int x1, int y1, int x2, int y2, int yoff)
 {
-        int x, y;
-        uint32_t pixel;
-        float r, g, b, Y, U, V, signal;
         static int wt;
-        float u_old[2][1536], v_old[2][1536];
-        float u_filt[4], v_filt[4];
-        float *uo[2], *vo[2];
+        pal_job_t job;
         ALLEGRO_LOCKED_REGION *dr;
 
-        for (x = x1; x < x2; x++)
-            u_old[0][x] = u_old[1][x] = v_old[0][x] = v_old[1][x] = 0.0;
-        for (x = 0; x < 4; x++)
-            u_filt[x] = v_filt[x] = 0.0;
-        dr = al_lock_bitmap(b32, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY);
-        for (y = y1; y < y2; y += yoff)
-        {
-                uo[0] = u_old[y&1];
-                vo[0] = v_old[y&1];
-                uo[1] = u_old[(y&1)^1];
-                vo[1] = v_old[(y&1)^1];
-                for (x = x1; x < x2; x++)
-                {
-                        pixel = get_pixel(region, x, y);
-                        r = (float)((pixel >> 16) & 0xff);
-                        g = (float)((pixel >> 8) & 0xff);
-                        b = (float)(pixel & 0xff);
-                        Y = vision_iir(0.299 * r + 0.587 * g + 0.114 * b);
-                        U = -0.147 * r - 0.289 * g + 0.436 * b;
-                        V = 0.615 * r - 0.515 * g - 0.100 * b;
-
-                        signal = Y + chroma_iir(U * sint[wt] + V * cost[wt]);
-
-                        u_filt[x & 3] = signal * sint[wt];
-                        v_filt[x & 3] = signal * cost[wt];
-                        U = u_filt[0] + u_filt[1] + u_filt[2] + u_filt[3];
-                        V = v_filt[0] + v_filt[1] + v_filt[2] + v_filt[3];
-                        uo[0][x] = U;
-                        vo[0][x] = V;
-                        U += uo[1][x];
-                        V += vo[1][x];
-                        wt++;
-
-                        r = Y + (1.140/2.0) * V;
-                        g = Y - (0.396/2.0) * U - (0.581/8.0) * V;
-                        b = Y + (2.029/2.0) * U;
-
-                        if (r > 255) r = 255;
-                        if (r < 0)   r = 0;
-                        if (g > 255) g = 255;
-                        if (g < 0)   g = 0;
-                        if (b > 255) b = 255;
-                        if (b < 0)   b = 0;
+        if (x2 - x1 > PAL_MAX_WIDTH)
+            x2 = x1 + PAL_MAX_WIDTH;
+        if (x2 <= x1 || y2 <= y1)
+            return;
+        job.width = x2 - x1;
+        job.lines = (y2 - y1 + yoff - 1) / yoff;
+        job.wt = wt;
+        job.delay = yoff == 1;
+        job.carry = pal_carry;
+        wt = pal_wt(&job, job.lines);
+
+        if (!pal_pool_start() || !pal_buffers((size_t)job.width * job.lines)) {
+            /* Convert straight from the frame on this thread. */
+            dr = al_lock_bitmap(b32, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY);
+            job.src = (const char *)src->data + src->pitch * y1 + x1 * sizeof(uint32_t);
+            job.src_stride = src->pitch * yoff;
+            job.dst = (char *)dr->data + dr->pitch * y1 + x1 * sizeof(uint32_t);
+            job.dst_stride = dr->pitch * yoff;
+            pal_band(&job, 0, job.lines);
+            al_unlock_bitmap(b32);
+            return;
+        }
 
-                        put_pixel(dr, x, y, 0xff000000|((uint32_t)r << 16)|((uint32_t)g << 8)|(uint32_t)b);
-                }
+        /* Wait for the last frame, take a copy of this one and start
+         * converting it.  If the last frame was the same shape show
+         * that while this one is converted, otherwise wait for this.
+         */
+        pal_wait();
+        bool show_last = pal_out_valid && pal_out_x == x1 && pal_out_y == y1 &&
+            pal_out_width == job.width && pal_out_lines == job.lines && pal_out_yoff == yoff;
+        for (int line = 0; line < job.lines; line++)
+            memcpy(pal_in + line * job.width, (const char *)src->data + src->pitch * (y1 + line * yoff) + x1 * sizeof(uint32_t),
+                   job.width * sizeof(uint32_t));
+        job.src = (const char *)pal_in;
+        job.src_stride = job.width * sizeof(uint32_t);
+        job.dst = (char *)pal_out[pal_cur];
+        job.dst_stride = job.width * sizeof(uint32_t);
+        pal_submit(&job, !show_last);
+        const uint32_t *out = pal_out[show_last ? pal_cur ^ 1 : pal_cur];
 
-                wt += (1024 - (x2 - x1));
-                wt %= 832;
-        }
+        dr = al_lock_bitmap(b32, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY);
+        for (int line = 0; line < job.lines; line++)
+            memcpy((char *)dr->data + dr->pitch * (y1 + line * yoff) + x1 * sizeof(uint32_t), out + line * job.width,
+                   job.width * sizeof(uint32_t));
         al_unlock_bitmap(b32);
+
+        pal_out_valid = true;
+        pal_out_x = x1;
+        pal_out_y = y1;
+        pal_out_width = job.width;
+        pal_out_lines = job.lines;
+        pal_out_yoff = yoff;
+        pal_cur ^= 1;
 }
 
 #endif
@@ -150,9 +150,10 @@ static void fillbuf2(int& count, int16_t *buf, int len)
         else            memset(buf,0,len*2);
 //        printf("Result %i len %i\n",c,len);
 }
+/* SID is clocked at 1MHz with output at FREQ_SID, 32 cycles per sample. */
 void sid_fillbuf(int16_t *buf, int len)
 {
-        int x=64;
-        
+        int x=len*32;
+
         fillbuf2(x,buf,len);
 }
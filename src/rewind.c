@@ -0,0 +1,332 @@
+/*B-em rewind - see rewind.h
+
+  Each snapshot in the ring holds the state sections other than memory,
+  in the format used by savestate.c, and the memory pages changed since
+  the snapshot before it.  Changed pages are found by comparing memory
+  with a shadow copy taken at the last snapshot and are stored as the
+  XOR of the old and new contents, run-length encoded as they are
+  mostly zero.  Rewinding applies these to the shadow copies, newest
+  first, then copies the shadows back and loads the other sections.
+
+  Snapshots are not taken while a tube processor or JIM expansion RAM is
+  in use as their memory is too large to compare every frame.*/
+
+#include "b-em.h"
+
+#include "6502.h"
+#include "mem.h"
+#include "model.h"
+#include "rewind.h"
+#include "savestate.h"
+
+#define RW_PAGE      256
+#define RW_NREGIONS  2
+#define RW_MAX_BYTES (64 * 1024 * 1024)
+
+int rewind_seconds;
+
+typedef struct {
+    uint8_t *state;     // sections saved by savestate_save_sections.
+    size_t  state_len;
+    uint8_t *delta;     // pages changed since the snapshot before.
+    size_t  delta_len;
+    uint8_t fe30, fe34;
+} rw_entry_t;
+
+static rw_entry_t *rw_ring;
+static int rw_size, rw_head, rw_count, rw_model;
+static size_t rw_bytes;
+static bool rw_failed;
+
+static uint8_t *rw_shadow[RW_NREGIONS];
+static const size_t rw_region_size[RW_NREGIONS] = { RAM_SIZE, ROM_SIZE * ROM_NSLOT };
+
+static uint8_t *rw_scratch;
+static size_t rw_scratch_len, rw_scratch_size;
+
+static FILE *rw_fp;
+
+static uint8_t *rw_region_mem(int region)
+{
+    return region ? rom : ram;
+}
+
+static rw_entry_t *rw_entry(int n)
+{
+    return rw_ring + (rw_head + n) % rw_size;
+}
+
+static void rw_free_entry(rw_entry_t *e)
+{
+    rw_bytes -= e->state_len + e->delta_len;
+    if (e->state)
+        free(e->state);
+    if (e->delta)
+        free(e->delta);
+    memset(e, 0, sizeof(rw_entry_t));
+}
+
+void rewind_clear(void)
+{
+    for (int n = 0; n < rw_count; n++)
+        rw_free_entry(rw_entry(n));
+    rw_head = rw_count = 0;
+    rw_bytes = 0;
+}
+
+void rewind_close(void)
+{
+    rewind_clear();
+    if (rw_ring) {
+        free(rw_ring);
+        rw_ring = NULL;
+    }
+    for (int r = 0; r < RW_NREGIONS; r++) {
+        if (rw_shadow[r]) {
+            free(rw_shadow[r]);
+            rw_shadow[r] = NULL;
+        }
+    }
+    if (rw_scratch) {
+        free(rw_scratch);
+        rw_scratch = NULL;
+        rw_scratch_size = 0;
+    }
+    if (rw_fp) {
+        fclose(rw_fp);
+        rw_fp = NULL;
+    }
+}
+
+static void rw_fail(const char *why)
+{
+    log_error("rewind: %s, rewind disabled", why);
+    rewind_close();
+    rw_failed = true;
+}
+
+static bool rw_open(void)
+{
+    rw_size = rewind_seconds * REWIND_FPS;
+    if (!(rw_ring = calloc(rw_size, sizeof(rw_entry_t)))) {
+        rw_fail("out of memory");
+        return false;
+    }
+    for (int r = 0; r < RW_NREGIONS; r++) {
+        if (!(rw_shadow[r] = malloc(rw_region_size[r]))) {
+            rw_fail("out of memory");
+            return false;
+        }
+    }
+    if (!(rw_fp = savestate_open_stream())) {
+        rw_fail("unable to open a stream for the state");
+        return false;
+    }
+    log_debug("rewind: ring of %d frames", rw_size);
+    return true;
+}
+
+static bool rw_put(const uint8_t *data, size_t len)
+{
+    if (rw_scratch_len + len > rw_scratch_size) {
+        size_t new_size = rw_scratch_size ? rw_scratch_size * 2 : 0x10000;
+        while (new_size < rw_scratch_len + len)
+            new_size *= 2;
+        uint8_t *new_scratch = realloc(rw_scratch, new_size);
+        if (!new_scratch)
+            return false;
+        rw_scratch = new_scratch;
+        rw_scratch_size = new_size;
+    }
+    memcpy(rw_scratch + rw_scratch_len, data, len);
+    rw_scratch_len += len;
+    return true;
+}
+
+/* A changed page is stored as the region, the page number and then
+ * pairs of a count of zero bytes and a count of non-zero bytes of the
+ * XOR of the old and new page, the non-zero bytes following the count,
+ * until the page is covered.
+ */
+static bool rw_encode(int region, size_t page, const uint8_t *old, const uint8_t *cur)
+{
+    uint8_t xbuf[RW_PAGE], hdr[3];
+    int pos = 0;
+
+    for (int i = 0; i < RW_PAGE; i++)
+        xbuf[i] = old[i] ^ cur[i];
+    hdr[0] = region;
+    hdr[1] = page;
+    hdr[2] = page >> 8;
+    if (!rw_put(hdr, sizeof hdr))
+        return false;
+    while (pos < RW_PAGE) {
+        uint8_t counts[2] = { 0, 0 };
+        while (pos < RW_PAGE && counts[0] < 255 && !xbuf[pos]) {
+            counts[0]++;
+            pos++;
+        }
+        int lits = pos;
+        while (pos < RW_PAGE && counts[1] < 255 && xbuf[pos]) {
+            counts[1]++;
+            pos++;
+        }
+        if (!rw_put(counts, 2) || !rw_put(xbuf + lits, counts[1]))
+            return false;
+    }
+    return true;
+}
+
+static void rw_decode(const uint8_t *p, size_t len)
+{
+    const uint8_t *end = p + len;
+
+    while (p < end) {
+        uint8_t *shadow = rw_shadow[p[0]] + (p[1] | (p[2] << 8)) * RW_PAGE;
+        int pos = 0;
+        p += 3;
+        while (pos < RW_PAGE) {
+            pos += *p++;
+            int lits = *p++;
+            while (lits--)
+                shadow[pos++] ^= *p++;
+        }
+    }
+}
+
+static void rw_drop_oldest(void)
+{
+    rw_free_entry(rw_entry(0));
+    rw_head = (rw_head + 1) % rw_size;
+    rw_count--;
+    /* The new oldest is not rewound from so its delta is not needed. */
+    if (rw_count) {
+        rw_entry_t *e = rw_entry(0);
+        if (e->delta) {
+            rw_bytes -= e->delta_len;
+            free(e->delta);
+            e->delta = NULL;
+            e->delta_len = 0;
+        }
+    }
+}
+
+/* Called at the end of each frame. */
+void rewind_capture(void)
+{
+    if (rewind_seconds <= 0 || rw_failed)
+        return;
+    if (curtube != -1 || mem_jim_size != JIM_NONE) {
+        if (rw_count) {
+            log_debug("rewind: not available with a tube processor or JIM RAM");
+            rewind_clear();
+        }
+        return;
+    }
+    if (rw_count && curmodel != rw_model)
+        rewind_clear();
+    if (!rw_ring && !rw_open())
+        return;
+
+    /* Memory pages changed since the last snapshot. */
+    rw_scratch_len = 0;
+    for (int r = 0; r < RW_NREGIONS; r++) {
+        const uint8_t *mem = rw_region_mem(r);
+        if (!rw_count) {
+            memcpy(rw_shadow[r], mem, rw_region_size[r]);
+            continue;
+        }
+        for (size_t page = 0; page < rw_region_size[r] / RW_PAGE; page++) {
+            uint8_t *shadow = rw_shadow[r] + page * RW_PAGE;
+            const uint8_t *cur = mem + page * RW_PAGE;
+            if (memcmp(shadow, cur, RW_PAGE)) {
+                if (!rw_encode(r, page, shadow, cur)) {
+                    rw_fail("out of memory");
+                    return;
+                }
+                memcpy(shadow, cur, RW_PAGE);
+            }
+        }
+    }
+
+    /* Everything else. */
+    fseek(rw_fp, 0, SEEK_SET);
+    savestate_save_sections(rw_fp);
+    long len = ftell(rw_fp);
+    fflush(rw_fp);
+    if (len <= 0 || ferror(rw_fp)) {
+        rw_fail("error saving state");
+        return;
+    }
+
+    uint8_t *state = malloc(len), *delta = NULL;
+    if (!state || (rw_scratch_len && !(delta = malloc(rw_scratch_len)))) {
+        if (state)
+            free(state);
+        rw_fail("out of memory");
+        return;
+    }
+    fseek(rw_fp, 0, SEEK_SET);
+    if (fread(state, len, 1, rw_fp) != 1) {
+        free(state);
+        if (delta)
+            free(delta);
+        rw_fail("error reading back state");
+        return;
+    }
+    if (delta)
+        memcpy(delta, rw_scratch, rw_scratch_len);
+
+    if (rw_count == rw_size)
+        rw_drop_oldest();
+    rw_entry_t *e = rw_entry(rw_count);
+    e->state = state;
+    e->state_len = len;
+    e->delta = delta;
+    e->delta_len = rw_scratch_len;
+    e->fe30 = ram_fe30;
+    e->fe34 = ram_fe34;
+    rw_bytes += e->state_len + e->delta_len;
+    rw_count++;
+    rw_model = curmodel;
+    while (rw_bytes > RW_MAX_BYTES && rw_count > 1)
+        rw_drop_oldest();
+}
+
+/* Frames that can be rewound, not counting the one just captured. */
+int rewind_available(void)
+{
+    return rw_count ? rw_count - 1 : 0;
+}
+
+/* Wind the machine back to the snapshot the given number of frames
+ * before the newest, or the oldest there is, and return how many
+ * frames that was.  The snapshots after it are discarded.
+ */
+int rewind_restore(int frames)
+{
+    if (frames > rewind_available())
+        frames = rewind_available();
+    if (frames <= 0)
+        return 0;
+
+    for (int n = 0; n < frames; n++) {
+        rw_entry_t *e = rw_entry(rw_count - 1);
+        rw_decode(e->delta, e->delta_len);
+        rw_free_entry(e);
+        rw_count--;
+    }
+    for (int r = 0; r < RW_NREGIONS; r++)
+        memcpy(rw_region_mem(r), rw_shadow[r], rw_region_size[r]);
+
+    rw_entry_t *e = rw_entry(rw_count - 1);
+    fseek(rw_fp, 0, SEEK_SET);
+    fwrite(e->state, e->state_len, 1, rw_fp);
+    fflush(rw_fp);
+    fseek(rw_fp, 0, SEEK_SET);
+    savestate_load_sections(rw_fp, e->state_len);
+    writemem(0xFE30, e->fe30);
+    writemem(0xFE34, e->fe34);
+    log_debug("rewind: rewound %d frames, %d left", frames, rewind_available());
+    return frames;
+}
@@ -0,0 +1,20 @@
+#ifndef __INC_REWIND_H
+#define __INC_REWIND_H
+
+/*
+ * Rewind: a ring of in-memory snapshots, one a frame, covering the last
+ * rewind_seconds of emulation, that the machine can be wound back
+ * through.
+ */
+
+#define REWIND_FPS 50
+
+extern int rewind_seconds;
+
+void rewind_capture(void);
+int  rewind_available(void);
+int  rewind_restore(int frames);
+void rewind_clear(void);
+void rewind_close(void);
+
+#endif
@@ -32,9 +32,46 @@ int savestate_wantsave, savestate_wantload;
 char *savestate_name;
 FILE *savestate_fp;
 
+/* Saving is in two halves.  At the end of a frame the state of each
+ * section is copied, uncompressed, into an arena.  A writer thread then
+ * compresses the sections that are compressed in the file and writes
+ * it, so the emulation never waits for zlib or the disc.
+ */
+
+#define SS_MAX_SECTS  24
+#define SS_STREAM_MAX (256 * 1024)
+
+typedef struct {
+    int    key;
+    bool   zlib;
+    size_t off;
+    size_t len;
+} ss_sect_t;
+
+typedef struct {
+    FILE      *fp;
+    char      *name;
+    uint8_t   *arena;
+    size_t    arena_len;
+    size_t    arena_size;
+    ss_sect_t sects[SS_MAX_SECTS];
+    int       nsects;
+    bool      failed;
+} ss_job_t;
+
+static ss_job_t ss_job;
+static FILE *ss_stream;
+static ALLEGRO_THREAD *ss_thread;
+static ALLEGRO_MUTEX *ss_mutex;
+static ALLEGRO_COND *ss_cond;
+static bool ss_thread_failed, ss_busy;
+static int ss_result;       // of the last save not yet reported: 1 ok, -1 failed.
+static bool ss_last_ok = true;
+
 void savestate_save(const char *name)
 {
     log_debug("savestate: save, name=%s", name);
+    savestate_wait();
     if (savestate_fp)
         log_error("savestate: an operation is already in progress");
     else if (curtube != -1 && !tube_proc_savestate)
@@ -68,6 +105,7 @@ void savestate_save(const char *name)
 void savestate_load(const char *name)
 {
     log_debug("savestate: load, name=%s", name);
+    savestate_wait();
     if (savestate_fp)
         log_error("savestate: an operation is already in progress");
     else {
@@ -139,65 +177,349 @@ static void save_sect(FILE *fp, int key, void (*save_func)(FILE *f))
     save_tail(fp, key, start, end, size);
 }
 
-static void save_zlib(FILE *fp, int key, void (*save_func)(ZFILE *zpf))
+/* A stdio stream in memory, where there is such a thing, for the
+ * sections that are saved through stdio.
+ */
+FILE *savestate_open_stream(void)
+{
+#ifdef WIN32
+    return tmpfile();
+#else
+    return fmemopen(NULL, SS_STREAM_MAX, "w+");
+#endif
+}
+
+static bool arena_put(const void *data, size_t len)
+{
+    ss_job_t *job = &ss_job;
+
+    if (job->arena_len + len > job->arena_size) {
+        size_t new_size = job->arena_size ? job->arena_size : 0x40000;
+        while (new_size < job->arena_len + len)
+            new_size *= 2;
+        uint8_t *new_arena = realloc(job->arena, new_size);
+        if (!new_arena) {
+            log_error("savestate: out of memory copying state");
+            job->failed = true;
+            return false;
+        }
+        job->arena = new_arena;
+        job->arena_size = new_size;
+    }
+    memcpy(job->arena + job->arena_len, data, len);
+    job->arena_len += len;
+    return true;
+}
+
+static ss_sect_t *copy_begin(int key, bool zlib)
+{
+    ss_job_t *job = &ss_job;
+
+    if (job->nsects >= SS_MAX_SECTS) {
+        log_error("savestate: too many sections");
+        job->failed = true;
+        return NULL;
+    }
+    ss_sect_t *sect = &job->sects[job->nsects++];
+    sect->key = key;
+    sect->zlib = zlib;
+    sect->off = job->arena_len;
+    sect->len = 0;
+    return sect;
+}
+
+static void copy_sect(int key, void (*save_func)(FILE *f))
+{
+    ss_sect_t *sect = copy_begin(key, false);
+    if (!sect)
+        return;
+    fseek(ss_stream, 0, SEEK_SET);
+    save_func(ss_stream);
+    long len = ftell(ss_stream);
+    fflush(ss_stream);
+    if (len < 0 || ferror(ss_stream)) {
+        log_error("savestate: error saving section %c", key);
+        clearerr(ss_stream);
+        ss_job.failed = true;
+        return;
+    }
+    uint8_t buf[BUFSIZ];
+    fseek(ss_stream, 0, SEEK_SET);
+    for (long left = len; left > 0; ) {
+        size_t chunk = left > BUFSIZ ? BUFSIZ : left;
+        if (fread(buf, chunk, 1, ss_stream) != 1) {
+            log_error("savestate: error copying section %c", key);
+            ss_job.failed = true;
+            return;
+        }
+        if (!arena_put(buf, chunk))
+            return;
+        left -= chunk;
+    }
+    sect->len = len;
+}
+
+static void copy_zlib(int key, void (*save_func)(ZFILE *zpf))
+{
+    ss_sect_t *sect = copy_begin(key, true);
+    if (sect) {
+        save_func(NULL);
+        sect->len = ss_job.arena_len - sect->off;
+    }
+}
+
+/* Sections saved through a ZFILE are copied as they are and only
+ * compressed by the writer.
+ */
+void savestate_zwrite(ZFILE *zfp, void *src, size_t size)
+{
+    arena_put(src, size);
+}
+
+static bool write_sect(FILE *fp, const ss_sect_t *sect, const uint8_t *data)
+{
+    long start = ftell(fp);
+    fseek(fp, 3, SEEK_CUR);
+    if (sect->len && fwrite(data, sect->len, 1, fp) != 1)
+        return false;
+    save_tail(fp, sect->key, start, ftell(fp), sect->len);
+    return true;
+}
+
+static bool write_zlib(FILE *fp, const ss_sect_t *sect, const uint8_t *data)
 {
     const unsigned hsize = 5;
     long start = ftell(fp);
     fseek(fp, hsize, SEEK_CUR);
 
-    ZFILE zfile;
-    zfile.zs.zalloc = Z_NULL;
-    zfile.zs.zfree = Z_NULL;
-    zfile.zs.opaque = Z_NULL;
-    deflateInit(&zfile.zs, Z_DEFAULT_COMPRESSION);
-    zfile.zs.next_out = zfile.buf;
-    zfile.zs.avail_out = BUFSIZ;
-    save_func(&zfile);
+    unsigned char buf[BUFSIZ];
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    deflateInit(&zs, Z_DEFAULT_COMPRESSION);
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = sect->len;
+    zs.next_out = buf;
+    zs.avail_out = BUFSIZ;
     int res;
-    while ((res = deflate(&zfile.zs, Z_FINISH)) == Z_OK) {
-        fwrite(zfile.buf, BUFSIZ, 1, fp);
-        zfile.zs.next_out = zfile.buf;
-        zfile.zs.avail_out = BUFSIZ;
+    while ((res = deflate(&zs, Z_FINISH)) == Z_OK) {
+        fwrite(buf, BUFSIZ, 1, fp);
+        zs.next_out = buf;
+        zs.avail_out = BUFSIZ;
     }
-    if (res == Z_STREAM_END) {
-        if (zfile.zs.avail_out < BUFSIZ)
-            fwrite(zfile.buf, BUFSIZ - zfile.zs.avail_out, 1, fp);
-        log_debug("savestate: section %c saved deflated, %ld bytes into %ld", key, zfile.zs.total_in, zfile.zs.total_out);
-        save_tail(fp, key|0x80, start, start + zfile.zs.total_out + hsize, zfile.zs.total_out);
+    bool ok = res == Z_STREAM_END;
+    if (ok) {
+        if (zs.avail_out < BUFSIZ)
+            fwrite(buf, BUFSIZ - zs.avail_out, 1, fp);
+        log_debug("savestate: section %c saved deflated, %ld bytes into %ld", sect->key, zs.total_in, zs.total_out);
+        save_tail(fp, sect->key|0x80, start, start + zs.total_out + hsize, zs.total_out);
     }
     else {
-        log_error("savestate: compression error in section %c: %d(%s)", key, res, zfile.zs.msg);
+        log_error("savestate: compression error in section %c: %d(%s)", sect->key, res, zs.msg);
         long end = ftell(fp);
-        save_tail(fp, key|0x80, start, end, end - start - hsize);
+        save_tail(fp, sect->key|0x80, start, end, end - start - hsize);
     }
-    deflateEnd(&zfile.zs);
+    deflateEnd(&zs);
+    return ok;
 }
 
-void savestate_zwrite(ZFILE *zfp, void *src, size_t size)
+static bool write_job(ss_job_t *job)
 {
-    int res;
+    FILE *fp = job->fp;
+    bool ok = fwrite("BEMSNAP3", 8, 1, fp) == 1;
+
+    for (int n = 0; n < job->nsects && ok; n++) {
+        const ss_sect_t *sect = &job->sects[n];
+        if (sect->zlib)
+            ok = write_zlib(fp, sect, job->arena + sect->off);
+        else
+            ok = write_sect(fp, sect, job->arena + sect->off);
+    }
+    if (ferror(fp))
+        ok = false;
+    if (fclose(fp))
+        ok = false;
+    job->fp = NULL;
+    if (ok)
+        log_debug("savestate: saved %s", job->name);
+    else
+        log_error("savestate: error writing %s: %s", job->name, strerror(errno));
+    return ok;
+}
 
-    zfp->zs.next_in = src;
-    zfp->zs.avail_in = size;
-    while ((res = deflate(&zfp->zs, Z_NO_FLUSH) == Z_OK)) {
-        if (zfp->zs.avail_out == 0) {
-            fwrite(zfp->buf, BUFSIZ, 1, savestate_fp);
-            zfp->zs.next_out = zfp->buf;
-            zfp->zs.avail_out = BUFSIZ;
+static void *savestate_writer(ALLEGRO_THREAD *thread, void *arg)
+{
+    al_lock_mutex(ss_mutex);
+    while (!al_get_thread_should_stop(thread)) {
+        if (ss_busy) {
+            al_unlock_mutex(ss_mutex);
+            bool ok = write_job(&ss_job);
+            al_lock_mutex(ss_mutex);
+            ss_busy = false;
+            ss_result = ok ? 1 : -1;
+            ss_last_ok = ok;
+            al_broadcast_cond(ss_cond);
         }
-        if (zfp->zs.avail_in == 0)
-            return;
+        else
+            al_wait_cond(ss_cond, ss_mutex);
+    }
+    al_unlock_mutex(ss_mutex);
+    return NULL;
+}
+
+static bool writer_start(void)
+{
+    if (ss_thread)
+        return true;
+    if (ss_thread_failed)
+        return false;
+    if ((ss_mutex || (ss_mutex = al_create_mutex())) && (ss_cond || (ss_cond = al_create_cond()))
+        && (ss_thread = al_create_thread(savestate_writer, NULL))) {
+        al_start_thread(ss_thread);
+        return true;
+    }
+    log_warn("savestate: unable to start writer thread, saving on the emulation thread");
+    ss_thread_failed = true;
+    return false;
+}
+
+/* Wait for a save being written and say whether the last save worked. */
+bool savestate_wait(void)
+{
+    if (ss_mutex) {
+        al_lock_mutex(ss_mutex);
+        while (ss_busy)
+            al_wait_cond(ss_cond, ss_mutex);
+        al_unlock_mutex(ss_mutex);
+    }
+    return ss_last_ok;
+}
+
+/* If a save has finished since the last call return its filename and
+ * whether it worked, otherwise NULL.
+ */
+const char *savestate_poll(bool *ok)
+{
+    int result;
+
+    if (ss_mutex) {
+        al_lock_mutex(ss_mutex);
+        result = ss_result;
+        ss_result = 0;
+        al_unlock_mutex(ss_mutex);
+    }
+    else {
+        result = ss_result;
+        ss_result = 0;
+    }
+    if (!result)
+        return NULL;
+    *ok = result > 0;
+    return ss_job.name;
+}
+
+void savestate_close(void)
+{
+    savestate_wait();
+    if (ss_thread) {
+        al_lock_mutex(ss_mutex);
+        al_set_thread_should_stop(ss_thread);
+        al_broadcast_cond(ss_cond);
+        al_unlock_mutex(ss_mutex);
+        al_destroy_thread(ss_thread);
+        ss_thread = NULL;
+    }
+    if (ss_cond) {
+        al_destroy_cond(ss_cond);
+        ss_cond = NULL;
+    }
+    if (ss_mutex) {
+        al_destroy_mutex(ss_mutex);
+        ss_mutex = NULL;
+    }
+    if (ss_stream) {
+        fclose(ss_stream);
+        ss_stream = NULL;
+    }
+    if (ss_job.arena) {
+        free(ss_job.arena);
+        ss_job.arena = NULL;
+        ss_job.arena_size = 0;
+    }
+    if (ss_job.name) {
+        free(ss_job.name);
+        ss_job.name = NULL;
     }
-    log_warn("savestate: compression error %d (%s)", res, zfp->zs.msg);
 }
 
 void savestate_dosave(void)
 {
-    FILE *fp = savestate_fp;
-    fwrite("BEMSNAP3", 8,1, fp);
-    save_sect(fp, 'm', model_savestate);
+    ss_job_t *job = &ss_job;
+
+    savestate_wait();
+    job->fp = savestate_fp;
+    if (job->name)
+        free(job->name);
+    job->name = strdup(savestate_name);
+    job->arena_len = 0;
+    job->nsects = 0;
+    job->failed = false;
+    savestate_wantsave = 0;
+    savestate_fp = NULL;
+
+    if (!ss_stream && !(ss_stream = savestate_open_stream())) {
+        log_error("savestate: unable to open a stream for the state");
+        job->failed = true;
+    }
+    else {
+        copy_sect('m', model_savestate);
+        copy_sect('6', m6502_savestate);
+        copy_zlib('M', mem_savezlib);
+        copy_sect('S', sysvia_savestate);
+        copy_sect('U', uservia_savestate);
+        copy_sect('V', videoula_savestate);
+        copy_sect('C', crtc_savestate);
+        copy_sect('v', video_savestate);
+        copy_sect('s', sn_savestate);
+        copy_sect('A', adc_savestate);
+        copy_sect('a', sysacia_savestate);
+        copy_sect('r', serial_savestate);
+        copy_sect('F', vdfs_savestate);
+        copy_sect('5', music5000_savestate);
+        copy_sect('p', paula_savestate);
+        copy_zlib('J', mem_jim_savez);
+        if (curtube != -1) {
+            copy_sect('T', tube_ula_savestate);
+            copy_zlib('P', tube_proc_savestate);
+        }
+    }
+    if (job->failed || !job->name) {
+        log_error("savestate: state not saved to %s", savestate_name);
+        fclose(job->fp);
+        remove(savestate_name);
+        job->fp = NULL;
+        ss_last_ok = false;
+        ss_result = -1;
+    }
+    else if (writer_start()) {
+        al_lock_mutex(ss_mutex);
+        ss_busy = true;
+        al_broadcast_cond(ss_cond);
+        al_unlock_mutex(ss_mutex);
+    }
+    else {
+        ss_last_ok = write_job(job);
+        ss_result = ss_last_ok ? 1 : -1;
+    }
+}
+
+/* The sections other than memory and the model, which can be saved and
+ * loaded without a restart, for rewind.
+ */
+void savestate_save_sections(FILE *fp)
+{
     save_sect(fp, '6', m6502_savestate);
-    save_zlib(fp, 'M', mem_savezlib);
     save_sect(fp, 'S', sysvia_savestate);
     save_sect(fp, 'U', uservia_savestate);
     save_sect(fp, 'V', videoula_savestate);
@@ -210,14 +532,13 @@ void savestate_dosave(void)
     save_sect(fp, 'F', vdfs_savestate);
     save_sect(fp, '5', music5000_savestate);
     save_sect(fp, 'p', paula_savestate);
-    save_zlib(fp, 'J', mem_jim_savez);
-    if (curtube != -1) {
-        save_sect(fp, 'T', tube_ula_savestate);
-        save_zlib(fp, 'P', tube_proc_savestate);
-    }
-    fclose(fp);
-    savestate_wantsave = 0;
-    savestate_fp = NULL;
+}
+
+static void load_state_three(FILE *fp, long end);
+
+void savestate_load_sections(FILE *fp, long len)
+{
+    load_state_three(fp, ftell(fp) + len);
 }
 
 static void load_state_one(FILE *fp)
@@ -372,11 +693,11 @@ static void load_state_two(FILE *fp)
     }
 }
 
-static void load_state_three(FILE *fp)
+static void load_state_three(FILE *fp, long end)
 {
     unsigned char hdr[3];
 
-    while (fread(hdr, sizeof hdr, 1, fp) == 1) {
+    while ((end < 0 || ftell(fp) < end) && fread(hdr, sizeof hdr, 1, fp) == 1) {
         int key = hdr[0];
         long size = hdr[1] | (hdr[2] << 8);
         if (key & 0x80) {
@@ -402,7 +723,7 @@ void savestate_doload(void)
             load_state_two(fp);
             break;
         case '3':
-            load_state_three(fp);
+            load_state_three(fp, -1);
             break;
     }
     if (ferror(fp))
@@ -1,6 +1,7 @@
 #ifndef __INC_SAVESTATE_H
 #define __INC_SAVESTATE_H
 
+#include <stdbool.h>
 #include <stdio.h>
 
 typedef struct _sszfile ZFILE;
@@ -12,6 +13,12 @@ void savestate_save(const char *name);
 void savestate_load(const char *name);
 void savestate_dosave(void);
 void savestate_doload(void);
+bool savestate_wait(void);
+const char *savestate_poll(bool *ok);
+void savestate_close(void);
+FILE *savestate_open_stream(void);
+void savestate_save_sections(FILE *f);
+void savestate_load_sections(FILE *f, long len);
 
 void savestate_zread(ZFILE *zfp, void *dest, size_t size);
 void savestate_zwrite(ZFILE *zfp, void *src, size_t size);
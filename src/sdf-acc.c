@@ -19,6 +19,16 @@
 #include "disc.h"
 #include "sdf.h"
 
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define MMB_DISC_SIZE      (200*1024)
 #define MMB_NAME_SIZE      16
 #define MMB_ZONE_DISCS     511
@@ -26,10 +36,35 @@
 #define MMB_ZONE_FULL_SIZE (MMB_ZONE_CAT_SIZE+MMB_NAME_SIZE+MMB_ZONE_DISCS*MMB_DISC_SIZE)
 #define MMB_ZONE_SKIP_SIZE (MMB_ZONE_DISCS*MMB_DISC_SIZE+MMB_NAME_SIZE)
 
+/*
+ * Disc images are mapped into memory where the OS allows it so a track
+ * is just a contiguous run of memory and reading or writing a byte of
+ * a sector is a memory access rather than a stdio call, with seeks
+ * being free.  Written pages are written back by the OS, and pushed
+ * out at spindown.  The FILE stays open for locking, for growing the
+ * image and as the fallback if the mapping can't be made.  An MMB file
+ * has one mapping shared between the drives.
+ */
+struct sdf_map {
+    FILE     *fp;
+    uint8_t  *base;
+    size_t   size;
+    bool     writable;
+    bool     dirty;
+    bool     stdio_used;  // sdf_owseek has handed out the FILE.
+#ifdef WIN32
+    HANDLE   hmap;
+#endif
+};
+
 static FILE *sdf_fp[NUM_DRIVES], *mmb_fp;
+static struct sdf_map drive_maps[NUM_DRIVES], mmb_map;
+static struct sdf_map *sdf_map[NUM_DRIVES];
 static const struct sdf_geometry *geometry[NUM_DRIVES];
 static uint8_t current_track[NUM_DRIVES];
 static off_t mmb_offset[NUM_DRIVES][2];
+static off_t sdf_offset[NUM_DRIVES];     // next byte to be read/written.
+static off_t sdf_sect_end[NUM_DRIVES];   // end of the sector being accessed.
 static unsigned mmb_boot_discs[4];
 static unsigned mmb_cat_size;
 static char *mmb_cat;
@@ -72,14 +107,139 @@ static uint8_t sdf_side;
 static uint8_t sdf_track;
 static uint8_t sdf_sector;
 
+static void map_unmap(struct sdf_map *map)
+{
+    if (map->base) {
+#ifdef WIN32
+        if (map->dirty)
+            FlushViewOfFile(map->base, 0);
+        UnmapViewOfFile(map->base);
+        CloseHandle(map->hmap);
+        map->hmap = NULL;
+#else
+        if (map->dirty)
+            msync(map->base, map->size, MS_ASYNC);
+        munmap(map->base, map->size);
+#endif
+        map->base = NULL;
+    }
+    map->size = 0;
+    map->dirty = false;
+}
+
+/* Map the first 'size' bytes of the file, growing it if need be. */
+static bool map_map(struct sdf_map *map, size_t size)
+{
+    if (size == 0)
+        return false;
+#ifdef WIN32
+    HANDLE fh = (HANDLE)_get_osfhandle(fileno(map->fp));
+    DWORD prot = map->writable ? PAGE_READWRITE : PAGE_READONLY;
+    DWORD access = map->writable ? FILE_MAP_WRITE : FILE_MAP_READ;
+    if (!(map->hmap = CreateFileMapping(fh, NULL, prot, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL)))
+        return false;
+    if (!(map->base = MapViewOfFile(map->hmap, access, 0, 0, size))) {
+        CloseHandle(map->hmap);
+        map->hmap = NULL;
+        return false;
+    }
+#else
+    int fd = fileno(map->fp);
+    struct stat stb;
+    if (fstat(fd, &stb))
+        return false;
+    if (stb.st_size < size && (!map->writable || ftruncate(fd, size)))
+        return false;
+    void *base = mmap(NULL, size, map->writable ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        return false;
+    map->base = base;
+#endif
+    map->size = size;
+    return true;
+}
+
+static void map_open(struct sdf_map *map, FILE *fp, bool writable, const char *fn)
+{
+    map->fp = fp;
+    map->writable = writable;
+    map->dirty = false;
+    map->stdio_used = false;
+    fflush(fp);
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        long size = ftell(fp);
+        if (size > 0 && !map_map(map, size))
+            log_warn("sdf: unable to map %s into memory, using file access", fn);
+    }
+}
+
+static void map_close(struct sdf_map *map)
+{
+    map_unmap(map);
+    map->fp = NULL;
+}
+
+/* Extend a mapped image, for a write beyond the current end of file,
+ * which can happen as image files are often shorter than the geometry
+ * says, stopping after the last sector in use.
+ */
+static bool map_grow(struct sdf_map *map, size_t size)
+{
+    map_unmap(map);
+    if (map_map(map, size))
+        return true;
+    log_warn("sdf: unable to grow the mapping of disc image, using file access");
+    return false;
+}
+
+/* Called before each sector access through the mapping. */
+static void map_sync_stdio(struct sdf_map *map)
+{
+    if (map->stdio_used) {
+        fflush(map->fp);
+        map->stdio_used = false;
+    }
+}
+
+static int sdf_getbyte(int drive)
+{
+    struct sdf_map *map = sdf_map[drive];
+    off_t pos = sdf_offset[drive]++;
+
+    if (map->base)
+        return pos < map->size ? map->base[pos] : EOF;
+    return getc(map->fp);
+}
+
+static void sdf_putbyte(int drive, int b)
+{
+    struct sdf_map *map = sdf_map[drive];
+    off_t pos = sdf_offset[drive]++;
+
+    if (map->base) {
+        if (!map->writable)
+            return;
+        if (pos < map->size || map_grow(map, pos < sdf_sect_end[drive] ? sdf_sect_end[drive] : pos + 1)) {
+            map->base[pos] = b;
+            map->dirty = true;
+            return;
+        }
+        fseek(map->fp, pos, SEEK_SET);
+    }
+    putc(b, map->fp);
+}
+
 static void sdf_close(int drive)
 {
     if (drive < NUM_DRIVES) {
         geometry[drive] = NULL;
         if (sdf_fp[drive]) {
-            if (sdf_fp[drive] != mmb_fp)
+            if (sdf_fp[drive] != mmb_fp) {
+                map_close(sdf_map[drive]);
                 fclose(sdf_fp[drive]);
+            }
             sdf_fp[drive] = NULL;
+            sdf_map[drive] = NULL;
         }
     }
 }
@@ -129,9 +289,15 @@ static bool io_seek(const struct sdf_geometry *geo, uint8_t drive, uint8_t secto
                     return false;
                 }
             }
-            offset += sector * geo->sector_size + mmb_offset[drive][side];
-            log_debug("sdf: drive %u: seeking for side=%u, track=%u, sector=%u to %d bytes\n", drive, side, track, sector, offset);
-            fseek(sdf_fp[drive], offset, SEEK_SET);
+            off_t pos = offset + sector * geo->sector_size + mmb_offset[drive][side];
+            log_debug("sdf: drive %u: seeking for side=%u, track=%u, sector=%u to %ld bytes\n", drive, side, track, sector, (long)pos);
+            sdf_offset[drive] = pos;
+            sdf_sect_end[drive] = pos + geo->sector_size;
+            struct sdf_map *map = sdf_map[drive];
+            if (map->base)
+                map_sync_stdio(map);
+            else
+                fseek(sdf_fp[drive], pos, SEEK_SET);
             return true;
         }
         else
@@ -149,8 +315,22 @@ FILE *sdf_owseek(uint8_t drive, uint8_t sector, uint8_t track, uint8_t side, uin
     if (drive < NUM_DRIVES) {
         if ((geo = geometry[drive])) {
             if (ssize == geo->sector_size) {
-                if (io_seek(geo, drive, sector, track, side))
+                if (io_seek(geo, drive, sector, track, side)) {
+                    struct sdf_map *map = sdf_map[drive];
+                    if (map->base) {
+                        // the caller will use stdio, make sure it sees what is in memory.
+                        if (map->dirty) {
+#ifdef WIN32
+                            FlushViewOfFile(map->base, 0);
+#else
+                            msync(map->base, map->size, MS_SYNC);
+#endif
+                        }
+                        fseek(sdf_fp[drive], sdf_offset[drive], SEEK_SET);
+                        map->stdio_used = true;
+                    }
                     return sdf_fp[drive];
+                }
             }
             else
                 log_debug("sdf: osword seek, sector size %u does not match disk (%u)", ssize, geo->sector_size);
@@ -370,7 +550,7 @@ static void sdf_poll_wrtrack_data(void)
     int b = fdc_getdata(0);
     log_debug("sdf: sdf_poll_wrtrack_data0 byte=%02X, count=%d", b, count);
     if (b != -1) {
-        putc(b, sdf_fp[sdf_drive]);
+        sdf_putbyte(sdf_drive, b);
         if (!--count)
             state = ST_WRTRACK_DATACRC;
     }
@@ -413,7 +593,7 @@ static void sdf_poll()
             break;
 
         case ST_READSECTOR:
-            if ((c = getc(sdf_fp[sdf_drive])) == EOF)
+            if ((c = sdf_getbyte(sdf_drive)) == EOF)
                 c = 0xe5;
             fdc_data(c);
             if (--count == 0) {
@@ -434,7 +614,7 @@ static void sdf_poll()
                 log_warn("sdf: data underrun on write");
                 count++;
             } else {
-                putc(c, sdf_fp[sdf_drive]);
+                sdf_putbyte(sdf_drive, c);
                 if (count == 0) {
                     fdc_finishread(false);
                     state = ST_IDLE;
@@ -509,9 +689,10 @@ static void sdf_poll()
             fdc_getdata(--count == 0);  // discard sector size.
             log_debug("sdf: poll format secsz, count=%d, sector=%d", count, sdf_sector);
             if (sdf_sector < geometry[sdf_drive]->sectors_per_track) {
-                log_debug("sdf: poll format secsz, filling at offset %lu", ftell(sdf_fp[sdf_drive]));
+                log_debug("sdf: poll format secsz, filling at offset %ld", (long)sdf_offset[sdf_drive]);
+                sdf_sect_end[sdf_drive] = sdf_offset[sdf_drive] + geometry[sdf_drive]->sector_size;
                 for (unsigned i = 0; i < geometry[sdf_drive]->sector_size; i++)
-                    putc(0xe5, sdf_fp[sdf_drive]);
+                    sdf_putbyte(sdf_drive, 0xe5);
                 sdf_sector++;
             }
             if (count == 0) {
@@ -596,6 +777,15 @@ static void sdf_spindown(int drive)
     FILE *fp = sdf_fp[drive];
     log_debug("sdf: spindown drive %d", drive);
     if (fp) {
+        struct sdf_map *map = sdf_map[drive];
+        if (map->base && map->dirty) {
+#ifdef WIN32
+            FlushViewOfFile(map->base, 0);
+#else
+            msync(map->base, map->size, MS_ASYNC);
+#endif
+            map->dirty = false;
+        }
         fflush(fp);
 #ifndef WIN32
         sdf_lock(drive, fp, F_UNLCK);
@@ -606,6 +796,12 @@ static void sdf_spindown(int drive)
 static void sdf_mount(int drive, const char *fn, FILE *fp, const struct sdf_geometry *geo)
 {
     sdf_fp[drive] = fp;
+    if (fp == mmb_map.fp)
+        sdf_map[drive] = &mmb_map;
+    else {
+        sdf_map[drive] = &drive_maps[drive];
+        map_open(&drive_maps[drive], fp, !writeprot[drive], fn);
+    }
     log_info("Loaded drive %d with %s, format %s, %s, %d tracks, %s, %d %d byte sectors/track",
              drive, fn, geo->name, sdf_desc_sides(geo), geo->tracks,
              sdf_desc_dens(geo), geo->sectors_per_track, geo->sector_size);
@@ -736,9 +932,14 @@ void mmb_load(char *fn)
     unsigned i = 0;
     for (mmb_ptr = mmb_cat; mmb_ptr < mmb_end; mmb_ptr += 16)
         log_debug("sdf-acc: mmb#%04u=%-12.12s", i++, mmb_ptr);
+    bool remount1 = mmb_fp && sdf_fp[1] == mmb_fp;
     if (mmb_fp) {
+        map_close(&mmb_map);
         fclose(mmb_fp);
-        if (sdf_fp[1] == mmb_fp) {
+    }
+    map_open(&mmb_map, fp, !writeprot[0], fn);
+    if (mmb_fp) {
+        if (remount1) {
             sdf_mount(1, fn, fp, &sdf_geometries.dfs_10s_seq_80t);
             writeprot[1] = writeprot[0];
             mmb_offset[1][0] = mmb_calc_offset(mmb_boot_discs[2]);
@@ -18,6 +18,9 @@
 
 #include "sdf.h"
 
+/* Checked by sdf-geo.c before logging debug messages. */
+unsigned log_options = 0x0000f;
+
 void log_debug(const char *fmt, ...)
 {
     va_list ap;
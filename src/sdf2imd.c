@@ -16,6 +16,9 @@ void log_error(const char *fmt, ...) printflike;
 void log_warn(const char *fmt, ...)  printflike;
 void log_debug(const char *fmt, ...) printflike;
 
+/* Checked by sdf-geo.c before logging debug messages. */
+unsigned log_options = 0x0000f;
+
 void log_error(const char *fmt, ...)
 {
     va_list ap;
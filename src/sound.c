@@ -11,6 +11,11 @@
 #include "music5000.h"
 #include "paula.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SND_SSE2
+#endif
+
 bool sound_internal = false, sound_beebsid = false, sound_dac = false;
 bool sound_ddnoise = false, sound_tape = false;
 bool sound_music5000 = false, sound_filter = false;
@@ -20,106 +25,151 @@ static ALLEGRO_VOICE *voice;
 static ALLEGRO_MIXER *mixer;
 static ALLEGRO_AUDIO_STREAM *stream;
 
-static int sound_pos = 0;
-static int sound_sn_pos = 0;
-
-static short sound_buffer[BUFLEN_SO];
+/*
+ * Sound is produced in blocks.  The scheduler brings sound up to date
+ * before any I/O write, i.e. before any write to a sound chip, so each
+ * call to sound_poll covers a stretch of time with no register changes
+ * and the chips can render it in one go.  The SN76489 runs at FREQ_SO
+ * and BeebSID, Paula and the printer port DAC at a quarter of that,
+ * each into its own buffer.  The two are mixed and filtered when a
+ * fragment is complete.  The quarter rate sources are summed at 32 bits
+ * and the mix is clamped to 16 bits once, so loud sources add up
+ * rather than wrapping.
+ */
 
-static int sound_sn76489_cycles = 0, sound_poll_cycles = 0;
+#define SLOW_RATIO (FREQ_SO / FREQ_SID)
 
-#define NCoef 2
-static float iir(float NewSample) {
-    static const float ACoef[NCoef+1] = {
-        0.9844825527642453,
-        -1.9689651055284907,
-        0.9844825527642453
-    };
+static int sound_pos = 0;       // FREQ_SO samples of this fragment done.
+static int sound_slow_pos = 0;  // FREQ_SID samples of this fragment done.
+static int sound_cycles = 0;
 
-    static const float BCoef[NCoef+1] = {
-        1,
-        -1.9687243044104659,
-        0.9692059066465155
-    };
+static int16_t sound_buffer[BUFLEN_SO];
+static int32_t sound_slow_buffer[BUFLEN_SO / SLOW_RATIO];
 
-    static float y[NCoef+1]; //output samples
-    static float x[NCoef+1]; //input samples
-    int n;
+/* High pass filter: a biquad with its state kept across fragments. */
+static float iir_x1, iir_x2, iir_y1, iir_y2;
 
-    //shift the old samples
-    for(n=NCoef; n>0; n--) {
-       x[n] = x[n-1];
-       y[n] = y[n-1];
+static void iir_block(float *buf, int len)
+{
+    static const float a0 = 0.9844825527642453, a1 = -1.9689651055284907, a2 = 0.9844825527642453;
+    static const float b1 = -1.9687243044104659, b2 = 0.9692059066465155;
+    float x1 = iir_x1, x2 = iir_x2, y1 = iir_y1, y2 = iir_y2;
+
+    for (int c = 0; c < len; c++) {
+        float x0 = buf[c];
+        float y0 = a0 * x0 + a1 * x1 + a2 * x2 - b1 * y1 - b2 * y2;
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+        buf[c] = y0;
     }
+    iir_x1 = x1;
+    iir_x2 = x2;
+    iir_y1 = y1;
+    iir_y2 = y2;
+}
 
-    //Calculate the new output
-    x[0] = NewSample;
-    y[0] = ACoef[0] * x[0];
-    for(n=1; n<=NCoef; n++)
-        y[0] += ACoef[n] * x[n] - BCoef[n] * y[n];
-
-    return y[0];
+/* Mix the SN76489 with the quarter rate sources, each of which applies
+ * to SLOW_RATIO consecutive samples, into the fragment for the stream,
+ * clamping the sum to the 16 bit range.
+ */
+static void sound_mix(float *buf)
+{
+    const float scale = 1.0f / 32767.0f;
+#ifdef SND_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128 vscale = _mm_set1_ps(scale);
+    for (int c = 0; c < BUFLEN_SO; c += 8) {
+        __m128i sn = _mm_loadu_si128((const __m128i *)(sound_buffer + c));
+        __m128i sign = _mm_cmpgt_epi16(zero, sn);
+        __m128i lo = _mm_add_epi32(_mm_unpacklo_epi16(sn, sign), _mm_set1_epi32(sound_slow_buffer[c / SLOW_RATIO]));
+        __m128i hi = _mm_add_epi32(_mm_unpackhi_epi16(sn, sign), _mm_set1_epi32(sound_slow_buffer[c / SLOW_RATIO + 1]));
+        __m128i mix = _mm_packs_epi32(lo, hi);  // saturates to 16 bits.
+        sign = _mm_cmpgt_epi16(zero, mix);
+        _mm_storeu_ps(buf + c, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(mix, sign)), vscale));
+        _mm_storeu_ps(buf + c + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(mix, sign)), vscale));
+    }
+#else
+    for (int c = 0; c < BUFLEN_SO; c++) {
+        int32_t mix = sound_buffer[c] + sound_slow_buffer[c / SLOW_RATIO];
+        if (mix > 32767)
+            mix = 32767;
+        else if (mix < -32768)
+            mix = -32768;
+        buf[c] = mix * scale;
+    }
+#endif
 }
 
-static void sound_poll_all(void)
+static void sound_fragment_done(void)
 {
     float *buf;
-    int c;
 
-    if ((sound_internal || sound_beebsid) && stream) {
-        int16_t temp_buffer[2] = {0};
+    if ((buf = al_get_audio_stream_fragment(stream))) {
+        sound_mix(buf);
+        if (sound_filter)
+            iir_block(buf, BUFLEN_SO);
+        al_set_audio_stream_fragment(stream, buf);
+        al_set_audio_stream_playing(stream, true);
+    } else
+        log_debug("sound: overrun");
+    sound_pos = 0;
+    sound_slow_pos = 0;
+    memset(sound_buffer, 0, sizeof(sound_buffer));
+    memset(sound_slow_buffer, 0, sizeof(sound_slow_buffer));
+}
 
-        if (sound_beebsid)
-            sid_fillbuf(temp_buffer, 2);
-        if (sound_paula)
-            paula_fillbuf(temp_buffer, 2);
-        if (sound_dac) {
-            temp_buffer[0] += (((int)lpt_dac - 0x80) * 32);
-            temp_buffer[1] += (((int)lpt_dac - 0x80) * 32);
-        }
+static void sound_slow_add(int32_t *slow, const int16_t *part, int len)
+{
+    for (int c = 0; c < len; c++)
+        slow[c] += part[c];
+}
 
-        for (c = 0; c < 8/2; c++) {
-            sound_buffer[sound_pos + c] += temp_buffer[0];
-            sound_buffer[sound_pos + c + 4] += temp_buffer[1];
+/* Render 'len' samples, which must not go past the end of the fragment. */
+static void sound_render(int len)
+{
+    if (sound_internal)
+        sn_fillbuf(sound_buffer + sound_pos, len);
+    sound_pos += len;
+
+    int slow_len = sound_pos / SLOW_RATIO - sound_slow_pos;
+    if (slow_len > 0) {
+        int32_t *slow = sound_slow_buffer + sound_slow_pos;
+        int16_t part[BUFLEN_SO / SLOW_RATIO];
+        if (sound_beebsid) {
+            sid_fillbuf(part, slow_len);
+            sound_slow_add(slow, part, slow_len);
         }
-        // skip forward 8 mono samples
-        sound_pos += 8;
-        if (sound_pos == BUFLEN_SO) {
-            if ((buf = al_get_audio_stream_fragment(stream))) {
-                if (sound_filter) {
-                    for (c = 0; c < BUFLEN_SO; c++)
-                        buf[c] = iir((float)sound_buffer[c] / 32767.0);
-                } else {
-                    for (c = 0; c < BUFLEN_SO; c++)
-                        buf[c] = (float)sound_buffer[c] / 32767.0;
-                }
-                al_set_audio_stream_fragment(stream, buf);
-                al_set_audio_stream_playing(stream, true);
-            } else
-                log_debug("sound: overrun");
-            sound_pos = 0;
-            sound_sn_pos = 0;
-            memset(sound_buffer, 0, sizeof(sound_buffer));
+        if (sound_paula) {
+            memset(part, 0, slow_len * sizeof(int16_t));
+            paula_fillbuf(part, slow_len);
+            sound_slow_add(slow, part, slow_len);
         }
+        if (sound_dac) {
+            int dac = ((int)lpt_dac - 0x80) * 32;
+            for (int c = 0; c < slow_len; c++)
+                slow[c] += dac;
+        }
+        sound_slow_pos += slow_len;
     }
+    if (sound_pos == BUFLEN_SO)
+        sound_fragment_done();
 }
 
 void sound_poll(int cycles)
 {
-    sound_sn76489_cycles -= cycles;
-    if (sound_sn76489_cycles < 0)
-    {
-        sound_sn76489_cycles += 16;
-
-        if (sound_internal)
-            sn_fillbuf(&sound_buffer[sound_sn_pos], 1);
+    sound_cycles += cycles;
+    int len = sound_cycles >> 4;
+    sound_cycles &= 15;
 
-        sound_sn_pos++;
-
-        sound_poll_cycles -= 16;
-        if (sound_poll_cycles < 0)
-        {
-            sound_poll_cycles += 128;
-            sound_poll_all();
+    if ((sound_internal || sound_beebsid) && stream) {
+        while (len > 0) {
+            int chunk = BUFLEN_SO - sound_pos;
+            if (chunk > len)
+                chunk = len;
+            sound_render(chunk);
+            len -= chunk;
         }
     }
 }
@@ -202,7 +202,11 @@ bool sprow_init(void *rom)
   m_State = ARMul_NewState();
   m_State->ROMDataPtr = m_ROMMemory;
 
-  ARMul_MemoryInit(m_State, 0x4000000);
+  if (!ARMul_MemoryInit(m_State, 0x4000000))
+  {
+    log_error("sprow: unable to allocate memory: %s", strerror(errno));
+    return false;
+  }
   m_CycleCount = 0;
 
   tube_type = TUBESPROW;
@@ -409,8 +413,17 @@ cpu_debug_t tubesprow_cpu_debug = {
    .parse_addr     = debug_parse_addr
 };
 
+/*
+ * The ARMulator counts the S (sequential), N (non-sequential), I
+ * (internal) and C (coprocessor) cycles each instruction uses, following
+ * the ARM7TDMI instruction cycle timings, so an instruction takes the
+ * total of these in clock cycles.  Memory wait states are not modelled.
+ */
+
 void sprow_exec()
 {
+  unsigned long last = ARMul_Time(m_State);
+
   while (tubecycles > 0)
   {
     if (sprow_debug_enabled)
@@ -422,27 +435,82 @@ void sprow_exec()
     m_State->NirqSig = HIGH;
     m_State->NfiqSig = HIGH;
 
-      // TODO: This is not accurate, it assumes instructions take 3 cycles each,
-      // on average. More info at:
-      // https://developer.arm.com/documentation/ddi0210/c/Instruction-Cycle-Timings
-
-      tubecycles -= 3;
+    unsigned long now = ARMul_Time(m_State);
+    tubecycles -= now - last;
+    last = now;
   }
 }
 
 /***************************************************************************\
-*        Get a Word from Virtual Memory, maybe allocating the page          *
+*                              Memory map                                   *
 \***************************************************************************/
 
-static ARMword
-GetWord (ARMul_State * state, ARMword address, int check)
+/*
+ * The 32-bit address space is mapped in 64K pages.  An entry points to
+ * the memory for its page or is NULL for pages that need the slow path:
+ * the hardware registers, the tube, writes to ROM and unmapped space.
+ * The map is rebuilt when the ROM is remapped, which is rare, and the
+ * RAM mirror offsets are worked out then rather than on each access.
+ *
+ * So remapControlRegister and romSelectRegister must only change by
+ * way of PutWordSlow, which rebuilds the map, or before the map first
+ * exists.  ARMul_Reset sets them directly but only runs from
+ * ARMul_NewState, ahead of ARMul_MemoryInit building the map, and
+ * sprow_reset writes them through ARMul_WriteWord.
+ */
+
+#define SPROW_PAGE_SHIFT 16
+#define SPROW_PAGE_SIZE  (1 << SPROW_PAGE_SHIFT)
+#define SPROW_PAGE_MASK  (SPROW_PAGE_SIZE - 1)
+#define SPROW_NPAGES     (1 << (32 - SPROW_PAGE_SHIFT))
+#define SPROW_ROM_SIZE   0x80000
+
+static unsigned char **read_map, **write_map;
+
+static void map_pages(ARMul_State *state)
 {
-    unsigned char *offset_address;
-    unsigned char *base_address;
+    // If the ROM has been selected to appear at 0x00000000 then
+    // we need to ensure that accesses go to the ROM
+    int rom_low = (state->romSelectRegister & 1) && !(state->remapControlRegister & 8);
 
-    // All fetches are word-aligned, caller rearranges bytes as needed
-    address &= ~(ARMword)3;
+    for (ARMword page = 0; page < SPROW_NPAGES; page++)
+    {
+        ARMword address = page << SPROW_PAGE_SHIFT;
+        unsigned char *rd, *wr;
+
+        if (address < state->MemSize) // RAM
+        {
+            if (rom_low)
+            {
+                rd = state->ROMDataPtr + (address & (SPROW_ROM_SIZE - 1));
+                wr = NULL;
+            }
+            else
+                rd = wr = state->MemDataPtr + address;
+        }
+        else if (address >= 0xC8000000 && address < 0xC8000000 + SPROW_ROM_SIZE) // Always ROM
+        {
+            rd = state->ROMDataPtr + (address - 0xC8000000);
+            wr = NULL;
+        }
+        else if (address >= 0xC0000000 && address < 0xD0000000)
+        {
+            rd = state->MemDataPtr + ((address - 0xC0000000) % state->MemSize);
+            wr = (address < 0xC8000000) ? rd : NULL;
+        }
+        else
+            rd = wr = NULL;
+        read_map[page] = rd;
+        write_map[page] = wr;
+    }
+}
 
+/***************************************************************************\
+*        Get a Word from Virtual Memory, maybe allocating the page          *
+\***************************************************************************/
+
+static ARMword GetWordSlow(ARMul_State * state, ARMword address)
+{
     // Hardware Registers..
     if (address >= 0x78000000 && address < 0xc0000000)
     {
@@ -454,39 +522,20 @@ GetWord (ARMul_State * state, ARMword address, int check)
         return 0xFF;
     }
 
-    // If the ROM has been selected to appear at 0x00000000 then
-    // we need to ensure that accesses go to the ROM
-    if (state->romSelectRegister & 1 && ((state->remapControlRegister & 8) == 0))
-    {
-        base_address = state->ROMDataPtr;
-    }
-    else
-    {
-        base_address = state->MemDataPtr;
-    }
+    // Where are we??
+    return 0;
+}
 
-    if (address <= state->MemSize) // RAM
-    {
-        offset_address = (base_address + address);
-    }
-    else if (address >= 0xC8000000 && address <= 0xC8080000) // Always ROM
-    {
-        address = address - 0xC8000000;
-        offset_address = (state->ROMDataPtr + address);
-    }
-    else if (address >= 0xC0000000 && address < 0xD0000000)
-    {
-        unsigned int wrapaddress = address - 0xC0000000;
-        offset_address = state->MemDataPtr + (wrapaddress % (unsigned int)state->MemSize);
-    }
-    else
-    {
-        // Where are we??
-        return 0;
-    }
+static inline ARMword
+GetWord (ARMul_State * state, ARMword address, int check)
+{
+    // All fetches are word-aligned, caller rearranges bytes as needed
+    address &= ~(ARMword)3;
 
-    ARMword *actual_address = (ARMword*)offset_address;
-    return actual_address[0];
+    const unsigned char *page = read_map[address >> SPROW_PAGE_SHIFT];
+    if (page)
+        return *(const ARMword *)(page + (address & SPROW_PAGE_MASK));
+    return GetWordSlow(state, address);
 }
 
 static void PutRegister(ARMul_State * state, ARMword registerNumber, ARMword data)
@@ -534,8 +583,7 @@ static void PutRegister(ARMul_State * state, ARMword registerNumber, ARMword dat
 *        Put a Word into Virtual Memory, maybe allocating the page          *
 \***************************************************************************/
 
-static void
-PutWord (ARMul_State * state, ARMword address, ARMword data, int check)
+static void PutWordSlow(ARMul_State * state, ARMword address, ARMword data)
 {
     /*
     0xB7000004 Block clock control register BCKCTL R/W 16 0x0000
@@ -544,9 +592,6 @@ PutWord (ARMul_State * state, ARMword address, ARMword data, int check)
     0xB800000C Clock wait register CKWT R/W 32 0x000000FF
     */
 
-    // All stores are word-aligned and unrotated
-    address &= ~(ARMword)3;
-
     if (address >= 0xF0000000 && address <= 0xF0000010)
     {
         return;
@@ -555,68 +600,32 @@ PutWord (ARMul_State * state, ARMword address, ARMword data, int check)
     if (address == RMPCON) // Remap control register
     {
         state->remapControlRegister = data;
+        map_pages(state);
     }
     else if (address == ROMSEL) //ROM select register
     {
         state->romSelectRegister = data;
+        map_pages(state);
     }
     else if (address >= 0x78000000 && address < 0xc0000000)
     {
         PutRegister(state, address, data);
     }
-    else
-    {
-        unsigned char *base_address;
-        unsigned char *offset_address;
-        ARMword *actual_address;
 
-             // If the ROM has been selected to appear at 0x00000000 then
-        // we need to ensure that accesses go to the ROM
-        if (state->romSelectRegister & 1 && ((state->remapControlRegister & 8) == 0))
-        {
-            base_address = state->ROMDataPtr;
-        }
-        else
-        {
-            base_address = state->MemDataPtr;
-        }
+    // Anything else is ROM or unmapped so the write is ignored.
+}
 
-        if (address <= state->MemSize) // RAM
-        {
-            if (state->romSelectRegister & 1 && ((state->remapControlRegister & 8) == 0)) // we're trying to write to ROM - NOPE!
-            {
-                return;
-            }
-            else
-            {
-                offset_address = (base_address + address);
-
-                if (address == 0x8)
-                {
-                    SWI_vector_installed = TRUE;
-                }
-
-                /* if (address <= 0x1c)
-                {
-                    int a= 0;
-                    // WHAT!?
-                } */
-            }
-        }
-        else if (address >= 0xC0000000 && address < 0xC8000000)
-        {
-            unsigned int wrapaddress = address - 0xC0000000;
-            offset_address = state->MemDataPtr + (wrapaddress % (unsigned int)state->MemSize);
-        }
-        else
-        {
-            // int a = 0; // where are we??
-            return;
-        }
+static inline void
+PutWord (ARMul_State * state, ARMword address, ARMword data, int check)
+{
+    // All stores are word-aligned and unrotated
+    address &= ~(ARMword)3;
 
-        actual_address = (ARMword*)offset_address;
-        actual_address[0] = data;
-    }
+    unsigned char *page = write_map[address >> SPROW_PAGE_SHIFT];
+    if (page)
+        *(ARMword *)(page + (address & SPROW_PAGE_MASK)) = data;
+    else
+        PutWordSlow(state, address, data);
 }
 
 /***************************************************************************\
@@ -636,6 +645,15 @@ ARMul_MemoryInit (ARMul_State * state, unsigned long initmemsize)
 
     state->MemDataPtr = memory;
 
+    if (!read_map)
+    {
+        read_map = malloc(2 * SPROW_NPAGES * sizeof(unsigned char *));
+        if (!read_map)
+            return FALSE;
+        write_map = read_map + SPROW_NPAGES;
+    }
+    map_pages(state);
+
     return TRUE;
 }
 
@@ -649,6 +667,11 @@ ARMul_MemoryExit (ARMul_State * state)
     unsigned char* memory = state->MemDataPtr;
 
     free(memory);
+    if (read_map)
+    {
+        free(read_map);
+        read_map = write_map = NULL;
+    }
 }
 
 /***************************************************************************\
@@ -5,11 +5,15 @@
 #include "tapenoise.h"
 #include "uef.h"
 #include "csw.h"
+#include "sysacia.h"
+#include "tapeidx.h"
 
 int tapelcount,tapellatch,tapeledcount;
 
 bool tape_loaded = false;
 bool fasttape = false;
+bool tape_instant = false;
+bool tape_instant_active = false;
 ALLEGRO_PATH *tape_fn = NULL;
 
 static struct
@@ -39,12 +43,16 @@ void tape_load(ALLEGRO_PATH *fn)
             p++;
         cpath = al_path_cstr(fn, ALLEGRO_NATIVE_PATH_SEP);
         log_info("tape: Loading %s %s", cpath, p);
+        tape_instant_active = false;
         while (loaders[c].ext)
         {
                 if (!strcasecmp(p, loaders[c].ext))
                 {
                         tape_loader = c;
                         loaders[c].load(cpath);
+                        if (tape_instant && tape_index.other)
+                            log_warn("tape: %lu bytes of %s are not in standard blocks and will be skipped by instant load",
+                                     (unsigned long)tape_index.other, cpath);
                         return;
                 }
                 c++;
@@ -56,9 +64,94 @@ void tape_close()
 {
         if (tape_loaded && tape_loader < 2)
            loaders[tape_loader].close();
+        tapeidx_free();
+        tape_instant_active = false;
         tape_loaded = 0;
 }
 
+/*
+ * Instant load.  Rather than the tape being played in real time the
+ * blocks found by the index are given to the ACIA as fast as the OS
+ * takes the bytes, with just enough carrier tone between blocks for
+ * the OS to finish with one block before the next arrives.  The OS
+ * still reads and checks the blocks itself so this works with any MOS
+ * and with loaders which read standard blocks through the ACIA.
+ */
+
+#define TAPE_INSTANT_TONE 256   /* polls (128 cycles each) of tone before a block. */
+
+static size_t   instant_blk;
+static uint32_t instant_pos;
+static int      instant_tone;
+
+static void tape_instant_start(void)
+{
+        instant_blk  = tapeidx_find(csw_ena ? csw_tell() : uef_tell());
+        instant_pos  = 0;
+        instant_tone = TAPE_INSTANT_TONE;
+        tape_instant_active = true;
+}
+
+/* Leave the real tape at the block instant load had got to. */
+static void tape_instant_stop(void)
+{
+        if (instant_blk < tape_index.nblocks)
+        {
+                uint32_t pos = tape_index.blocks[instant_blk].pos;
+                if (csw_ena) csw_seek(pos);
+                else         uef_seek(pos);
+        }
+        tape_instant_active = false;
+}
+
+/* Position the tape at the start of a named file. */
+bool tape_seek_file(const char *name)
+{
+        size_t blk = tapeidx_find_file(name);
+
+        if (blk >= tape_index.nblocks)
+        {
+                log_error("tape: file %s not found on tape", name);
+                return false;
+        }
+        log_debug("tape: seeking to file %s at %u", name, tape_index.blocks[blk].pos);
+        if (csw_ena) csw_seek(tape_index.blocks[blk].pos);
+        else         uef_seek(tape_index.blocks[blk].pos);
+        if (tape_instant_active)
+        {
+                instant_blk  = blk;
+                instant_pos  = 0;
+                instant_tone = TAPE_INSTANT_TONE;
+        }
+        return true;
+}
+
+static void tape_instant_poll(void)
+{
+        const tape_block_t *blk;
+
+        if (instant_blk >= tape_index.nblocks)
+                return;
+        if (instant_tone)
+        {
+                if (instant_tone == TAPE_INSTANT_TONE)
+                        acia_dcdhigh(&sysacia);
+                if (--instant_tone == 0)
+                        acia_dcdlow(&sysacia);
+                return;
+        }
+        if (acia_rx_full(&sysacia))
+                return;
+        blk = &tape_index.blocks[instant_blk];
+        acia_receive(&sysacia, tape_index.data[blk->offset + instant_pos]);
+        if (++instant_pos >= blk->size)
+        {
+                instant_blk++;
+                instant_pos  = 0;
+                instant_tone = TAPE_INSTANT_TONE;
+        }
+}
+
 /*Every 128 clocks, ie 15.625khz*/
 /*Div by 13 gives roughly 1200hz*/
 
@@ -66,6 +159,14 @@ static uint16_t newdat;
 
 void tape_poll(void) {
     if (motor) {
+        if (tape_instant && tape_index.nblocks) {
+            if (!tape_instant_active)
+                tape_instant_start();
+            tape_instant_poll();
+            return;
+        }
+        if (tape_instant_active)
+            tape_instant_stop();
         if (csw_ena) csw_poll();
         else         uef_poll();
 
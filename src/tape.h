@@ -8,10 +8,12 @@ extern bool tape_loaded;
 
 void tape_load(ALLEGRO_PATH *fn);
 void tape_close(void);
+bool tape_seek_file(const char *name);
 void tape_poll(void);
 void tape_receive(ACIA *acia, uint8_t data);
 
 extern int tapelcount,tapellatch,tapeledcount;
 extern bool fasttape;
+extern bool tape_instant, tape_instant_active;
 
 #endif
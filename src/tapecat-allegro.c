@@ -1,8 +1,7 @@
 #include "b-em.h"
 #include <allegro5/allegro_native_dialog.h>
 #include "tapecat-allegro.h"
-#include "csw.h"
-#include "uef.h"
+#include "tapeidx.h"
 
 static ALLEGRO_TEXTLOG *textlog;
 ALLEGRO_EVENT_SOURCE uevsrc;
@@ -35,10 +34,22 @@ static void *tapecat_thread(ALLEGRO_THREAD *thread, void *tdata)
 
 static void start_cat(void)
 {
-    if (csw_ena)
-        csw_findfilenames();
-    else
-        uef_findfilenames();
+    char s[256];
+    unsigned fsize = 0;
+    bool crc_ok = true;
+
+    for (size_t i = 0; i < tape_index.nblocks; i++) {
+        const tape_block_t *blk = &tape_index.blocks[i];
+        fsize += blk->len;
+        crc_ok &= blk->crc_ok;
+        if (blk->flag & 0x80) {
+            snprintf(s, sizeof s, "%-13s Size %04X Load %08X Run %08X%s", blk->name, fsize,
+                     blk->load, blk->exec, crc_ok ? "" : " (bad CRC)");
+            cataddname(s);
+            fsize = 0;
+            crc_ok = true;
+        }
+    }
 }
 
 void gui_tapecat_start(void)
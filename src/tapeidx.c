@@ -0,0 +1,368 @@
+/*B-em tape block index - see tapeidx.h
+
+  The tape decoders (uef.c, csw.c) run over the whole tape once when it
+  is loaded and pass each byte decoded here, where the blocks written
+  by the OS tape filing system are picked out.  A block is a sync byte
+  of &2A after carrier tone then a header of the filename, terminated
+  by a zero, load and exec addresses, block number, data length, flag,
+  address of the next file and a CRC followed, if the length is not
+  zero, by the data and its CRC.
+
+  The index is saved to a cache file named from the CRC32 and length
+  of the tape image so opening a tape seen before needs only that file
+  and a read through the image to hash it.*/
+
+#include "b-em.h"
+#include <zlib.h>
+#include "tapeidx.h"
+
+#define TAPE_SYNC     0x2a
+#define TAPE_NAME_MAX 10
+#define TAPE_HDR_LEN  19    // after the filename, including the CRC.
+
+#define CACHE_MAGIC   "BEMTIDX1"
+#define CACHE_HDR_LEN 28
+#define CACHE_BLK_LEN 37
+
+tape_index_t tape_index;
+
+static enum {
+    IDX_IDLE,
+    IDX_NAME,
+    IDX_HEADER,
+    IDX_DATA
+} idx_state;
+
+static size_t   blocks_size, data_size;
+static uint32_t tone_pos;
+static size_t   blk_start;   // offset in data of the block being collected.
+static unsigned idx_count;
+
+/* Key of the current tape for the cache file. */
+static bool     key_valid;
+static uint32_t key_crc, key_len;
+
+void tapeidx_free(void)
+{
+    if (tape_index.blocks) {
+        free(tape_index.blocks);
+        tape_index.blocks = NULL;
+    }
+    if (tape_index.data) {
+        free(tape_index.data);
+        tape_index.data = NULL;
+    }
+    tape_index.nblocks = tape_index.data_len = tape_index.other = 0;
+    blocks_size = data_size = 0;
+}
+
+void tapeidx_begin(void)
+{
+    tapeidx_free();
+    idx_state = IDX_IDLE;
+    tone_pos = 0;
+}
+
+void tapeidx_tone(uint32_t pos)
+{
+    tone_pos = pos;
+}
+
+static bool idx_append(uint8_t val)
+{
+    if (tape_index.data_len >= data_size) {
+        size_t new_size = data_size ? data_size * 2 : 0x10000;
+        uint8_t *new_data = realloc(tape_index.data, new_size);
+        if (!new_data) {
+            log_error("tapeidx: out of memory indexing tape");
+            return false;
+        }
+        tape_index.data = new_data;
+        data_size = new_size;
+    }
+    tape_index.data[tape_index.data_len++] = val;
+    return true;
+}
+
+static void idx_abandon(void)
+{
+    tape_index.other += tape_index.data_len - blk_start;
+    tape_index.data_len = blk_start;
+    idx_state = IDX_IDLE;
+}
+
+static uint32_t idx_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* The CRC used by the OS on tape, CRC-16/XMODEM, stored high byte first. */
+static bool idx_crc_ok(const uint8_t *p, size_t len)
+{
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return p[len] == (crc >> 8) && p[len+1] == (crc & 0xff);
+}
+
+static void idx_add_block(void)
+{
+    if (tape_index.nblocks >= blocks_size) {
+        size_t new_size = blocks_size ? blocks_size * 2 : 64;
+        tape_block_t *new_blocks = realloc(tape_index.blocks, new_size * sizeof(tape_block_t));
+        if (!new_blocks) {
+            log_error("tapeidx: out of memory indexing tape");
+            idx_abandon();
+            return;
+        }
+        tape_index.blocks = new_blocks;
+        blocks_size = new_size;
+    }
+    tape_block_t *blk = &tape_index.blocks[tape_index.nblocks++];
+    const uint8_t *p = tape_index.data + blk_start + 1;
+    size_t namelen = strlen((const char *)p);
+    memcpy(blk->name, p, namelen + 1);
+    p += namelen + 1;
+    blk->load   = idx_le32(p);
+    blk->exec   = idx_le32(p + 4);
+    blk->blkno  = p[8] | (p[9] << 8);
+    blk->len    = p[10] | (p[11] << 8);
+    blk->flag   = p[12];
+    blk->crc_ok = idx_crc_ok(tape_index.data + blk_start + 1, namelen + 1 + TAPE_HDR_LEN - 2);
+    if (blk->len)
+        blk->crc_ok &= idx_crc_ok(p + TAPE_HDR_LEN, blk->len);
+    blk->pos    = tone_pos;
+    blk->offset = blk_start;
+    blk->size   = tape_index.data_len - blk_start;
+    idx_state = IDX_IDLE;
+}
+
+void tapeidx_byte(uint8_t val, bool after_tone)
+{
+    if (after_tone && val == TAPE_SYNC) {
+        if (idx_state != IDX_IDLE)
+            idx_abandon();
+        blk_start = tape_index.data_len;
+        if (idx_append(val)) {
+            idx_state = IDX_NAME;
+            idx_count = 0;
+        }
+        return;
+    }
+    if (idx_state == IDX_IDLE) {
+        tape_index.other++;
+        return;
+    }
+    if (!idx_append(val)) {
+        idx_abandon();
+        return;
+    }
+    switch (idx_state) {
+        case IDX_NAME:
+            if (val == 0) {
+                idx_state = IDX_HEADER;
+                idx_count = TAPE_HDR_LEN;
+            }
+            else if (++idx_count > TAPE_NAME_MAX)
+                idx_abandon();
+            break;
+        case IDX_HEADER:
+            if (!--idx_count) {
+                const uint8_t *len = tape_index.data + tape_index.data_len - 9;
+                if ((idx_count = len[0] | (len[1] << 8)))
+                    idx_count += 2;
+                if (idx_count)
+                    idx_state = IDX_DATA;
+                else
+                    idx_add_block();
+            }
+            break;
+        case IDX_DATA:
+            if (!--idx_count)
+                idx_add_block();
+            break;
+        default:
+            break;
+    }
+}
+
+void tapeidx_end(void)
+{
+    if (idx_state != IDX_IDLE)
+        idx_abandon();
+    log_debug("tapeidx: %lu blocks indexed, %lu bytes outside blocks",
+              (unsigned long)tape_index.nblocks, (unsigned long)tape_index.other);
+}
+
+/* Find the first block at or after a tape position. */
+size_t tapeidx_find(uint32_t pos)
+{
+    size_t blk;
+    for (blk = 0; blk < tape_index.nblocks; blk++)
+        if (tape_index.blocks[blk].pos >= pos)
+            break;
+    return blk;
+}
+
+/* Find the first block of a named file. */
+size_t tapeidx_find_file(const char *name)
+{
+    size_t blk;
+    for (blk = 0; blk < tape_index.nblocks; blk++)
+        if (tape_index.blocks[blk].blkno == 0 && !strcasecmp(tape_index.blocks[blk].name, name))
+            break;
+    return blk;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static ALLEGRO_PATH *cache_path(void)
+{
+    char name[32];
+    snprintf(name, sizeof name, "tape-%08x-%x", key_crc, key_len);
+    return find_cfg_dest(name, ".idx");
+}
+
+/* Hash the tape image and, if there is a cache file for it, load the
+ * index from that.
+ */
+bool tapeidx_load_cache(const char *fn)
+{
+    FILE *fp;
+    uint8_t buf[8192];
+    size_t nbytes;
+    uLong crc = crc32(0, NULL, 0);
+    uint32_t len = 0;
+
+    key_valid = false;
+    if (!(fp = fopen(fn, "rb")))
+        return false;
+    while ((nbytes = fread(buf, 1, sizeof buf, fp)) > 0) {
+        crc = crc32(crc, buf, nbytes);
+        len += nbytes;
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    if (!ok)
+        return false;
+    key_crc = crc;
+    key_len = len;
+    key_valid = true;
+
+    ALLEGRO_PATH *path = cache_path();
+    if (!path)
+        return false;
+    const char *cpath = al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP);
+    fp = fopen(cpath, "rb");
+    al_destroy_path(path);
+    if (!fp)
+        return false;
+
+    tapeidx_begin();
+    ok = false;
+    if (fread(buf, CACHE_HDR_LEN, 1, fp) == 1 && !memcmp(buf, CACHE_MAGIC, 8)
+        && idx_le32(buf + 8) == key_crc && idx_le32(buf + 12) == key_len) {
+        size_t nblocks = idx_le32(buf + 16);
+        size_t data_len = idx_le32(buf + 20);
+        tape_index.other = idx_le32(buf + 24);
+        tape_index.blocks = malloc(nblocks * sizeof(tape_block_t) + 1);
+        tape_index.data = malloc(data_len + 1);
+        if (tape_index.blocks && tape_index.data) {
+            blocks_size = nblocks;
+            data_size = data_len;
+            ok = true;
+            for (size_t blk = 0; blk < nblocks && ok; blk++) {
+                tape_block_t *b = &tape_index.blocks[blk];
+                if (fread(buf, CACHE_BLK_LEN, 1, fp) != 1)
+                    ok = false;
+                else {
+                    memcpy(b->name, buf, sizeof b->name);
+                    b->name[sizeof b->name - 1] = 0;
+                    b->load   = idx_le32(buf + 11);
+                    b->exec   = idx_le32(buf + 15);
+                    b->blkno  = buf[19] | (buf[20] << 8);
+                    b->len    = buf[21] | (buf[22] << 8);
+                    b->flag   = buf[23];
+                    b->crc_ok = buf[24];
+                    b->pos    = idx_le32(buf + 25);
+                    b->offset = idx_le32(buf + 29);
+                    b->size   = idx_le32(buf + 33);
+                    ok = b->offset <= data_len && b->size <= data_len - b->offset;
+                }
+            }
+            if (ok && data_len && fread(tape_index.data, data_len, 1, fp) != 1)
+                ok = false;
+            if (ok) {
+                tape_index.nblocks = nblocks;
+                tape_index.data_len = data_len;
+            }
+        }
+    }
+    fclose(fp);
+    if (!ok) {
+        log_warn("tapeidx: ignoring invalid cache file for %s", fn);
+        tapeidx_free();
+        return false;
+    }
+    log_debug("tapeidx: %lu blocks loaded from cache", (unsigned long)tape_index.nblocks);
+    return true;
+}
+
+void tapeidx_save_cache(void)
+{
+    ALLEGRO_PATH *path;
+    FILE *fp;
+    uint8_t buf[CACHE_HDR_LEN];
+
+    if (!key_valid || !(path = cache_path()))
+        return;
+    const char *cpath = al_path_cstr(path, ALLEGRO_NATIVE_PATH_SEP);
+    if ((fp = fopen(cpath, "wb"))) {
+        memcpy(buf, CACHE_MAGIC, 8);
+        put32(buf + 8, key_crc);
+        put32(buf + 12, key_len);
+        put32(buf + 16, tape_index.nblocks);
+        put32(buf + 20, tape_index.data_len);
+        put32(buf + 24, tape_index.other);
+        bool ok = fwrite(buf, CACHE_HDR_LEN, 1, fp) == 1;
+        for (size_t blk = 0; blk < tape_index.nblocks && ok; blk++) {
+            const tape_block_t *b = &tape_index.blocks[blk];
+            uint8_t bb[CACHE_BLK_LEN];
+            memcpy(bb, b->name, sizeof b->name);
+            put32(bb + 11, b->load);
+            put32(bb + 15, b->exec);
+            put16(bb + 19, b->blkno);
+            put16(bb + 21, b->len);
+            bb[23] = b->flag;
+            bb[24] = b->crc_ok;
+            put32(bb + 25, b->pos);
+            put32(bb + 29, b->offset);
+            put32(bb + 33, b->size);
+            ok = fwrite(bb, CACHE_BLK_LEN, 1, fp) == 1;
+        }
+        if (ok && tape_index.data_len)
+            ok = fwrite(tape_index.data, tape_index.data_len, 1, fp) == 1;
+        if (fclose(fp) || !ok) {
+            log_warn("tapeidx: error writing cache file %s: %s", cpath, strerror(errno));
+            remove(cpath);
+        }
+    }
+    else
+        log_warn("tapeidx: unable to create cache file %s: %s", cpath, strerror(errno));
+    al_destroy_path(path);
+}
@@ -0,0 +1,44 @@
+#ifndef __INC_TAPEIDX_H
+#define __INC_TAPEIDX_H
+
+/*
+ * Index of the blocks in the OS tape filing system format found on the
+ * loaded tape, built in one pass over the tape when it is loaded and
+ * kept in a cache file keyed by a hash of the tape image so the pass
+ * is only needed the first time a tape is seen.
+ */
+
+typedef struct {
+    char     name[11];
+    uint32_t load;
+    uint32_t exec;
+    uint16_t blkno;
+    uint16_t len;      // length of the data part.
+    uint8_t  flag;
+    bool     crc_ok;   // header and data CRCs match.
+    uint32_t pos;      // position of the carrier tone before the block.
+    uint32_t offset;   // of the block bytes in tape_index.data.
+    uint32_t size;     // bytes from the sync byte to the data CRC inclusive.
+} tape_block_t;
+
+typedef struct {
+    tape_block_t *blocks;
+    size_t   nblocks;
+    uint8_t  *data;
+    size_t   data_len;
+    size_t   other;    // bytes on the tape not part of a standard block.
+} tape_index_t;
+
+extern tape_index_t tape_index;
+
+void tapeidx_begin(void);
+void tapeidx_tone(uint32_t pos);
+void tapeidx_byte(uint8_t val, bool after_tone);
+void tapeidx_end(void);
+void tapeidx_free(void);
+bool tapeidx_load_cache(const char *fn);
+void tapeidx_save_cache(void);
+size_t tapeidx_find(uint32_t pos);
+size_t tapeidx_find_file(const char *name);
+
+#endif
@@ -25,6 +25,8 @@ int tubecycles = 0;
 
 uint8_t (*tube_readmem)(uint32_t addr);
 void (*tube_writemem)(uint32_t addr, uint8_t byte);
+void (*tube_readblk)(uint32_t addr, uint8_t *buf, size_t len);
+void (*tube_writeblk)(uint32_t addr, const uint8_t *buf, size_t len);
 void (*tube_exec)(void);
 void (*tube_proc_savestate)(ZFILE *zfp);
 void (*tube_proc_loadstate)(ZFILE *zfp);
@@ -346,6 +348,30 @@ void tube_updatespeed()
     tube_multipler = tube_speeds[tube_speed_num].multipler * tubes[curtube].speed_multiplier;
 }
 
+/* Block copies for processors with no faster way: a byte at a time. */
+
+void tube_readblk_bytes(uint32_t addr, uint8_t *buf, size_t len)
+{
+        while (len--)
+                *buf++ = tube_readmem(addr++);
+}
+
+void tube_writeblk_bytes(uint32_t addr, const uint8_t *buf, size_t len)
+{
+        while (len--)
+                tube_writemem(addr++, *buf++);
+}
+
+static void n32016_readblk(uint32_t addr, uint8_t *buf, size_t len)
+{
+        read_Arbitary(addr, buf, len);
+}
+
+static void n32016_writeblk(uint32_t addr, const uint8_t *buf, size_t len)
+{
+        write_Arbitary(addr, (void *)buf, len);
+}
+
 bool tube_32016_init(void *rom)
 {
         tube_type = TUBE32016;
@@ -353,6 +379,8 @@ bool tube_32016_init(void *rom)
         n32016_reset();
         tube_readmem = read_x8;
         tube_writemem = write_x8;
+        tube_readblk = n32016_readblk;
+        tube_writeblk = n32016_writeblk;
         tube_exec  = n32016_exec;
         tube_proc_savestate = NULL;
         tube_proc_loadstate = NULL;
@@ -3,6 +3,7 @@
 
 #include "savestate.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef enum {
@@ -46,6 +47,8 @@ bool tube_32016_init(void *rom);
 
 extern uint8_t (*tube_readmem)(uint32_t addr);
 extern void (*tube_writemem)(uint32_t addr, uint8_t byte);
+extern void (*tube_readblk)(uint32_t addr, uint8_t *buf, size_t len);
+extern void (*tube_writeblk)(uint32_t addr, const uint8_t *buf, size_t len);
 extern void (*tube_exec)(void);
 extern void (*tube_proc_savestate)(ZFILE *zfp);
 extern void (*tube_proc_loadstate)(ZFILE *zfp);
@@ -54,6 +57,9 @@ extern int tubecycles;
 static inline void tubeUseCycles(int c) {tubecycles -= c;}
 static inline int tubeContinueRunning(void) {return tubecycles > 0;}
 
+void tube_readblk_bytes(uint32_t addr, uint8_t *buf, size_t len);
+void tube_writeblk_bytes(uint32_t addr, const uint8_t *buf, size_t len);
+
 uint8_t tube_host_read(uint16_t addr);
 void    tube_host_write(uint16_t addr, uint8_t val);
 uint8_t tube_parasite_read(uint32_t addr);
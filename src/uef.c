@@ -8,6 +8,7 @@
 #include "csw.h"
 #include "uef.h"
 #include "tape.h"
+#include "tapeidx.h"
 
 int pps;
 gzFile uef_f = NULL;
@@ -19,6 +20,9 @@ static int uef_chunkpos = 0, uef_chunkdatabits = 8;
 static int uef_startchunk;
 static float uef_chunkf;
 static int uef_intone = 0;
+static uint32_t uef_chunkstart;
+
+static void uef_build_index(void);
 
 void uef_load(const char *fn)
 {
@@ -31,12 +35,18 @@ void uef_load(const char *fn)
         for (c = 0; c < 12; c++)
             gzgetc(uef_f);
         uef_inchunk = uef_chunklen = uef_chunkid = 0;
+        uef_chunkstart = 12;
         tapellatch = (1000000 / (1200 / 10)) / 64;
         tapelcount = 0;
         pps = 120;
         csw_ena = 0;
 //      printf("Tapellatch %i\n",tapellatch);
         tape_loaded = 1;
+        if (!tapeidx_load_cache(fn))
+        {
+                uef_build_index();
+                tapeidx_save_cache();
+        }
 //      gzseek(uef,27535,SEEK_SET);
 }
 
@@ -50,14 +60,31 @@ void uef_close()
         }
 }
 
-static int infilenames = 0;
+static int indexing = 0;
 static int uefloop = 0;
 static uint8_t fdat;
-int ffound;
+static int ffound;
+
+/* Carrier detect only goes to the ACIA when the tape is being played,
+   rather than scanned for the index. */
+static void uef_dcdhigh(void)
+{
+        if (indexing)
+           tapeidx_tone(uef_chunkstart);
+        else
+           acia_dcdhigh(&sysacia);
+}
+
+static void uef_dcdlow(void)
+{
+        if (!indexing)
+           acia_dcdlow(&sysacia);
+}
+
 static void uef_receive(uint8_t val)
 {
         uef_toneon--;
-        if (infilenames)
+        if (indexing)
         {
                 ffound = 1;
                 fdat = val;
@@ -81,12 +108,14 @@ void uef_poll()
         if (!uef_inchunk)
         {
                 uef_startchunk = 1;
+                uef_chunkstart = gztell(uef_f);
 //                printf("%i ",gztell(uef));
                 gzread(uef_f, &uef_chunkid, 2);
                 gzread(uef_f, &uef_chunklen, 4);
                 if (gzeof(uef_f))
                 {
                         gzseek(uef_f, 12, SEEK_SET);
+                        uef_chunkstart = 12;
                         gzread(uef_f, &uef_chunkid, 2);
                         gzread(uef_f, &uef_chunklen, 4);
                         uefloop = 1;
@@ -114,7 +143,7 @@ void uef_poll()
             case 0x100: /*Raw data*/
                 if (uef_startchunk)
                 {
-                        acia_dcdlow(&sysacia);
+                        uef_dcdlow();
                         uef_startchunk = 0;
                 }
                 uef_chunklen--;
@@ -133,7 +162,7 @@ void uef_poll()
                         gzgetc(uef_f);
                         uef_chunklen -= 3;
                         uef_chunkpos = 1;
-                        acia_dcdlow(&sysacia);
+                        uef_dcdlow();
                 }
                 else
                 {
@@ -151,7 +180,7 @@ void uef_poll()
                 uef_toneon = 2;
                 if (!uef_intone)
                 {
-                        acia_dcdhigh(&sysacia);
+                        uef_dcdhigh();
                         uef_intone = gzgetc(uef_f);
                         uef_intone |= (gzgetc(uef_f) << 8);
                         uef_intone /= 20;
@@ -172,7 +201,7 @@ void uef_poll()
                 uef_toneon = 2;
                 if (!uef_intone)
                 {
-                        acia_dcdhigh(&sysacia);
+                        uef_dcdhigh();
                         uef_intone = gzgetc(uef_f);
                         uef_intone |= (gzgetc(uef_f)<<8);
                         uef_intone /= 20;
@@ -273,41 +302,17 @@ void uef_poll()
 //        exit(-1);
 }
 
-uint8_t fbuffer[4];
-
-#define getuefbyte()            ffound = 0; \
-                                while (!ffound && !uefloop) \
-                                { \
-                                        uef_poll(); \
-                                } \
-                                if (uefloop) break;
-
-uint8_t ffilename[16];
-void uef_findfilenames()
+/* Run over the whole tape once, recording the blocks on it. */
+static void uef_build_index(void)
 {
-        int temp;
-        uint8_t tb;
-        int c;
-        int fsize = 0;
-        char s[256];
-        uint32_t run, load;
-        uint8_t status;
-        int skip;
-        int binchunk  = uef_inchunk,  bchunkid = uef_chunkid, bchunklen = uef_chunklen;
-        int bchunkpos = uef_chunkpos, bchunkdatabits = uef_chunkdatabits;
-        int bintone   = uef_intone,   bffound = ffound;
-        float bchunkf = uef_chunkf;
-        uint8_t bdat  = fdat;
-        if (!uef_f) return;
-
+        tapeidx_begin();
+        gzseek(uef_f, 12, SEEK_SET);
         uef_inchunk  = 0; uef_chunkid = 0; uef_chunklen = 0;
         uef_chunkpos = 0; uef_chunkdatabits = 8; uef_intone = 0;
         uef_chunkf   = 0;
-
-        temp=gztell(uef_f);
-        gzseek(uef_f, 12, SEEK_SET);
+        uef_toneon   = 0;
         uefloop = 0;
-        infilenames = 1;
+        indexing = 1;
         while (!uefloop)
         {
                 ffound = 0;
@@ -316,83 +321,29 @@ void uef_findfilenames()
                         uef_poll();
                 }
                 if (uefloop) break;
-                fbuffer[0] = fbuffer[1];
-                fbuffer[1] = fbuffer[2];
-                fbuffer[2] = fbuffer[3];
-                fbuffer[3] = fdat;
-                if (fdat == 0x2A && uef_toneon == 1)
-                {
-                        fbuffer[3] = 0;
-                        c = 0;
-                        do
-                        {
-                                ffound = 0;
-                                while (!ffound && !uefloop)
-                                {
-                                        uef_poll();
-                                }
-                                if (uefloop) break;
-                                ffilename[c++] = fdat;
-                        } while (fdat != 0x0 && c < 10);
-                        if (uefloop) break;
-                        c--;
-                        while (c < 13) ffilename[c++] = 32;
-                        ffilename[c] = 0;
-
-                                getuefbyte();
-                                tb = fdat;
-                                getuefbyte();
-                                load = tb | (fdat << 8);
-                                getuefbyte();
-                                tb = fdat;
-                                getuefbyte();
-                                load |= (tb | (fdat << 8)) << 16;
-
-                                getuefbyte();
-                                tb = fdat;
-                                getuefbyte();
-                                run = tb | (fdat << 8);
-                                getuefbyte();
-                                tb = fdat;
-                                getuefbyte();
-                                run |= (tb | (fdat << 8)) << 16;
-
-                                getuefbyte();
-                                getuefbyte();
-
-                                getuefbyte();
-                                tb = fdat;
-                                getuefbyte();
-                                skip = tb | (fdat << 8);
-
-                                fsize += skip;
+                tapeidx_byte(fdat, uef_toneon == 1);
+        }
+        indexing = 0;
+        tapeidx_end();
+        uef_seek(12);
+        uef_toneon = 0;
+        tapellatch = (1000000 / (1200 / 10)) / 64;
+        pps = 120;
+}
 
-                                getuefbyte();
-                                status = fdat;
+uint32_t uef_tell(void)
+{
+        return uef_chunkstart;
+}
 
-                        if (status & 0x80)
-                        {
-                                sprintf(s, "%s Size %04X Load %08X Run %08X", ffilename, fsize, load, run);
-                                cataddname(s);
-                                fsize = 0;
-                        }
-                        for (c = 0; c <skip + 8; c++)
-                        {
-                                getuefbyte();
-                        }
-                }
-        }
-        infilenames = 0;
-        gzseek(uef_f, temp, SEEK_SET);
+/* Move to the start of a chunk. */
+void uef_seek(uint32_t pos)
+{
+        if (!uef_f)
+           return;
+        gzseek(uef_f, pos, SEEK_SET);
+        uef_chunkstart = pos;
+        uef_inchunk = uef_chunkpos = uef_intone = 0;
+        uef_chunkf = 0;
         uefloop = 0;
-        uef_inchunk       = binchunk;
-        uef_chunkid       = bchunkid;
-        uef_chunklen      = bchunklen;
-        uef_chunkpos      = bchunkpos;
-        uef_chunkdatabits = bchunkdatabits;
-        uef_chunkf        = bchunkf;
-        fdat = bdat;
-        ffound = bffound;
-        uef_intone = bintone;
 }
-
@@ -4,7 +4,8 @@
 void uef_load(const char *fn);
 void uef_close(void);
 void uef_poll(void);
-void uef_findfilenames(void);
+uint32_t uef_tell(void);
+void uef_seek(uint32_t pos);
 
 extern int uef_toneon;
 
@@ -52,6 +52,13 @@
 
 #include <sys/stat.h>
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <limits.h>
+#include <unistd.h>
+#define VDFS_INOTIFY
+#endif
+
 bool vdfs_enabled = 0;
 const char *vdfs_cfg_root = NULL;
 const char *vdfs_boot_dir = NULL;
@@ -71,7 +78,10 @@ const char *vdfs_boot_dir = NULL;
  *
  * In the event this is a directory rather than a file this entry
  * will contain a head pointer to a linked list of children, those
- * being contents of the directory.
+ * being contents of the directory.  The children are also indexed
+ * by two hash tables, one by host filename and one by Acorn filename,
+ * chained through host_hnext and acorn_hnext, so finding a file in a
+ * large directory does not mean walking the whole list.
  */
 
 #define MAX_FILE_NAME    10
@@ -126,6 +136,11 @@ struct vdfs_entry {
     uint16_t   attribs;
     time_t     btime;
     time_t     mtime;
+    vdfs_entry *host_hnext;
+    vdfs_entry *acorn_hnext;
+    unsigned   host_hash;
+    unsigned   acorn_hash;
+    bool       indexed;
     union {
         struct {
             uint32_t   load_addr;
@@ -134,6 +149,11 @@ struct vdfs_entry {
         } file;
         struct {
             vdfs_entry *children;
+            vdfs_entry **host_index;
+            vdfs_entry **acorn_index;
+            unsigned   index_size;
+            unsigned   index_count;
+            int        watch;
             time_t     scan_mtime;
             unsigned   scan_seq;
             sort_type  sorted;
@@ -391,6 +411,35 @@ static void writemem32(uint16_t addr, uint32_t value)
     writemem(addr+3, (value >> 24) & 0xff);
 }
 
+/*
+ * Copy blocks between the host and the guest.  Addresses of the form
+ * FFFFxxxx, or any address when there is no second processor, are in
+ * the I/O processor and the rest are in the second processor.
+ */
+
+static void copy_to_guest(uint32_t addr, const uint8_t *buf, size_t len)
+{
+    if (addr >= 0xffff0000 || curtube == -1)
+        writemem_block(addr, buf, len);
+    else
+        tube_writeblk(addr, buf, len);
+}
+
+static void copy_from_guest(uint32_t addr, uint8_t *buf, size_t len)
+{
+    if (addr >= 0xffff0000 || curtube == -1)
+        readmem_block(addr, buf, len);
+    else
+        tube_readblk(addr, buf, len);
+}
+
+static void translate_nl(uint8_t *buf, size_t len, int from, int to)
+{
+    uint8_t *end = buf + len;
+    while ((buf = memchr(buf, from, end - buf)))
+        *buf++ = to;
+}
+
 static void rom_dispatch(enum vdfs_action act)
 {
     int max = readmem(0x8000);
@@ -409,6 +458,203 @@ static void flush_all(void)
     }
 }
 
+/*
+ * The hash index of a directory.  The tables are a power of two in
+ * size and are rebuilt from the list of children at twice the size
+ * when the number of entries reaches the size.  If memory runs out
+ * the tables are left as they were, or absent, and searches fall back
+ * to walking the list.
+ */
+
+#define INDEX_MIN_SIZE 64
+
+static unsigned hash_host(const char *name)
+{
+    unsigned hash = 2166136261u;
+    while (*name)
+        hash = (hash ^ *(const unsigned char *)name++) * 16777619u;
+    return hash;
+}
+
+// As vdfs_cmp, Acorn names are hashed ignoring case.
+
+static unsigned hash_acorn(const char *name)
+{
+    unsigned hash = 2166136261u;
+    for (size_t len = MAX_FILE_NAME; len > 0 && *name; len--) {
+        int ch = *(const unsigned char *)name++;
+        if (ch >= 'a' && ch <= 'z')
+            ch = ch - 'a' + 'A';
+        hash = (hash ^ ch) * 16777619u;
+    }
+    return hash;
+}
+
+static void index_insert(vdfs_entry *dir, vdfs_entry *ent)
+{
+    unsigned mask = dir->u.dir.index_size - 1;
+    vdfs_entry **host_slot = dir->u.dir.host_index + (ent->host_hash & mask);
+    vdfs_entry **acorn_slot = dir->u.dir.acorn_index + (ent->acorn_hash & mask);
+    ent->host_hnext = *host_slot;
+    *host_slot = ent;
+    ent->acorn_hnext = *acorn_slot;
+    *acorn_slot = ent;
+    dir->u.dir.index_count++;
+}
+
+static void index_free(vdfs_entry *dir)
+{
+    if (dir->u.dir.host_index)
+        free(dir->u.dir.host_index);
+    if (dir->u.dir.acorn_index)
+        free(dir->u.dir.acorn_index);
+    dir->u.dir.host_index = dir->u.dir.acorn_index = NULL;
+    dir->u.dir.index_size = dir->u.dir.index_count = 0;
+}
+
+static bool index_build(vdfs_entry *dir, unsigned size)
+{
+    vdfs_entry **host_index = calloc(size, sizeof(vdfs_entry *));
+    vdfs_entry **acorn_index = calloc(size, sizeof(vdfs_entry *));
+    if (!host_index || !acorn_index) {
+        log_warn("vdfs: out of memory indexing %s", dir->host_path);
+        if (host_index)
+            free(host_index);
+        if (acorn_index)
+            free(acorn_index);
+        return false;
+    }
+    index_free(dir);
+    dir->u.dir.host_index = host_index;
+    dir->u.dir.acorn_index = acorn_index;
+    dir->u.dir.index_size = size;
+    for (vdfs_entry *ent = dir->u.dir.children; ent; ent = ent->next)
+        if (ent->indexed)
+            index_insert(dir, ent);
+    return true;
+}
+
+// Add an entry just linked into the list of children to the index.
+
+static void index_add(vdfs_entry *dir, vdfs_entry *ent)
+{
+    unsigned size = dir->u.dir.index_size;
+    ent->host_hash = hash_host(ent->host_fn);
+    ent->acorn_hash = hash_acorn(ent->acorn_fn);
+    ent->indexed = true;
+    if (dir->u.dir.index_count >= size && index_build(dir, size ? size * 2 : INDEX_MIN_SIZE))
+        return;
+    if (size)
+        index_insert(dir, ent);
+}
+
+/*
+ * Re-index an entry after a rescan, which may have changed its Acorn
+ * name from the .inf file.  The host name does not change.
+ */
+
+static void index_update(vdfs_entry *ent)
+{
+    if (ent->indexed) {
+        unsigned hash = hash_acorn(ent->acorn_fn);
+        if (hash != ent->acorn_hash) {
+            vdfs_entry *dir = ent->parent;
+            if (dir->u.dir.index_size) {
+                unsigned mask = dir->u.dir.index_size - 1;
+                vdfs_entry **slot = dir->u.dir.acorn_index + (ent->acorn_hash & mask);
+                while (*slot && *slot != ent)
+                    slot = &(*slot)->acorn_hnext;
+                if (*slot)
+                    *slot = ent->acorn_hnext;
+                slot = dir->u.dir.acorn_index + (hash & mask);
+                ent->acorn_hnext = *slot;
+                *slot = ent;
+            }
+            ent->acorn_hash = hash;
+        }
+    }
+}
+
+/*
+ * On Linux inotify is used to keep directories that have been scanned
+ * up to date.  Each watch reports changes to the files in one host
+ * directory and these are applied to the individual entries concerned
+ * so there is no need to stat the directory on each access or to scan
+ * it all again when one file changes.  The dirs being watched are
+ * kept in a table by watch descriptor.
+ */
+
+#ifdef VDFS_INOTIFY
+
+#define WATCH_MASK (IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_CLOSE_WRITE|IN_ATTRIB|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR)
+
+static int        watch_fd = -1;
+static vdfs_entry **watch_dirs;
+static int        watch_max;
+
+static void watch_forget(vdfs_entry *dir)
+{
+    int wd = dir->u.dir.watch;
+    if (wd >= 0) {
+        if (wd < watch_max && watch_dirs[wd] == dir)
+            watch_dirs[wd] = NULL;
+        dir->u.dir.watch = -1;
+    }
+}
+
+static void watch_remove(vdfs_entry *dir)
+{
+    int wd = dir->u.dir.watch;
+    if (wd >= 0) {
+        watch_forget(dir);
+        inotify_rm_watch(watch_fd, wd);
+    }
+}
+
+static void watch_add(vdfs_entry *dir)
+{
+    if (watch_fd >= 0 && dir->u.dir.watch < 0) {
+        int wd = inotify_add_watch(watch_fd, dir->host_path, WATCH_MASK);
+        if (wd < 0) {
+            log_debug("vdfs: unable to watch %s: %s", dir->host_path, strerror(errno));
+            return;
+        }
+        if (wd >= watch_max) {
+            int new_max = watch_max ? watch_max * 2 : 64;
+            while (new_max <= wd)
+                new_max *= 2;
+            vdfs_entry **new_dirs = realloc(watch_dirs, new_max * sizeof(vdfs_entry *));
+            if (!new_dirs) {
+                inotify_rm_watch(watch_fd, wd);
+                return;
+            }
+            memset(new_dirs + watch_max, 0, (new_max - watch_max) * sizeof(vdfs_entry *));
+            watch_dirs = new_dirs;
+            watch_max = new_max;
+        }
+        // The same host dir may already be watched for another entry.
+        if (watch_dirs[wd])
+            watch_dirs[wd]->u.dir.watch = -1;
+        watch_dirs[wd] = dir;
+        dir->u.dir.watch = wd;
+    }
+}
+
+#else
+static inline void watch_remove(vdfs_entry *dir) {}
+#endif
+
+static void free_entry(vdfs_entry *ent);
+
+static void free_dir(vdfs_entry *dir)
+{
+    watch_remove(dir);
+    free_entry(dir->u.dir.children);
+    dir->u.dir.children = NULL;
+    dir->u.dir.sorted = SORT_NONE;
+    index_free(dir);
+}
+
 static void free_entry(vdfs_entry *ent)
 {
     if (ent) {
@@ -417,7 +663,7 @@ static void free_entry(vdfs_entry *ent)
         if (ptr)
             free(ptr);
         if (ent->attribs & ATTR_IS_DIR)
-            free_entry(ent->u.dir.children);
+            free_dir(ent);
         free(ent);
     }
 }
@@ -601,6 +847,11 @@ static void adfs_hosterr(int errnum)
 static void init_dir(vdfs_entry *ent)
 {
     ent->u.dir.children = NULL;
+    ent->u.dir.host_index = NULL;
+    ent->u.dir.acorn_index = NULL;
+    ent->u.dir.index_size = 0;
+    ent->u.dir.index_count = 0;
+    ent->u.dir.watch = -1;
     ent->u.dir.scan_mtime = 0;
     ent->u.dir.scan_seq = 0;
     ent->u.dir.sorted = SORT_NONE;
@@ -641,7 +892,7 @@ static void scan_attr(vdfs_entry *ent)
             if (attribs & ATTR_IS_DIR) {
                 log_debug("vdfs: dir %s has become a file", ent->acorn_fn);
                 attribs &= ~ATTR_IS_DIR;
-                free_entry(ent->u.dir.children);
+                free_dir(ent);
             }
             ent->u.file.load_addr = 0;
             ent->u.file.exec_addr = 0;
@@ -695,7 +946,7 @@ static void scan_attr(vdfs_entry *ent)
             if (attribs & ATTR_IS_DIR) {
                 log_debug("vdfs: dir %s has become a file", ent->acorn_fn);
                 attribs &= ~ATTR_IS_DIR;
-                free_entry(ent->u.dir.children);
+                free_dir(ent);
             }
             ent->u.file.load_addr = 0;
             ent->u.file.exec_addr = 0;
@@ -1022,6 +1273,7 @@ static void scan_entry(vdfs_entry *ent)
         scan_inf_file(ent);
     if (ent->acorn_fn[0] == '\0')
         hst2bbc(ent->host_fn, ent->acorn_fn);
+    index_update(ent);
 }
 
 static void init_entry(vdfs_entry *ent)
@@ -1033,6 +1285,8 @@ static void init_entry(vdfs_entry *ent)
     ent->acorn_fn[MAX_FILE_NAME] = '\0';
     ent->dfs_dir = '$';
     ent->attribs = 0;
+    ent->host_hnext = ent->acorn_hnext = NULL;
+    ent->indexed = false;
 }
 
 static int vdfs_cmp(const char *namea, const char *nameb, size_t len)
@@ -1057,6 +1311,13 @@ static int vdfs_cmp(const char *namea, const char *nameb, size_t len)
 
 static vdfs_entry *acorn_search(vdfs_entry *dir, const char *acorn_fn)
 {
+    if (dir->u.dir.index_size) {
+        unsigned hash = hash_acorn(acorn_fn);
+        for (vdfs_entry *ent = dir->u.dir.acorn_index[hash & (dir->u.dir.index_size - 1)]; ent; ent = ent->acorn_hnext)
+            if (ent->acorn_hash == hash && !vdfs_cmp(ent->acorn_fn, acorn_fn, MAX_FILE_NAME))
+                return ent;
+        return NULL;
+    }
     for (vdfs_entry *ent = dir->u.dir.children; ent; ent = ent->next)
         if (!vdfs_cmp(ent->acorn_fn, acorn_fn, MAX_FILE_NAME))
             return ent;
@@ -1108,8 +1369,15 @@ static bool vdfs_wildmat(const char *pattern, const char *candidate)
     return true;
 }
 
+static bool is_wild(const char *pattern)
+{
+    return strpbrk(pattern, "*#") != NULL;
+}
+
 static vdfs_entry *wild_search(vdfs_entry *dir, const char *pattern)
 {
+    if (!is_wild(pattern) && strlen(pattern) <= MAX_FILE_NAME)
+        return acorn_search(dir, pattern);
     for (vdfs_entry *ent = dir->u.dir.children; ent; ent = ent->next)
         if (vdfs_wildmat(pattern, ent->acorn_fn))
             return ent;
@@ -1159,6 +1427,7 @@ static vdfs_entry *new_entry(vdfs_entry *dir, const char *host_fn)
             ent->next = dir->u.dir.children;
             dir->u.dir.children = ent;
             dir->u.dir.sorted = SORT_NONE;
+            index_add(dir, ent);
             log_debug("vdfs: new_entry: returning new entry %p", ent);
             return ent;
         }
@@ -1171,6 +1440,13 @@ static vdfs_entry *new_entry(vdfs_entry *dir, const char *host_fn)
 
 static vdfs_entry *host_search(vdfs_entry *dir, const char *host_fn)
 {
+    if (dir->u.dir.index_size) {
+        unsigned hash = hash_host(host_fn);
+        for (vdfs_entry *ent = dir->u.dir.host_index[hash & (dir->u.dir.index_size - 1)]; ent; ent = ent->host_hnext)
+            if (ent->host_hash == hash && !strcmp(ent->host_fn, host_fn))
+                return ent;
+        return NULL;
+    }
     for (vdfs_entry *ent = dir->u.dir.children; ent; ent = ent->next)
         if (!strcmp(ent->host_fn, host_fn))
             return ent;
@@ -1208,12 +1484,86 @@ static void scan_dir_host(vdfs_entry *dir, DIR *dp)
     }
 }
 
+#ifdef VDFS_INOTIFY
+
+// Apply a change reported by inotify to the entry for one file.
+
+static void watch_event(vdfs_entry *dir, const char *name, uint32_t mask)
+{
+    char host_fn[NAME_MAX+1];
+    bool inf = is_inf(name);
+    bool gone = mask & (IN_DELETE|IN_MOVED_FROM);
+
+    if (*name == '.')
+        return;
+    snprintf(host_fn, sizeof host_fn, "%s", name);
+    if (inf)
+        host_fn[strlen(host_fn)-4] = '\0';
+    vdfs_entry *ent = host_search(dir, host_fn);
+    log_debug("vdfs: watch event %08X for %s in %s", mask, name, dir->host_path);
+    if (inf) {
+        if (ent && ent->attribs & ATTR_EXISTS)
+            scan_entry(ent);
+    }
+    else if (ent) {
+        ent->attribs &= (ATTR_IS_DIR|ATTR_OPEN_READ|ATTR_OPEN_WRITE);
+        if (!gone)
+            scan_entry(ent);
+        dir->u.dir.sorted = SORT_NONE;
+    }
+    else if (!gone)
+        new_entry(dir, name);
+}
+
+static void watch_poll(void)
+{
+    union {
+        struct inotify_event ev;
+        char buf[4096];
+    } u;
+    ssize_t len;
+
+    if (watch_fd < 0)
+        return;
+    while ((len = read(watch_fd, u.buf, sizeof u.buf)) > 0) {
+        const char *ptr = u.buf;
+        const char *end = ptr + len;
+        while (ptr < end) {
+            const struct inotify_event *ev = (const struct inotify_event *)ptr;
+            ptr += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                log_debug("vdfs: watch queue overflowed, rescanning all");
+                scan_seq++;
+                continue;
+            }
+            vdfs_entry *dir = (ev->wd >= 0 && ev->wd < watch_max) ? watch_dirs[ev->wd] : NULL;
+            if (dir) {
+                if (ev->mask & IN_MOVE_SELF)
+                    watch_remove(dir);
+                else if (ev->mask & (IN_IGNORED|IN_DELETE_SELF))
+                    watch_forget(dir);
+                else if (ev->len)
+                    watch_event(dir, ev->name, ev->mask);
+            }
+        }
+    }
+}
+
+#endif
+
 static int scan_dir(vdfs_entry *dir)
 {
     struct stat stb;
 
     // Has this been scanned sufficiently recently already?
 
+#ifdef VDFS_INOTIFY
+    watch_poll();
+    if (dir->u.dir.watch >= 0 && scan_seq <= dir->u.dir.scan_seq) {
+        log_debug("vdfs: using watched dir info for %s", dir->host_path);
+        return 0;
+    }
+#endif
     if (stat(dir->host_path, &stb) == -1)
         log_warn("vdfs: unable to stat directory '%s': %s", dir->host_path, strerror(errno));
     else if (scan_seq <= dir->u.dir.scan_seq && stb.st_mtime <= dir->u.dir.scan_mtime) {
@@ -1222,6 +1572,10 @@ static int scan_dir(vdfs_entry *dir)
     }
     show_activity();
 
+#ifdef VDFS_INOTIFY
+    // Watch before reading so no change made during the scan is missed.
+    watch_add(dir);
+#endif
     DIR *dp = opendir(dir->host_path);
     if (dp) {
         scan_dir_host(dir, dp);
@@ -1372,6 +1726,19 @@ static vdfs_entry *find_entry_dfs(const char *filename, vdfs_findres *res, vdfs_
     }
     memcpy(res->acorn_fn, filename, len+1);
     if (!scan_dir(dir->dir)) {
+        if (!is_wild(filename)) {
+            // No wildcards so look the name up in the index.  Only if
+            // it is in another DFS dir is the list searched for a file
+            // of the same name in the right one.
+            vdfs_entry *ent = acorn_search(dir->dir, filename);
+            if (!ent) {
+                res->parent = dir->dir;
+                res->errmsg = err_notfound;
+                return NULL;
+            }
+            if (srchdir == '*' || srchdir == '#' || srchdir == ent->dfs_dir)
+                return ent;
+        }
         for (vdfs_entry *ent = dir->dir->u.dir.children; ent; ent = ent->next) {
             log_debug("vdfs: find_entry_dfs, considering entry %c.%s", ent->dfs_dir, ent->acorn_fn);
             if (srchdir == '*' || srchdir == '#' || srchdir == ent->dfs_dir) {
@@ -1433,6 +1800,7 @@ static vdfs_entry *add_new_file(vdfs_findres *res)
             new_ent->next = dir->u.dir.children;
             dir->u.dir.children = new_ent;
             dir->u.dir.sorted = SORT_NONE;
+            index_add(dir, new_ent);
             return new_ent;
         }
         free(new_ent);
@@ -1527,11 +1895,8 @@ void vdfs_close(void)
         free(ptr);
         root_dir.host_path = NULL;
     }
-    if ((ptr = root_dir.u.dir.children)) {
-        free_entry(ptr);
-        root_dir.u.dir.children = NULL;
-        root_dir.u.dir.sorted = SORT_NONE;
-    }
+    if (root_dir.attribs & ATTR_IS_DIR)
+        free_dir(&root_dir);
 }
 
 void vdfs_set_root(const char *root)
@@ -1812,22 +2177,10 @@ static void exec_swr_ram(uint8_t flags, uint32_t ram_start, uint16_t len, uint32
     int16_t nromid = swr_calc_addr(flags, &sw_start, romid);
     if (nromid >= 0) {
         uint8_t *rom_ptr = rom + romid * 0x4000 + sw_start;
-        if (ram_start >= 0xffff0000 || curtube == -1) {
-            if (flags & 0x80)
-                while (len--)
-                    *rom_ptr++ = readmem(ram_start++);
-            else
-                while (len--)
-                    writemem(ram_start++, *rom_ptr++);
-        }
-        else {
-            if (flags & 0x80)
-                while (len--)
-                    *rom_ptr++ = tube_readmem(ram_start++);
-            else
-                while (len--)
-                    tube_writemem(ram_start++, *rom_ptr++);
-        }
+        if (flags & 0x80)
+            copy_from_guest(ram_start, rom_ptr, len);
+        else
+            copy_to_guest(ram_start, rom_ptr, len);
     }
 }
 
@@ -2070,57 +2423,16 @@ static void osfile_attribs(uint32_t pb, vdfs_entry *ent)
 
 static uint32_t write_bytes(FILE *fp, uint32_t addr, size_t bytes, unsigned nlflag)
 {
-    if (addr >= 0xffff0000 || curtube == -1) {
-        char buffer[8192];
-        while (bytes >= sizeof buffer) {
-            char *ptr = buffer;
-            size_t chunk = sizeof buffer;
-            while (chunk--) {
-                int ch = readmem(addr++);
-                if (ch == '\r' && nlflag)
-                    ch = '\n';
-                *ptr++ = ch;
-            }
-            fwrite(buffer, sizeof buffer, 1, fp);
-            bytes -= sizeof buffer;
-        }
-        if (bytes > 0) {
-            char *ptr = buffer;
-            size_t chunk = bytes;
-            while (chunk--) {
-                int ch = readmem(addr++);
-                if (ch == '\r' && nlflag)
-                    ch = '\n';
-                *ptr++ = ch;
-            }
-            fwrite(buffer, bytes, 1, fp);
-        }
-    }
-    else {
-        char buffer[8192];
-        while (bytes >= sizeof buffer) {
-            char *ptr = buffer;
-            size_t chunk = sizeof buffer;
-            while (chunk--) {
-                int ch = tube_readmem(addr++);
-                if (ch == '\r' && nlflag)
-                    ch = '\n';
-                *ptr++ = ch;
-            }
-            fwrite(buffer, sizeof buffer, 1, fp);
-            bytes -= sizeof buffer;
-        }
-        if (bytes > 0) {
-            char *ptr = buffer;
-            size_t chunk = bytes;
-            while (chunk--) {
-                int ch = tube_readmem(addr++);
-                if (ch == '\r' && nlflag)
-                    ch = '\n';
-                *ptr++ = ch;
-            }
-            fwrite(buffer, bytes, 1, fp);
-        }
+    uint8_t buffer[32768];
+
+    while (bytes > 0) {
+        size_t chunk = bytes < sizeof buffer ? bytes : sizeof buffer;
+        copy_from_guest(addr, buffer, chunk);
+        if (nlflag)
+            translate_nl(buffer, chunk, '\r', '\n');
+        fwrite(buffer, chunk, 1, fp);
+        addr += chunk;
+        bytes -= chunk;
     }
     return addr;
 }
@@ -2523,38 +2835,32 @@ static void update_length(vdfs_entry *ent, uint32_t addr, uint32_t dest)
 
 static void read_file_io(vdfs_entry *ent, FILE *fp, uint32_t addr)
 {
-    char buffer[32768];
+    uint8_t buffer[32768];
     size_t nbytes;
     uint32_t dest = addr;
     unsigned nlflag = ent->attribs & ATTR_NL_TRANS;
 
     while ((nbytes = fread(buffer, 1, sizeof buffer, fp)) > 0) {
-        char *ptr = buffer;
-        while (nbytes--) {
-            int ch = *ptr++;
-            if (ch == '\n' && nlflag)
-                ch = '\r';
-            writemem(dest++, ch);
-        }
+        if (nlflag)
+            translate_nl(buffer, nbytes, '\n', '\r');
+        writemem_block(dest, buffer, nbytes);
+        dest += nbytes;
     }
     update_length(ent, addr, dest);
 }
 
 static void read_file_tube(vdfs_entry *ent, FILE *fp, uint32_t addr)
 {
-    char buffer[32768];
+    uint8_t buffer[32768];
     size_t nbytes;
     uint32_t dest = addr;
     unsigned nlflag = ent->attribs & ATTR_NL_TRANS;
 
     while ((nbytes = fread(buffer, 1, sizeof buffer, fp)) > 0) {
-        char *ptr = buffer;
-        while (nbytes--) {
-            int ch = *ptr++;
-            if (ch == '\n' && nlflag)
-                ch = '\r';
-            tube_writemem(dest++, ch);
-        }
+        if (nlflag)
+            translate_nl(buffer, nbytes, '\n', '\r');
+        tube_writeblk(dest, buffer, nbytes);
+        dest += nbytes;
     }
     update_length(ent, addr, dest);
 }
@@ -2844,52 +3150,18 @@ static void osgbpb_write(uint32_t pb)
 
 static size_t read_bytes(FILE *fp, uint32_t addr, size_t bytes, unsigned nlflag)
 {
-    char buffer[8192];
+    uint8_t buffer[32768];
     size_t nbytes;
 
-    while (bytes >= sizeof buffer) {
-        char *ptr = buffer;
-        if ((nbytes = fread(buffer, 1, sizeof buffer, fp)) <= 0)
-            return bytes;
-        bytes -= nbytes;
-        if (addr >= 0xffff0000 || curtube == -1) {
-            while (nbytes--) {
-                int ch = *ptr++;
-                if (ch == '\n' && nlflag)
-                    ch = '\r';
-                writemem(addr++, ch);
-            }
-        }
-        else {
-            while (nbytes--) {
-                int ch = *ptr++;
-                if (ch == '\n' && nlflag)
-                    ch = '\r';
-                tube_writemem(addr++, ch);
-            }
-        }
-    }
     while (bytes > 0) {
-        char *ptr = buffer;
-        if ((nbytes = fread(buffer, 1, bytes, fp)) <= 0)
+        size_t chunk = bytes < sizeof buffer ? bytes : sizeof buffer;
+        if ((nbytes = fread(buffer, 1, chunk, fp)) <= 0)
             return bytes;
         bytes -= nbytes;
-        if (addr >= 0xffff0000 || curtube == -1) {
-            while (nbytes--) {
-                int ch = *ptr++;
-                if (ch == '\n' && nlflag)
-                    ch = '\r';
-                writemem(addr++, ch);
-            }
-        }
-        else {
-            while (nbytes--) {
-                int ch = *ptr++;
-                if (ch == '\n' && nlflag)
-                    ch = '\r';
-                tube_writemem(addr++, ch);
-            }
-        }
+        if (nlflag)
+            translate_nl(buffer, nbytes, '\n', '\r');
+        copy_to_guest(addr, buffer, nbytes);
+        addr += nbytes;
     }
     return 0;
 }
@@ -2915,17 +3187,10 @@ static int osgbpb_read(uint32_t pb)
 
 static uint32_t write_len_str(uint32_t mem_ptr, const char *str, size_t len)
 {
-    if (mem_ptr >= 0xffff0000 || curtube == -1) {
-        writemem(mem_ptr++, len);
-        for (const char *ptr = str, *end = str + len; ptr < end; )
-            writemem(mem_ptr++, *ptr++);
-    }
-    else {
-        tube_writemem(mem_ptr++, len);
-        for (const char *ptr = str, *end = str + len; ptr < end; )
-            tube_writemem(mem_ptr++, *ptr++);
-    }
-    return mem_ptr;
+    uint8_t len_byte = len;
+    copy_to_guest(mem_ptr++, &len_byte, 1);
+    copy_to_guest(mem_ptr, (const uint8_t *)str, len);
+    return mem_ptr + len;
 }
 
 static void osgbpb_get_title(uint32_t pb)
@@ -3768,13 +4033,27 @@ static void rename_tail(vdfs_entry *old_ent, vdfs_entry *new_ent)
     if (rename(old_ent->host_path, new_ent->host_path) == 0) {
         log_debug("vdfs: '%s' renamed to '%s'", old_ent->host_path, new_ent->host_path);
         if (old_ent->attribs & ATTR_IS_DIR) {
+            if (new_ent->attribs & ATTR_IS_DIR) {
+                watch_remove(new_ent);
+                index_free(new_ent);
+            }
+            watch_remove(old_ent);
             new_ent->attribs |= ATTR_EXISTS|ATTR_IS_DIR;
-            new_ent->u.dir.children   = old_ent->u.dir.children;
-            new_ent->u.dir.scan_seq   = old_ent->u.dir.scan_seq;
-            new_ent->u.dir.scan_mtime = old_ent->u.dir.scan_mtime;
-            new_ent->u.dir.sorted     = old_ent->u.dir.sorted;
-            old_ent->u.dir.children   = NULL;
-            old_ent->u.dir.sorted     = SORT_NONE;
+            new_ent->u.dir.children    = old_ent->u.dir.children;
+            new_ent->u.dir.host_index  = old_ent->u.dir.host_index;
+            new_ent->u.dir.acorn_index = old_ent->u.dir.acorn_index;
+            new_ent->u.dir.index_size  = old_ent->u.dir.index_size;
+            new_ent->u.dir.index_count = old_ent->u.dir.index_count;
+            new_ent->u.dir.watch       = -1;
+            new_ent->u.dir.scan_seq    = old_ent->u.dir.scan_seq;
+            new_ent->u.dir.scan_mtime  = old_ent->u.dir.scan_mtime;
+            new_ent->u.dir.sorted      = old_ent->u.dir.sorted;
+            old_ent->u.dir.children    = NULL;
+            old_ent->u.dir.host_index  = old_ent->u.dir.acorn_index = NULL;
+            old_ent->u.dir.index_size  = old_ent->u.dir.index_count = 0;
+            old_ent->u.dir.sorted      = SORT_NONE;
+            for (vdfs_entry *ent = new_ent->u.dir.children; ent; ent = ent->next)
+                ent->parent = new_ent;
         }
         else {
             new_ent->attribs |= ATTR_EXISTS;
@@ -5036,6 +5315,10 @@ static void init_dirlib(vdfs_dirlib *dir, const char *desc)
 void vdfs_init(const char *root, const char *dir)
 {
     scan_seq = 0;
+#ifdef VDFS_INOTIFY
+    if (watch_fd < 0 && (watch_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC)) < 0)
+        log_warn("vdfs: unable to use inotify, directories will be checked on each access: %s", strerror(errno));
+#endif
     init_dirlib(&cur_dir, "current");
     init_dirlib(&lib_dir, "library");
     init_dirlib(&prev_dir, "previous");
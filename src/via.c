@@ -1,3 +1,4 @@
+#include <limits.h>
 #include "b-em.h"
 #include "6502.h"
 #include "via.h"
@@ -71,6 +72,25 @@ void via_poll(VIA *v, int cycles)
         via_shift(v, cycles);
 }
 
+/* Cycles until via_poll would next do something visible to the CPU,
+ * i.e. raise a timer interrupt.  The shift register clocks CB1 so is
+ * polled every time while it is running.
+ */
+int via_next_event(VIA *v)
+{
+    int next = INT_MAX;
+    if (v->acr & 0x1c)
+        return 1;
+    if (!v->t1hit || (v->acr & 0x40))
+        next = v->t1c - TLIMIT + 1;
+    if (!(v->acr & 0x20) && !v->t2hit) {
+        int t2 = v->t2c - TLIMIT + 1;
+        if (t2 < next)
+            next = t2;
+    }
+    return next;
+}
+
 void via_write(VIA *v, uint16_t addr, uint8_t val)
 {
         switch (addr&0xF)
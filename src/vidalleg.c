@@ -33,11 +33,17 @@ int fast_forward_triangles_y = 40;
 int fast_forward_triangles_size = 20;
 
 bool vid_print_mode = false;
+bool vid_headless = false;
+
+static void frame_close(void);
 
 void video_close()
 {
+    frame_close();
     al_destroy_bitmap(b32);
     al_destroy_bitmap(b16);
+    al_destroy_bitmap(bshow);
+    al_unlock_bitmap(b);
     al_destroy_bitmap(b);
 }
 
@@ -231,207 +237,253 @@ static void upscale_only(ALLEGRO_BITMAP *src, int sx, int sy, int sw, int sh, in
     }
 }
 
-static void line_double(void)
+/*
+ * The frame is drawn into b on whichever thread is running the
+ * emulation while everything from there to the display is done on the
+ * main thread.  Unless the emulation has a thread of its own
+ * video_doblit just calls show_frame.  Otherwise it copies the frame
+ * into the back one of three buffers and swaps that with the middle
+ * one, which video_show_frame, on the main thread, swaps with the front
+ * one to show it.  Neither thread waits for the other: if the main
+ * thread has not taken the last frame yet the new one is dropped,
+ * unless it is wanted for a screenshot.
+ */
+typedef struct {
+    ALLEGRO_LOCKED_REGION region;
+    int firstx, firsty, lastx, lasty;
+    enum vid_disptype dtype;
+    bool due, scrshot, clear_b32, non_ttx;
+    uint8_t vtotal;
+} vid_frame_t;
+
+static vid_frame_t vid_frames[3];
+static vid_frame_t *frame_back = vid_frames, *frame_mid = vid_frames + 1, *frame_front = vid_frames + 2;
+static ALLEGRO_MUTEX *frame_mutex;
+static bool frame_fresh, frame_posted, frame_failed;
+
+static void line_double(vid_frame_t *f)
 {
-    char *yptr1 = (char *)region->data + region->pitch * firsty * 2;
-    char *yptr2 = yptr1 + region->pitch;
-    size_t linesize = abs(region->pitch);
+    char *yptr1 = (char *)f->region.data + f->region.pitch * f->firsty * 2;
+    char *yptr2 = yptr1 + f->region.pitch;
+    size_t linesize = abs(f->region.pitch);
 
-    for (int y = firsty; y < lasty; y++) {
+    for (int y = f->firsty; y < f->lasty; y++) {
         memcpy(yptr2, yptr1, linesize);
-        yptr1 = yptr2 + region->pitch;
-        yptr2 = yptr1 + region->pitch;
+        yptr1 = yptr2 + f->region.pitch;
+        yptr2 = yptr1 + f->region.pitch;
     }
 }
 
-static inline void save_screenshot(void)
+/* Copy the part of the frame about to be drawn into bshow. */
+static void show_copy(const vid_frame_t *f, int sx, int sy, int sw, int sh)
 {
-    vid_savescrshot--;
-    if (!vid_savescrshot) {
-        int xsize = lastx - firstx;
-        int ysize = lasty - firsty;
-        ALLEGRO_BITMAP *scrshotb  = al_create_bitmap(xsize, ysize << 1);
-        int c;
-
-        if (vid_pal) {
-            switch(vid_dtype_intern) {
-                case VDT_SCALE:
-                    pal_convert(firstx, firsty, lastx, lasty, 1);
-                    al_set_target_bitmap(scrshotb);
-                    al_draw_scaled_bitmap(b32, firstx, firsty, xsize, ysize, 0, 0, xsize, ysize << 1, 0);
-                    break;
-                case VDT_INTERLACE:
-                    pal_convert(firstx, firsty << 1, lastx, lasty << 1, 1);
-                    al_set_target_bitmap(scrshotb);
-                    al_draw_bitmap_region(b32, firstx, firsty << 1, xsize, ysize << 1, 0, 0, 0);
-                    break;
-                case VDT_SCANLINES:
-                    pal_convert(firstx, firsty, lastx, lasty, 1);
-                    al_set_target_bitmap(scrshotb);
-                    c = 0;
-                    for (int y = firsty; y < lasty; y++) {
-                        al_draw_bitmap_region(b32, firstx, y, xsize, 1, 0, c, 0);
-                        c += 2;
-                    }
-                    break;
-                case VDT_LINEDOUBLE:
-                    line_double();
-                    pal_convert(firstx, firsty << 1, lastx, lasty << 1, 1);
-                    al_set_target_bitmap(scrshotb);
-                    al_draw_bitmap_region(b32, firstx, firsty << 1, xsize, ysize << 1, 0, 0, 0);
-                    break;
-            }
+    ALLEGRO_LOCKED_REGION *dr;
+
+    if (sx < 0) {
+        sw += sx;
+        sx = 0;
+    }
+    if (sy < 0) {
+        sh += sy;
+        sy = 0;
+    }
+    if (sx + sw > 1280)
+        sw = 1280 - sx;
+    if (sy + sh > 800)
+        sh = 800 - sy;
+    if (sw <= 0 || sh <= 0)
+        return;
+    if ((dr = al_lock_bitmap_region(bshow, sx, sy, sw, sh, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY))) {
+        const char *src = (const char *)f->region.data + f->region.pitch * sy + sx * sizeof(uint32_t);
+        for (int y = 0; y < sh; y++)
+            memcpy((char *)dr->data + dr->pitch * y, src + f->region.pitch * y, sw * sizeof(uint32_t));
+        al_unlock_bitmap(bshow);
+    }
+}
+
+static inline void save_screenshot(vid_frame_t *f)
+{
+    int xsize = f->lastx - f->firstx;
+    int ysize = f->lasty - f->firsty;
+    ALLEGRO_BITMAP *scrshotb  = al_create_bitmap(xsize, ysize << 1);
+    int c;
+
+    if (vid_pal) {
+        switch(f->dtype) {
+            case VDT_SCALE:
+                pal_convert(&f->region, f->firstx, f->firsty, f->lastx, f->lasty, 1);
+                al_set_target_bitmap(scrshotb);
+                al_draw_scaled_bitmap(b32, f->firstx, f->firsty, xsize, ysize, 0, 0, xsize, ysize << 1, 0);
+                break;
+            case VDT_INTERLACE:
+                pal_convert(&f->region, f->firstx, f->firsty << 1, f->lastx, f->lasty << 1, 1);
+                al_set_target_bitmap(scrshotb);
+                al_draw_bitmap_region(b32, f->firstx, f->firsty << 1, xsize, ysize << 1, 0, 0, 0);
+                break;
+            case VDT_SCANLINES:
+                pal_convert(&f->region, f->firstx, f->firsty, f->lastx, f->lasty, 1);
+                al_set_target_bitmap(scrshotb);
+                c = 0;
+                for (int y = f->firsty; y < f->lasty; y++) {
+                    al_draw_bitmap_region(b32, f->firstx, y, xsize, 1, 0, c, 0);
+                    c += 2;
+                }
+                break;
+            case VDT_LINEDOUBLE:
+                line_double(f);
+                pal_convert(&f->region, f->firstx, f->firsty << 1, f->lastx, f->lasty << 1, 1);
+                al_set_target_bitmap(scrshotb);
+                al_draw_bitmap_region(b32, f->firstx, f->firsty << 1, xsize, ysize << 1, 0, 0, 0);
+                break;
         }
-        else {
-            al_set_target_bitmap(scrshotb);
-            switch(vid_dtype_intern) {
-                case VDT_SCALE:
-                    al_unlock_bitmap(b);
-                    al_set_target_bitmap(scrshotb);
-                    al_draw_scaled_bitmap(b, firstx, firsty, xsize, ysize, 0, 0, xsize, ysize << 1, 0);
-                    break;
-                case VDT_INTERLACE:
-                    al_unlock_bitmap(b);
-                    al_set_target_bitmap(scrshotb);
-                    al_draw_bitmap_region(b, firstx, firsty << 1, xsize, ysize << 1, 0, 0, 0);
-                    break;
-                case VDT_SCANLINES:
-                    al_unlock_bitmap(b);
-                    al_set_target_bitmap(scrshotb);
-                    c = 0;
-                    for (int y = firsty; y < lasty; y++) {
-                        al_draw_bitmap_region(b, firstx, y, xsize, 1, 0, c, 0);
-                        c += 2;
-                    }
-                    break;
-                case VDT_LINEDOUBLE:
-                    line_double();
-                    al_unlock_bitmap(b);
-                    al_draw_scaled_bitmap(b, firstx, firsty << 1, xsize, ysize << 1, 0, 0, xsize, ysize << 1, 0);
-                    break;
-            }
-            region = al_lock_bitmap(b, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY);
+    }
+    else {
+        switch(f->dtype) {
+            case VDT_SCALE:
+                show_copy(f, f->firstx, f->firsty, xsize, ysize);
+                al_set_target_bitmap(scrshotb);
+                al_draw_scaled_bitmap(bshow, f->firstx, f->firsty, xsize, ysize, 0, 0, xsize, ysize << 1, 0);
+                break;
+            case VDT_INTERLACE:
+                show_copy(f, f->firstx, f->firsty << 1, xsize, ysize << 1);
+                al_set_target_bitmap(scrshotb);
+                al_draw_bitmap_region(bshow, f->firstx, f->firsty << 1, xsize, ysize << 1, 0, 0, 0);
+                break;
+            case VDT_SCANLINES:
+                show_copy(f, f->firstx, f->firsty, xsize, ysize);
+                al_set_target_bitmap(scrshotb);
+                c = 0;
+                for (int y = f->firsty; y < f->lasty; y++) {
+                    al_draw_bitmap_region(bshow, f->firstx, y, xsize, 1, 0, c, 0);
+                    c += 2;
+                }
+                break;
+            case VDT_LINEDOUBLE:
+                line_double(f);
+                show_copy(f, f->firstx, f->firsty << 1, xsize, ysize << 1);
+                al_set_target_bitmap(scrshotb);
+                al_draw_scaled_bitmap(bshow, f->firstx, f->firsty << 1, xsize, ysize << 1, 0, 0, xsize, ysize << 1, 0);
+                break;
         }
-        al_save_bitmap(vid_scrshotname, scrshotb);
-        al_destroy_bitmap(scrshotb);
     }
+    al_save_bitmap(vid_scrshotname, scrshotb);
+    al_destroy_bitmap(scrshotb);
 }
 
-static inline void calc_limits(bool non_ttx, uint8_t vtotal)
+static inline void calc_limits(vid_frame_t *f)
 {
     switch(vid_fullborders) {
         case 0:
-            if (non_ttx) {
-                firstx = BORDER_NONE_X_START_GRA;
-                lastx  = BORDER_NONE_X_END_GRA;
+            if (f->non_ttx) {
+                f->firstx = BORDER_NONE_X_START_GRA;
+                f->lastx  = BORDER_NONE_X_END_GRA;
             }
             else {
-                firstx = BORDER_NONE_X_START_TTX;
-                lastx  = BORDER_NONE_X_END_TTX;
+                f->firstx = BORDER_NONE_X_START_TTX;
+                f->lastx  = BORDER_NONE_X_END_TTX;
             }
-            if (vtotal > 30) {
-                firsty = BORDER_NONE_Y_START_GRA;
-                lasty  = BORDER_NONE_Y_END_GRA;
+            if (f->vtotal > 30) {
+                f->firsty = BORDER_NONE_Y_START_GRA;
+                f->lasty  = BORDER_NONE_Y_END_GRA;
             }
             else {
-                firsty = BORDER_NONE_Y_START_TXT;
-                lasty  = BORDER_NONE_Y_END_TXT;
+                f->firsty = BORDER_NONE_Y_START_TXT;
+                f->lasty  = BORDER_NONE_Y_END_TXT;
             }
             break;
         case 1:
-            if (non_ttx) {
-                firstx = BORDER_MED_X_START_GRA;
-                lastx  = BORDER_MED_X_END_GRA;
+            if (f->non_ttx) {
+                f->firstx = BORDER_MED_X_START_GRA;
+                f->lastx  = BORDER_MED_X_END_GRA;
             }
             else {
-                firstx = BORDER_MED_X_START_TTX;
-                lastx  = BORDER_MED_X_END_TTX;
+                f->firstx = BORDER_MED_X_START_TTX;
+                f->lastx  = BORDER_MED_X_END_TTX;
             }
-            if (vtotal > 30) {
-                firsty = BORDER_MED_Y_START_GRA;
-                lasty  = BORDER_MED_Y_END_GRA;
+            if (f->vtotal > 30) {
+                f->firsty = BORDER_MED_Y_START_GRA;
+                f->lasty  = BORDER_MED_Y_END_GRA;
             }
             else {
-                firsty = BORDER_MED_Y_START_TXT;
-                lasty  = BORDER_MED_Y_END_TXT;
+                f->firsty = BORDER_MED_Y_START_TXT;
+                f->lasty  = BORDER_MED_Y_END_TXT;
             }
             break;
         case 2:
-            if (non_ttx) {
-                firstx = BORDER_FULL_X_START_GRA;
-                lastx  = BORDER_FULL_X_END_GRA;
+            if (f->non_ttx) {
+                f->firstx = BORDER_FULL_X_START_GRA;
+                f->lastx  = BORDER_FULL_X_END_GRA;
             }
             else {
-                firstx = BORDER_FULL_X_START_TTX;
-                lastx  = BORDER_FULL_X_END_TTX;
+                f->firstx = BORDER_FULL_X_START_TTX;
+                f->lastx  = BORDER_FULL_X_END_TTX;
             }
-            if (vtotal > 30) {
-                firsty = BORDER_FULL_Y_START_GRA;
-                lasty  = BORDER_FULL_Y_END_GRA;
+            if (f->vtotal > 30) {
+                f->firsty = BORDER_FULL_Y_START_GRA;
+                f->lasty  = BORDER_FULL_Y_END_GRA;
             }
             else {
-                firsty = BORDER_FULL_Y_START_TXT;
-                lasty  = BORDER_FULL_Y_END_TXT;
+                f->firsty = BORDER_FULL_Y_START_TXT;
+                f->lasty  = BORDER_FULL_Y_END_TXT;
             }
     }
 }
 
-static inline void blit_screen(void)
+static inline void blit_screen(vid_frame_t *f)
 {
-    int xsize = lastx - firstx;
-    int ysize = lasty - firsty + 1;
+    int xsize = f->lastx - f->firstx;
+    int ysize = f->lasty - f->firsty + 1;
 
     if (vid_pal) {
-        switch(vid_dtype_intern) {
+        switch(f->dtype) {
             case VDT_SCALE:
-                pal_convert(firstx, firsty, lastx, lasty, 1);
+                pal_convert(&f->region, f->firstx, f->firsty, f->lastx, f->lasty, 1);
                 al_set_target_backbuffer(al_get_current_display());
-                al_draw_scaled_bitmap(b32, firstx, firsty, xsize, ysize, scr_x_start, scr_y_start, scr_x_size, scr_y_size, 0);
+                al_draw_scaled_bitmap(b32, f->firstx, f->firsty, xsize, ysize, scr_x_start, scr_y_start, scr_x_size, scr_y_size, 0);
                 break;
             case VDT_INTERLACE:
-                pal_convert(firstx, firsty << 1, lastx, lasty << 1, 1);
-                upscale_only(b32, firstx, firsty << 1, xsize, ysize << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
+                pal_convert(&f->region, f->firstx, f->firsty << 1, f->lastx, f->lasty << 1, 1);
+                upscale_only(b32, f->firstx, f->firsty << 1, xsize, ysize << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
                 break;
             case VDT_SCANLINES:
-                pal_convert(firstx, firsty, lastx, lasty, 1);
+                pal_convert(&f->region, f->firstx, f->firsty, f->lastx, f->lasty, 1);
                 al_set_target_bitmap(b16);
                 al_clear_to_color(al_map_rgb(0, 0,0));
-                for (int c = firsty; c < lasty; c++)
-                    al_draw_bitmap_region(b32, firstx, c, lastx - firstx, 1, 0, c << 1, 0);
-                upscale_only(b16, 0, firsty << 1, xsize, ysize << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
+                for (int c = f->firsty; c < f->lasty; c++)
+                    al_draw_bitmap_region(b32, f->firstx, c, f->lastx - f->firstx, 1, 0, c << 1, 0);
+                upscale_only(b16, 0, f->firsty << 1, xsize, ysize << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
                 break;
             case VDT_LINEDOUBLE:
-                line_double();
-                pal_convert(firstx, firsty << 1, lastx, lasty << 1, 1);
-                upscale_only(b32, firstx, firsty << 1, xsize, ysize << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
+                line_double(f);
+                pal_convert(&f->region, f->firstx, f->firsty << 1, f->lastx, f->lasty << 1, 1);
+                upscale_only(b32, f->firstx, f->firsty << 1, xsize, ysize << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
                 break;
         }
     }
     else {
-        switch(vid_dtype_intern) {
+        switch(f->dtype) {
             case VDT_SCALE:
-                al_unlock_bitmap(b);
+                show_copy(f, f->firstx, f->firsty, xsize, ysize);
                 al_set_target_backbuffer(al_get_current_display());
-                al_draw_scaled_bitmap(b, firstx, firsty, xsize, ysize, scr_x_start, scr_y_start, scr_x_size, scr_y_size, 0);
+                al_draw_scaled_bitmap(bshow, f->firstx, f->firsty, xsize, ysize, scr_x_start, scr_y_start, scr_x_size, scr_y_size, 0);
                 break;
             case VDT_INTERLACE:
-                al_unlock_bitmap(b);
-                upscale_only(b, firstx, firsty << 1, lastx - firstx, (lasty - firsty) << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
+                show_copy(f, f->firstx, f->firsty << 1, xsize, (ysize - 1) << 1);
+                upscale_only(bshow, f->firstx, f->firsty << 1, f->lastx - f->firstx, (f->lasty - f->firsty) << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
                 break;
             case VDT_SCANLINES:
-                al_unlock_bitmap(b);
+                show_copy(f, f->firstx, f->firsty, xsize, ysize - 1);
                 al_set_target_bitmap(b16);
                 al_clear_to_color(border_col);
-                for (int c = firsty; c < lasty; c++)
-                    al_draw_bitmap_region(b, firstx, c, xsize, 1, 0, c << 1, 0);
-                upscale_only(b16, 0, firsty << 1, lastx - firstx, (lasty - firsty) << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
+                for (int c = f->firsty; c < f->lasty; c++)
+                    al_draw_bitmap_region(bshow, f->firstx, c, xsize, 1, 0, c << 1, 0);
+                upscale_only(b16, 0, f->firsty << 1, f->lastx - f->firstx, (f->lasty - f->firsty) << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
                 break;
             case VDT_LINEDOUBLE:
-                line_double();
-                al_unlock_bitmap(b);
-                upscale_only(b, firstx, firsty << 1, xsize, ysize  << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
+                line_double(f);
+                show_copy(f, f->firstx, f->firsty << 1, xsize, ysize << 1);
+                upscale_only(bshow, f->firstx, f->firsty << 1, xsize, ysize  << 1, scr_x_start, scr_y_start, scr_x_size, scr_y_size);
         }
-        region = al_lock_bitmap(b, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY);
     }
 }
 
@@ -508,24 +560,161 @@ static void render_hud(void)
     }
 }
 
+static void show_frame(vid_frame_t *f)
+{
+    if (f->clear_b32) {
+        al_set_target_bitmap(b32);
+        al_clear_to_color(al_map_rgb(0, 0, 0));
+    }
+    if (f->scrshot)
+        save_screenshot(f);
+
+    if (f->due) {
+        calc_limits(f);
+        if (!vid_headless) {
+            led_draw();
+            blit_screen(f);
+            if (scr_x_start > 0)
+                fill_pillarbox();
+            else if (scr_y_start > 0)
+                fill_letterbox();
+
+            render_leds();
+            render_hud();
+            al_flip_display();
+        }
+    }
+}
+
+static bool frame_buffers(void)
+{
+    if (!frame_mutex && !frame_failed) {
+        for (int i = 0; i < 3; i++) {
+            ALLEGRO_LOCKED_REGION *r = &vid_frames[i].region;
+            if (!(r->data = malloc(1280 * 800 * sizeof(uint32_t)))) {
+                frame_failed = true;
+                break;
+            }
+            r->format = ALLEGRO_PIXEL_FORMAT_ARGB_8888;
+            r->pitch = 1280 * sizeof(uint32_t);
+            r->pixel_size = sizeof(uint32_t);
+        }
+        if (frame_failed || !(frame_mutex = al_create_mutex())) {
+            log_error("vidalleg: unable to allocate frame buffers, frames from the emulation thread will not be shown");
+            frame_failed = true;
+        }
+    }
+    return frame_mutex;
+}
+
+static void frame_close(void)
+{
+    for (int i = 0; i < 3; i++) {
+        free(vid_frames[i].region.data);
+        vid_frames[i].region.data = NULL;
+    }
+    if (frame_mutex) {
+        al_destroy_mutex(frame_mutex);
+        frame_mutex = NULL;
+    }
+    frame_fresh = frame_posted = frame_failed = false;
+}
+
+/* Called on the emulation thread to pass a frame to the main thread,
+ * returning false if the frame was dropped.
+ */
+static bool frame_publish(const vid_frame_t *f)
+{
+    vid_frame_t *back;
+    bool notify;
+
+    if (!frame_buffers())
+        return false;
+    al_lock_mutex(frame_mutex);
+    bool busy = frame_fresh && (!f->scrshot || frame_mid->scrshot);
+    al_unlock_mutex(frame_mutex);
+    if (busy)
+        return false;
+
+    back = frame_back;
+    for (int y = 0; y < 800; y++)
+        memcpy((char *)back->region.data + back->region.pitch * y, (const char *)f->region.data + f->region.pitch * y,
+               1280 * sizeof(uint32_t));
+    back->firstx = f->firstx;
+    back->firsty = f->firsty;
+    back->lastx = f->lastx;
+    back->lasty = f->lasty;
+    back->dtype = f->dtype;
+    back->due = f->due;
+    back->scrshot = f->scrshot;
+    back->clear_b32 = f->clear_b32;
+    back->non_ttx = f->non_ttx;
+    back->vtotal = f->vtotal;
+
+    al_lock_mutex(frame_mutex);
+    if (frame_fresh) {
+        back->due |= frame_mid->due;
+        back->clear_b32 |= frame_mid->clear_b32;
+    }
+    frame_back = frame_mid;
+    frame_mid = back;
+    frame_fresh = true;
+    notify = !frame_posted;
+    frame_posted = true;
+    al_unlock_mutex(frame_mutex);
+    if (notify)
+        main_frame_handoff();
+    return true;
+}
+
+/* Show the last frame passed over by the emulation thread, if it has
+ * not been shown already.  Called on the main thread.
+ */
+void video_show_frame(void)
+{
+    bool fresh;
+
+    if (!frame_mutex)
+        return;
+    al_lock_mutex(frame_mutex);
+    frame_posted = false;
+    if ((fresh = frame_fresh)) {
+        vid_frame_t *f = frame_front;
+        frame_front = frame_mid;
+        frame_mid = f;
+        frame_fresh = false;
+    }
+    al_unlock_mutex(frame_mutex);
+    if (fresh)
+        show_frame(frame_front);
+}
+
 void video_doblit(bool non_ttx, uint8_t vtotal)
 {
-    if (vid_savescrshot)
-        save_screenshot();
+    vid_frame_t frame;
 
+    frame.due = false;
     if (++fskipcount >= ((motor && fasttape) ? 5 : vid_fskipmax)) {
-        lasty++;
-        calc_limits(non_ttx, vtotal);
         fskipcount = 0;
-        blit_screen();
-        if (scr_x_start > 0)
-            fill_pillarbox();
-        else if (scr_y_start > 0)
-            fill_letterbox();
-
-        render_leds();
-        render_hud();
-        al_flip_display();
+        frame.due = true;
+    }
+    frame.scrshot = vid_savescrshot && !--vid_savescrshot;
+    if (frame.due || frame.scrshot) {
+        frame.region = *region;
+        frame.firstx = firstx;
+        frame.firsty = firsty;
+        frame.lastx = lastx;
+        frame.lasty = lasty;
+        frame.dtype = vid_dtype_intern;
+        frame.clear_b32 = vid_clear_b32;
+        frame.non_ttx = non_ttx;
+        frame.vtotal = vtotal;
+        if (!main_on_emu_thread()) {
+            show_frame(&frame);
+            vid_clear_b32 = false;
+        }
+        else if (frame_publish(&frame))
+            vid_clear_b32 = false;
     }
     firstx = firsty = 65535;
     lastx  = lasty  = 0;
@@ -15,6 +15,19 @@
 #include "video.h"
 #include "video_render.h"
 
+/* Vector pixel kernels: AVX2 or SSE2 where the compiler targets them,
+ * otherwise plain C.  SSE2 is always there on x86-64; AVX2 is only
+ * used by builds made for it, e.g. with ./configure --enable-avx2.
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VID_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VID_SSE2
+#endif
+
 int fullscreen = 0;
 
 static int scrx, scry;
@@ -126,6 +139,16 @@ int nula_collook[16];           // maps palette (logical) colours to 12-bit RGB
 
 static uint8_t table4bpp[4][256][16];
 
+/* Each screen byte expanded to the (up to) 16 pixels it produces with
+ * the current ULA mode and palette.  Entries are refreshed lazily: a
+ * ULA write just bumps the generation and an entry is rebuilt the next
+ * time the byte it is for is displayed, so palette changes mid-frame
+ * cost nothing until they are used.
+ */
+static uint32_t ula_pixels[256][16];
+static uint32_t ula_pixels_tag[256];
+static uint32_t ula_pixels_gen = 1;
+
 static int nula_pal_write_flag = 0;
 static uint8_t nula_pal_first_byte;
 uint8_t nula_flash[8];
@@ -167,6 +190,111 @@ static inline int get_pixel(ALLEGRO_LOCKED_REGION *region, int x, int y)
     return *((uint32_t *)((char *)region->data + region->pitch * y + x * region->pixel_size));
 }
 
+static inline void pix_fill(uint32_t *dst, int count, uint32_t colour)
+{
+#if defined(VID_AVX2)
+    __m256i v = _mm256_set1_epi32(colour);
+    for (; count >= 8; count -= 8, dst += 8)
+        _mm256_storeu_si256((__m256i *)dst, v);
+#elif defined(VID_SSE2)
+    __m128i v = _mm_set1_epi32(colour);
+    for (; count >= 4; count -= 4, dst += 4)
+        _mm_storeu_si128((__m128i *)dst, v);
+#endif
+    while (count-- > 0)
+        *dst++ = colour;
+}
+
+static inline void pix_copy(uint32_t *dst, const uint32_t *src, int count)
+{
+#if defined(VID_AVX2)
+    for (; count >= 8; count -= 8, dst += 8, src += 8)
+        _mm256_storeu_si256((__m256i *)dst, _mm256_loadu_si256((const __m256i *)src));
+#elif defined(VID_SSE2)
+    for (; count >= 4; count -= 4, dst += 4, src += 4)
+        _mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+#endif
+    while (count-- > 0)
+        *dst++ = *src++;
+}
+
+/* Eight pixels from the bits of a screen byte: pixel c is 'on' if the
+ * bit in mask[c] is set in dat, 'off' otherwise.
+ */
+static inline void pix_expand_2col(uint32_t *dst, uint32_t dat, const uint32_t *mask, uint32_t on, uint32_t off)
+{
+#if defined(VID_AVX2)
+    __m256i m = _mm256_loadu_si256((const __m256i *)mask);
+    __m256i sel = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(dat), m), m);
+    _mm256_storeu_si256((__m256i *)dst, _mm256_blendv_epi8(_mm256_set1_epi32(off), _mm256_set1_epi32(on), sel));
+#elif defined(VID_SSE2)
+    __m128i d = _mm_set1_epi32(dat), von = _mm_set1_epi32(on), voff = _mm_set1_epi32(off);
+    for (int c = 0; c < 8; c += 4) {
+        __m128i m = _mm_loadu_si128((const __m128i *)(mask + c));
+        __m128i sel = _mm_cmpeq_epi32(_mm_and_si128(d, m), m);
+        _mm_storeu_si128((__m128i *)(dst + c), _mm_or_si128(_mm_and_si128(sel, von), _mm_andnot_si128(sel, voff)));
+    }
+#else
+    for (int c = 0; c < 8; c++)
+        dst[c] = (dat & mask[c]) ? on : off;
+#endif
+}
+
+/* As above but two bits per pixel choosing from four colours. */
+static inline void pix_expand_4col(uint32_t *dst, uint32_t dat, const uint32_t *hmask, const uint32_t *lmask, const int *cols)
+{
+#if defined(VID_AVX2)
+    __m256i d = _mm256_set1_epi32(dat);
+    __m256i hm = _mm256_loadu_si256((const __m256i *)hmask);
+    __m256i lm = _mm256_loadu_si256((const __m256i *)lmask);
+    __m256i hsel = _mm256_cmpeq_epi32(_mm256_and_si256(d, hm), hm);
+    __m256i lsel = _mm256_cmpeq_epi32(_mm256_and_si256(d, lm), lm);
+    __m256i lo = _mm256_blendv_epi8(_mm256_set1_epi32(cols[0]), _mm256_set1_epi32(cols[1]), lsel);
+    __m256i hi = _mm256_blendv_epi8(_mm256_set1_epi32(cols[2]), _mm256_set1_epi32(cols[3]), lsel);
+    _mm256_storeu_si256((__m256i *)dst, _mm256_blendv_epi8(lo, hi, hsel));
+#elif defined(VID_SSE2)
+    __m128i d = _mm_set1_epi32(dat);
+    __m128i c0 = _mm_set1_epi32(cols[0]), c1 = _mm_set1_epi32(cols[1]);
+    __m128i c2 = _mm_set1_epi32(cols[2]), c3 = _mm_set1_epi32(cols[3]);
+    for (int c = 0; c < 8; c += 4) {
+        __m128i hm = _mm_loadu_si128((const __m128i *)(hmask + c));
+        __m128i lm = _mm_loadu_si128((const __m128i *)(lmask + c));
+        __m128i hsel = _mm_cmpeq_epi32(_mm_and_si128(d, hm), hm);
+        __m128i lsel = _mm_cmpeq_epi32(_mm_and_si128(d, lm), lm);
+        __m128i lo = _mm_or_si128(_mm_and_si128(lsel, c1), _mm_andnot_si128(lsel, c0));
+        __m128i hi = _mm_or_si128(_mm_and_si128(lsel, c3), _mm_andnot_si128(lsel, c2));
+        _mm_storeu_si128((__m128i *)(dst + c), _mm_or_si128(_mm_and_si128(hsel, hi), _mm_andnot_si128(hsel, lo)));
+    }
+#else
+    for (int c = 0; c < 8; c++)
+        dst[c] = cols[((dat & hmask[c]) ? 2 : 0) | ((dat & lmask[c]) ? 1 : 0)];
+#endif
+}
+
+/* Pixels from a row of a teletext glyph: each byte holds the weights
+ * for two scanlines, one per nibble, which select from a 16 entry
+ * table of colours blended between foreground and background.
+ * SSE2 has no variable shuffle so only AVX2 gets a vector version.
+ */
+static inline void pix_lookup16(uint32_t *dst, const uint8_t *src, int count, int shift, const int *table)
+{
+#if defined(VID_AVX2)
+    __m256i tlo = _mm256_loadu_si256((const __m256i *)table);
+    __m256i thi = _mm256_loadu_si256((const __m256i *)(table + 8));
+    __m128i sh = _mm_cvtsi32_si128(shift);
+    __m256i nib = _mm256_set1_epi32(15), seven = _mm256_set1_epi32(7);
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        __m256i ix = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)src));
+        ix = _mm256_and_si256(_mm256_srl_epi32(ix, sh), nib);
+        __m256i lo = _mm256_permutevar8x32_epi32(tlo, ix);
+        __m256i hi = _mm256_permutevar8x32_epi32(thi, ix);
+        _mm256_storeu_si256((__m256i *)dst, _mm256_blendv_epi8(lo, hi, _mm256_cmpgt_epi32(ix, seven)));
+    }
+#endif
+    while (count-- > 0)
+        *dst++ = table[(*src++ >> shift) & 15];
+}
+
 #ifdef PIXEL_BOUNDS_CHECK
 
 static inline void put_pixel_checked(ALLEGRO_LOCKED_REGION *region, int x, int y, uint32_t colour, int line)
@@ -178,17 +306,18 @@ static inline void put_pixel_checked(ALLEGRO_LOCKED_REGION *region, int x, int y
     *((uint32_t *)((char *)region->data + region->pitch * y + x * region->pixel_size)) = colour;
 }
 
-static inline void put_pixels_checked(ALLEGRO_LOCKED_REGION *region, int x, int y, int count, uint32_t colour, int line)
+static inline uint32_t *pix_row_checked(ALLEGRO_LOCKED_REGION *region, int x, int y, int count, int line)
 {
-    char *ptr = (char *)region->data + region->pitch * y + x * region->pixel_size;
     if (x < 0 || (x + count) > 1280)
         log_debug("video: pixel out of bounds, x=%d at %d", x, line);
     if (y < 0 || y > 800)
         log_debug("video: pixel out of bounds, y=%d at %d", y, line);
-    while (count--) {
-        *(uint32_t *)ptr = colour;
-        ptr += region->pixel_size;
-    }
+    return (uint32_t *)((char *)region->data + region->pitch * y) + x;
+}
+
+static inline void put_pixels_checked(ALLEGRO_LOCKED_REGION *region, int x, int y, int count, uint32_t colour, int line)
+{
+    pix_fill(pix_row_checked(region, x, y, count, line), count, colour);
 }
 
 static inline void nula_putpixel_checked(ALLEGRO_LOCKED_REGION *region, int x, int y, uint32_t colour, int line)
@@ -200,6 +329,7 @@ static inline void nula_putpixel_checked(ALLEGRO_LOCKED_REGION *region, int x, i
 }
 
 #define put_pixel(region, x, y, colour) put_pixel_checked(region, x, y, colour, __LINE__)
+#define pix_row(region, x, y, count) pix_row_checked(region, x, y, count, __LINE__)
 #define put_pixels(region, x, y, count, colour) put_pixels_checked(region, x, y, count, colour, __LINE__)
 #define nula_putpixel(region, x, y, colour) nula_putpixel_checked(region, x, y, colour, __LINE__)
 
@@ -210,13 +340,17 @@ static inline void put_pixel(ALLEGRO_LOCKED_REGION *region, int x, int y, uint32
     *((uint32_t *)((char *)region->data + region->pitch * y + x * region->pixel_size)) = colour;
 }
 
+/* The bitmap is always locked as ARGB_8888 so a row is just an array of
+ * uint32_t which the kernels below can write to directly.
+ */
+static inline uint32_t *pix_row(ALLEGRO_LOCKED_REGION *region, int x, int y, int count)
+{
+    return (uint32_t *)((char *)region->data + region->pitch * y) + x;
+}
+
 static inline void put_pixels(ALLEGRO_LOCKED_REGION *region, int x, int y, int count, uint32_t colour)
 {
-    char *ptr = (char *)region->data + region->pitch * y + x * region->pixel_size;
-    while (count--) {
-        *(uint32_t *)ptr = colour;
-        ptr += region->pixel_size;
-    }
+    pix_fill(pix_row(region, x, y, count), count, colour);
 }
 
 static inline void nula_putpixel(ALLEGRO_LOCKED_REGION *region, int x, int y, uint32_t colour)
@@ -229,6 +363,57 @@ static inline void nula_putpixel(ALLEGRO_LOCKED_REGION *region, int x, int y, ui
 
 #endif
 
+/* Write a row of pixels, clipped to the NuLA left blank and offset when
+ * those are in use.
+ */
+static inline void nula_put_row(ALLEGRO_LOCKED_REGION *region, int x, int y, const uint32_t *pix, int count)
+{
+#ifndef PIXEL_BOUNDS_CHECK
+    if (!(crtc_mode && (nula_horizontal_offset || nula_left_blank)) && x >= 0 && x + count <= 1280) {
+        pix_copy(pix_row(region, x, y, count), pix, count);
+        return;
+    }
+#endif
+    for (int c = 0; c < count; c++)
+        nula_putpixel(region, x + c, y, pix[c]);
+}
+
+/* Which bit of a screen byte each pixel comes from in the NuLA
+ * attribute modes, for pix_expand_2col and pix_expand_4col.
+ */
+static uint32_t nula_mask_hifreq[8], nula_mask_lofreq[16];
+static uint32_t nula_mask_2bpp_hi[8], nula_mask_2bpp_lo[8];
+static uint32_t nula_mask_spect[16];
+
+static void nula_make_masks(void)
+{
+    float pc = 0.0f;
+    for (int c = 0; c < 8; c++, pc += 0.75f) {
+        int a = 3 - ((int) pc) / 2;
+        nula_mask_hifreq[c] = 1 << (7 - (int) pc);
+        nula_mask_2bpp_hi[c] = 1 << (a + 4);
+        nula_mask_2bpp_lo[c] = 1 << a;
+    }
+    pc = 0.0f;
+    for (int c = 0; c < 16; c++, pc += 0.375f) {
+        nula_mask_lofreq[c] = 1 << (7 - (int) pc);
+        nula_mask_spect[c] = 0x80 >> (c >> 1);
+    }
+}
+
+static inline const uint32_t *ula_byte_pixels(uint8_t dat)
+{
+    uint32_t *pix = ula_pixels[dat];
+    if (ula_pixels_tag[dat] != ula_pixels_gen) {
+        const int *pal = nula_palette_mode ? nula_collook : ula_pal;
+        const uint8_t *idx = table4bpp[ula_mode][dat];
+        for (int c = 0; c < 16; c++)
+            pix[c] = pal[idx[c]];
+        ula_pixels_tag[dat] = ula_pixels_gen;
+    }
+    return pix;
+}
+
 static void nula_default_palette(void)
 {
     nula_collook[0]  = 0xff000000; // black
@@ -249,6 +434,7 @@ static void nula_default_palette(void)
     nula_collook[15] = 0xffffffff; // white
 
     mode7_need_new_lookup = 1;
+    ula_pixels_gen++;
 }
 
 void nula_reset(void)
@@ -402,6 +588,7 @@ void videoula_write(uint16_t addr, uint8_t val)
         break;
 
     }
+    ula_pixels_gen++;
 }
 
 void videoula_savestate(FILE * f)
@@ -451,6 +638,7 @@ void videoula_loadstate(FILE * f)
     nula_disable = *ptr++;
     nula_attribute_mode = *ptr++;
     nula_attribute_text = *ptr++;
+    ula_pixels_gen++;
 }
 
 /*Mode 7 (SAA5050)*/
@@ -601,8 +789,7 @@ static inline void mode7_render(ALLEGRO_LOCKED_REGION *region, uint8_t dat)
         uint8_t *mode7_px = mode7_p;
 
         if (dat == 255) {
-            for (int c = 0; c < mode7_width; c++)
-                put_pixel(region, scrx + c + 16, scry, colblack);
+            put_pixels(region, scrx + 16, scry, mode7_width, colblack);
             return;
         }
 
@@ -691,10 +878,8 @@ static inline void mode7_render(ALLEGRO_LOCKED_REGION *region, uint8_t dat)
         int off = mode7_lookup[0][mode7_bg & 7][0];
         int xpos = scrx + 16;
 
-        if (mode7_flashx && !mode7_flashon) {
-            for (int c = 0; c < mode7_width; c++)
-                put_pixel(region, xpos++, scry, off);
-        }
+        if (mode7_flashx && !mode7_flashon)
+            put_pixels(region, xpos, scry, mode7_width, off);
         else {
             const uint8_t *ptr = mode7_px + (dat - 0x20) * mode7_bytes_per_char;
             if (mode7_dblx) {
@@ -712,14 +897,8 @@ static inline void mode7_render(ALLEGRO_LOCKED_REGION *region, uint8_t dat)
                 on = mode7_lookup[mcolx & 7][mode7_bg & 7];
 
             int interindex = (vid_dtype_intern == VDT_INTERLACE) && interlline;
-            if ((!mode7_dblx && interindex) || (mode7_dblx && sc & 1)) {
-                for (int c = 0; c < mode7_width; c++)
-                    put_pixel(region, xpos++, scry, on[*ptr++ >> 4]);
-            }
-            else {
-                for (int c = 0; c < mode7_width; c++)
-                    put_pixel(region, xpos++, scry, on[*ptr++ & 0x0f]);
-            }
+            int shift = ((!mode7_dblx && interindex) || (mode7_dblx && sc & 1)) ? 4 : 0;
+            pix_lookup16(pix_row(region, xpos, scry, mode7_width), ptr, mode7_width, shift, on);
         }
         scrx -= (16 - mode7_width);
 
@@ -758,42 +937,29 @@ static int oldr8;
 int firstx, firsty, lastx, lasty;
 
 static ALLEGRO_DISPLAY *display;
-ALLEGRO_BITMAP *b, *b16, *b32;
+ALLEGRO_BITMAP *b, *bshow, *b16, *b32;
 
 ALLEGRO_LOCKED_REGION *region;
+bool vid_clear_b32;
 
 ALLEGRO_COLOR border_col;
 
-ALLEGRO_DISPLAY *video_init(void)
+static void video_init_bitmaps(int flags)
 {
     int c;
     int temp, temp2, left;
 
-#ifdef ALLEGRO_GTK_TOPLEVEL
-    al_set_new_display_flags(ALLEGRO_WINDOWED | ALLEGRO_GTK_TOPLEVEL | ALLEGRO_RESIZABLE);
-#else
-    al_set_new_display_flags(ALLEGRO_WINDOWED | ALLEGRO_RESIZABLE);
-#endif
-    al_set_new_display_option(ALLEGRO_VSYNC, 2, ALLEGRO_REQUIRE);
-    log_debug("video: vsync=%d", al_get_new_display_option(ALLEGRO_VSYNC, &temp));
-
-    video_set_window_size(true);
-
-    al_set_new_display_option(ALLEGRO_VSYNC, 2, ALLEGRO_SUGGEST);
-    if ((display = al_create_display(winsizex, winsizey)) == NULL) {
-        log_fatal("video: unable to create display");
-        exit(1);
-    }
-
-    al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP|ALLEGRO_NO_PRESERVE_TEXTURE);
+    al_set_new_bitmap_flags(flags);
     b16 = al_create_bitmap(832, 614);
     b32 = al_create_bitmap(1536, 800);
+    bshow = al_create_bitmap(1280, 800);
 
     colblack = 0xff000000;
     colwhite = 0xffffffff;
     border_col = al_map_rgb(0, 0, 0);
 
     nula_default_palette();
+    nula_make_masks();
 
     for (c = 0; c < 8; c++)
         nula_flash[c] = 1;
@@ -819,13 +985,50 @@ ALLEGRO_DISPLAY *video_init(void)
             table4bpp[0][temp][c] = table4bpp[3][temp][c >> 3];
         }
     }
+    /* The frame is drawn into b, which may be on the emulation thread,
+     * so it is kept in memory and left locked.  video_show_frame copies
+     * what is to be drawn into bshow.
+     */
+    al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
     b = al_create_bitmap(1280, 800);
     al_set_target_bitmap(b);
     al_clear_to_color(al_map_rgb(0, 0,0));
-    region = al_lock_bitmap(b, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY);
+    region = al_lock_bitmap(b, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_READWRITE);
+    al_set_new_bitmap_flags(flags);
+}
+
+ALLEGRO_DISPLAY *video_init(void)
+{
+    int temp;
+
+#ifdef ALLEGRO_GTK_TOPLEVEL
+    al_set_new_display_flags(ALLEGRO_WINDOWED | ALLEGRO_GTK_TOPLEVEL | ALLEGRO_RESIZABLE);
+#else
+    al_set_new_display_flags(ALLEGRO_WINDOWED | ALLEGRO_RESIZABLE);
+#endif
+    al_set_new_display_option(ALLEGRO_VSYNC, 2, ALLEGRO_REQUIRE);
+    log_debug("video: vsync=%d", al_get_new_display_option(ALLEGRO_VSYNC, &temp));
+
+    video_set_window_size(true);
+
+    al_set_new_display_option(ALLEGRO_VSYNC, 2, ALLEGRO_SUGGEST);
+    if ((display = al_create_display(winsizex, winsizey)) == NULL) {
+        log_fatal("video: unable to create display");
+        exit(1);
+    }
+    video_init_bitmaps(ALLEGRO_VIDEO_BITMAP|ALLEGRO_NO_PRESERVE_TEXTURE);
     return display;
 }
 
+/* Set up for rendering without a display: the frame is still drawn in
+ * full, into memory bitmaps, so it can be saved as a screenshot.
+ */
+void video_init_headless(void)
+{
+    vid_headless = true;
+    video_init_bitmaps(ALLEGRO_MEMORY_BITMAP);
+}
+
 void video_set_disptype(enum vid_disptype dtype)
 {
     vid_dtype_user = dtype;
@@ -842,6 +1045,12 @@ static int ccount = 0;
 
 static int vid_cleared;
 
+static void video_clear_frame(void)
+{
+    for (int y = 0; y < 800; y++)
+        pix_fill(pix_row(region, 0, y, 1280), 1280, colblack);
+}
+
 static int firstdispen = 0;
 
 void video_reset()
@@ -874,13 +1083,111 @@ static inline int is_free_run(void) {
     return 0;
 }
 
+static inline uint8_t video_fetch(void)
+{
+    uint16_t addr;
+
+    if (ma & 0x2000)
+        return ram[ttxbank | (ma & 0x3FF) | vidbank];
+    if ((crtc[8] & 3) == 3)
+        addr = (ma << 3) | ((sc & 3) << 1) | interlline;
+    else
+        addr = (ma << 3) | (sc & 7);
+    if (addr & 0x8000)
+        addr -= screenlen[scrsize];
+    return ram[(addr & 0x7FFF) | vidbank];
+}
+
+/* Number of characters before the horizontal counter reaches 'target'. */
+static inline int chars_to(int target, int limit)
+{
+    int n = (target - hc) & 255;
+    return n < limit ? n : limit;
+}
+
+/* Render a run of characters of an ordinary bitmap mode in one go.
+ * Within a run nothing the per-clock loop in video_poll checks for can
+ * happen (end of display, sync, end of line, the cursor) so the
+ * characters can be fetched and drawn in a tight loop and the counters
+ * advanced at the end.  Returns the number of clocks used, zero if the
+ * next character has to go through the per-clock loop.
+ */
+static int video_run_chars(int clocks)
+{
+    if (crtc_mode == CRTC_TELETEXT || cdraw || hvblcount)
+        return 0;
+    if ((nula_attribute_mode && ula_mode > 1) || nula_horizontal_offset || nula_left_blank)
+        return 0;
+
+    int hifreq = ula_ctrl & 0x10;
+    if (!hifreq && oddclock)
+        return 0;              // the next clock is the gap between characters.
+    int stride = hifreq ? 1 : 2;
+    int width = hifreq ? 8 : 16;
+
+    int n = chars_to(crtc[1], clocks / stride);
+    n = chars_to(crtc[2], n);
+    n = chars_to(crtc[0], n);
+    if (interline)
+        n = chars_to(crtc[0] >> 1, n);
+    if (con) {
+        int cur = (crtc[15] | (crtc[14] << 8)) - ma;
+        if ((cur & 0x3FFF) < n)
+            n = cur & 0x3FFF;
+    }
+    int x = scrx + 8;
+    int room = (1280 - 16 - x + width - 1) / width;
+    if (room < n)
+        n = room;
+    if (n <= 0)
+        return 0;
+
+    int y = scry;
+    if (vid_dtype_intern == VDT_INTERLACE)
+        y = (y << 1) + interlline;
+    else if (vid_dtype_intern == VDT_LINEDOUBLE)
+        y <<= 1;
+
+    if (x < firstx)
+        firstx = x;
+    if (x + n * width > lastx)
+        lastx = x + n * width;
+
+    uint32_t *dst = pix_row(region, x, y, n * width);
+    if ((crtc[8] & 0x30) == 0x30 || (sc & 8)) {
+        // Gaps between lines in modes 3 & 6.
+        pix_fill(dst, n * width, colblack);
+        ma += n;
+    }
+    else {
+        for (int c = 0; c < n; c++, dst += width) {
+            pix_copy(dst, ula_byte_pixels(video_fetch()), width);
+            ma++;
+        }
+    }
+
+    int used = n * stride;
+    scrx += used * 8;
+    vidclocks += used;
+    vidbytes += n;
+    if (hifreq)
+        oddclock ^= n & 1;
+    hc = (hc + n) & 255;
+    lasthc = hc;
+    return used;
+}
+
 void video_poll(int clocks, int timer_enable)
 {
     int c, oldvc;
-    uint16_t addr;
     uint8_t dat;
 
-    while (clocks--) {
+    while (clocks > 0) {
+        if (dispen && (c = video_run_chars(clocks))) {
+            clocks -= c;
+            continue;
+        }
+        clocks--;
         scrx += 8;
         vidclocks++;
         oddclock = !oddclock;
@@ -920,17 +1227,7 @@ void video_poll(int clocks, int timer_enable)
             if (!((ma ^ (crtc[15] | (crtc[14] << 8))) & 0x3FFF) && con)
                 cdraw = cdrawlook[crtc[8] >> 6];
 
-            if (ma & 0x2000)
-                dat = ram[ttxbank | (ma & 0x3FF) | vidbank];
-            else {
-                if ((crtc[8] & 3) == 3)
-                    addr = (ma << 3) | ((sc & 3) << 1) | interlline;
-                else
-                    addr = (ma << 3) | (sc & 7);
-                if (addr & 0x8000)
-                    addr -= screenlen[scrsize];
-                dat = ram[(addr & 0x7FFF) | vidbank];
-            }
+            dat = video_fetch();
 
             if (scrx < (1280-16)) {
                 if ((crtc[8] & 0x30) == 0x30 || ((sc & 8) && !(ula_ctrl & 2))) {
@@ -948,27 +1245,22 @@ void video_poll(int clocks, int timer_enable)
                             if ((scrx + 8) > lastx)
                                 lastx = scrx + 8;
                             if (nula_attribute_mode && ula_mode > 1) {
+                                uint32_t pix[16];
                                 if (ula_mode == 3) {
                                     // 1bpp
                                     if (nula_attribute_text) {
                                         int attribute = ((dat & 7) << 1);
-                                        float pc = 0.0f;
-                                        for (c = 0; c < 7; c++, pc += 0.75f) {
-                                            int output = ula_pal[attribute | (dat >> (7 - (int) pc) & 1)];
-                                            nula_putpixel(region, scrx + c, scry, output);
-                                        }
+                                        pix_expand_2col(pix, dat, nula_mask_hifreq, ula_pal[attribute | 1], ula_pal[attribute]);
                                         // Very loose approximation of the text attribute mode
-                                        nula_putpixel(region, scrx + 7, scry, ula_pal[attribute]);
+                                        pix[7] = ula_pal[attribute];
+                                        nula_put_row(region, scrx, scry, pix, 8);
                                     }
                                     else if (nula_attribute_mode >= 2) {
                                         /* Spectrum mode */
                                         if (nula_spect_toggle) {
-                                            for (int c = -8; c < 8; c += 2) {
-                                                int colour = dat & 0x80 ? nula_spect_ink : nula_spect_paper;
-                                                nula_putpixel(region, scrx + c, scry, colour);
-                                                nula_putpixel(region, scrx + c + 1, scry, colour);
-                                                dat <<= 1;
-                                            }
+                                            pix_expand_2col(pix, dat, nula_mask_spect, nula_spect_ink, nula_spect_paper);
+                                            pix_expand_2col(pix + 8, dat, nula_mask_spect + 8, nula_spect_ink, nula_spect_paper);
+                                            nula_put_row(region, scrx - 8, scry, pix, 16);
                                             nula_spect_toggle = 0;
                                         }
                                         else {
@@ -1024,26 +1316,16 @@ void video_poll(int clocks, int timer_enable)
                                     else {
                                         /* Normal NuLA attribute mode */
                                         int attribute = ((dat & 3) << 2);
-                                        float pc = 0.0f;
-                                        for (c = 0; c < 8; c++, pc += 0.75f) {
-                                            int output = ula_pal[attribute | (dat >> (7 - (int) pc) & 1)];
-                                            nula_putpixel(region, scrx + c, scry, output);
-                                        }
+                                        pix_expand_2col(pix, dat, nula_mask_hifreq, ula_pal[attribute | 1], ula_pal[attribute]);
+                                        nula_put_row(region, scrx, scry, pix, 8);
                                     }
                                 } else {
                                     int attribute = (((dat & 16) >> 1) | ((dat & 1) << 2));
-                                    float pc = 0.0f;
-                                    for (c = 0; c < 8; c++, pc += 0.75f) {
-                                        int a = 3 - ((int) pc) / 2;
-                                        int output = ula_pal[attribute | ((dat >> (a + 3)) & 2) | ((dat >> a) & 1)];
-                                        nula_putpixel(region, scrx + c, scry, output);
-                                    }
-                                }
-                            } else {
-                                for (c = 0; c < 8; c++) {
-                                    nula_putpixel(region, scrx + c, scry, nula_palette_mode ? nula_collook[table4bpp[ula_mode][dat][c]] : ula_pal[table4bpp[ula_mode][dat][c]]);
+                                    pix_expand_4col(pix, dat, nula_mask_2bpp_hi, nula_mask_2bpp_lo, ula_pal + attribute);
+                                    nula_put_row(region, scrx, scry, pix, 8);
                                 }
-                            }
+                            } else
+                                nula_put_row(region, scrx, scry, ula_byte_pixels(dat), 8);
                         }
                         break;
                     case CRTC_LOFREQ:
@@ -1054,30 +1336,22 @@ void video_poll(int clocks, int timer_enable)
                                 lastx = scrx + 16;
                             if (nula_attribute_mode && ula_mode > 1) {
                                 // In low frequency clock can only have 1bpp modes
+                                uint32_t pix[16];
                                 if (nula_attribute_text) {
                                     int attribute = ((dat & 7) << 1);
-                                    float pc = 0.0f;
-                                    for (c = 0; c < 14; c++, pc += 0.375f) {
-                                        int output = ula_pal[attribute | (dat >> (7 - (int) pc) & 1)];
-                                        nula_putpixel(region, scrx + c, scry, output);
-                                    }
+                                    pix_expand_2col(pix, dat, nula_mask_lofreq, ula_pal[attribute | 1], ula_pal[attribute]);
+                                    pix_expand_2col(pix + 8, dat, nula_mask_lofreq + 8, ula_pal[attribute | 1], ula_pal[attribute]);
 
                                     // Very loose approximation of the text attribute mode
-                                    nula_putpixel(region, scrx + 14, scry, ula_pal[attribute]);
-                                    nula_putpixel(region, scrx + 15, scry, ula_pal[attribute]);
+                                    pix[14] = pix[15] = ula_pal[attribute];
                                 } else {
                                     int attribute = ((dat & 3) << 2);
-                                    float pc = 0.0f;
-                                    for (c = 0; c < 16; c++, pc += 0.375f) {
-                                        int output = ula_pal[attribute | (dat >> (7 - (int) pc) & 1)];
-                                        nula_putpixel(region, scrx + c, scry, output);
-                                    }
+                                    pix_expand_2col(pix, dat, nula_mask_lofreq, ula_pal[attribute | 1], ula_pal[attribute]);
+                                    pix_expand_2col(pix + 8, dat, nula_mask_lofreq + 8, ula_pal[attribute | 1], ula_pal[attribute]);
                                 }
-                            } else {
-                                for (c = 0; c < 16; c++) {
-                                    nula_putpixel(region, scrx + c, scry, nula_palette_mode ? nula_collook[table4bpp[ula_mode][dat][c]] : ula_pal[table4bpp[ula_mode][dat][c]]);
-                                }
-                            }
+                                nula_put_row(region, scrx, scry, pix, 16);
+                            } else
+                                nula_put_row(region, scrx, scry, ula_byte_pixels(dat), 16);
                         }
                         break;
                     }
@@ -1212,13 +1486,8 @@ void video_poll(int clocks, int timer_enable)
                     // Reached vertical sync position.
                     int intsync = crtc[8] & 1;
                     if (!intsync && oldr8) {
-                        ALLEGRO_COLOR black = al_map_rgb(0, 0, 0);
-                        al_set_target_bitmap(b32);
-                        al_clear_to_color(black);
-                        al_unlock_bitmap(b);
-                        al_set_target_bitmap(b);
-                        al_clear_to_color(black);
-                        region = al_lock_bitmap(b, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY);
+                        vid_clear_b32 = true;
+                        video_clear_frame();
                     }
                     frameodd ^= 1;
                     if (frameodd)
@@ -1230,10 +1499,7 @@ void video_poll(int clocks, int timer_enable)
                         vid_cleared = 0;
                     } else if (vidclocks <= 1024 && !vid_cleared) {
                         vid_cleared = 1;
-                        al_unlock_bitmap(b);
-                        al_set_target_bitmap(b);
-                        al_clear_to_color(al_map_rgb(0, 0, 0));
-                        region = al_lock_bitmap(b, ALLEGRO_PIXEL_FORMAT_ARGB_8888, ALLEGRO_LOCK_WRITEONLY);
+                        video_clear_frame();
                         video_doblit(crtc_mode, crtc[4]);
                     }
                     ccount++;
@@ -1292,6 +1558,27 @@ void video_poll(int clocks, int timer_enable)
     }
 }
 
+/* A lower bound on the number of clocks before video_poll next does
+ * something the CPU can see, i.e. changes the vsync input to the system
+ * VIA.  That only happens at the end of a line or on the character
+ * after, so this is the distance to the next end of line.
+ */
+int video_next_event(void)
+{
+    int target, chars;
+
+    if (hvblcount)
+        return 1;
+    if (interline && hc <= (crtc[0] >> 1))
+        target = crtc[0] >> 1;
+    else
+        target = crtc[0];
+    chars = ((target - hc) & 255) + 1;
+    if (ula_ctrl & 0x10)
+        return chars;
+    return chars * 2 - 1; // low frequency: one character every two clocks.
+}
+
 void video_savestate(FILE * f)
 {
     unsigned char bytes[9];
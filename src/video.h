@@ -36,8 +36,10 @@ extern uint8_t nula_attribute_mode;
 extern uint8_t nula_attribute_text;
 
 ALLEGRO_DISPLAY *video_init(void);
+void video_init_headless(void);
 void video_reset(void);
 void video_poll(int clocks, int timer_enable);
+int  video_next_event(void);
 void video_savestate(FILE *f);
 void video_loadstate(FILE *f);
 
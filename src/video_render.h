@@ -1,8 +1,9 @@
 #ifndef __INC_VIDEO_RENDER_H
 #define __INC_VIDEO_RENDER_H
 
-extern ALLEGRO_BITMAP *b, *b16, *b32;
+extern ALLEGRO_BITMAP *b, *bshow, *b16, *b32;
 extern ALLEGRO_LOCKED_REGION *region;
+extern bool vid_clear_b32;
 extern ALLEGRO_COLOR border_col;
 
 #define BORDER_NONE_X_START_GRA 336
@@ -49,11 +50,13 @@ extern bool vid_pal;
 extern int vid_fskipmax, vid_fullborders;
 extern int vid_ledlocation, vid_ledvisibility;
 extern bool vid_print_mode;
+extern bool vid_headless;
 
 extern int vid_savescrshot;
 extern char vid_scrshotname[260];
 
 void video_doblit(bool non_ttx, uint8_t vtotal);
+void video_show_frame(void);
 void video_enterfullscreen(void);
 void video_leavefullscreen(void);
 void video_set_window_size(bool fudge);
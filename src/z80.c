@@ -101,6 +101,28 @@ void tube_z80_writemem(uint32_t addr, uint8_t byte)
     z80_writemem(addr & 0xffff, byte);
 }
 
+/* Block copies for VDFS: straight to or from RAM unless the debugger
+ * is watching or, for a read, the ROM is paged in over it.
+ */
+static void tube_z80_readblk(uint32_t addr, uint8_t *buf, size_t len)
+{
+    uint32_t start = z80_rom_in ? 0x1000 : 0;
+    if (!dbg_tube_z80 && addr >= start && addr < 0x10000 && len <= 0x10000 - addr)
+        memcpy(buf, z80ram + addr, len);
+    else
+        while (len--)
+            *buf++ = tube_z80_readmem(addr++);
+}
+
+static void tube_z80_writeblk(uint32_t addr, const uint8_t *buf, size_t len)
+{
+    if (!dbg_tube_z80 && addr < 0x10000 && len <= 0x10000 - addr)
+        memcpy(z80ram + addr, buf, len);
+    else
+        while (len--)
+            tube_z80_writemem(addr++, *buf++);
+}
+
 static void dbg_z80_writemem(uint32_t addr, uint32_t value)
 {
     z80_writemem(addr & 0xffff, value);
@@ -587,6 +609,8 @@ bool z80_init(void *rom)
     makeznptable();
     tube_readmem = tube_z80_readmem;
     tube_writemem = tube_z80_writemem;
+    tube_readblk = tube_z80_readblk;
+    tube_writeblk = tube_z80_writeblk;
     tube_exec = z80_exec;
     tube_proc_savestate = z80_savestate;
     tube_proc_loadstate = z80_loadstate;
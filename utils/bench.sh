@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# bench.sh: runs a fixed workload on every model and on every tube
+#	    processor with the headless build of b-em and reports, one
+#	    line per run:
+#
+#	    model, tube, frames, emulated MHz, host ns per emulated cycle,
+#	    CRC of host RAM, CRC of the first 64K of tube memory.
+#
+#	    Speed shows performance regressions; a change in either CRC
+#	    for the same workload shows a change in behaviour.
+#
+# Intended to be run from the top of the source tree via "make bench".
+#
+# usage: bench.sh [b-em-headless] [frames]
+
+BEM=${1:-src/b-em-headless}
+FRAMES=${2:-1500}
+
+# Host for the tube processors: BBC Master 128.
+TUBE_HOST=10
+
+# A workload for BASIC; where there is no BASIC (some tubes) the boot
+# and the command line is what gets measured.
+WORK='10A=0:FORI%=1TO5000:A=A+SQR(I%)*SIN(I%):NEXT\r20PRINTA\rRUN\r'
+
+# Some models need ROMs that are not shipped, e.g. the test ROM, so a
+# run that fails gets a line saying so rather than stopping the lot.
+run() {
+	"$BEM" "$@" -frames $FRAMES -paste "$WORK" -bench ||
+		printf "%-28s %-14s failed\n" "$1" "${2:-none}"
+}
+
+printf "%-28s %-14s %6s %8s %8s %8s %8s\n" model tube frames MHz ns/cyc ram tube
+
+for m in `sed -n 's/^\[model_0*\([0-9][0-9]*\)\]/\1/p' b-em.cfg | sort -n`; do
+	run -m$m
+done
+
+# Which tubes there are depends on the build, e.g. the 68000.
+for t in `"$BEM" -tubes | cut -f1`; do
+	run -m$TUBE_HOST -t$t
+done